@@ -1,15 +1,53 @@
 #include "imdb/database.hpp"
 #include "imdb/table.hpp"
 #include "imdb/types.hpp"
+#include "imdb/predicate.hpp"
+#include "imdb/aggregate.hpp"
+#include "imdb/sort.hpp"
+#include "imdb/planner.hpp"
+#include "imdb/profile.hpp"
+#include "imdb/statement.hpp"
+#include "imdb/sql.hpp"
+#include "imdb/plan.hpp"
+#include "imdb/cache.hpp"
+#include "imdb/view.hpp"
+#include "imdb/transaction.hpp"
+#include "imdb/pool.hpp"
+#include "imdb/cancel.hpp"
+#include "imdb/wire.hpp"
+#include "imdb/async.hpp"
+#include "imdb/scheduler.hpp"
+#ifdef IMDB_SERVER
+#include "imdb/server.hpp"
+#endif
 #include <iostream>
 #include <vector>
 #include <string>
 #include <iomanip>
 #include <cctype>
 #include <optional>
+#include <sstream>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <chrono>
+#include <unordered_map>
+#include <atomic>
+#include <csignal>
+#include <memory>
+#include <deque>
+#include <fstream>
+#include <filesystem>
+#include <future>
 
 using namespace imdb;
 
+static thread_local std::ostream* output_stream = nullptr;
+
+static std::ostream& output() {
+    return output_stream ? *output_stream : std::cout;
+}
+
 static std::string trim_quotes(const std::string& s) {
     if (s.size() >= 2 && s.front() == '"' && s.back() == '"') return s.substr(1, s.size() - 2);
     return s;
@@ -83,298 +121,1430 @@ static Value parse_value_token(const std::string& token, std::optional<ColumnTyp
     return t;
 }
 
+static std::optional<ColumnType> column_type(const std::vector<Column>& cols, const std::string& name) {
+    for (size_t i = 0; i < cols.size(); i++) {
+        if (cols[i].name == name) return cols[i].type;
+    }
+    return std::nullopt;
+}
+
+static std::vector<std::string> split_parens(const std::vector<std::string>& tokens, size_t start) {
+    std::vector<std::string> out;
+    for (size_t i = start; i < tokens.size(); i++) {
+        std::string t = tokens[i];
+        if (!t.empty() && t.front() == '"') { out.push_back(t); continue; }
+        size_t open = 0;
+        while (open < t.size() && t[open] == '(') { out.push_back("("); open++; }
+        size_t close = 0;
+        while (close < t.size() - open && t[t.size() - 1 - close] == ')') close++;
+        if (t.size() - open - close > 0) out.push_back(t.substr(open, t.size() - open - close));
+        for (size_t k = 0; k < close; k++) out.push_back(")");
+    }
+    return out;
+}
+
+static bool parse_or(const std::vector<std::string>& t, size_t& pos, const std::vector<Column>& cols,
+                     Predicate& out, std::string& err, size_t* parameters);
+
+static bool parse_unary(const std::vector<std::string>& t, size_t& pos, const std::vector<Column>& cols,
+                        Predicate& out, std::string& err, size_t* parameters) {
+    if (pos >= t.size()) { err = "bad condition"; return false; }
+    if (to_upper(t[pos]) == "NOT") {
+        pos++;
+        Predicate child;
+        if (!parse_unary(t, pos, cols, child, err, parameters)) return false;
+        out = Predicate::negate(std::move(child));
+        return true;
+    }
+    if (t[pos] == "(") {
+        pos++;
+        if (!parse_or(t, pos, cols, out, err, parameters)) return false;
+        if (pos >= t.size() || t[pos] != ")") { err = "bad condition"; return false; }
+        pos++;
+        return true;
+    }
+    if (pos + 2 >= t.size()) { err = "bad condition"; return false; }
+    std::string col_name = trim_quotes(t[pos]);
+    auto type = column_type(cols, col_name);
+    if (!type) { err = "no such column"; return false; }
+    auto op = parse_compare_op(t[pos + 1]);
+    if (!op) { err = "bad condition"; return false; }
+    if (parameters && t[pos + 2] == "?") out = Predicate::placeholder(col_name, *op, (*parameters)++);
+    else out = Predicate::compare(col_name, *op, parse_value_token(t[pos + 2], type));
+    pos += 3;
+    return true;
+}
+
+static bool parse_and(const std::vector<std::string>& t, size_t& pos, const std::vector<Column>& cols,
+                      Predicate& out, std::string& err, size_t* parameters) {
+    std::vector<Predicate> terms(1);
+    if (!parse_unary(t, pos, cols, terms[0], err, parameters)) return false;
+    while (pos < t.size() && to_upper(t[pos]) == "AND") {
+        pos++;
+        terms.emplace_back();
+        if (!parse_unary(t, pos, cols, terms.back(), err, parameters)) return false;
+    }
+    out = Predicate::all_of(std::move(terms));
+    return true;
+}
+
+static bool parse_or(const std::vector<std::string>& t, size_t& pos, const std::vector<Column>& cols,
+                     Predicate& out, std::string& err, size_t* parameters) {
+    std::vector<Predicate> terms(1);
+    if (!parse_and(t, pos, cols, terms[0], err, parameters)) return false;
+    while (pos < t.size() && to_upper(t[pos]) == "OR") {
+        pos++;
+        terms.emplace_back();
+        if (!parse_and(t, pos, cols, terms.back(), err, parameters)) return false;
+    }
+    out = Predicate::any_of(std::move(terms));
+    return true;
+}
+
+static bool parse_where(const std::vector<std::string>& tokens, size_t start, size_t end,
+                        const std::vector<Column>& cols, Predicate& out, std::string& err,
+                        size_t* parameters = nullptr) {
+    std::vector<std::string> t = split_parens(std::vector<std::string>(tokens.begin(), tokens.begin() + end), start);
+    size_t pos = 0;
+    if (!parse_or(t, pos, cols, out, err, parameters)) return false;
+    if (pos != t.size()) { err = "bad condition"; return false; }
+    return true;
+}
+
+static size_t find_keyword(const std::vector<std::string>& tokens, size_t start, const std::string& word) {
+    for (size_t i = start; i < tokens.size(); i++) {
+        if (to_upper(tokens[i]) == word) return i;
+    }
+    return tokens.size();
+}
+
+static std::vector<std::string> split_list(const std::vector<std::string>& tokens, size_t start, size_t end) {
+    std::vector<std::string> items;
+    std::string current;
+    for (size_t i = start; i < end; i++) {
+        for (char c : tokens[i]) {
+            if (c == ',') {
+                items.push_back(current);
+                current.clear();
+            } else {
+                current.push_back(c);
+            }
+        }
+        if (i + 1 < end && !current.empty()) current.push_back(' ');
+    }
+    items.push_back(current);
+    for (auto& item : items) {
+        while (!item.empty() && item.back() == ' ') item.pop_back();
+        while (!item.empty() && item.front() == ' ') item.erase(item.begin());
+    }
+    return items;
+}
+
+struct SelectItem {
+    std::optional<AggregateSpec> aggregate;
+    std::string column;
+};
+
+static bool parse_select_item(const std::string& text, SelectItem& out) {
+    size_t open = text.find('(');
+    if (open == std::string::npos) {
+        if (text.empty()) return false;
+        out.column = trim_quotes(text);
+        return true;
+    }
+    if (text.back() != ')') return false;
+    std::string name;
+    for (size_t i = 0; i < open; i++) {
+        if (!std::isspace(static_cast<unsigned char>(text[i]))) name.push_back(text[i]);
+    }
+    auto func = parse_aggregate_func(to_upper(name));
+    if (!func) return false;
+    std::string arg;
+    for (size_t i = open + 1; i + 1 < text.size(); i++) {
+        if (!std::isspace(static_cast<unsigned char>(text[i]))) arg.push_back(text[i]);
+    }
+    if (arg.empty()) return false;
+    AggregateSpec spec;
+    spec.func = *func;
+    if (arg != "*") spec.column = trim_quotes(arg);
+    else if (*func != AggregateFunc::Count) return false;
+    out.aggregate = spec;
+    return true;
+}
+
+struct OrderClause {
+    bool present = false;
+    std::string column;
+    bool descending = false;
+    std::optional<size_t> limit;
+};
+
+static size_t find_order_clause(const std::vector<std::string>& tokens, size_t start) {
+    return std::min(find_keyword(tokens, start, "ORDER"), find_keyword(tokens, start, "LIMIT"));
+}
+
+static bool parse_order_clause(const std::vector<std::string>& tokens, size_t start, OrderClause& out, std::string& err) {
+    size_t pos = start;
+    if (pos < tokens.size() && to_upper(tokens[pos]) == "ORDER") {
+        if (pos + 2 >= tokens.size() || to_upper(tokens[pos + 1]) != "BY") { err = "bad ORDER BY"; return false; }
+        out.present = true;
+        out.column = trim_quotes(tokens[pos + 2]);
+        pos += 3;
+        if (pos < tokens.size() && (to_upper(tokens[pos]) == "ASC" || to_upper(tokens[pos]) == "DESC")) {
+            out.descending = to_upper(tokens[pos]) == "DESC";
+            pos++;
+        }
+    }
+    if (pos < tokens.size() && to_upper(tokens[pos]) == "LIMIT") {
+        auto n = pos + 1 < tokens.size() ? to_int64(tokens[pos + 1]) : std::nullopt;
+        if (!n || *n < 0) { err = "bad LIMIT"; return false; }
+        out.limit = static_cast<size_t>(*n);
+        pos += 2;
+    }
+    if (pos != tokens.size()) { err = "bad query"; return false; }
+    return true;
+}
+
+static std::vector<size_t> ordered_ids(const Table* table, std::vector<size_t> ids, const OrderClause& order) {
+    if (order.present) {
+        auto column = table->get_column_index(order.column);
+        return order_rows(*table, ids, *column, order.descending, order.limit, ThreadPool::shared().size());
+    }
+    if (order.limit && *order.limit < ids.size()) ids.resize(*order.limit);
+    return ids;
+}
+
 static void print_banner() {
-    std::cout << "\n=============================================\n";
-    std::cout << "  In-Memory Database CLI\n";
-    std::cout << "  Type HELP for commands, EXIT to quit\n";
-    std::cout << "=============================================\n\n";
+    output() << "\n=============================================\n";
+    output() << "  In-Memory Database CLI\n";
+    output() << "  Type HELP for commands, EXIT to quit\n";
+    output() << "=============================================\n\n";
 }
 
-static void print_rows(const Table* table, const std::vector<Row>& rows) {
-    if (!table) { std::cout << "No table.\n"; return; }
-    auto columns = table->get_columns();
-    if (columns.empty()) { std::cout << "No columns.\n"; return; }
+template <typename CellAt>
+static void print_cells(size_t row_count, size_t column_count, int width, CellAt cell_at) {
+    std::vector<std::string> chunks(morsel_count(row_count));
+    ThreadPool::shared().parallel_for(chunks.size(), [&](size_t m) {
+        std::ostringstream out;
+        size_t end = std::min(row_count, (m + 1) * ThreadPool::morsel_rows);
+        for (size_t r = m * ThreadPool::morsel_rows; r < end; r++) {
+            for (size_t c = 0; c < column_count; c++) {
+                const Value* value = cell_at(r, c);
+                out << std::setw(width) << (value ? value_to_string(*value) : std::string());
+                if (c + 1 < column_count) out << " | ";
+            }
+            out << "\n";
+        }
+        chunks[m] = out.str();
+    });
+    for (const auto& chunk : chunks) output() << chunk;
+}
+
+static std::atomic<size_t> interruptible_statements{ 0 };
+static thread_local std::chrono::milliseconds query_timeout{ 0 };
+
+enum class ResultFormat { Text, Binary, Count };
+static thread_local ResultFormat result_format = ResultFormat::Text;
+
+#ifdef IMDB_SERVER
+static std::atomic<Server*> serving{ nullptr };
+#endif
+
+static void on_interrupt(int) {
+    bool running = interruptible_statements.load() > 0;
+    if (running) interrupt_all();
+#ifdef IMDB_SERVER
+    if (Server* server = serving.load()) {
+        server->stop();
+        return;
+    }
+#endif
+    if (running) return;
+    std::signal(SIGINT, SIG_DFL);
+    std::raise(SIGINT);
+}
+
+class InterruptScope {
+private:
+    CancelToken token;
+    CancelScope scope;
+
+public:
+    InterruptScope() : scope(&token) {
+        if (query_timeout.count() > 0) token.set_timeout(query_timeout);
+        token.watch_interrupts();
+        interruptible_statements.fetch_add(1);
+    }
+    ~InterruptScope() { interruptible_statements.fetch_sub(1); }
+    InterruptScope(const InterruptScope&) = delete;
+    InterruptScope& operator=(const InterruptScope&) = delete;
+};
+
+static bool report_cancelled() {
+    if (!cancellation_requested()) return false;
+    output() << "ERR: " << active_cancel_token()->reason() << "\n";
+    return true;
+}
+
+static const char* format_name(ResultFormat format) {
+    if (format == ResultFormat::Binary) return "BINARY";
+    if (format == ResultFormat::Count) return "COUNT";
+    return "TEXT";
+}
+
+static void print_binary(const std::string& batch) {
+    output() << "BINARY " << batch.size() << "\n";
+    output().write(batch.data(), static_cast<std::streamsize>(batch.size()));
+}
+
+static void print_rows(const std::vector<std::string>& headers, const std::vector<ColumnType>& types,
+                       const std::vector<Row>& rows) {
+    if (report_cancelled()) return;
+    if (headers.empty()) { output() << "No columns.\n"; return; }
+    StageTimer timer("Output");
+    timer.rows(rows.size(), rows.size());
+    if (result_format == ResultFormat::Count) { output() << "Rows: " << rows.size() << "\n"; return; }
+    if (result_format == ResultFormat::Binary) { print_binary(encode_result(headers, types, rows)); return; }
     const int width = 18;
-    for (size_t i = 0; i < columns.size(); i++) {
-        std::cout << std::setw(width) << columns[i].name;
-        if (i + 1 < columns.size()) std::cout << " | ";
+    for (size_t i = 0; i < headers.size(); i++) {
+        output() << std::setw(width) << headers[i];
+        if (i + 1 < headers.size()) output() << " | ";
     }
-    std::cout << "\n";
-    for (size_t i = 0; i < columns.size(); i++) {
-        std::cout << std::string(width, '-');
-        if (i + 1 < columns.size()) std::cout << "-+-";
+    output() << "\n";
+    for (size_t i = 0; i < headers.size(); i++) {
+        output() << std::string(width, '-');
+        if (i + 1 < headers.size()) output() << "-+-";
     }
-    std::cout << "\n";
-    for (size_t r = 0; r < rows.size(); r++) {
-        for (size_t i = 0; i < columns.size(); i++) {
-            std::string cell = "";
-            if (i < rows[r].values.size()) cell = value_to_string(rows[r].values[i]);
-            std::cout << std::setw(width) << cell;
-            if (i + 1 < columns.size()) std::cout << " | ";
-        }
-        std::cout << "\n";
+    output() << "\n";
+    print_cells(rows.size(), headers.size(), width, [&](size_t r, size_t c) {
+        return c < rows[r].values.size() ? &rows[r].values[c] : nullptr;
+    });
+    output() << "\nRows: " << rows.size() << "\n\n";
+}
+
+static void print_rows(const Table* table, const std::vector<Row>& rows) {
+    if (!table) { output() << "No table.\n"; return; }
+    std::vector<std::string> headers;
+    std::vector<ColumnType> types;
+    for (const auto& c : table->get_columns()) {
+        headers.push_back(c.name);
+        types.push_back(c.type);
     }
-    std::cout << "\nRows: " << rows.size() << "\n\n";
+    print_rows(headers, types, rows);
 }
 
-static void print_join(const std::vector<std::string>& headers,
-                       const std::vector<std::vector<Value>>& rows) {
-    if (headers.empty()) { std::cout << "(empty)\n"; return; }
+static void print_result(const std::vector<std::string>& headers, const std::vector<ColumnType>& types,
+                         const std::vector<std::vector<Value>>& rows) {
+    if (report_cancelled()) return;
+    if (headers.empty()) { output() << "(empty)\n"; return; }
+    StageTimer timer("Output");
+    timer.rows(rows.size(), rows.size());
+    if (result_format == ResultFormat::Count) { output() << "Rows: " << rows.size() << "\n"; return; }
+    if (result_format == ResultFormat::Binary) { print_binary(encode_result(headers, types, rows)); return; }
     const int width = 18;
     for (size_t i = 0; i < headers.size(); i++) {
-        std::cout << std::setw(width) << headers[i];
-        if (i + 1 < headers.size()) std::cout << " | ";
+        output() << std::setw(width) << headers[i];
+        if (i + 1 < headers.size()) output() << " | ";
     }
-    std::cout << "\n";
+    output() << "\n";
     for (size_t i = 0; i < headers.size(); i++) {
-        std::cout << std::string(width, '-');
-        if (i + 1 < headers.size()) std::cout << "-+-";
+        output() << std::string(width, '-');
+        if (i + 1 < headers.size()) output() << "-+-";
+    }
+    output() << "\n";
+    print_cells(rows.size(), headers.size(), width, [&](size_t r, size_t c) {
+        return c < rows[r].size() ? &rows[r][c] : nullptr;
+    });
+    output() << "\nRows: " << rows.size() << "\n\n";
+}
+
+static void print_access_plan(const std::string& table_name, const AccessPlan& plan) {
+    output() << "PLAN " << table_name << ": " << describe_access(plan) << "\n";
+}
+
+static void print_join_plan(const Database& db, const std::vector<JoinCondition>& conditions) {
+    JoinPlan plan;
+    if (!db.plan_join(conditions, plan)) { output() << "ERR\n"; return; }
+    auto lines = describe_join_plan(plan, conditions);
+    for (size_t i = 0; i < lines.size(); i++) output() << "PLAN " << i + 1 << ": " << lines[i] << "\n";
+}
+
+static bool order_join(JoinResult& joined, const OrderClause& order) {
+    if (!order.present) {
+        if (order.limit && *order.limit < joined.size()) {
+            std::vector<size_t> keep(*order.limit);
+            std::iota(keep.begin(), keep.end(), 0);
+            joined.reorder(keep);
+        }
+        return true;
     }
-    std::cout << "\n";
-    for (size_t r = 0; r < rows.size(); r++) {
-        for (size_t c = 0; c < headers.size(); c++) {
-            std::string cell = "";
-            if (c < rows[r].size()) cell = value_to_string(rows[r][c]);
-            std::cout << std::setw(width) << cell;
-            if (c + 1 < headers.size()) std::cout << " | ";
+    auto col = joined.resolve(order.column);
+    if (!col) return false;
+    std::vector<const Value*> keys;
+    keys.reserve(joined.size());
+    for (size_t i = 0; i < joined.size(); i++) keys.push_back(&joined.value(i, *col));
+    joined.reorder(order_by(keys, order.descending, order.limit, ThreadPool::shared().size()));
+    return true;
+}
+
+static void print_plan(const Database& db, const PlanNode& plan) {
+    for (const auto& [depth, line] : describe_plan(db, plan)) output() << std::string(depth * 2, ' ') << "PLAN " << line << "\n";
+}
+
+struct CacheProbe {
+    std::string key;
+    TableVersions versions;
+    bool usable = false;
+};
+
+static std::shared_ptr<const CachedResult> probe_cache(Database& db, const std::string& text,
+                                                     const std::vector<std::string>& tables, CacheProbe& probe) {
+    probe.key = normalize_sql(text);
+    probe.usable = db.table_versions(tables, probe.versions);
+    if (!probe.usable) return nullptr;
+    StageTimer timer("CacheLookup");
+    auto hit = db.result_cache().lookup(probe.key, probe.versions);
+    if (hit) timer.rows(hit->rows.size(), hit->rows.size());
+    return hit;
+}
+
+static void print_and_cache(Database& db, const CacheProbe& probe, CachedResult result) {
+    if (report_cancelled()) return;
+    print_result(result.headers, result.types, result.rows);
+    if (probe.usable) db.result_cache().store(probe.key, probe.versions, std::move(result));
+}
+
+static void print_queued(bool ok, const std::string& err) {
+    if (ok) output() << "QUEUED\n";
+    else output() << "ERR: " << err << "\n";
+}
+
+static void run_sql(Database& db, const std::string& text, const SqlStatement& sql, bool explain, Transaction* txn) {
+    PlanNode plan;
+    std::string err;
+    if (!compile_sql(db, sql, plan, err)) { output() << "ERR: " << err << "\n"; return; }
+    if (explain) { print_plan(db, plan); return; }
+    if (sql.parameter_count > 0) { output() << "ERR: use PREPARE for parameters\n"; return; }
+    if (txn && plan.kind != PlanNode::Kind::Project) {
+        bool ok = txn->stage(plan, err);
+        print_queued(ok, err);
+        return;
+    }
+    CacheProbe probe;
+    if (plan.kind == PlanNode::Kind::Project) {
+        if (auto hit = probe_cache(db, text, plan_tables(plan), probe)) { print_result(hit->headers, hit->types, hit->rows); return; }
+    }
+    QueryResult result;
+    if (!execute_plan(db, plan, {}, result, err)) { output() << "ERR: " << err << "\n"; return; }
+    switch (plan.kind) {
+        case PlanNode::Kind::Insert: output() << "INSERTED " << result.affected << "\n"; break;
+        case PlanNode::Kind::Update: output() << "UPDATED " << result.affected << "\n"; break;
+        case PlanNode::Kind::Delete: output() << "DELETED " << result.affected << "\n"; break;
+        case PlanNode::Kind::CreateTable: output() << "OK\n"; break;
+        default: print_and_cache(db, probe, CachedResult{ std::move(result.headers), std::move(result.types), std::move(result.rows) }); break;
+    }
+}
+
+static Operand parse_operand(const std::string& token, ColumnType type, size_t& parameters) {
+    if (token == "?") return Operand{ Value{}, parameters++ };
+    return Operand{ parse_value_token(token, type), std::nullopt };
+}
+
+static bool parse_statement(Database& db, const std::vector<std::string>& tokens, size_t start,
+                            StatementSpec& out, std::string& err) {
+    if (start >= tokens.size()) { err = "nothing to prepare"; return false; }
+    std::string cmd = to_upper(tokens[start]);
+    size_t where_pos = tokens.size();
+    if (cmd == "SELECT" && start + 3 < tokens.size() && to_upper(tokens[start + 1]) == "WHERE") {
+        out.kind = StatementKind::Select;
+        out.table = trim_quotes(tokens[start + 2]);
+        where_pos = start + 3;
+    } else if (cmd == "SELECT" && find_keyword(tokens, start + 1, "FROM") + 1 < tokens.size()) {
+        size_t from = find_keyword(tokens, start + 1, "FROM");
+        out.kind = StatementKind::Select;
+        out.table = trim_quotes(tokens[from + 1]);
+        auto items = split_list(tokens, start + 1, from);
+        if (items.size() != 1 || items[0] != "*") {
+            for (const auto& text : items) {
+                SelectItem item;
+                if (!parse_select_item(text, item) || item.aggregate) { err = "bad select list"; return false; }
+                out.columns.push_back(item.column);
+            }
+        }
+        if (from + 2 < tokens.size()) {
+            if (to_upper(tokens[from + 2]) != "WHERE" || from + 3 >= tokens.size()) { err = "bad statement"; return false; }
+            where_pos = from + 3;
         }
-        std::cout << "\n";
+    } else if (cmd == "INSERT" && start + 2 < tokens.size()) {
+        out.kind = StatementKind::Insert;
+        out.table = trim_quotes(tokens[start + 1]);
+    } else if (cmd == "UPDATE" && start + 6 < tokens.size() && to_upper(tokens[start + 2]) == "SET" &&
+               to_upper(tokens[start + 5]) == "WHERE") {
+        out.kind = StatementKind::Update;
+        out.table = trim_quotes(tokens[start + 1]);
+        out.update_column = trim_quotes(tokens[start + 3]);
+        where_pos = start + 6;
+    } else if (cmd == "DELETE" && start + 4 < tokens.size() && to_upper(tokens[start + 1]) == "FROM" &&
+               to_upper(tokens[start + 3]) == "WHERE") {
+        out.kind = StatementKind::Delete;
+        out.table = trim_quotes(tokens[start + 2]);
+        where_pos = start + 4;
+    } else {
+        err = "cannot PREPARE " + tokens[start];
+        return false;
+    }
+
+    TableReader tbl = db.read_table(out.table);
+    if (!tbl) { err = "no such table"; return false; }
+    auto cols = tbl->get_columns();
+    size_t parameters = 0;
+    if (out.kind == StatementKind::Insert) {
+        if (tokens.size() - start - 2 != cols.size()) { err = "need " + std::to_string(cols.size()) + " values"; return false; }
+        for (size_t i = 0; i < cols.size(); i++) out.values.push_back(parse_operand(tokens[start + 2 + i], cols[i].type, parameters));
     }
-    std::cout << "\nRows: " << rows.size() << "\n\n";
+    if (out.kind == StatementKind::Update) {
+        auto type = column_type(cols, out.update_column);
+        if (!type) { err = "no such column"; return false; }
+        out.values.push_back(parse_operand(tokens[start + 4], *type, parameters));
+    }
+    if (where_pos < tokens.size()) {
+        Predicate where;
+        if (!parse_where(tokens, where_pos, tokens.size(), cols, where, err, &parameters)) return false;
+        out.where = std::move(where);
+    }
+    return true;
+}
+
+static std::string write_target(const std::vector<std::string>& tokens) {
+    std::string cmd = to_upper(tokens[0]);
+    if ((cmd == "INSERT" || cmd == "UPDATE") && tokens.size() >= 2) return trim_quotes(tokens[1]);
+    if ((cmd == "DELETE" || cmd == "IMPORT" || cmd == "ADD") && tokens.size() >= 3) return trim_quotes(tokens[2]);
+    return "";
 }
 
 static void print_help() {
     const int a = 32;
-    auto line = [](){ std::cout << std::string(70, '-') << "\n"; };
-    std::cout << "\n";
+    auto line = [](){ output() << std::string(70, '-') << "\n"; };
+    output() << "\n";
     line();
-    std::cout << std::left << std::setw(a) << "HELP" << "Show this help\n";
-    std::cout << std::left << std::setw(a) << "TABLES" << "List all tables\n";
-    std::cout << std::left << std::setw(a) << "CREATE TABLE <name>" << "Create table\n";
-    std::cout << std::left << std::setw(a) << "DROP TABLE <name>" << "Drop table\n";
-    std::cout << std::left << std::setw(a) << "ADD COLUMN <table> <col> <type>" << "Add column (INT or TEXT)\n";
-    std::cout << std::left << std::setw(a) << "ADD CONSTRAINT <table> PRIMARY KEY <col>" << "Set primary key\n";
-    std::cout << std::left << std::setw(a) << "ADD CONSTRAINT <table> NOT NULL <col>" << "Set not-null on column\n";
-    std::cout << std::left << std::setw(a) << "INSERT <table> <values...>" << "Insert row\n";
-    std::cout << std::left << std::setw(a) << "SELECT ALL <table>" << "Show all rows\n";
-    std::cout << std::left << std::setw(a) << "SELECT WHERE <table> <col> = <val>" << "Filter rows\n";
-    std::cout << std::left << std::setw(a) << "UPDATE <table> <col> <val> <set_col> <new_val>" << "Update rows\n";
-    std::cout << std::left << std::setw(a) << "DELETE FROM <table> <col> <val>" << "Delete rows\n";
-    std::cout << std::left << std::setw(a) << "JOIN <t1> <c1> <t2> <c2>" << "Inner join and print\n";
-    std::cout << std::left << std::setw(a) << "PRINT TABLE <table>" << "Print table\n";
-    std::cout << std::left << std::setw(a) << "PRINT SCHEMA <table>" << "Print schema\n";
-    std::cout << std::left << std::setw(a) << "IMPORT CSV <table> \"path\" [HEADER]" << "Import CSV\n";
-    std::cout << std::left << std::setw(a) << "EXIT" << "Quit\n";
+    output() << std::left << std::setw(a) << "HELP" << "Show this help\n";
+    output() << std::left << std::setw(a) << "TABLES" << "List all tables\n";
+    output() << std::left << std::setw(a) << "CREATE TABLE <name>" << "Create table\n";
+    output() << std::left << std::setw(a) << "CREATE TABLE <name> (<col> <type> [PRIMARY KEY] [NOT NULL], ...)" << "Create table with columns\n";
+    output() << std::left << std::setw(a) << "DROP TABLE <name>" << "Drop table\n";
+    output() << std::left << std::setw(a) << "CREATE MATERIALIZED VIEW <name> AS <select>" << "Store a query result kept current on writes\n";
+    output() << std::left << std::setw(a) << "DROP VIEW <name>" << "Drop a materialized view\n";
+    output() << std::left << std::setw(a) << "ADD COLUMN <table> <col> <type>" << "Add column (INT or TEXT)\n";
+    output() << std::left << std::setw(a) << "CREATE INDEX <table> <col> [HASH|ORDERED]" << "Index a column\n";
+    output() << std::left << std::setw(a) << "DROP INDEX <table> <col>" << "Drop a column index\n";
+    output() << std::left << std::setw(a) << "ANALYZE <table>" << "Refresh column statistics\n";
+    output() << std::left << std::setw(a) << "ADD CONSTRAINT <table> PRIMARY KEY <col>" << "Set primary key\n";
+    output() << std::left << std::setw(a) << "ADD CONSTRAINT <table> NOT NULL <col>" << "Set not-null on column\n";
+    output() << std::left << std::setw(a) << "INSERT <table> <values...>" << "Insert row\n";
+    output() << std::left << std::setw(a) << "INSERT INTO <table> [(<cols>)] VALUES (<vals>), ..." << "Insert rows\n";
+    output() << std::left << std::setw(a) << "SELECT ALL <table> [<order>]" << "Show all rows\n";
+    output() << std::left << std::setw(a) << "SELECT WHERE <table> <cond> [<order>]" << "Filter rows\n";
+    output() << std::left << std::setw(a) << "SELECT <items> FROM <table> [WHERE <cond>] [GROUP BY <cols>] [<order>]" << "Project or aggregate rows\n";
+    output() << std::left << std::setw(a) << "SELECT <items> FROM <t1> JOIN <t2> ON <c1> = <c2> [JOIN ...] [GROUP BY <cols>] [<order>]" << "Join, project or aggregate\n";
+    output() << std::left << std::setw(a) << "UPDATE <table> <col> <val> <set_col> <new_val>" << "Update rows\n";
+    output() << std::left << std::setw(a) << "UPDATE <table> SET <col> <val> WHERE <cond>" << "Update rows\n";
+    output() << std::left << std::setw(a) << "UPDATE <table> SET <col> = <val>, ... [WHERE <cond>]" << "Update rows\n";
+    output() << std::left << std::setw(a) << "DELETE FROM <table> <col> <val>" << "Delete rows\n";
+    output() << std::left << std::setw(a) << "DELETE FROM <table> [WHERE <cond>]" << "Delete rows\n";
+    output() << std::left << std::setw(a) << "JOIN <t1> <c1> <t2> <c2> [<t> <c> <t> <c> ...] [<order>]" << "Inner join and print\n";
+    output() << std::left << std::setw(a) << "BEGIN" << "Start buffering writes\n";
+    output() << std::left << std::setw(a) << "COMMIT" << "Check constraints and apply buffered writes at once\n";
+    output() << std::left << std::setw(a) << "ROLLBACK" << "Discard buffered writes\n";
+    output() << std::left << std::setw(a) << "EXPLAIN <command>" << "Show the chosen plan\n";
+    output() << std::left << std::setw(a) << "EXPLAIN ANALYZE <command>" << "Run and profile each stage\n";
+    output() << std::left << std::setw(a) << "CACHE [CLEAR | LIMIT <bytes>]" << "Show, clear or cap the result cache\n";
+    output() << std::left << std::setw(a) << "SCHEDULER [LIMIT SHORT|LONG <n> [<bytes>]]" << "Show queue waits or cap a query class\n";
+    output() << std::left << std::setw(a) << "SET TIMEOUT [<ms>]" << "Show or set the per-command time limit, 0 for none\n";
+    output() << std::left << std::setw(a) << "SET FORMAT [TEXT|BINARY|COUNT]" << "Show or set how result rows are sent\n";
+    output() << std::left << std::setw(a) << "SET THREADS [<n>]" << "Show or size the shared worker pool\n";
+    output() << std::left << std::setw(a) << "PREPARE <name> AS <command>" << "Plan a select/insert/update/delete once\n";
+    output() << std::left << std::setw(a) << "EXECUTE <name> <values...>" << "Run a prepared statement\n";
+    output() << std::left << std::setw(a) << "DEALLOCATE <name>" << "Drop a prepared statement\n";
+    output() << std::left << std::setw(a) << "PRINT TABLE <table>" << "Print table\n";
+    output() << std::left << std::setw(a) << "PRINT SCHEMA <table>" << "Print schema\n";
+    output() << std::left << std::setw(a) << "IMPORT CSV <table> \"path\" [HEADER]" << "Import CSV\n";
+    output() << std::left << std::setw(a) << "EXIT" << "Quit\n";
     line();
-    std::cout << "Use quotes for names or values with spaces.\n";
+    output() << "Use quotes for names or values with spaces.\n";
+    output() << "<cond>: <col> <op> <val> combined with AND, OR, NOT and ( ).\n";
+    output() << "         <op> is one of = != < <= > >=, separated by spaces.\n";
+    output() << "<items>: *, columns and COUNT(*), COUNT/SUM/MIN/MAX/AVG(<col>), comma separated.\n";
+    output() << "<order>: [ORDER BY <col> [ASC|DESC]] [LIMIT <n>]\n";
+    output() << "SQL statements use 'quoted' or \"quoted\" strings and are compiled to an operator tree.\n";
+    output() << "Prepared statements take ? in place of values, bound in order by EXECUTE.\n";
+    output() << "Between BEGIN and COMMIT writes are QUEUED and become visible together at COMMIT.\n";
+    output() << "In BINARY format a result is 'BINARY <bytes>' followed by a column-oriented batch.\n";
+    output() << "Run a file with --script <file>, or stdin with --batch; add --counts and --parallel as needed.\n";
+    output() << "Ctrl-C cancels the running command; cancelled writes leave tables unchanged.\n";
     line();
-    std::cout << "\n";
+    output() << "\n";
 }
 
-int main() {
-    Database db("DB");
-    print_banner();
-    std::cout << "Type HELP to see commands.\n\n";
+static bool run_command(Database& db, std::unordered_map<std::string, PreparedStatement>& prepared,
+                        std::optional<Transaction>& txn, std::vector<std::string> tokens) {
+    std::string cmd = to_upper(tokens[0]);
+    bool explain = false;
+    if (cmd == "EXPLAIN" && tokens.size() >= 2) {
+        tokens.erase(tokens.begin());
+        cmd = to_upper(tokens[0]);
+        explain = true;
+    }
 
-    std::string input;
-    while (true) {
-        std::cout << "> ";
-        if (!std::getline(std::cin, input)) break;
-        if (input.empty()) continue;
+    if (!explain && (cmd == "BEGIN" || cmd == "COMMIT" || cmd == "ROLLBACK") && tokens.size() == 1) {
+        if (cmd == "BEGIN") {
+            if (txn) { output() << "ERR: transaction already open\n"; return true; }
+            txn.emplace(db);
+            output() << "OK\n";
+            return true;
+        }
+        if (!txn) { output() << "ERR: no transaction\n"; return true; }
+        if (cmd == "ROLLBACK") {
+            output() << "ROLLED BACK " << txn->pending() << "\n";
+            txn.reset();
+            return true;
+        }
+        size_t pending = txn->pending();
+        std::string err;
+        bool ok = txn->commit(err);
+        txn.reset();
+        if (ok) output() << "COMMITTED " << pending << "\n";
+        else output() << "ERR: " << err << "\n";
+        return true;
+    }
+    if (txn && !explain && (cmd == "CREATE" || cmd == "DROP" || cmd == "ADD" || cmd == "ANALYZE")) {
+        output() << "ERR: not allowed inside a transaction\n";
+        return true;
+    }
 
-        std::vector<std::string> tokens = tokenize(input);
-        if (tokens.empty()) continue;
+    std::string text;
+    for (size_t i = 0; i < tokens.size(); i++) text += (i ? " " : "") + tokens[i];
+    SqlStatement sql;
+    std::string sql_err;
+    if (parse_sql(text, sql, sql_err)) {
+        run_sql(db, text, sql, explain, txn ? &*txn : nullptr);
+        return true;
+    }
+    bool sql_like = cmd == "SELECT" || cmd == "INSERT" || cmd == "UPDATE" || cmd == "DELETE" || cmd == "CREATE";
+    if (explain && cmd != "SELECT" && cmd != "UPDATE" && cmd != "DELETE" && cmd != "JOIN" && cmd != "EXECUTE") {
+        output() << "ERR: cannot EXPLAIN " << tokens[0] << "\n";
+        return true;
+    }
 
-        std::string cmd = to_upper(tokens[0]);
+    std::string target = write_target(tokens);
+    if (!target.empty() && db.is_view(target)) {
+        output() << "ERR: cannot modify materialized view\n";
+        return true;
+    }
 
-        if (cmd == "HELP" || cmd == "?") { print_help(); continue; }
-        if (cmd == "EXIT" || cmd == "QUIT") { std::cout << "Goodbye!\n"; break; }
+    if (cmd == "HELP" || cmd == "?") { print_help(); return true; }
+    if (cmd == "EXIT" || cmd == "QUIT") { output() << "Goodbye!\n"; return false; }
 
-        if (cmd == "TABLES") {
-            auto names = db.get_table_names();
-            if (names.empty()) { std::cout << "(no tables)\n"; continue; }
-            for (size_t i = 0; i < names.size(); i++) std::cout << " - " << names[i] << "\n";
-            std::cout << "\n";
-            continue;
+    if (cmd == "TABLES") {
+        auto names = db.get_table_names();
+        if (names.empty()) { output() << "(no tables)\n"; return true; }
+        for (size_t i = 0; i < names.size(); i++) {
+            output() << " - " << names[i] << (db.is_view(names[i]) ? " (materialized view)" : "") << "\n";
         }
+        output() << "\n";
+        return true;
+    }
 
-        if (cmd == "CREATE" && tokens.size() >= 3 && to_upper(tokens[1]) == "TABLE") {
-            std::string table_name = trim_quotes(tokens[2]);
-            bool ok = db.create_table(table_name);
-            if (ok) std::cout << "OK\n"; else std::cout << "ERR: table exists?\n";
-            continue;
+    if (cmd == "CREATE" && tokens.size() >= 6 && to_upper(tokens[1]) == "MATERIALIZED" &&
+        to_upper(tokens[2]) == "VIEW" && to_upper(tokens[4]) == "AS") {
+        std::string query;
+        for (size_t i = 5; i < tokens.size(); i++) query += (i > 5 ? " " : "") + tokens[i];
+        SqlStatement definition;
+        std::string err;
+        if (parse_sql(query, definition, err) && db.create_view(trim_quotes(tokens[3]), definition, err)) output() << "OK\n";
+        else output() << "ERR: " << err << "\n";
+        return true;
+    }
+
+    if (cmd == "CREATE" && tokens.size() >= 3 && to_upper(tokens[1]) == "TABLE") {
+        std::string table_name = trim_quotes(tokens[2]);
+        bool ok = db.create_table(table_name);
+        if (ok) output() << "OK\n"; else output() << "ERR: table exists?\n";
+        return true;
+    }
+
+    if (cmd == "CREATE" && tokens.size() >= 4 && to_upper(tokens[1]) == "INDEX") {
+        std::string table_name = trim_quotes(tokens[2]);
+        std::string col_name = trim_quotes(tokens[3]);
+        TableWriter tbl = db.write_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        auto kind = tokens.size() >= 5 ? parse_index_kind(to_upper(tokens[4])) : std::optional<IndexKind>(IndexKind::Ordered);
+        if (!kind) { output() << "ERR: unknown index kind\n"; return true; }
+        if (!tbl->get_column_index(col_name)) { output() << "ERR: no such column\n"; return true; }
+        bool ok = tbl->create_index(col_name, *kind);
+        if (ok) output() << "OK\n"; else output() << "ERR: index exists\n";
+        return true;
+    }
+
+    if (cmd == "ANALYZE" && tokens.size() >= 2) {
+        TableWriter tbl = db.write_table(trim_quotes(tokens[1]));
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        tbl->analyze();
+        output() << "OK\n";
+        return true;
+    }
+
+    if (cmd == "DROP" && tokens.size() >= 4 && to_upper(tokens[1]) == "INDEX") {
+        std::string table_name = trim_quotes(tokens[2]);
+        TableWriter tbl = db.write_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        bool ok = tbl->drop_index(trim_quotes(tokens[3]));
+        if (ok) output() << "OK\n"; else output() << "ERR: no such index\n";
+        return true;
+    }
+
+    if (cmd == "DROP" && tokens.size() >= 3 && to_upper(tokens[1]) == "TABLE") {
+        std::string table_name = trim_quotes(tokens[2]);
+        if (db.is_view(table_name)) { output() << "ERR: use DROP VIEW\n"; return true; }
+        if (db.has_dependent_views(table_name)) { output() << "ERR: table has dependent views\n"; return true; }
+        bool ok = db.drop_table(table_name);
+        if (ok) output() << "OK\n"; else output() << "ERR: no such table\n";
+        return true;
+    }
+
+    if (cmd == "DROP" && tokens.size() >= 3 && to_upper(tokens[1]) == "VIEW") {
+        std::string view_name = trim_quotes(tokens[2]);
+        if (!db.is_view(view_name)) { output() << "ERR: no such view\n"; return true; }
+        bool ok = db.drop_view(view_name);
+        if (ok) output() << "OK\n"; else output() << "ERR: view has dependent views\n";
+        return true;
+    }
+
+    if (cmd == "ADD" && tokens.size() >= 5 && to_upper(tokens[1]) == "COLUMN") {
+        std::string table_name = trim_quotes(tokens[2]);
+        std::string col_name = trim_quotes(tokens[3]);
+        std::string col_type = tokens[4];
+        TableWriter tbl = db.write_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        try {
+            tbl->add_column(col_name, parse_type(col_type));
+            output() << "OK\n";
+        } catch (...) {
+            output() << "ERR: column exists\n";
         }
+        return true;
+    }
 
-        if (cmd == "DROP" && tokens.size() >= 3 && to_upper(tokens[1]) == "TABLE") {
-            std::string table_name = trim_quotes(tokens[2]);
-            bool ok = db.drop_table(table_name);
-            if (ok) std::cout << "OK\n"; else std::cout << "ERR: no such table\n";
-            continue;
+    if (cmd == "ADD" && tokens.size() >= 6 && to_upper(tokens[1]) == "CONSTRAINT") {
+        std::string table_name = trim_quotes(tokens[2]);
+        TableWriter tbl = db.write_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        std::string word3 = to_upper(tokens[3]);
+        if (word3 == "PRIMARY" && tokens.size() >= 6 && to_upper(tokens[4]) == "KEY") {
+            std::string col_name = trim_quotes(tokens[5]);
+            bool ok = tbl->set_primary_key(col_name);
+            if (ok) output() << "OK\n"; else output() << "ERR\n";
+            return true;
+        }
+        if (word3 == "NOT" && tokens.size() >= 6 && to_upper(tokens[4]) == "NULL") {
+            std::string col_name = trim_quotes(tokens[5]);
+            bool ok = tbl->set_not_null(col_name, true);
+            if (ok) output() << "OK\n"; else output() << "ERR\n";
+            return true;
         }
+        output() << "ERR\n";
+        return true;
+    }
 
-        if (cmd == "ADD" && tokens.size() >= 5 && to_upper(tokens[1]) == "COLUMN") {
-            std::string table_name = trim_quotes(tokens[2]);
-            std::string col_name = trim_quotes(tokens[3]);
-            std::string col_type = tokens[4];
-            Table* tbl = db.get_table(table_name);
-            if (!tbl) { std::cout << "ERR: no such table\n"; continue; }
-            try {
-                tbl->add_column(col_name, parse_type(col_type));
-                std::cout << "OK\n";
-            } catch (...) {
-                std::cout << "ERR: column exists\n";
-            }
-            continue;
+    if (cmd == "INSERT" && tokens.size() >= 3) {
+        std::string table_name = trim_quotes(tokens[1]);
+        TableWriter tbl = db.write_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        auto cols = tbl->get_columns();
+        if (cols.empty()) { output() << "ERR: define columns first\n"; return true; }
+        if (tokens.size() - 2 < cols.size()) { output() << "ERR: need " << cols.size() << " values\n"; return true; }
+        std::vector<Value> values;
+        values.reserve(cols.size());
+        for (size_t i = 0; i < cols.size(); i++) {
+            values.push_back(parse_value_token(tokens[2 + i], cols[i].type));
         }
+        if (txn) {
+            tbl = {};
+            std::string err;
+            bool ok = txn->insert(table_name, std::move(values), err);
+            print_queued(ok, err);
+            return true;
+        }
+        bool ok = tbl->insert_row(values);
+        if (ok) output() << "OK\n"; else output() << "ERR\n";
+        return true;
+    }
 
-        if (cmd == "ADD" && tokens.size() >= 6 && to_upper(tokens[1]) == "CONSTRAINT") {
-            std::string table_name = trim_quotes(tokens[2]);
-            Table* tbl = db.get_table(table_name);
-            if (!tbl) { std::cout << "ERR: no such table\n"; continue; }
-            std::string word3 = to_upper(tokens[3]);
-            if (word3 == "PRIMARY" && tokens.size() >= 6 && to_upper(tokens[4]) == "KEY") {
-                std::string col_name = trim_quotes(tokens[5]);
-                bool ok = tbl->set_primary_key(col_name);
-                if (ok) std::cout << "OK\n"; else std::cout << "ERR\n";
-                continue;
-            }
-            if (word3 == "NOT" && tokens.size() >= 6 && to_upper(tokens[4]) == "NULL") {
-                std::string col_name = trim_quotes(tokens[5]);
-                bool ok = tbl->set_not_null(col_name, true);
-                if (ok) std::cout << "OK\n"; else std::cout << "ERR\n";
-                continue;
-            }
-            std::cout << "ERR\n";
-            continue;
+    if (cmd == "SELECT" && tokens.size() >= 3 && to_upper(tokens[1]) == "ALL") {
+        std::string table_name = trim_quotes(tokens[2]);
+        TableReader tbl = db.read_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        OrderClause order;
+        std::string err;
+        if (!parse_order_clause(tokens, 3, order, err)) { output() << "ERR: " << err << "\n"; return true; }
+        if (explain) { print_access_plan(table_name, plan_scan(*tbl)); return true; }
+        if (!order.present && !order.limit) { print_rows(tbl.get(), tbl->select_all()); return true; }
+        if (order.present && !tbl->get_column_index(order.column)) { output() << "ERR: no such column\n"; return true; }
+        std::vector<size_t> ids(tbl->row_count());
+        std::iota(ids.begin(), ids.end(), 0);
+        print_rows(tbl.get(), tbl->select_rows(ordered_ids(tbl.get(), std::move(ids), order)));
+        return true;
+    }
+
+    if (cmd == "SELECT" && tokens.size() >= 6 && to_upper(tokens[1]) == "WHERE") {
+        std::string table_name = trim_quotes(tokens[2]);
+        TableReader tbl = db.read_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        size_t order_pos = find_order_clause(tokens, 3);
+        Predicate where;
+        OrderClause order;
+        std::string err;
+        if (!parse_where(tokens, 3, order_pos, tbl->get_columns(), where, err) ||
+            !parse_order_clause(tokens, order_pos, order, err)) {
+            output() << "ERR: " << err << "\n";
+            return true;
+        }
+        if (order.present && !tbl->get_column_index(order.column)) { output() << "ERR: no such column\n"; return true; }
+        if (explain) { print_access_plan(table_name, plan_access(*tbl, where)); return true; }
+        CacheProbe probe;
+        if (auto hit = probe_cache(db, text, { table_name }, probe)) { print_result(hit->headers, hit->types, hit->rows); return true; }
+        CachedResult result;
+        for (const auto& c : tbl->get_columns()) {
+            result.headers.push_back(c.name);
+            result.types.push_back(c.type);
         }
+        for (auto& row : tbl->select_rows(ordered_ids(tbl.get(), tbl->find_rows(where), order))) result.rows.push_back(std::move(row.values));
+        print_and_cache(db, probe, std::move(result));
+        return true;
+    }
 
-        if (cmd == "INSERT" && tokens.size() >= 3) {
-            std::string table_name = trim_quotes(tokens[1]);
-            Table* tbl = db.get_table(table_name);
-            if (!tbl) { std::cout << "ERR: no such table\n"; continue; }
-            auto cols = tbl->get_columns();
-            if (cols.empty()) { std::cout << "ERR: define columns first\n"; continue; }
-            if (tokens.size() - 2 < cols.size()) { std::cout << "ERR: need " << cols.size() << " values\n"; continue; }
-            std::vector<Value> values;
-            values.reserve(cols.size());
-            for (size_t i = 0; i < cols.size(); i++) {
-                values.push_back(parse_value_token(tokens[2 + i], cols[i].type));
-            }
-            bool ok = tbl->insert_row(values);
-            if (ok) std::cout << "OK\n"; else std::cout << "ERR\n";
-            continue;
+    if (cmd == "UPDATE" && tokens.size() >= 9 && to_upper(tokens[2]) == "SET" && to_upper(tokens[5]) == "WHERE") {
+        std::string table_name = trim_quotes(tokens[1]);
+        std::string update_col = trim_quotes(tokens[3]);
+        TableWriter tbl = db.write_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        auto cols = tbl->get_columns();
+        auto update_type = column_type(cols, update_col);
+        if (!update_type) { output() << "ERR: no such column\n"; return true; }
+        Predicate where;
+        std::string err;
+        if (!parse_where(tokens, 6, tokens.size(), cols, where, err)) { output() << "ERR: " << err << "\n"; return true; }
+        if (explain) { print_access_plan(table_name, plan_access(*tbl, where)); return true; }
+        Value new_value = parse_value_token(tokens[4], update_type);
+        if (txn) {
+            tbl = {};
+            bool ok = txn->update(table_name, std::move(where), update_col, new_value, err);
+            print_queued(ok, err);
+            return true;
         }
+        size_t n = tbl->update_where(where, update_col, new_value);
+        if (n == 0 && report_cancelled()) return true;
+        output() << "UPDATED " << n << "\n";
+        return true;
+    }
 
-        if (cmd == "SELECT" && tokens.size() >= 3 && to_upper(tokens[1]) == "ALL") {
-            std::string table_name = trim_quotes(tokens[2]);
-            Table* tbl = db.get_table(table_name);
-            if (!tbl) { std::cout << "ERR: no such table\n"; continue; }
-            print_rows(tbl, tbl->select_all());
-            continue;
+    if (cmd == "UPDATE" && tokens.size() >= 6) {
+        std::string table_name = trim_quotes(tokens[1]);
+        std::string search_col = trim_quotes(tokens[2]);
+        std::string search_val_token = tokens[3];
+        std::string update_col = trim_quotes(tokens[4]);
+        std::string new_val_token = tokens[5];
+        TableWriter tbl = db.write_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        auto cols = tbl->get_columns();
+        std::optional<ColumnType> search_type;
+        std::optional<ColumnType> update_type;
+        for (size_t i = 0; i < cols.size(); i++) {
+            if (cols[i].name == search_col) search_type = cols[i].type;
+            if (cols[i].name == update_col) update_type = cols[i].type;
+        }
+        if (!search_type || !update_type) { output() << "ERR: no such column\n"; return true; }
+        Value search_value = parse_value_token(search_val_token, search_type);
+        Value new_value = parse_value_token(new_val_token, update_type);
+        if (explain) {
+            print_access_plan(table_name, plan_access(*tbl, Predicate::compare(search_col, CompareOp::Eq, search_value)));
+            return true;
+        }
+        if (txn) {
+            tbl = {};
+            std::string err;
+            bool ok = txn->update(table_name, Predicate::compare(search_col, CompareOp::Eq, search_value), update_col, new_value, err);
+            print_queued(ok, err);
+            return true;
         }
+        size_t n = tbl->update_where(search_col, search_value, update_col, new_value);
+        if (n == 0 && report_cancelled()) return true;
+        output() << "UPDATED " << n << "\n";
+        return true;
+    }
+
+    if (cmd == "DELETE" && tokens.size() >= 7 && to_upper(tokens[1]) == "FROM" && to_upper(tokens[3]) == "WHERE") {
+        std::string table_name = trim_quotes(tokens[2]);
+        TableWriter tbl = db.write_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        Predicate where;
+        std::string err;
+        if (!parse_where(tokens, 4, tokens.size(), tbl->get_columns(), where, err)) { output() << "ERR: " << err << "\n"; return true; }
+        if (explain) { print_access_plan(table_name, plan_access(*tbl, where)); return true; }
+        if (txn) {
+            tbl = {};
+            bool ok = txn->remove(table_name, std::move(where), err);
+            print_queued(ok, err);
+            return true;
+        }
+        size_t n = tbl->delete_where(where);
+        if (n == 0 && report_cancelled()) return true;
+        output() << "DELETED " << n << "\n";
+        return true;
+    }
+
+    if (cmd == "DELETE" && tokens.size() >= 5 && to_upper(tokens[1]) == "FROM") {
+        std::string table_name = trim_quotes(tokens[2]);
+        std::string col_name = trim_quotes(tokens[3]);
+        std::string value_token = tokens[4];
+        TableWriter tbl = db.write_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        auto cols = tbl->get_columns();
+        std::optional<ColumnType> col_type;
+        for (size_t i = 0; i < cols.size(); i++) {
+            if (cols[i].name == col_name) col_type = cols[i].type;
+        }
+        if (!col_type) { output() << "ERR: no such column\n"; return true; }
+        Value v = parse_value_token(value_token, col_type);
+        if (explain) { print_access_plan(table_name, plan_access(*tbl, Predicate::compare(col_name, CompareOp::Eq, v))); return true; }
+        if (txn) {
+            tbl = {};
+            std::string err;
+            bool ok = txn->remove(table_name, Predicate::compare(col_name, CompareOp::Eq, v), err);
+            print_queued(ok, err);
+            return true;
+        }
+        size_t n = tbl->delete_where(col_name, v);
+        if (n == 0 && report_cancelled()) return true;
+        output() << "DELETED " << n << "\n";
+        return true;
+    }
 
-        if (cmd == "SELECT" && tokens.size() >= 6 && to_upper(tokens[1]) == "WHERE") {
-            std::string table_name = trim_quotes(tokens[2]);
-            std::string col_name = trim_quotes(tokens[3]);
-            std::string equal_sign = tokens[4];
-            std::string value_token = tokens[5];
-            if (equal_sign != "=") { std::cout << "ERR\n"; continue; }
-            Table* tbl = db.get_table(table_name);
-            if (!tbl) { std::cout << "ERR: no such table\n"; continue; }
-            auto cols = tbl->get_columns();
-            std::optional<ColumnType> col_type;
-            for (size_t i = 0; i < cols.size(); i++) {
-                if (cols[i].name == col_name) { col_type = cols[i].type; break; }
+    if (cmd == "JOIN" && tokens.size() >= 5) {
+        size_t order_pos = find_order_clause(tokens, 5);
+        if ((order_pos - 1) % 4 != 0) { output() << "ERR: expected JOIN <t1> <c1> <t2> <c2> ...\n"; return true; }
+        std::vector<JoinCondition> conditions;
+        for (size_t i = 1; i < order_pos; i += 4) {
+            conditions.push_back(JoinCondition{ trim_quotes(tokens[i]), trim_quotes(tokens[i + 1]),
+                                                trim_quotes(tokens[i + 2]), trim_quotes(tokens[i + 3]) });
+        }
+        OrderClause order;
+        std::string err;
+        if (!parse_order_clause(tokens, order_pos, order, err)) { output() << "ERR: " << err << "\n"; return true; }
+        if (explain) { print_join_plan(db, conditions); return true; }
+        std::vector<std::string> names;
+        for (const auto& c : conditions) {
+            for (const auto& name : { c.left_table, c.right_table }) {
+                if (std::find(names.begin(), names.end(), name) == names.end()) names.push_back(name);
             }
-            if (!col_type) { std::cout << "ERR: no such column\n"; continue; }
-            Value v = parse_value_token(value_token, col_type);
-            print_rows(tbl, tbl->select_where(col_name, v));
-            continue;
         }
+        CacheProbe probe;
+        if (auto hit = probe_cache(db, text, names, probe)) { print_result(hit->headers, hit->types, hit->rows); return true; }
+        TableLocks held = db.lock_tables(names, {});
+        JoinResult joined;
+        bool ok = db.join_rows_unlocked(conditions, joined);
+        if (!ok && report_cancelled()) return true;
+        if (!ok) { output() << "ERR\n"; return true; }
+        if (!order_join(joined, order)) { output() << "ERR: no such column\n"; return true; }
+        CachedResult result;
+        joined.materialize(joined.all_columns(), result.headers, result.types, result.rows);
+        print_and_cache(db, probe, std::move(result));
+        return true;
+    }
+
+    if (cmd == "CACHE" && tokens.size() == 1) {
+        auto stats = db.result_cache().stats();
+        output() << "Cache: hits=" << stats.hits << " misses=" << stats.misses << " evictions=" << stats.evictions
+                  << " entries=" << stats.entries << " bytes=" << stats.bytes << " capacity=" << stats.capacity << "\n";
+        return true;
+    }
+
+    if (cmd == "CACHE" && tokens.size() >= 2 && to_upper(tokens[1]) == "CLEAR") {
+        db.result_cache().clear();
+        output() << "OK\n";
+        return true;
+    }
+
+    if (cmd == "CACHE" && tokens.size() >= 3 && to_upper(tokens[1]) == "LIMIT") {
+        auto bytes = to_int64(tokens[2]);
+        if (!bytes || *bytes < 0) { output() << "ERR: bad size\n"; return true; }
+        db.result_cache().set_capacity(static_cast<size_t>(*bytes));
+        output() << "OK\n";
+        return true;
+    }
+
+    if (cmd == "SCHEDULER" && tokens.size() == 1) {
+        for (QueryClass cls : { QueryClass::Short, QueryClass::Long }) {
+            auto stats = QueryScheduler::shared().stats(cls);
+            auto limits = QueryScheduler::shared().limits(cls);
+            uint64_t average = stats.admitted ? stats.wait_nanos / stats.admitted / 1000 : 0;
+            output() << "Scheduler " << query_class_name(cls) << ": running=" << stats.running << "/" << limits.max_running
+                      << " waiting=" << stats.waiting << " admitted=" << stats.admitted << " abandoned=" << stats.abandoned
+                      << " memory=" << stats.memory << "/" << limits.memory_budget
+                      << " wait_avg_us=" << average << " wait_max_us=" << stats.max_wait_nanos / 1000 << "\n";
+        }
+        return true;
+    }
+
+    if (cmd == "SCHEDULER" && tokens.size() >= 4 && to_upper(tokens[1]) == "LIMIT") {
+        std::string name = to_upper(tokens[2]);
+        auto running = to_int64(tokens[3]);
+        auto memory = tokens.size() >= 5 ? to_int64(tokens[4]) : std::optional<int64_t>(0);
+        if ((name != "SHORT" && name != "LONG") || !running || *running < 1 || !memory || *memory < 0) {
+            output() << "ERR: bad limit\n";
+            return true;
+        }
+        QueryClass cls = name == "SHORT" ? QueryClass::Short : QueryClass::Long;
+        ClassLimits limits = QueryScheduler::shared().limits(cls);
+        limits.max_running = static_cast<size_t>(*running);
+        if (tokens.size() >= 5) limits.memory_budget = static_cast<size_t>(*memory);
+        QueryScheduler::shared().set_limits(cls, limits);
+        output() << "OK\n";
+        return true;
+    }
+
+    if (cmd == "SET" && tokens.size() >= 2 && to_upper(tokens[1]) == "TIMEOUT") {
+        if (tokens.size() >= 3) {
+            auto ms = to_int64(tokens[2]);
+            if (!ms || *ms < 0) { output() << "ERR: bad timeout\n"; return true; }
+            query_timeout = std::chrono::milliseconds(*ms);
+        }
+        output() << "TIMEOUT " << query_timeout.count() << "\n";
+        return true;
+    }
 
-        if (cmd == "UPDATE" && tokens.size() >= 6) {
-            std::string table_name = trim_quotes(tokens[1]);
-            std::string search_col = trim_quotes(tokens[2]);
-            std::string search_val_token = tokens[3];
-            std::string update_col = trim_quotes(tokens[4]);
-            std::string new_val_token = tokens[5];
-            Table* tbl = db.get_table(table_name);
-            if (!tbl) { std::cout << "ERR: no such table\n"; continue; }
-            auto cols = tbl->get_columns();
-            std::optional<ColumnType> search_type;
-            std::optional<ColumnType> update_type;
-            for (size_t i = 0; i < cols.size(); i++) {
-                if (cols[i].name == search_col) search_type = cols[i].type;
-                if (cols[i].name == update_col) update_type = cols[i].type;
+    if (cmd == "SET" && tokens.size() >= 2 && to_upper(tokens[1]) == "FORMAT") {
+        if (tokens.size() >= 3) {
+            std::string format = to_upper(tokens[2]);
+            if (format == "TEXT") result_format = ResultFormat::Text;
+            else if (format == "BINARY") result_format = ResultFormat::Binary;
+            else if (format == "COUNT") result_format = ResultFormat::Count;
+            else { output() << "ERR: bad format\n"; return true; }
+        }
+        output() << "FORMAT " << format_name(result_format) << "\n";
+        return true;
+    }
+
+    if (cmd == "SET" && tokens.size() >= 2 && to_upper(tokens[1]) == "THREADS") {
+        if (tokens.size() >= 3) {
+            auto n = to_int64(tokens[2]);
+            if (!n || *n < 1 || *n > 256) { output() << "ERR: bad thread count\n"; return true; }
+            if (!ThreadPool::shared().resize(static_cast<size_t>(*n))) {
+                output() << "ERR: cannot resize the pool from one of its workers\n";
+                return true;
             }
-            if (!search_type || !update_type) { std::cout << "ERR: no such column\n"; continue; }
-            Value search_value = parse_value_token(search_val_token, search_type);
-            Value new_value = parse_value_token(new_val_token, update_type);
-            size_t n = tbl->update_where(search_col, search_value, update_col, new_value);
-            std::cout << "UPDATED " << n << "\n";
-            continue;
         }
+        output() << "THREADS " << ThreadPool::shared().size() << "\n";
+        return true;
+    }
 
-        if (cmd == "DELETE" && tokens.size() >= 5 && to_upper(tokens[1]) == "FROM") {
-            std::string table_name = trim_quotes(tokens[2]);
-            std::string col_name = trim_quotes(tokens[3]);
-            std::string value_token = tokens[4];
-            Table* tbl = db.get_table(table_name);
-            if (!tbl) { std::cout << "ERR: no such table\n"; continue; }
-            auto cols = tbl->get_columns();
-            std::optional<ColumnType> col_type;
-            for (size_t i = 0; i < cols.size(); i++) {
-                if (cols[i].name == col_name) col_type = cols[i].type;
+    if (cmd == "PREPARE" && tokens.size() >= 4 && to_upper(tokens[2]) == "AS") {
+        StatementSpec spec;
+        std::string err;
+        if (!parse_statement(db, tokens, 3, spec, err)) { output() << "ERR: " << err << "\n"; return true; }
+        auto stmt = PreparedStatement::prepare(db, std::move(spec));
+        if (!stmt) { output() << "ERR: cannot prepare\n"; return true; }
+        prepared.insert_or_assign(tokens[1], std::move(*stmt));
+        output() << "OK\n";
+        return true;
+    }
+
+    if (cmd == "EXECUTE" && tokens.size() >= 2) {
+        auto it = prepared.find(tokens[1]);
+        if (it == prepared.end()) { output() << "ERR: no such statement\n"; return true; }
+        PreparedStatement& stmt = it->second;
+        if (tokens.size() - 2 != stmt.parameter_count()) {
+            output() << "ERR: need " << stmt.parameter_count() << " values\n";
+            return true;
+        }
+        std::vector<Value> params;
+        params.reserve(stmt.parameter_count());
+        for (size_t i = 0; i < stmt.parameter_count(); i++) params.push_back(parse_value_token(tokens[2 + i], stmt.parameter_type(i)));
+        if (explain) {
+            if (!stmt.refresh()) { output() << "ERR: cannot prepare\n"; return true; }
+            print_access_plan(stmt.table_name(), stmt.access_plan());
+            return true;
+        }
+        if (txn && stmt.kind() != StatementKind::Select) {
+            output() << "ERR: prepared writes are not allowed inside a transaction\n";
+            return true;
+        }
+        StatementResult result;
+        if (!stmt.execute(params, result)) {
+            if (!report_cancelled()) output() << "ERR\n";
+            return true;
+        }
+        switch (stmt.kind()) {
+            case StatementKind::Select: print_rows(result.headers, result.types, result.rows); break;
+            case StatementKind::Insert: output() << "OK\n"; break;
+            case StatementKind::Update: output() << "UPDATED " << result.affected << "\n"; break;
+            case StatementKind::Delete: output() << "DELETED " << result.affected << "\n"; break;
+        }
+        return true;
+    }
+
+    if (cmd == "DEALLOCATE" && tokens.size() >= 2) {
+        if (prepared.erase(tokens[1]) == 0) { output() << "ERR: no such statement\n"; return true; }
+        output() << "OK\n";
+        return true;
+    }
+
+    if (cmd == "PRINT" && tokens.size() >= 3 && to_upper(tokens[1]) == "TABLE") {
+        std::string table_name = trim_quotes(tokens[2]);
+        TableReader tbl = db.read_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        tbl->print_table(output());
+        return true;
+    }
+
+    if (cmd == "PRINT" && tokens.size() >= 3 && to_upper(tokens[1]) == "SCHEMA") {
+        std::string table_name = trim_quotes(tokens[2]);
+        TableReader tbl = db.read_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        tbl->print_schema(output());
+        return true;
+    }
+
+    if (cmd == "IMPORT" && tokens.size() >= 4 && to_upper(tokens[1]) == "CSV") {
+        std::string table_name = trim_quotes(tokens[2]);
+        std::string path = trim_quotes(tokens[3]);
+        bool header = false;
+        if (tokens.size() >= 5 && to_upper(tokens[4]) == "HEADER") header = true;
+        TableWriter tbl = db.write_table(table_name);
+        if (!tbl) { output() << "ERR: no such table\n"; return true; }
+        if (txn) {
+            std::vector<std::vector<Value>> parsed;
+            std::string err;
+            if (!tbl->read_csv(path, header, parsed, err)) {
+                if (!err.empty()) output() << "IMPORT CSV: " << err << "\n";
+                output() << "IMPORTED 0\n";
+                return true;
             }
-            if (!col_type) { std::cout << "ERR: no such column\n"; continue; }
-            Value v = parse_value_token(value_token, col_type);
-            size_t n = tbl->delete_where(col_name, v);
-            std::cout << "DELETED " << n << "\n";
-            continue;
+            tbl = {};
+            for (auto& values : parsed) {
+                if (!txn->insert(table_name, std::move(values), err)) { output() << "ERR: " << err << "\n"; return true; }
+            }
+            output() << "QUEUED " << parsed.size() << "\n";
+            return true;
         }
+        std::string err;
+        size_t n = tbl->import_csv(path, header, err);
+        if (n == 0 && report_cancelled()) return true;
+        if (!err.empty()) output() << "IMPORT CSV: " << err << "\n";
+        output() << "IMPORTED " << n << "\n";
+        return true;
+    }
 
-        if (cmd == "JOIN" && tokens.size() >= 5) {
-            std::string t1 = trim_quotes(tokens[1]);
-            std::string c1 = trim_quotes(tokens[2]);
-            std::string t2 = trim_quotes(tokens[3]);
-            std::string c2 = trim_quotes(tokens[4]);
-            std::vector<std::string> headers;
-            std::vector<std::vector<Value>> rows;
-            bool ok = db.inner_join(t1, c1, t2, c2, headers, rows);
-            if (!ok) { std::cout << "ERR\n"; continue; }
-            print_join(headers, rows);
-            continue;
+    if (sql_like) output() << "ERR: " << sql_err << "\n";
+    else output() << "ERR: unknown command. Type HELP.\n";
+    return true;
+}
+
+static bool execute_line(Database& db, std::unordered_map<std::string, PreparedStatement>& prepared,
+                         std::optional<Transaction>& txn, const std::string& input) {
+    auto started = std::chrono::steady_clock::now();
+    std::vector<std::string> tokens = tokenize(input);
+    if (tokens.empty()) return true;
+    std::optional<InterruptScope> interruptible;
+    if (!active_cancel_token()) interruptible.emplace();
+
+    if (tokens.size() >= 3 && to_upper(tokens[0]) == "EXPLAIN" && to_upper(tokens[1]) == "ANALYZE") {
+        QueryProfile profile;
+        StageProfile tokenize_stage;
+        tokenize_stage.name = "Tokenize";
+        tokenize_stage.nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started).count());
+        tokenize_stage.rows_out = tokens.size();
+        tokenize_stage.bytes = input.size();
+        profile.add_stage(std::move(tokenize_stage));
+        tokens.erase(tokens.begin(), tokens.begin() + 2);
+
+        bool keep_going;
+        {
+            ProfileScope scope(profile);
+            StageTimer timer("Execute");
+            keep_going = run_command(db, prepared, txn, std::move(tokens));
         }
+        profile.print(output());
+        return keep_going;
+    }
 
-        if (cmd == "PRINT" && tokens.size() >= 3 && to_upper(tokens[1]) == "TABLE") {
-            std::string table_name = trim_quotes(tokens[2]);
-            Table* tbl = db.get_table(table_name);
-            if (!tbl) { std::cout << "ERR: no such table\n"; continue; }
-            tbl->print_table();
-            continue;
+    return run_command(db, prepared, txn, std::move(tokens));
+}
+
+class OutputRedirect {
+private:
+    std::ostream* saved;
+
+public:
+    explicit OutputRedirect(std::ostream& target) : saved(output_stream) { output_stream = &target; }
+    ~OutputRedirect() { output_stream = saved; }
+    OutputRedirect(const OutputRedirect&) = delete;
+    OutputRedirect& operator=(const OutputRedirect&) = delete;
+};
+
+struct ScriptOptions {
+    bool counts = false;
+    bool parallel = false;
+};
+
+struct ScriptStep {
+    std::future<std::pair<bool, std::string>> result;
+    std::vector<std::string> reads;
+    std::vector<std::string> writes;
+};
+
+static bool statement_tables(const Database& db, const std::vector<std::string>& tokens,
+                             std::vector<std::string>& reads, std::vector<std::string>& writes) {
+    std::string cmd = to_upper(tokens[0]);
+    std::string text;
+    for (size_t i = 0; i < tokens.size(); i++) text += (i ? " " : "") + tokens[i];
+    SqlStatement sql;
+    std::string err;
+    if (parse_sql(text, sql, err)) {
+        if (sql.kind == SqlKind::CreateTable) return false;
+        if (sql.kind == SqlKind::Select) reads.push_back(sql.table);
+        else writes.push_back(sql.table);
+        for (const auto& join : sql.joins) reads.push_back(join.table);
+    } else if (cmd == "SELECT" && tokens.size() >= 3 && (to_upper(tokens[1]) == "ALL" || to_upper(tokens[1]) == "WHERE")) {
+        reads.push_back(trim_quotes(tokens[2]));
+    } else if (cmd == "INSERT" || cmd == "UPDATE" || cmd == "DELETE" || (cmd == "IMPORT" && tokens.size() >= 2 && to_upper(tokens[1]) == "CSV")) {
+        std::string target = write_target(tokens);
+        if (target.empty()) return false;
+        writes.push_back(target);
+    } else {
+        return false;
+    }
+    for (const auto* names : { &reads, &writes }) {
+        for (const auto& name : *names) {
+            if (!db.table_exists(name) || db.is_view(name) || db.has_dependent_views(name)) return false;
         }
+    }
+    return true;
+}
 
-        if (cmd == "PRINT" && tokens.size() >= 3 && to_upper(tokens[1]) == "SCHEMA") {
-            std::string table_name = trim_quotes(tokens[2]);
-            Table* tbl = db.get_table(table_name);
-            if (!tbl) { std::cout << "ERR: no such table\n"; continue; }
-            tbl->print_schema();
-            continue;
+static QueryCost statement_cost(const Database& db, const std::vector<std::string>& tokens,
+                                const std::vector<std::string>& tables) {
+    std::string text;
+    for (size_t i = 0; i < tokens.size(); i++) text += (i ? " " : "") + tokens[i];
+    SqlStatement sql;
+    PlanNode plan;
+    std::string err;
+    if (parse_sql(text, sql, err) && compile_sql(db, sql, plan, err)) {
+        TableLocks held = db.lock_tables(plan_tables(plan), {});
+        return estimate_cost(db, plan);
+    }
+
+    QueryCost cost;
+    if (to_upper(tokens[0]) == "INSERT") {
+        cost.work = 1.0;
+        cost.bytes = tokens.size() * sizeof(Value);
+        return cost;
+    }
+    if (to_upper(tokens[0]) == "IMPORT" && tokens.size() >= 4) {
+        std::error_code ec;
+        auto bytes = std::filesystem::file_size(trim_quotes(tokens[3]), ec);
+        if (!ec) {
+            cost.work = static_cast<double>(bytes);
+            cost.bytes = static_cast<size_t>(bytes) * 4;
         }
+        return cost;
+    }
+    for (const auto& name : tables) {
+        if (TableReader t = db.read_table(name)) {
+            cost.work += static_cast<double>(t->row_count());
+            cost.bytes += t->row_count() * t->column_count() * sizeof(Value);
+        }
+    }
+    return cost;
+}
+
+static bool execute_admitted(Database& db, std::unordered_map<std::string, PreparedStatement>& prepared,
+                             std::optional<Transaction>& txn, const std::string& input, const QueryCost& cost) {
+    InterruptScope interruptible;
+    Admission admission = QueryScheduler::shared().admit(QueryScheduler::classify(cost), cost.bytes);
+    if (!admission.admitted()) {
+        report_cancelled();
+        return true;
+    }
+    return execute_line(db, prepared, txn, input);
+}
 
-        if (cmd == "IMPORT" && tokens.size() >= 4 && to_upper(tokens[1]) == "CSV") {
-            std::string table_name = trim_quotes(tokens[2]);
-            std::string path = trim_quotes(tokens[3]);
-            bool header = false;
-            if (tokens.size() >= 5 && to_upper(tokens[4]) == "HEADER") header = true;
-            Table* tbl = db.get_table(table_name);
-            if (!tbl) { std::cout << "ERR: no such table\n"; continue; }
-            size_t n = tbl->import_csv(path, header);
-            std::cout << "IMPORTED " << n << "\n";
+static bool overlaps(const std::vector<std::string>& a, const std::vector<std::string>& b) {
+    for (const auto& name : a) {
+        if (std::find(b.begin(), b.end(), name) != b.end()) return true;
+    }
+    return false;
+}
+
+static int run_script(Database& db, std::istream& in, const ScriptOptions& options) {
+    static char buffer[1 << 20];
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+    std::cout.rdbuf()->pubsetbuf(buffer, sizeof(buffer));
+    if (options.counts) result_format = ResultFormat::Count;
+
+    std::unordered_map<std::string, PreparedStatement> prepared;
+    std::optional<Transaction> txn;
+    std::deque<ScriptStep> running;
+    const size_t max_running = std::max<size_t>(2, ThreadPool::shared().size() * 2);
+    bool keep_going = true;
+    auto finish_oldest = [&]() {
+        auto [keep, text] = running.front().result.get();
+        output() << text;
+        keep_going = keep_going && keep;
+        running.pop_front();
+    };
+
+    std::string input;
+    while (keep_going && std::getline(in, input)) {
+        std::vector<std::string> tokens = tokenize(input);
+        if (tokens.empty() || tokens[0].rfind("--", 0) == 0) continue;
+        std::vector<std::string> reads;
+        std::vector<std::string> writes;
+        if (!options.parallel || txn || !statement_tables(db, tokens, reads, writes)) {
+            while (!running.empty()) finish_oldest();
+            keep_going = execute_line(db, prepared, txn, input);
             continue;
         }
+        auto conflicts = [&]() {
+            for (const auto& step : running) {
+                if (overlaps(writes, step.reads) || overlaps(writes, step.writes) || overlaps(reads, step.writes)) return true;
+            }
+            return false;
+        };
+        while (!running.empty() && (running.size() >= max_running || conflicts())) finish_oldest();
+        std::vector<std::string> tables = reads;
+        tables.insert(tables.end(), writes.begin(), writes.end());
+        QueryCost cost = statement_cost(db, tokens, tables);
+        auto result = run_async([&db, &prepared, &txn, input, cost, format = result_format, timeout = query_timeout]() {
+            result_format = format;
+            query_timeout = timeout;
+            std::ostringstream out;
+            bool keep;
+            {
+                OutputRedirect redirect(out);
+                keep = execute_admitted(db, prepared, txn, input, cost);
+            }
+            return std::make_pair(keep, out.str());
+        });
+        running.push_back(ScriptStep{ std::move(result), std::move(reads), std::move(writes) });
+    }
+    while (!running.empty()) finish_oldest();
+    std::cout.flush();
+    return 0;
+}
+
+#ifdef IMDB_SERVER
+class CliSession : public ServerSession {
+private:
+    Database& db;
+    std::unordered_map<std::string, PreparedStatement> prepared;
+    std::optional<Transaction> txn;
+    ResultFormat format = ResultFormat::Text;
+    std::chrono::milliseconds timeout{ 0 };
+
+public:
+    explicit CliSession(Database& db) : db(db) {}
+
+    bool handle(const std::string& request, std::string& response) override {
+        std::vector<std::string> tokens = tokenize(request);
+        std::vector<std::string> reads;
+        std::vector<std::string> writes;
+        bool queued = !tokens.empty() && !txn && statement_tables(db, tokens, reads, writes);
+        std::ostringstream out;
+        bool keep_going;
+        {
+            OutputRedirect redirect(out);
+            result_format = format;
+            query_timeout = timeout;
+            if (queued) {
+                reads.insert(reads.end(), writes.begin(), writes.end());
+                keep_going = execute_admitted(db, prepared, txn, request, statement_cost(db, tokens, reads));
+            } else {
+                keep_going = execute_line(db, prepared, txn, request);
+            }
+            format = result_format;
+            timeout = query_timeout;
+        }
+        response = out.str();
+        return keep_going;
+    }
+};
 
-        std::cout << "ERR: unknown command. Type HELP.\n";
+static int serve(Database& db, const std::string& path) {
+    Server server(path, [&db]() { return std::make_unique<CliSession>(db); });
+    std::string err;
+    if (!server.listen(err)) {
+        std::cerr << "ERR: " << err << "\n";
+        return 1;
+    }
+    serving.store(&server);
+    std::signal(SIGTERM, on_interrupt);
+    std::cout << "Serving on " << server.path() << std::endl;
+    server.run();
+    serving.store(nullptr);
+    std::cout << "Served " << server.request_count() << " requests" << std::endl;
+    return 0;
+}
+#endif
+
+int main(int argc, char** argv) {
+    Database db("DB");
+    std::signal(SIGINT, on_interrupt);
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (!args.empty() && args[0] == "--serve") {
+#ifdef IMDB_SERVER
+        if (args.size() < 2) { std::cerr << "usage: " << argv[0] << " --serve <socket path>\n"; return 2; }
+        return serve(db, args[1]);
+#else
+        std::cerr << "ERR: server mode is not supported on this platform\n";
+        return 2;
+#endif
+    }
+
+    ScriptOptions options;
+    std::string script;
+    bool batch = false;
+    bool usage = false;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == "--script" && i + 1 < args.size()) { script = args[++i]; batch = true; }
+        else if (args[i] == "--batch") batch = true;
+        else if (args[i] == "--counts") options.counts = true;
+        else if (args[i] == "--parallel") options.parallel = true;
+        else usage = true;
+    }
+    if (usage || (!batch && !args.empty())) {
+        std::cerr << "usage: " << argv[0] << " [--serve <socket path> | --script <file> | --batch] [--counts] [--parallel]\n";
+        return 2;
+    }
+    if (batch) {
+        if (script.empty()) return run_script(db, std::cin, options);
+        std::ifstream file(script);
+        if (!file) { std::cerr << "ERR: cannot open " << script << "\n"; return 1; }
+        return run_script(db, file, options);
+    }
+
+    std::unordered_map<std::string, PreparedStatement> prepared;
+    std::optional<Transaction> txn;
+    print_banner();
+    output() << "Type HELP to see commands.\n\n";
+
+    std::string input;
+    while (true) {
+        output() << "> ";
+        if (!std::getline(std::cin, input)) break;
+        if (input.empty()) continue;
+        if (!execute_line(db, prepared, txn, input)) break;
     }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include "imdb/database.hpp"
+#include "imdb/plan.hpp"
+#include "imdb/sql.hpp"
+#include "imdb/statement.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace imdb;
+
+static bool run_sql(Database& db, const std::string& text, QueryResult& out) {
+    SqlStatement stmt;
+    PlanNode plan;
+    std::string err;
+    return parse_sql(text, stmt, err) && compile_sql(db, stmt, plan, err) && execute_plan(db, plan, {}, out, err);
+}
+
+static double run_readers(Database& db, size_t threads, size_t queries, bool with_writer) {
+    std::atomic<size_t> next{ 0 };
+    std::atomic<bool> done{ false };
+    std::vector<std::thread> pool;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; t++) {
+        pool.emplace_back([&, t]() {
+            StatementSpec spec;
+            spec.table = "events";
+            spec.columns = { "id" };
+            spec.where = Predicate::placeholder("kind", CompareOp::Eq, 0);
+            auto stmt = PreparedStatement::prepare(db, spec);
+            QueryResult agg;
+            for (size_t i = next++; i < queries; i = next++) {
+                if (i % 2 == 0) {
+                    StatementResult out;
+                    stmt->execute({ Value{ int64_t((i + t) % 50) } }, out);
+                } else {
+                    run_sql(db, "SELECT kind, COUNT(*), SUM(amount) FROM events WHERE amount > 500 GROUP BY kind", agg);
+                }
+            }
+        });
+    }
+    std::thread writer;
+    if (with_writer) {
+        writer = std::thread([&]() {
+            QueryResult out;
+            for (int64_t id = 1000000; !done; id++) {
+                run_sql(db, "INSERT INTO events VALUES (" + std::to_string(id) + ", 7, 1)", out);
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        });
+    }
+    for (auto& t : pool) t.join();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    done = true;
+    if (writer.joinable()) writer.join();
+    return static_cast<double>(queries) / elapsed;
+}
+
+int main(int argc, char** argv) {
+    size_t rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    size_t queries = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 400;
+    size_t max_threads = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    Database db("bench");
+    QueryResult out;
+    run_sql(db, "CREATE TABLE events (id INT, kind INT, amount INT)", out);
+    Table* events = db.get_table("events");
+    std::vector<Value> values(3);
+    for (size_t i = 0; i < rows; i++) {
+        values[0] = static_cast<int64_t>(i);
+        values[1] = static_cast<int64_t>(i % 50);
+        values[2] = static_cast<int64_t>((i * 7919) % 1000);
+        events->insert_row(values);
+    }
+    events->create_index("kind", IndexKind::Hash);
+    events->analyze();
+
+    std::cout << "rows=" << rows << " queries=" << queries << " max_threads=" << max_threads << "\n";
+    std::cout << std::left << std::setw(10) << "threads" << std::setw(16) << "queries/s"
+              << std::setw(12) << "speedup" << "with writer q/s\n";
+    double base = 0.0;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        double qps = run_readers(db, threads, queries, false);
+        double mixed = run_readers(db, threads, queries, true);
+        if (threads == 1) base = qps;
+        std::cout << std::left << std::setw(10) << threads << std::setw(16) << std::fixed << std::setprecision(1) << qps
+                  << std::setw(12) << std::setprecision(2) << qps / base << std::setprecision(1) << mixed << "\n";
+    }
+    return 0;
+}
\ No newline at end of file
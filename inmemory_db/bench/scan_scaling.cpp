@@ -0,0 +1,57 @@
+#include "imdb/database.hpp"
+#include "imdb/pool.hpp"
+#include "imdb/predicate.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace imdb;
+
+static double run_scans(const Table& table, const Predicate& where, size_t scans, size_t& matched) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < scans; i++) matched = table.find_rows(where).size();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(table.row_count() * scans) / elapsed;
+}
+
+int main(int argc, char** argv) {
+    size_t rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t scans = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20;
+    size_t max_threads = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    Database db("bench");
+    db.create_table("events");
+    Table* events = db.get_table("events");
+    events->add_column("id", ColumnType::Int);
+    events->add_column("kind", ColumnType::Int);
+    events->add_column("amount", ColumnType::Int);
+    std::vector<Value> values(3);
+    for (size_t i = 0; i < rows; i++) {
+        values[0] = static_cast<int64_t>(i);
+        values[1] = static_cast<int64_t>(i % 50);
+        values[2] = static_cast<int64_t>((i * 7919) % 1000);
+        events->insert_row(values);
+    }
+    Predicate where = Predicate::all_of({ Predicate::compare("amount", CompareOp::Gt, Value{ int64_t(500) }),
+                                          Predicate::compare("kind", CompareOp::Ne, Value{ int64_t(3) }) });
+
+    std::cout << "rows=" << rows << " scans=" << scans << " morsel=" << ThreadPool::morsel_rows
+              << " max_threads=" << max_threads << "\n";
+    std::cout << std::left << std::setw(10) << "threads" << std::setw(16) << "Mrows/s"
+              << std::setw(12) << "speedup" << "matched\n";
+    double base = 0.0;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        ThreadPool::shared().resize(threads);
+        size_t matched = 0;
+        double rate = run_scans(*events, where, scans, matched) / 1e6;
+        if (threads == 1) base = rate;
+        std::cout << std::left << std::setw(10) << threads << std::setw(16) << std::fixed << std::setprecision(1) << rate
+                  << std::setw(12) << std::setprecision(2) << rate / base << matched << "\n";
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "imdb/server.hpp"
+#include "imdb/wire.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace imdb;
+using Clock = std::chrono::steady_clock;
+
+struct ClientStats {
+    std::vector<double> latencies;
+    size_t errors = 0;
+};
+
+static bool load_table(const std::string& path, size_t rows, std::string& err) {
+    ServerClient client;
+    if (!client.connect(path, err)) return false;
+    std::string response;
+    client.send("DROP TABLE load");
+    client.receive(response);
+    if (!client.send("CREATE TABLE load (id INT PRIMARY KEY, v INT)") || !client.receive(response)) return false;
+    size_t batches = 0;
+    for (size_t start = 0; start < rows; start += 500) {
+        std::string insert = "INSERT INTO load VALUES ";
+        for (size_t i = start; i < std::min(rows, start + 500); i++) {
+            insert += (i > start ? ", (" : "(") + std::to_string(i) + ", " + std::to_string((i * 7919) % 1000) + ")";
+        }
+        if (!client.send(insert)) return false;
+        batches++;
+    }
+    for (size_t i = 0; i < batches; i++) {
+        if (!client.receive(response)) return false;
+        if (response.rfind("ERR", 0) == 0) { err = response; return false; }
+    }
+    return true;
+}
+
+static bool single_row(const std::string& response, bool binary) {
+    if (!binary) return response.find("Rows: 1") != std::string::npos;
+    size_t header = response.find('\n');
+    if (response.rfind("BINARY ", 0) != 0 || header == std::string::npos) return false;
+    std::vector<WireColumn> columns;
+    std::vector<std::vector<Value>> decoded;
+    std::string err;
+    return decode_result(std::string_view(response).substr(header + 1), columns, decoded, err) && decoded.size() == 1;
+}
+
+static void run_client(const std::string& path, size_t id, size_t requests, size_t depth, size_t rows, bool binary,
+                       ClientStats& stats) {
+    ServerClient client;
+    std::string err;
+    std::string response;
+    if (!client.connect(path, err)) { stats.errors = requests; return; }
+    if (binary && (!client.send("SET FORMAT BINARY") || !client.receive(response))) { stats.errors = requests; return; }
+    std::deque<Clock::time_point> in_flight;
+    size_t sent = 0;
+    size_t key = id * 7919;
+    stats.latencies.reserve(requests);
+    while (stats.latencies.size() + stats.errors < requests) {
+        while (sent < requests && in_flight.size() < depth) {
+            key = (key * 1103515245 + 12345) % std::max<size_t>(1, rows);
+            in_flight.push_back(Clock::now());
+            if (!client.send("SELECT * FROM load WHERE id = " + std::to_string(key))) { stats.errors += requests - sent; return; }
+            sent++;
+        }
+        if (!client.receive(response)) { stats.errors += requests - stats.latencies.size() - stats.errors; return; }
+        stats.latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - in_flight.front()).count());
+        in_flight.pop_front();
+        if (!single_row(response, binary)) stats.errors++;
+    }
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t at = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+    return sorted[at];
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <socket path> [clients] [requests per client] [pipeline depth] [rows] [text|binary]\n";
+        return 2;
+    }
+    std::string path = argv[1];
+    size_t clients = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 8;
+    size_t requests = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 10000;
+    size_t depth = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 16;
+    size_t rows = argc > 5 ? std::strtoul(argv[5], nullptr, 10) : 10000;
+    bool binary = argc > 6 && std::string(argv[6]) == "binary";
+    clients = std::max<size_t>(1, clients);
+    depth = std::max<size_t>(1, depth);
+
+    std::string err;
+    if (!load_table(path, rows, err)) {
+        std::cerr << "ERR: " << err << "\n";
+        return 1;
+    }
+
+    std::vector<ClientStats> stats(clients);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (size_t i = 0; i < clients; i++) {
+        threads.emplace_back([&, i]() { run_client(path, i, requests, depth, rows, binary, stats[i]); });
+    }
+    for (auto& t : threads) t.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> latencies;
+    size_t errors = 0;
+    for (const auto& s : stats) {
+        latencies.insert(latencies.end(), s.latencies.begin(), s.latencies.end());
+        errors += s.errors;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << "clients=" << clients << " requests=" << clients * requests << " depth=" << depth << " rows=" << rows
+              << " format=" << (binary ? "binary" : "text") << "\n";
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "throughput=" << static_cast<double>(latencies.size()) / elapsed << " req/s"
+              << " p50=" << percentile(latencies, 0.50) << "us"
+              << " p99=" << percentile(latencies, 0.99) << "us"
+              << " errors=" << errors << "\n";
+    return errors == 0 ? 0 : 1;
+}
\ No newline at end of file
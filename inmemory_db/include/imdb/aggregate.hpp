@@ -0,0 +1,51 @@
+#pragma once
+#include "table.hpp"
+#include "predicate.hpp"
+#include "join.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace imdb {
+
+enum class AggregateFunc { Count, Sum, Min, Max, Avg };
+
+struct AggregateSpec {
+    AggregateFunc func = AggregateFunc::Count;
+    std::string column;
+};
+
+struct AggregateQuery {
+    std::vector<std::string> group_by;
+    std::vector<AggregateSpec> aggregates;
+    std::optional<Predicate> where;
+};
+
+struct ExactSum {
+    int64_t low = 0;
+    int64_t wraps = 0;
+
+    void add(int64_t v) noexcept;
+    void subtract(int64_t v) noexcept;
+    void merge(const ExactSum& other) noexcept;
+    std::optional<int64_t> value() const noexcept;
+    double average(int64_t count) const noexcept;
+};
+
+const char* aggregate_name(AggregateFunc f) noexcept;
+std::optional<AggregateFunc> parse_aggregate_func(const std::string& s);
+std::string aggregate_header(const AggregateSpec& spec);
+
+bool hash_aggregate(const Table& table,
+                    const AggregateQuery& query,
+                    std::vector<std::string>& out_headers,
+                    std::vector<std::vector<Value>>& out_rows,
+                    size_t threads = 1);
+
+bool hash_aggregate(const JoinResult& join,
+                    const AggregateQuery& query,
+                    std::vector<std::string>& out_headers,
+                    std::vector<std::vector<Value>>& out_rows,
+                    size_t threads = 1);
+
+}
\ No newline at end of file
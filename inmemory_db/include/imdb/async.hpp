@@ -0,0 +1,64 @@
+#pragma once
+#include "cancel.hpp"
+#include "database.hpp"
+#include "plan.hpp"
+#include "pool.hpp"
+#include "scheduler.hpp"
+#include <chrono>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace imdb {
+
+struct AsyncOptions {
+    std::optional<std::chrono::milliseconds> timeout;
+    std::shared_ptr<CancelToken> token;
+};
+
+struct QueryOutcome {
+    bool ok = false;
+    QueryResult result;
+    std::string err;
+    QueryClass query_class = QueryClass::Short;
+    std::chrono::nanoseconds queue_wait{ 0 };
+};
+
+class AsyncQuery {
+private:
+    std::future<QueryOutcome> outcome;
+    std::shared_ptr<CancelToken> token;
+
+public:
+    AsyncQuery(std::future<QueryOutcome> outcome, std::shared_ptr<CancelToken> token)
+        : outcome(std::move(outcome)), token(std::move(token)) {}
+
+    void cancel() noexcept { token->cancel(); }
+    const std::shared_ptr<CancelToken>& cancel_token() const noexcept { return token; }
+    bool ready() const { return outcome.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+    void wait() const { outcome.wait(); }
+    template <typename Rep, typename Period>
+    std::future_status wait_for(const std::chrono::duration<Rep, Period>& timeout) const { return outcome.wait_for(timeout); }
+    QueryOutcome get() { return outcome.get(); }
+};
+
+AsyncQuery execute_async(Database& db, std::string sql, std::vector<Value> params = {}, AsyncOptions options = {});
+AsyncQuery execute_async(Database& db, PlanNode plan, std::vector<Value> params = {}, AsyncOptions options = {});
+
+template <typename Fn>
+std::future<std::invoke_result_t<Fn&>> run_async(Fn fn, std::shared_ptr<CancelToken> token = nullptr) {
+    using Result = std::invoke_result_t<Fn&>;
+    auto task = std::make_shared<std::packaged_task<Result()>>([fn = std::move(fn), token]() mutable {
+        CancelScope scope(token.get());
+        return fn();
+    });
+    std::future<Result> result = task->get_future();
+    ThreadPool::shared().submit([task]() { (*task)(); });
+    return result;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+#include "types.hpp"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace imdb {
+
+struct CachedResult {
+    std::vector<std::string> headers;
+    std::vector<ColumnType> types;
+    std::vector<std::vector<Value>> rows;
+};
+
+using TableVersions = std::vector<std::pair<std::string, uint64_t>>;
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t capacity = 0;
+};
+
+size_t estimate_bytes(const CachedResult& result);
+
+class ResultCache {
+private:
+    struct Entry {
+        std::string key;
+        TableVersions versions;
+        std::shared_ptr<const CachedResult> result;
+        size_t bytes = 0;
+    };
+
+    mutable std::mutex guard;
+    size_t capacity;
+    size_t used = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+
+    void erase(std::list<Entry>::iterator it);
+    void shrink_to(size_t bytes);
+
+public:
+    static constexpr size_t default_capacity = 64 * 1024 * 1024;
+
+    explicit ResultCache(size_t capacity_bytes = default_capacity) : capacity(capacity_bytes) {}
+
+    std::shared_ptr<const CachedResult> lookup(const std::string& key, const TableVersions& versions);
+    void store(const std::string& key, TableVersions versions, CachedResult result);
+    void clear();
+    void set_capacity(size_t bytes);
+    CacheStats stats() const;
+};
+
+}
\ No newline at end of file
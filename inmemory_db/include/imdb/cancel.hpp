@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace imdb {
+
+void interrupt_all() noexcept;
+
+class CancelToken {
+private:
+    static constexpr uint64_t not_watching = static_cast<uint64_t>(-1);
+
+    std::atomic<bool> requested{ false };
+    std::atomic<int64_t> deadline{ 0 };
+    std::atomic<uint64_t> interrupt_base{ not_watching };
+
+public:
+    void cancel() noexcept { requested.store(true, std::memory_order_release); }
+    void set_deadline(std::chrono::steady_clock::time_point when) noexcept;
+    void set_timeout(std::chrono::milliseconds timeout) noexcept;
+    void watch_interrupts() noexcept;
+
+    bool interrupted() const noexcept;
+    bool cancel_requested() const noexcept { return requested.load(std::memory_order_acquire) || interrupted(); }
+    bool expired() const noexcept;
+    std::chrono::steady_clock::time_point deadline_point() const noexcept;
+    bool stop_requested() const noexcept { return cancel_requested() || expired(); }
+    const char* reason() const noexcept;
+};
+
+constexpr size_t cancel_interval = 4096;
+
+const CancelToken* active_cancel_token() noexcept;
+bool cancellation_requested() noexcept;
+inline bool cancellation_due(size_t step) noexcept { return step % cancel_interval == 0 && cancellation_requested(); }
+
+class CancelScope {
+private:
+    const CancelToken* previous;
+
+public:
+    explicit CancelScope(const CancelToken* token);
+    ~CancelScope();
+    CancelScope(const CancelScope&) = delete;
+    CancelScope& operator=(const CancelScope&) = delete;
+};
+
+}
\ No newline at end of file
@@ -1,20 +1,68 @@
 #pragma once
 #include "table.hpp"
+#include "join.hpp"
+#include "cache.hpp"
 #include <unordered_map>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 
 namespace imdb {
 
+class MaterializedView;
+struct SqlStatement;
+
+class TableLocks {
+private:
+    std::vector<std::shared_ptr<Table>> pinned;
+    std::vector<std::shared_lock<std::shared_mutex>> readers;
+    std::vector<std::unique_lock<std::shared_mutex>> writers;
+
+    friend class Database;
+
+public:
+    size_t size() const noexcept { return readers.size() + writers.size(); }
+    size_t exclusive() const noexcept { return writers.size(); }
+};
+
+template <typename T>
+class TableHandle {
+private:
+    TableLocks held;
+    T* table = nullptr;
+
+    friend class Database;
+
+public:
+    explicit operator bool() const noexcept { return table != nullptr; }
+    T* operator->() const noexcept { return table; }
+    T& operator*() const noexcept { return *table; }
+    T* get() const noexcept { return table; }
+};
+
+using TableReader = TableHandle<const Table>;
+using TableWriter = TableHandle<Table>;
+
 class Database {
 private:
     std::string database_name;
-    std::unordered_map<std::string, std::unique_ptr<Table>> tables;
+    mutable std::shared_mutex catalog;
+    std::unordered_map<std::string, std::shared_ptr<Table>> tables;
+    std::unordered_map<std::string, std::unique_ptr<MaterializedView>> views;
+    ResultCache cache;
+
+    Table* find_table(const std::string& table_name) const;
+    bool has_dependents(const std::string& table_name) const;
+    void collect_writes(const std::string& table_name, std::map<std::string, bool>& wanted) const;
+    std::map<std::string, bool> lock_set(const std::vector<std::string>& reads,
+                                         const std::vector<std::string>& writes) const;
 
 public:
     explicit Database(const std::string& name);
-    ~Database() = default;
+    ~Database();
 
     bool create_table(const std::string& table_name);
     bool drop_table(const std::string& table_name);
@@ -24,15 +72,55 @@ public:
     bool table_exists(const std::string& table_name) const;
     std::vector<std::string> get_table_names() const;
 
+    TableLocks lock_tables(const std::vector<std::string>& reads, const std::vector<std::string>& writes) const;
+    TableReader read_table(const std::string& table_name) const;
+    TableWriter write_table(const std::string& table_name);
+    std::unique_ptr<Database> snapshot(const std::vector<std::string>& names) const;
+
     void clear_all_tables();
     size_t get_total_rows() const;
 
     bool rename_table(const std::string& old_name, const std::string& new_name);
 
+    bool create_view(const std::string& name, const SqlStatement& definition, std::string& err);
+    bool drop_view(const std::string& name);
+    bool is_view(const std::string& name) const;
+    bool has_dependent_views(const std::string& table_name) const;
+    const MaterializedView* get_view(const std::string& name) const;
+    std::vector<std::string> get_view_names() const;
+
+    bool table_versions(const std::vector<std::string>& names, TableVersions& out) const;
+    ResultCache& result_cache() noexcept { return cache; }
+
+    bool join_rows(const std::string& left_table,
+                   const std::string& left_col,
+                   const std::string& right_table,
+                   const std::string& right_col,
+                   JoinResult& out) const;
+    bool join_rows(const JoinInput& left, const JoinInput& right, JoinResult& out) const;
+    bool join_rows_unlocked(const JoinInput& left, const JoinInput& right, JoinResult& out) const;
+
+    bool plan_join(const std::vector<JoinCondition>& conditions, JoinPlan& out) const;
+    bool plan_join_unlocked(const std::vector<JoinCondition>& conditions, JoinPlan& out) const;
+    bool join_rows(const std::vector<JoinCondition>& conditions, JoinResult& out) const;
+    bool join_rows_unlocked(const std::vector<JoinCondition>& conditions, JoinResult& out) const;
+    bool inner_join(const std::vector<JoinCondition>& conditions,
+                    const std::vector<std::string>& out_columns,
+                    std::vector<std::string>& out_headers,
+                    std::vector<std::vector<Value>>& out_rows) const;
+
+    bool inner_join(const std::string& left_table,
+                    const std::string& left_col,
+                    const std::string& right_table,
+                    const std::string& right_col,
+                    std::vector<std::string>& out_headers,
+                    std::vector<std::vector<Value>>& out_rows) const;
+
     bool inner_join(const std::string& left_table,
                     const std::string& left_col,
                     const std::string& right_table,
                     const std::string& right_col,
+                    const std::vector<std::string>& out_columns,
                     std::vector<std::string>& out_headers,
                     std::vector<std::vector<Value>>& out_rows) const;
 };
@@ -0,0 +1,42 @@
+#pragma once
+#include "types.hpp"
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace imdb {
+
+enum class IndexKind { Hash, Ordered };
+
+const char* index_kind_name(IndexKind k) noexcept;
+std::optional<IndexKind> parse_index_kind(const std::string& s);
+
+class ColumnIndex {
+private:
+    IndexKind index_kind;
+    size_t column_index;
+    std::map<Value, std::vector<size_t>> ordered;
+    std::unordered_map<Value, std::vector<size_t>> hashed;
+
+    std::vector<size_t>& postings(const Value& key);
+
+public:
+    ColumnIndex(IndexKind kind, size_t column);
+
+    IndexKind kind() const noexcept { return index_kind; }
+    size_t column() const noexcept { return column_index; }
+    void set_column(size_t column) noexcept { column_index = column; }
+
+    void insert(const Value& key, size_t row);
+    void erase(const Value& key, size_t row);
+    void rebuild(const std::vector<Row>& rows);
+
+    const std::vector<size_t>* find(const Value& key) const;
+    size_t distinct_keys() const noexcept { return index_kind == IndexKind::Hash ? hashed.size() : ordered.size(); }
+    const std::map<Value, std::vector<size_t>>& ordered_entries() const noexcept { return ordered; }
+    std::vector<size_t> sorted_row_ids() const;
+};
+
+}
\ No newline at end of file
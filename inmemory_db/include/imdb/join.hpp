@@ -0,0 +1,91 @@
+#pragma once
+#include "table.hpp"
+#include "predicate.hpp"
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace imdb {
+
+enum class JoinStrategy { Hash, SortMerge, IndexNestedLoop };
+
+const char* join_strategy_name(JoinStrategy s) noexcept;
+
+struct JoinInput {
+    std::string table;
+    std::string column;
+    std::optional<Predicate> where;
+};
+
+struct JoinCondition {
+    std::string left_table;
+    std::string left_column;
+    std::string right_table;
+    std::string right_column;
+};
+
+struct JoinStep {
+    size_t table = 0;
+    size_t condition = 0;
+    JoinStrategy strategy = JoinStrategy::Hash;
+    bool build_inner = true;
+    double estimated_rows = 0.0;
+};
+
+struct JoinPlan {
+    std::vector<std::string> tables;
+    std::vector<JoinStep> steps;
+};
+
+std::vector<std::string> describe_join_plan(const JoinPlan& plan, const std::vector<JoinCondition>& conditions);
+
+struct JoinColumn {
+    size_t side = 0;
+    size_t index = 0;
+};
+
+class JoinResult {
+private:
+    std::vector<const Table*> tables;
+    std::vector<std::shared_ptr<const Table>> pinned;
+    std::vector<std::string> table_names;
+    std::vector<std::vector<Column>> table_columns;
+    std::vector<size_t> row_ids;
+    JoinStrategy join_strategy = JoinStrategy::Hash;
+
+public:
+    JoinResult() = default;
+    JoinResult(std::vector<const Table*> sources, std::vector<std::string> names);
+
+    size_t size() const noexcept { return tables.empty() ? 0 : row_ids.size() / tables.size(); }
+    size_t width() const noexcept { return tables.size(); }
+    size_t row_id(size_t i, size_t side) const { return row_ids[i * tables.size() + side]; }
+    std::pair<size_t, size_t> row_pair(size_t i) const { return { row_id(i, 0), row_id(i, 1) }; }
+
+    JoinStrategy strategy() const noexcept { return join_strategy; }
+    void set_strategy(JoinStrategy s) noexcept { join_strategy = s; }
+
+    void reserve(size_t n) { row_ids.reserve(n * tables.size()); }
+    void add(size_t left_row, size_t right_row);
+    void add(const std::vector<size_t>& tuple);
+    void reorder(const std::vector<size_t>& order);
+    void pin();
+
+    const Value& value(size_t i, const JoinColumn& col) const {
+        return tables[col.side]->get_rows()[row_id(i, col.side)].values[col.index];
+    }
+
+    std::optional<JoinColumn> resolve(const std::string& name) const;
+    std::vector<JoinColumn> all_columns() const;
+    std::string header(const JoinColumn& col) const;
+    ColumnType column_type(const JoinColumn& col) const { return table_columns[col.side][col.index].type; }
+
+    void materialize(const std::vector<JoinColumn>& cols,
+                     std::vector<std::string>& out_headers,
+                     std::vector<ColumnType>& out_types,
+                     std::vector<std::vector<Value>>& out_rows) const;
+    bool export_csv(const std::string& path, const std::vector<JoinColumn>& cols) const;
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+#include "database.hpp"
+#include "planner.hpp"
+#include "aggregate.hpp"
+#include "sql.hpp"
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace imdb {
+
+struct PlanNode {
+    enum class Kind { Scan, Join, Filter, Aggregate, Sort, Limit, Project, Insert, Update, Delete, CreateTable };
+
+    Kind kind = Kind::Scan;
+    std::string table;
+    uint64_t catalog_version = 0;
+    std::optional<Predicate> where;
+    AccessPlan access;
+    std::vector<JoinCondition> conditions;
+    std::vector<std::optional<Predicate>> side_filters;
+    AggregateQuery aggregate;
+    std::vector<std::string> columns;
+    std::vector<size_t> output;
+    std::vector<std::vector<Operand>> values;
+    std::vector<SqlColumnDef> definitions;
+    bool descending = false;
+    std::optional<size_t> limit;
+    std::vector<PlanNode> children;
+};
+
+struct QueryResult {
+    std::vector<std::string> headers;
+    std::vector<ColumnType> types;
+    std::vector<std::vector<Value>> rows;
+    size_t affected = 0;
+};
+
+const char* plan_node_name(PlanNode::Kind kind) noexcept;
+std::string describe_predicate(const Predicate& p);
+
+bool compile_sql(const Database& db, const SqlStatement& stmt, PlanNode& out, std::string& err);
+bool compile_sql_unlocked(const Database& db, const SqlStatement& stmt, PlanNode& out, std::string& err);
+bool execute_plan(Database& db, const PlanNode& plan, const std::vector<Value>& params,
+                  QueryResult& out, std::string& err);
+bool execute_plan_unlocked(Database& db, const PlanNode& plan, const std::vector<Value>& params,
+                           QueryResult& out, std::string& err);
+std::vector<std::string> plan_tables(const PlanNode& plan);
+std::vector<std::pair<size_t, std::string>> describe_plan(const Database& db, const PlanNode& plan);
+
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+#include "table.hpp"
+#include "predicate.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace imdb {
+
+enum class AccessMethod { FullScan, ZoneMapScan, HashIndex, OrderedIndex };
+
+const char* access_method_name(AccessMethod m) noexcept;
+
+struct AccessPlan {
+    AccessMethod method = AccessMethod::FullScan;
+    std::string column;
+    CompareOp op = CompareOp::Eq;
+    Value value;
+    std::optional<size_t> parameter;
+    size_t table_rows = 0;
+    double selectivity = 1.0;
+    double estimated_rows = 0.0;
+    double estimated_cost = 0.0;
+};
+
+double estimate_selectivity(const Table& table, const Predicate& where);
+AccessPlan plan_scan(const Table& table);
+AccessPlan plan_access(const Table& table, const Predicate& where);
+std::vector<size_t> access_candidates(const Table& table, const AccessPlan& plan);
+std::string describe_access(const AccessPlan& plan);
+
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+#include "cancel.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+namespace imdb {
+
+class ThreadPool {
+public:
+    static constexpr size_t morsel_rows = 4096;
+
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static ThreadPool& shared();
+
+    size_t size() const noexcept { return threads.load(std::memory_order_acquire); }
+    bool resize(size_t threads);
+    void parallel_for(size_t count, const std::function<void(size_t)>& task);
+    void submit(std::function<void()> job);
+
+private:
+    struct Batch {
+        const std::function<void(size_t)>* task = nullptr;
+        const CancelToken* token = nullptr;
+        std::atomic<size_t> remaining{ 0 };
+        std::mutex done_mutex;
+        std::condition_variable done;
+    };
+
+    struct Task {
+        std::shared_ptr<Batch> batch;
+        size_t index = 0;
+        std::function<void()> job;
+    };
+
+    struct Queue {
+        std::mutex guard;
+        std::deque<Task> tasks;
+    };
+
+    std::atomic<size_t> threads{ 1 };
+    std::mutex control;
+    std::shared_mutex layout;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queued{ 0 };
+    std::atomic<size_t> next_queue{ 0 };
+    bool stopping = false;
+
+    void start(size_t count);
+    void stop();
+    void work(size_t self);
+    bool take(size_t self, Task& out);
+    static void run(Task& task);
+};
+
+size_t morsel_count(size_t rows, size_t morsel = ThreadPool::morsel_rows);
+
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+#include "types.hpp"
+#include <optional>
+#include <utility>
+#include <string>
+#include <vector>
+
+namespace imdb {
+
+enum class CompareOp { Eq, Ne, Lt, Le, Gt, Ge };
+
+struct Predicate {
+    enum class Kind { Compare, And, Or, Not };
+
+    Kind kind = Kind::Compare;
+    std::string column;
+    CompareOp op = CompareOp::Eq;
+    Value value;
+    std::optional<size_t> parameter;
+    std::vector<Predicate> children;
+
+    static Predicate compare(const std::string& column, CompareOp op, const Value& value);
+    static Predicate placeholder(const std::string& column, CompareOp op, size_t slot);
+    static Predicate all_of(std::vector<Predicate> children);
+    static Predicate any_of(std::vector<Predicate> children);
+    static Predicate negate(Predicate child);
+};
+
+const char* op_symbol(CompareOp op) noexcept;
+std::optional<CompareOp> parse_compare_op(const std::string& s);
+bool compare_values(const Value& lhs, CompareOp op, const Value& rhs);
+
+class PredicateEvaluator {
+public:
+    static constexpr size_t batch_size = 1024;
+
+    static std::optional<PredicateEvaluator> bind(const Predicate& predicate,
+                                                  const std::vector<Column>& columns);
+
+    void filter(const std::vector<Row>& rows, std::vector<size_t>& out) const;
+    void filter_range(const std::vector<Row>& rows, size_t begin, size_t end, std::vector<size_t>& out) const;
+    void filter_batch(const std::vector<Row>& rows, std::vector<size_t>& selection) const;
+
+    size_t parameter_count() const noexcept;
+    bool bind_parameters(const std::vector<Value>& values);
+
+    double estimated_selectivity() const noexcept { return nodes[root].selectivity; }
+
+private:
+    struct Node {
+        Predicate::Kind kind = Predicate::Kind::Compare;
+        size_t column = 0;
+        CompareOp op = CompareOp::Eq;
+        Value value;
+        std::vector<size_t> children;
+        double cost = 1.0;
+        double selectivity = 1.0;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<std::pair<size_t, size_t>> parameters;
+    size_t root = 0;
+
+    std::optional<size_t> bind_node(const Predicate& p, const std::vector<Column>& columns);
+    void order_children(Node& node);
+    void eval(size_t node, const std::vector<Row>& rows, std::vector<size_t>& selection) const;
+    void eval_compare(const Node& node, const std::vector<Row>& rows, std::vector<size_t>& selection) const;
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace imdb {
+
+struct StageProfile {
+    std::string name;
+    size_t depth = 0;
+    uint64_t nanos = 0;
+    size_t rows_in = 0;
+    size_t rows_out = 0;
+    size_t bytes = 0;
+    size_t rows_skipped = 0;
+    size_t zones_skipped = 0;
+};
+
+class QueryProfile {
+private:
+    std::vector<StageProfile> stages;
+    size_t depth = 0;
+
+    friend class StageTimer;
+
+public:
+    const std::vector<StageProfile>& get_stages() const noexcept { return stages; }
+    void add_stage(StageProfile stage);
+    uint64_t total_nanos() const;
+    void print(std::ostream& out) const;
+};
+
+QueryProfile* active_profile() noexcept;
+
+class ProfileScope {
+private:
+    QueryProfile* previous;
+
+public:
+    explicit ProfileScope(QueryProfile& profile);
+    ~ProfileScope();
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+class StageTimer {
+private:
+    QueryProfile* profile;
+    size_t index = 0;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit StageTimer(const char* name);
+    ~StageTimer();
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    bool active() const noexcept { return profile != nullptr; }
+    void label(const std::string& detail);
+    void rows(size_t in, size_t out);
+    void bytes(size_t n);
+    void skipped(size_t rows, size_t zones);
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+#include "plan.hpp"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+namespace imdb {
+
+enum class QueryClass { Short, Long };
+
+constexpr size_t query_class_count = 2;
+
+const char* query_class_name(QueryClass cls) noexcept;
+
+struct QueryCost {
+    double work = 0.0;
+    double rows = 0.0;
+    size_t bytes = 0;
+};
+
+QueryCost estimate_cost(const Database& db, const PlanNode& plan);
+
+struct ClassLimits {
+    size_t max_running = 1;
+    size_t memory_budget = 0;
+};
+
+struct SchedulerStats {
+    uint64_t admitted = 0;
+    uint64_t abandoned = 0;
+    size_t running = 0;
+    size_t waiting = 0;
+    size_t memory = 0;
+    uint64_t wait_nanos = 0;
+    uint64_t max_wait_nanos = 0;
+};
+
+class QueryScheduler;
+
+class Admission {
+private:
+    QueryScheduler* scheduler = nullptr;
+    QueryClass cls = QueryClass::Short;
+    size_t bytes = 0;
+    std::chrono::nanoseconds waited{ 0 };
+
+    friend class QueryScheduler;
+
+public:
+    Admission() = default;
+    ~Admission() { release(); }
+    Admission(Admission&& other) noexcept;
+    Admission& operator=(Admission&& other) noexcept;
+
+    bool admitted() const noexcept { return scheduler != nullptr; }
+    QueryClass query_class() const noexcept { return cls; }
+    std::chrono::nanoseconds queue_wait() const noexcept { return waited; }
+    void release() noexcept;
+};
+
+class QueryScheduler {
+public:
+    static constexpr double short_work_limit = 100000.0;
+    static constexpr std::chrono::milliseconds long_yield_limit{ 250 };
+
+    QueryScheduler();
+
+    QueryScheduler(const QueryScheduler&) = delete;
+    QueryScheduler& operator=(const QueryScheduler&) = delete;
+
+    static QueryScheduler& shared();
+    static QueryClass classify(const QueryCost& cost) noexcept;
+
+    Admission admit(QueryClass cls, size_t bytes);
+    void set_limits(QueryClass cls, ClassLimits limits);
+    ClassLimits limits(QueryClass cls) const;
+    SchedulerStats stats(QueryClass cls) const;
+
+private:
+    struct Lane {
+        ClassLimits limits;
+        SchedulerStats stats;
+        std::deque<uint64_t> queue;
+    };
+
+    mutable std::mutex guard;
+    std::condition_variable changed;
+    std::array<Lane, query_class_count> lanes;
+    uint64_t next_ticket = 0;
+
+    bool can_start(QueryClass cls, uint64_t ticket, size_t bytes, std::chrono::steady_clock::time_point since) const;
+    void finish(QueryClass cls, size_t bytes) noexcept;
+
+    friend class Admission;
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace imdb {
+
+class ServerSession {
+public:
+    virtual ~ServerSession() = default;
+    virtual bool handle(const std::string& request, std::string& response) = 0;
+};
+
+using SessionFactory = std::function<std::unique_ptr<ServerSession>()>;
+
+class ThreadPool;
+
+class Server {
+public:
+    static constexpr size_t max_request_bytes = 1 << 20;
+    static constexpr size_t max_pending_output = 4 << 20;
+    static constexpr size_t session_threads = 8;
+
+    Server(std::string socket_path, SessionFactory factory);
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    bool listen(std::string& err);
+    void run();
+    void stop() noexcept;
+
+    const std::string& path() const noexcept { return socket_path; }
+    size_t client_count() const noexcept { return clients.load(std::memory_order_relaxed); }
+    uint64_t request_count() const noexcept { return requests.load(std::memory_order_relaxed); }
+
+private:
+    struct Client {
+        int fd = -1;
+        uint64_t id = 0;
+        std::shared_ptr<ServerSession> session;
+        std::string input;
+        std::string output;
+        size_t written = 0;
+        uint32_t interest = 0;
+        bool eof = false;
+        bool closing = false;
+        bool busy = false;
+    };
+
+    struct Completion {
+        int fd = -1;
+        uint64_t id = 0;
+        std::string response;
+        bool keep = true;
+    };
+
+    std::string socket_path;
+    SessionFactory factory;
+    int listener = -1;
+    int poller = -1;
+    int wakeup = -1;
+    int finished = -1;
+    uint64_t next_client = 0;
+    std::unordered_map<int, std::unique_ptr<Client>> connections;
+    std::mutex completion_mutex;
+    std::condition_variable idle;
+    std::vector<Completion> completions;
+    size_t in_flight = 0;
+    std::atomic<size_t> clients{ 0 };
+    std::atomic<uint64_t> requests{ 0 };
+    std::unique_ptr<ThreadPool> executor;
+
+    void accept_clients();
+    void service(Client& client, uint32_t events);
+    bool read_client(Client& client);
+    void dispatch(Client& client);
+    void collect();
+    bool flush_client(Client& client);
+    void watch(Client& client);
+    void close_client(int fd);
+    void shutdown();
+};
+
+class ServerClient {
+private:
+    int fd = -1;
+    std::string buffer;
+
+public:
+    ServerClient() = default;
+    ~ServerClient();
+
+    ServerClient(const ServerClient&) = delete;
+    ServerClient& operator=(const ServerClient&) = delete;
+
+    bool connect(const std::string& socket_path, std::string& err);
+    bool send(const std::string& request);
+    bool receive(std::string& response);
+    void close();
+    bool connected() const noexcept { return fd >= 0; }
+};
+
+std::string frame_response(const std::string& payload);
+
+}
\ No newline at end of file
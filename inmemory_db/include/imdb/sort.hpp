@@ -0,0 +1,16 @@
+#pragma once
+#include "table.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace imdb {
+
+std::vector<size_t> order_by(const std::vector<const Value*>& keys, bool descending,
+                             std::optional<size_t> limit = std::nullopt, size_t threads = 1);
+
+std::vector<size_t> order_rows(const Table& table, const std::vector<size_t>& row_ids,
+                               size_t column, bool descending,
+                               std::optional<size_t> limit = std::nullopt, size_t threads = 1);
+
+}
\ No newline at end of file
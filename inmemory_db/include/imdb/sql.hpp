@@ -0,0 +1,61 @@
+#pragma once
+#include "types.hpp"
+#include "predicate.hpp"
+#include "aggregate.hpp"
+#include "statement.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace imdb {
+
+enum class SqlTokenKind { Word, Number, String, Symbol, Parameter, End };
+
+struct SqlToken {
+    SqlTokenKind kind = SqlTokenKind::End;
+    std::string text;
+    size_t offset = 0;
+};
+
+bool lex_sql(const std::string& text, std::vector<SqlToken>& out, std::string& err);
+
+enum class SqlKind { Select, Insert, Update, Delete, CreateTable };
+
+struct SqlSelectItem {
+    std::optional<AggregateSpec> aggregate;
+    std::string column;
+};
+
+struct SqlJoin {
+    std::string table;
+    std::string left;
+    std::string right;
+};
+
+struct SqlColumnDef {
+    std::string name;
+    ColumnType type = ColumnType::Int;
+    bool primary_key = false;
+    bool not_null = false;
+};
+
+struct SqlStatement {
+    SqlKind kind = SqlKind::Select;
+    std::string table;
+    std::vector<SqlSelectItem> items;
+    std::vector<SqlJoin> joins;
+    std::optional<Predicate> where;
+    std::vector<std::string> group_by;
+    std::optional<std::string> order_by;
+    bool descending = false;
+    std::optional<size_t> limit;
+    std::vector<std::string> columns;
+    std::vector<std::vector<Operand>> values;
+    std::vector<SqlColumnDef> definitions;
+    size_t parameter_count = 0;
+};
+
+bool parse_sql(const std::string& text, SqlStatement& out, std::string& err);
+std::string normalize_sql(const std::string& text);
+
+}
\ No newline at end of file
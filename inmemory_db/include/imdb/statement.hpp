@@ -0,0 +1,64 @@
+#pragma once
+#include "database.hpp"
+#include "planner.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace imdb {
+
+enum class StatementKind { Select, Insert, Update, Delete };
+
+struct Operand {
+    Value value;
+    std::optional<size_t> parameter;
+};
+
+struct StatementSpec {
+    StatementKind kind = StatementKind::Select;
+    std::string table;
+    std::vector<std::string> columns;
+    std::optional<Predicate> where;
+    std::string update_column;
+    std::vector<Operand> values;
+};
+
+struct StatementResult {
+    std::vector<std::string> headers;
+    std::vector<ColumnType> types;
+    std::vector<Row> rows;
+    size_t affected = 0;
+};
+
+class PreparedStatement {
+private:
+    Database* db = nullptr;
+    StatementSpec spec;
+    Table* table = nullptr;
+    uint64_t version = 0;
+    std::vector<size_t> column_ids;
+    std::vector<std::string> headers;
+    std::vector<ColumnType> types;
+    std::optional<PredicateEvaluator> where;
+    AccessPlan plan;
+    size_t update_column = 0;
+    std::vector<std::optional<ColumnType>> parameter_types;
+
+    bool bind();
+    bool bind_operand(const Operand& operand, ColumnType type);
+    void collect_parameters(const Predicate& p, const std::vector<Column>& cols);
+
+public:
+    static std::optional<PreparedStatement> prepare(Database& db, StatementSpec spec);
+
+    StatementKind kind() const noexcept { return spec.kind; }
+    const std::string& table_name() const noexcept { return spec.table; }
+    size_t parameter_count() const noexcept { return parameter_types.size(); }
+    std::optional<ColumnType> parameter_type(size_t slot) const;
+    const AccessPlan& access_plan() const noexcept { return plan; }
+
+    bool refresh();
+    bool execute(const std::vector<Value>& params, StatementResult& out);
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+#include "types.hpp"
+#include "predicate.hpp"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace imdb {
+
+class HyperLogLog {
+public:
+    static constexpr size_t precision = 12;
+    static constexpr size_t register_count = size_t(1) << precision;
+
+    void add(const Value& v);
+    void merge(const HyperLogLog& other);
+    void clear() { registers.fill(0); }
+    double estimate() const;
+
+private:
+    std::array<uint8_t, register_count> registers{};
+};
+
+struct HistogramBucket {
+    Value upper;
+    size_t count = 0;
+};
+
+class ColumnStats {
+private:
+    size_t values = 0;
+    size_t nulls = 0;
+    Value min_value;
+    Value max_value;
+    HyperLogLog sketch;
+    std::vector<HistogramBucket> buckets;
+    size_t changes = 0;
+
+public:
+    static constexpr size_t histogram_buckets = 16;
+    static constexpr size_t refresh_floor = 1024;
+
+    void add(const Value& v);
+    void remove(const Value& v);
+    void rebuild(const std::vector<Row>& rows, size_t column);
+    bool stale(size_t rows) const noexcept;
+
+    size_t null_count() const noexcept { return nulls; }
+    size_t value_count() const noexcept { return values; }
+    const Value& min() const noexcept { return min_value; }
+    const Value& max() const noexcept { return max_value; }
+    size_t distinct() const;
+    const std::vector<HistogramBucket>& histogram() const noexcept { return buckets; }
+    size_t changes_since_analyze() const noexcept { return changes; }
+};
+
+class ZoneMap {
+private:
+    struct Zone {
+        Value min;
+        Value max;
+    };
+    std::vector<Zone> zones;
+    Value last;
+    size_t appended = 0;
+    bool ascending = true;
+
+public:
+    static constexpr size_t zone_rows = 1024;
+
+    void add(const Value& v, size_t row);
+    void rebuild(const std::vector<Row>& rows, size_t column);
+
+    size_t zone_count() const noexcept { return zones.size(); }
+    bool sorted() const noexcept { return ascending; }
+    bool may_match(size_t zone, CompareOp op, const Value& v) const;
+};
+
+}
\ No newline at end of file
@@ -1,56 +1,163 @@
 #pragma once
 #include "types.hpp"
+#include "predicate.hpp"
+#include "index.hpp"
+#include "stats.hpp"
 #include <vector>
 #include <string>
 #include <optional>
+#include <ostream>
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <utility>
 
 namespace imdb {
 
+struct AccessPlan;
+class Table;
+
+class TableObserver {
+public:
+    virtual ~TableObserver() = default;
+    virtual void on_insert(const Table& table, const Row& row) = 0;
+    virtual void on_delete(const Table& table, const Row& row) = 0;
+    virtual void on_update(const Table& table, const Row& before, const Row& after) {
+        on_delete(table, before);
+        on_insert(table, after);
+    }
+    virtual void on_delete_rows(const Table& table, const std::vector<Row>& rows) {
+        for (const auto& row : rows) on_delete(table, row);
+    }
+    virtual void on_update_rows(const Table& table, const std::vector<std::pair<Row, Row>>& changes) {
+        for (const auto& [before, after] : changes) on_update(table, before, after);
+    }
+    virtual void on_reset(const Table& table) = 0;
+};
+
+struct TableStorage {
+    std::vector<Row> rows;
+    std::vector<ColumnIndex> indexes;
+    std::vector<ColumnStats> stats;
+    std::vector<ZoneMap> zone_maps;
+    std::atomic<size_t> snapshots{ 0 };
+
+    TableStorage() = default;
+    TableStorage(const TableStorage& other)
+        : rows(other.rows), indexes(other.indexes), stats(other.stats), zone_maps(other.zone_maps) {}
+};
+
+struct TableChange {
+    enum class Kind { Insert, Update, Delete };
+
+    Kind kind = Kind::Insert;
+    std::vector<Value> values;
+    std::optional<Predicate> where;
+    std::vector<std::pair<size_t, Value>> assignments;
+};
+
+struct TableBatch {
+    static constexpr size_t new_row = static_cast<size_t>(-1);
+
+    std::vector<Row> rows;
+    std::vector<size_t> origin;
+};
+
 class Table {
 private:
     std::string table_name;
     std::vector<Column> columns;
-    std::vector<Row> rows;
+    std::shared_ptr<TableStorage> storage;
     std::optional<size_t> primary_key_index;
+    uint64_t catalog_changes = 0;
+    std::atomic<uint64_t> data_version{ 0 };
+    bool pins_storage = false;
+    mutable std::shared_mutex latch;
+    std::vector<TableObserver*> observers;
 
     std::optional<size_t> find_column_index(const std::string& column_name) const;
     bool is_null_value(const Value& v) const;
+    bool row_fits(const std::vector<Value>& values) const;
+    void append_row(const std::vector<Value>& values);
+    void touch();
+    void detach();
+    void reset_observers();
+    void notify_updates(std::vector<std::pair<size_t, Row>> changed);
 
 public:
     explicit Table(const std::string& name);
-    ~Table() = default;
+    ~Table();
 
     void add_column(const std::string& name, ColumnType type);
     bool remove_column(const std::string& name);
 
     bool insert_row(const std::vector<Value>& values);
     bool insert_row(const Row& row);
+    bool insert_rows(const std::vector<std::vector<Value>>& rows);
 
     std::vector<Row> select_all() const;
     std::vector<Row> select_where(const std::string& column_name, const Value& value) const;
+    std::vector<Row> select_where(const Predicate& where) const;
+    std::vector<size_t> find_rows(const Predicate& where) const;
+    std::vector<size_t> find_rows(const PredicateEvaluator& where, const AccessPlan& plan) const;
+    std::vector<Row> select_rows(const std::vector<size_t>& row_ids) const;
+    std::vector<Row> select_rows(const std::vector<size_t>& row_ids, const std::vector<size_t>& column_ids) const;
+    std::vector<Row> select_where(const Predicate& where, const std::vector<std::string>& column_names) const;
 
     size_t update_where(const std::string& column_name, const Value& old_value,
                         const std::string& update_column, const Value& new_value);
+    size_t update_where(const Predicate& where, const std::string& update_column, const Value& new_value);
+    size_t update_rows(const std::vector<size_t>& row_ids, size_t update_column, const Value& new_value);
+    bool update_rows(const std::vector<size_t>& row_ids, const std::vector<std::pair<size_t, Value>>& assignments,
+                     size_t& updated);
 
     size_t delete_where(const std::string& column_name, const Value& value);
+    size_t delete_where(const Predicate& where);
+    size_t delete_rows(const std::vector<size_t>& row_ids);
 
     void clear_all_rows();
 
-    size_t row_count() const noexcept { return rows.size(); }
+    bool stage_batch(const std::vector<TableChange>& changes, TableBatch& out) const;
+    void apply_batch(TableBatch batch);
+
+    size_t row_count() const noexcept { return storage->rows.size(); }
     size_t column_count() const noexcept { return columns.size(); }
     std::string get_table_name() const { return table_name; }
     std::vector<Column> get_columns() const { return columns; }
+    const std::vector<Row>& get_rows() const noexcept { return storage->rows; }
+    uint64_t catalog_version() const noexcept { return catalog_changes; }
+    uint64_t version() const noexcept { return data_version.load(std::memory_order_acquire); }
+    std::shared_mutex& mutex() const noexcept { return latch; }
+
+    std::shared_ptr<Table> snapshot() const;
+    size_t snapshot_readers() const noexcept { return storage->snapshots.load(std::memory_order_acquire); }
+
+    void add_observer(TableObserver* observer);
+    void remove_observer(TableObserver* observer);
+    bool has_observers() const noexcept { return !observers.empty(); }
 
-    void print_table() const;
-    void print_schema() const;
+    void print_table(std::ostream& out) const;
+    void print_schema(std::ostream& out) const;
 
     bool set_primary_key(const std::string& column_name);
     bool set_not_null(const std::string& column_name, bool value);
 
     size_t import_csv(const std::string& path, bool header);
+    size_t import_csv(const std::string& path, bool header, std::string& err);
+    bool read_csv(const std::string& path, bool header, std::vector<std::vector<Value>>& out, std::string& err) const;
     bool export_csv(const std::string& path) const;
 
     std::optional<size_t> get_column_index(const std::string& column_name) const;
+
+    bool create_index(const std::string& column_name, IndexKind kind);
+    bool drop_index(const std::string& column_name);
+    const ColumnIndex* get_index(size_t column) const;
+    bool is_sorted_by(size_t column) const;
+    size_t estimate_distinct(size_t column) const;
+
+    void analyze();
+    const ColumnStats& column_stats(size_t column) const { return storage->stats[column]; }
+    const ZoneMap& zone_map(size_t column) const { return storage->zone_maps[column]; }
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+#include "database.hpp"
+#include "plan.hpp"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace imdb {
+
+class Transaction {
+public:
+    explicit Transaction(Database& db);
+
+    bool insert(const std::string& table, std::vector<Value> values, std::string& err);
+    bool update(const std::string& table, std::optional<Predicate> where,
+                const std::string& column, const Value& value, std::string& err);
+    bool remove(const std::string& table, std::optional<Predicate> where, std::string& err);
+    bool stage(const PlanNode& plan, std::string& err);
+
+    bool commit(std::string& err);
+    void rollback();
+
+    size_t pending() const noexcept;
+    bool empty() const noexcept { return writes.empty(); }
+
+private:
+    struct WriteSet {
+        uint64_t catalog_version = 0;
+        std::vector<Column> columns;
+        std::vector<TableChange> changes;
+    };
+
+    WriteSet* write_set(const std::string& table, std::string& err);
+    bool check_where(const WriteSet& set, const std::optional<Predicate>& where, std::string& err) const;
+
+    Database& db;
+    std::map<std::string, WriteSet> writes;
+};
+
+}
\ No newline at end of file
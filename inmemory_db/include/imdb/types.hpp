@@ -24,5 +24,6 @@ struct Row {
 const char* type_name(ColumnType t) noexcept;
 std::string value_to_string(const Value& v);
 bool value_matches_type(const Value& v, ColumnType t) noexcept;
+std::string csv_escape(const std::string& s);
 
 }
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+#include "database.hpp"
+#include "plan.hpp"
+#include "sql.hpp"
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace imdb {
+
+class MaterializedView : public TableObserver {
+public:
+    enum class Shape { Select, Aggregate, Join };
+
+    static std::unique_ptr<MaterializedView> create(Database& db, const std::string& name,
+                                                    const SqlStatement& definition, std::string& err);
+    ~MaterializedView() override;
+
+    MaterializedView(const MaterializedView&) = delete;
+    MaterializedView& operator=(const MaterializedView&) = delete;
+
+    const std::string& name() const noexcept { return view_name; }
+    Shape shape() const noexcept { return view_shape; }
+    const std::vector<std::string>& sources() const noexcept { return source_names; }
+    bool depends_on(const std::string& table) const;
+    bool is_stale() const noexcept { return stale; }
+
+    void on_insert(const Table& table, const Row& row) override;
+    void on_delete(const Table& table, const Row& row) override;
+    void on_delete_rows(const Table& table, const std::vector<Row>& rows) override;
+    void on_update_rows(const Table& table, const std::vector<std::pair<Row, Row>>& changes) override;
+    void on_reset(const Table& table) override;
+
+private:
+    struct BoundAggregate {
+        AggregateFunc func = AggregateFunc::Count;
+        std::optional<size_t> column;
+    };
+
+    struct Accumulator {
+        int64_t count = 0;
+        ExactSum sum;
+        std::map<Value, size_t> values;
+    };
+
+    struct Group {
+        size_t rows = 0;
+        std::optional<size_t> slot;
+        std::vector<Accumulator> states;
+    };
+
+    struct Side {
+        Table* table = nullptr;
+        size_t key = 0;
+        std::string key_name;
+        std::optional<PredicateEvaluator> filter;
+    };
+
+    MaterializedView(Database& db, std::string name, SqlStatement definition);
+
+    bool bind(std::string& err);
+    bool bind_select(const PlanNode& project, std::vector<Column>& layout, std::string& err);
+    bool bind_aggregate(const PlanNode& project, std::vector<Column>& layout, std::string& err);
+    bool bind_join(const PlanNode& project, std::vector<Column>& layout, std::string& err);
+    void rebuild();
+
+    void apply(const Table& table, const Row& row, bool insert);
+    void apply_row(const Row& row, bool insert);
+    void apply_group(const Row& row, bool insert, bool publish);
+    void apply_join(const Table& table, const Row& row, bool insert);
+    void publish_group(std::map<std::vector<Value>, Group>::iterator it);
+    std::vector<Value> group_row(const std::vector<Value>& key, const Group& group) const;
+    void remove_row(const std::vector<Value>& values);
+    void flush_removals();
+    void remove_slot(size_t slot);
+
+    Database& db;
+    std::string view_name;
+    SqlStatement definition;
+    Shape view_shape = Shape::Select;
+    std::vector<std::string> source_names;
+    std::vector<Table*> source_tables;
+    Table* target = nullptr;
+    bool stale = false;
+
+    PlanNode plan;
+    std::optional<PredicateEvaluator> where;
+    std::vector<size_t> columns;
+    std::vector<JoinColumn> join_columns;
+    std::vector<Side> sides;
+    std::vector<size_t> group_columns;
+    std::vector<BoundAggregate> aggregates;
+    std::vector<size_t> output;
+    std::map<std::vector<Value>, Group> groups;
+    std::vector<std::vector<Value>> removals;
+};
+
+}
\ No newline at end of file
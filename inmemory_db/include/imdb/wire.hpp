@@ -0,0 +1,29 @@
+#pragma once
+#include "types.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace imdb {
+
+enum class WireType : uint8_t { Int = 0, Text = 1 };
+
+struct WireColumn {
+    std::string name;
+    WireType type = WireType::Int;
+};
+
+constexpr char wire_magic[4] = { 'I', 'M', 'D', 'B' };
+constexpr uint8_t wire_version = 1;
+constexpr size_t wire_batch_rows = 65536;
+
+std::string encode_result(const std::vector<std::string>& headers, const std::vector<ColumnType>& types,
+                          const std::vector<Row>& rows);
+std::string encode_result(const std::vector<std::string>& headers, const std::vector<ColumnType>& types,
+                          const std::vector<std::vector<Value>>& rows);
+bool decode_result(std::string_view data, std::vector<WireColumn>& columns,
+                   std::vector<std::vector<Value>>& rows, std::string& err);
+
+}
\ No newline at end of file
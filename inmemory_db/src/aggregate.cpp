@@ -0,0 +1,358 @@
+#include "imdb/aggregate.hpp"
+#include "imdb/planner.hpp"
+#include "imdb/profile.hpp"
+#include "imdb/pool.hpp"
+#include "imdb/cancel.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+#include <utility>
+
+namespace imdb {
+
+void ExactSum::add(int64_t v) noexcept {
+    if (__builtin_add_overflow(low, v, &low)) wraps += v < 0 ? -1 : 1;
+}
+
+void ExactSum::subtract(int64_t v) noexcept {
+    if (__builtin_sub_overflow(low, v, &low)) wraps += v < 0 ? 1 : -1;
+}
+
+void ExactSum::merge(const ExactSum& other) noexcept {
+    add(other.low);
+    wraps += other.wraps;
+}
+
+std::optional<int64_t> ExactSum::value() const noexcept {
+    if (wraps != 0) return std::nullopt;
+    return low;
+}
+
+double ExactSum::average(int64_t count) const noexcept {
+    return (static_cast<double>(low) + static_cast<double>(wraps) * 18446744073709551616.0) / static_cast<double>(count);
+}
+
+const char* aggregate_name(AggregateFunc f) noexcept {
+    switch (f) {
+        case AggregateFunc::Count: return "COUNT";
+        case AggregateFunc::Sum: return "SUM";
+        case AggregateFunc::Min: return "MIN";
+        case AggregateFunc::Max: return "MAX";
+        case AggregateFunc::Avg: return "AVG";
+    }
+    return "?";
+}
+
+std::optional<AggregateFunc> parse_aggregate_func(const std::string& s) {
+    if (s == "COUNT") return AggregateFunc::Count;
+    if (s == "SUM") return AggregateFunc::Sum;
+    if (s == "MIN") return AggregateFunc::Min;
+    if (s == "MAX") return AggregateFunc::Max;
+    if (s == "AVG") return AggregateFunc::Avg;
+    return std::nullopt;
+}
+
+std::string aggregate_header(const AggregateSpec& spec) {
+    return std::string(aggregate_name(spec.func)) + "(" + (spec.column.empty() ? "*" : spec.column) + ")";
+}
+
+namespace {
+
+constexpr size_t min_rows_per_thread = 16384;
+
+struct BoundAggregate {
+    AggregateFunc func = AggregateFunc::Count;
+    std::optional<size_t> column;
+};
+
+struct AggState {
+    int64_t count = 0;
+    ExactSum sum;
+    Value min;
+    Value max;
+};
+
+struct KeyHash {
+    size_t operator()(const std::vector<Value>& key) const noexcept {
+        size_t h = 0;
+        for (const auto& v : key) h = h * 31 + std::hash<Value>{}(v);
+        return h;
+    }
+};
+
+struct PartialAggregate {
+    std::unordered_map<std::vector<Value>, size_t, KeyHash> groups;
+    std::vector<std::vector<Value>> keys;
+    std::vector<AggState> states;
+};
+
+bool is_null(const Value& v) {
+    return std::holds_alternative<std::monostate>(v);
+}
+
+void accumulate(AggState& s, AggregateFunc func, const Value* v) {
+    if (!v) {
+        s.count++;
+        return;
+    }
+    if (is_null(*v)) return;
+    s.count++;
+    switch (func) {
+        case AggregateFunc::Count:
+            break;
+        case AggregateFunc::Sum:
+        case AggregateFunc::Avg:
+            s.sum.add(std::get<int64_t>(*v));
+            break;
+        case AggregateFunc::Min:
+            if (is_null(s.min) || *v < s.min) s.min = *v;
+            break;
+        case AggregateFunc::Max:
+            if (is_null(s.max) || s.max < *v) s.max = *v;
+            break;
+    }
+}
+
+void merge_state(AggState& into, const AggState& from) {
+    into.count += from.count;
+    into.sum.merge(from.sum);
+    if (!is_null(from.min) && (is_null(into.min) || from.min < into.min)) into.min = from.min;
+    if (!is_null(from.max) && (is_null(into.max) || into.max < from.max)) into.max = from.max;
+}
+
+Value finalize(const AggState& s, AggregateFunc func) {
+    switch (func) {
+        case AggregateFunc::Count:
+            return s.count;
+        case AggregateFunc::Sum:
+            if (s.count == 0) return std::monostate{};
+            if (auto sum = s.sum.value()) return *sum;
+            return std::monostate{};
+        case AggregateFunc::Avg: {
+            if (s.count == 0) return std::monostate{};
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), "%.2f", s.sum.average(s.count));
+            return std::string(buf);
+        }
+        case AggregateFunc::Min:
+            return s.min;
+        case AggregateFunc::Max:
+            return s.max;
+    }
+    return std::monostate{};
+}
+
+struct TableSource {
+    const std::vector<Row>& rows;
+    std::vector<size_t> columns;
+    const std::optional<PredicateEvaluator>& where;
+    const std::optional<std::vector<size_t>>& ids;
+
+    size_t size() const { return ids ? ids->size() : rows.size(); }
+    const Value& value(size_t i, size_t slot) const { return rows[ids ? (*ids)[i] : i].values[columns[slot]]; }
+    void filter(std::vector<size_t>& selection) const {
+        if (where && !ids) where->filter_batch(rows, selection);
+    }
+};
+
+struct JoinSource {
+    const JoinResult& join;
+    std::vector<JoinColumn> columns;
+
+    size_t size() const { return join.size(); }
+    const Value& value(size_t i, size_t slot) const { return join.value(i, columns[slot]); }
+    void filter(std::vector<size_t>&) const {}
+};
+
+template <typename Source>
+void aggregate_range(const Source& source, size_t begin, size_t end,
+                     const std::vector<size_t>& group_slots,
+                     const std::vector<BoundAggregate>& aggs,
+                     PartialAggregate& out) {
+    std::vector<size_t> selection;
+    selection.reserve(PredicateEvaluator::batch_size);
+    std::vector<Value> key(group_slots.size());
+
+    for (size_t batch = begin; batch < end; batch += PredicateEvaluator::batch_size) {
+        if (cancellation_requested()) return;
+        size_t batch_end = std::min(end, batch + PredicateEvaluator::batch_size);
+        selection.clear();
+        for (size_t r = batch; r < batch_end; r++) selection.push_back(r);
+        source.filter(selection);
+
+        for (size_t r : selection) {
+            for (size_t k = 0; k < group_slots.size(); k++) key[k] = source.value(r, group_slots[k]);
+
+            auto it = out.groups.find(key);
+            size_t g;
+            if (it == out.groups.end()) {
+                g = out.keys.size();
+                out.groups.emplace(key, g);
+                out.keys.push_back(key);
+                out.states.resize(out.states.size() + aggs.size());
+            } else {
+                g = it->second;
+            }
+
+            AggState* states = &out.states[g * aggs.size()];
+            for (size_t a = 0; a < aggs.size(); a++) {
+                if (aggs[a].column) accumulate(states[a], aggs[a].func, &source.value(r, *aggs[a].column));
+                else accumulate(states[a], aggs[a].func, nullptr);
+            }
+        }
+    }
+}
+
+template <typename Source>
+void run_aggregate(const Source& source,
+                   const std::vector<size_t>& group_slots,
+                   const std::vector<BoundAggregate>& aggs,
+                   size_t threads,
+                   std::vector<std::vector<Value>>& out_rows) {
+    StageTimer timer("HashAggregate");
+    const size_t n = source.size();
+    size_t workers = std::max<size_t>(1, std::min(threads, n / min_rows_per_thread));
+
+    std::vector<PartialAggregate> partials(workers);
+    if (workers == 1) {
+        aggregate_range(source, 0, n, group_slots, aggs, partials[0]);
+    } else {
+        size_t chunk = (n + workers - 1) / workers;
+        ThreadPool::shared().parallel_for(workers, [&](size_t w) {
+            size_t begin = std::min(n, w * chunk);
+            size_t end = std::min(n, begin + chunk);
+            aggregate_range(source, begin, end, group_slots, aggs, partials[w]);
+        });
+    }
+
+    PartialAggregate& total = partials[0];
+    for (size_t w = 1; w < workers; w++) {
+        PartialAggregate& part = partials[w];
+        for (size_t g = 0; g < part.keys.size(); g++) {
+            auto it = total.groups.find(part.keys[g]);
+            size_t into;
+            if (it == total.groups.end()) {
+                into = total.keys.size();
+                total.groups.emplace(part.keys[g], into);
+                total.keys.push_back(std::move(part.keys[g]));
+                total.states.resize(total.states.size() + aggs.size());
+            } else {
+                into = it->second;
+            }
+            for (size_t a = 0; a < aggs.size(); a++) {
+                merge_state(total.states[into * aggs.size() + a], part.states[g * aggs.size() + a]);
+            }
+        }
+    }
+
+    if (group_slots.empty() && total.keys.empty()) {
+        total.keys.emplace_back();
+        total.states.resize(aggs.size());
+    }
+
+    out_rows.reserve(total.keys.size());
+    for (size_t g = 0; g < total.keys.size(); g++) {
+        std::vector<Value> row = std::move(total.keys[g]);
+        row.reserve(group_slots.size() + aggs.size());
+        for (size_t a = 0; a < aggs.size(); a++) {
+            row.push_back(finalize(total.states[g * aggs.size() + a], aggs[a].func));
+        }
+        out_rows.push_back(std::move(row));
+    }
+    timer.rows(n, out_rows.size());
+    timer.bytes(total.keys.size() * (group_slots.size() + aggs.size()) * sizeof(Value) +
+                total.states.size() * sizeof(AggState));
+}
+
+template <typename ColumnRef, typename Resolve, typename TypeOf>
+bool bind_query(const AggregateQuery& query, Resolve resolve, TypeOf type_of,
+                std::vector<ColumnRef>& columns,
+                std::vector<size_t>& group_slots,
+                std::vector<BoundAggregate>& aggs,
+                std::vector<std::string>& out_headers) {
+    for (const auto& name : query.group_by) {
+        std::optional<ColumnRef> col = resolve(name);
+        if (!col) return false;
+        group_slots.push_back(columns.size());
+        columns.push_back(*col);
+        out_headers.push_back(name);
+    }
+
+    for (const auto& spec : query.aggregates) {
+        BoundAggregate b;
+        b.func = spec.func;
+        if (!spec.column.empty()) {
+            std::optional<ColumnRef> col = resolve(spec.column);
+            if (!col) return false;
+            if ((spec.func == AggregateFunc::Sum || spec.func == AggregateFunc::Avg) &&
+                type_of(*col) != ColumnType::Int) {
+                return false;
+            }
+            b.column = columns.size();
+            columns.push_back(*col);
+        } else if (spec.func != AggregateFunc::Count) {
+            return false;
+        }
+        aggs.push_back(b);
+        out_headers.push_back(aggregate_header(spec));
+    }
+    return true;
+}
+
+}
+
+bool hash_aggregate(const Table& table,
+                    const AggregateQuery& query,
+                    std::vector<std::string>& out_headers,
+                    std::vector<std::vector<Value>>& out_rows,
+                    size_t threads) {
+    out_headers.clear();
+    out_rows.clear();
+
+    auto columns = table.get_columns();
+    std::vector<size_t> refs;
+    std::vector<size_t> group_slots;
+    std::vector<BoundAggregate> aggs;
+    bool ok = bind_query<size_t>(query,
+        [&](const std::string& name) { return table.get_column_index(name); },
+        [&](size_t c) { return columns[c].type; },
+        refs, group_slots, aggs, out_headers);
+    if (!ok) return false;
+
+    std::optional<PredicateEvaluator> where;
+    std::optional<std::vector<size_t>> ids;
+    if (query.where) {
+        where = PredicateEvaluator::bind(*query.where, columns);
+        if (!where) return false;
+        if (plan_access(table, *query.where).method != AccessMethod::FullScan) ids = table.find_rows(*query.where);
+    }
+
+    TableSource source{ table.get_rows(), std::move(refs), where, ids };
+    run_aggregate(source, group_slots, aggs, threads, out_rows);
+    return true;
+}
+
+bool hash_aggregate(const JoinResult& join,
+                    const AggregateQuery& query,
+                    std::vector<std::string>& out_headers,
+                    std::vector<std::vector<Value>>& out_rows,
+                    size_t threads) {
+    out_headers.clear();
+    out_rows.clear();
+    if (query.where) return false;
+
+    std::vector<JoinColumn> refs;
+    std::vector<size_t> group_slots;
+    std::vector<BoundAggregate> aggs;
+    bool ok = bind_query<JoinColumn>(query,
+        [&](const std::string& name) { return join.resolve(name); },
+        [&](const JoinColumn& c) { return join.column_type(c); },
+        refs, group_slots, aggs, out_headers);
+    if (!ok) return false;
+
+    JoinSource source{ join, std::move(refs) };
+    run_aggregate(source, group_slots, aggs, threads, out_rows);
+    return true;
+}
+
+}
\ No newline at end of file
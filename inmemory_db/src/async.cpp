@@ -0,0 +1,55 @@
+#include "imdb/async.hpp"
+#include "imdb/sql.hpp"
+
+namespace imdb {
+
+static std::shared_ptr<CancelToken> prepare_token(AsyncOptions& options) {
+    std::shared_ptr<CancelToken> token = options.token ? options.token : std::make_shared<CancelToken>();
+    if (options.timeout) token->set_timeout(*options.timeout);
+    return token;
+}
+
+static QueryOutcome run_plan(Database& db, const PlanNode& plan, const std::vector<Value>& params,
+                             const CancelToken& token) {
+    QueryOutcome outcome;
+    if (token.stop_requested()) {
+        outcome.err = token.reason();
+        return outcome;
+    }
+    QueryCost cost;
+    {
+        TableLocks held = db.lock_tables(plan_tables(plan), {});
+        cost = estimate_cost(db, plan);
+    }
+    outcome.query_class = QueryScheduler::classify(cost);
+    Admission admission = QueryScheduler::shared().admit(outcome.query_class, cost.bytes);
+    outcome.queue_wait = admission.queue_wait();
+    if (!admission.admitted()) {
+        outcome.err = token.reason();
+        return outcome;
+    }
+    outcome.ok = execute_plan(db, plan, params, outcome.result, outcome.err);
+    return outcome;
+}
+
+AsyncQuery execute_async(Database& db, std::string sql, std::vector<Value> params, AsyncOptions options) {
+    auto token = prepare_token(options);
+    auto future = run_async([&db, sql = std::move(sql), params = std::move(params), token]() {
+        SqlStatement stmt;
+        PlanNode plan;
+        QueryOutcome outcome;
+        if (!parse_sql(sql, stmt, outcome.err) || !compile_sql(db, stmt, plan, outcome.err)) return outcome;
+        return run_plan(db, plan, params, *token);
+    }, token);
+    return AsyncQuery(std::move(future), token);
+}
+
+AsyncQuery execute_async(Database& db, PlanNode plan, std::vector<Value> params, AsyncOptions options) {
+    auto token = prepare_token(options);
+    auto future = run_async([&db, plan = std::move(plan), params = std::move(params), token]() {
+        return run_plan(db, plan, params, *token);
+    }, token);
+    return AsyncQuery(std::move(future), token);
+}
+
+}
\ No newline at end of file
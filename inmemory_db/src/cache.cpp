@@ -0,0 +1,84 @@
+#include "imdb/cache.hpp"
+
+namespace imdb {
+
+size_t estimate_bytes(const CachedResult& result) {
+    size_t bytes = sizeof(CachedResult);
+    for (const auto& h : result.headers) bytes += sizeof(std::string) + h.size();
+    for (const auto& row : result.rows) {
+        bytes += sizeof(row) + row.size() * sizeof(Value);
+        for (const auto& v : row) {
+            if (const auto* s = std::get_if<std::string>(&v)) bytes += s->size();
+        }
+    }
+    return bytes;
+}
+
+void ResultCache::erase(std::list<Entry>::iterator it) {
+    used -= it->bytes;
+    entries.erase(it->key);
+    lru.erase(it);
+}
+
+void ResultCache::shrink_to(size_t bytes) {
+    while (used > bytes && !lru.empty()) {
+        erase(std::prev(lru.end()));
+        evictions++;
+    }
+}
+
+std::shared_ptr<const CachedResult> ResultCache::lookup(const std::string& key, const TableVersions& versions) {
+    std::lock_guard<std::mutex> lock(guard);
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        misses++;
+        return nullptr;
+    }
+    if (it->second->versions != versions) {
+        erase(it->second);
+        misses++;
+        return nullptr;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    hits++;
+    return it->second->result;
+}
+
+void ResultCache::store(const std::string& key, TableVersions versions, CachedResult result) {
+    std::lock_guard<std::mutex> lock(guard);
+    auto existing = entries.find(key);
+    if (existing != entries.end()) erase(existing->second);
+    size_t bytes = estimate_bytes(result) + key.size();
+    if (bytes > capacity) return;
+    shrink_to(capacity - bytes);
+    lru.push_front(Entry{ key, std::move(versions), std::make_shared<const CachedResult>(std::move(result)), bytes });
+    entries[key] = lru.begin();
+    used += bytes;
+}
+
+void ResultCache::clear() {
+    std::lock_guard<std::mutex> lock(guard);
+    lru.clear();
+    entries.clear();
+    used = 0;
+}
+
+void ResultCache::set_capacity(size_t bytes) {
+    std::lock_guard<std::mutex> lock(guard);
+    capacity = bytes;
+    shrink_to(capacity);
+}
+
+CacheStats ResultCache::stats() const {
+    std::lock_guard<std::mutex> lock(guard);
+    CacheStats s;
+    s.hits = hits;
+    s.misses = misses;
+    s.evictions = evictions;
+    s.entries = lru.size();
+    s.bytes = used;
+    s.capacity = capacity;
+    return s;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "imdb/cancel.hpp"
+
+namespace imdb {
+
+static thread_local const CancelToken* current_token = nullptr;
+static std::atomic<uint64_t> interrupt_epoch{ 0 };
+
+void interrupt_all() noexcept {
+    interrupt_epoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void CancelToken::watch_interrupts() noexcept {
+    interrupt_base.store(interrupt_epoch.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+bool CancelToken::interrupted() const noexcept {
+    uint64_t base = interrupt_base.load(std::memory_order_acquire);
+    return base != not_watching && interrupt_epoch.load(std::memory_order_acquire) != base;
+}
+
+void CancelToken::set_deadline(std::chrono::steady_clock::time_point when) noexcept {
+    int64_t ticks = when.time_since_epoch().count();
+    deadline.store(ticks == 0 ? 1 : ticks, std::memory_order_release);
+}
+
+void CancelToken::set_timeout(std::chrono::milliseconds timeout) noexcept {
+    set_deadline(std::chrono::steady_clock::now() + timeout);
+}
+
+bool CancelToken::expired() const noexcept {
+    int64_t ticks = deadline.load(std::memory_order_acquire);
+    return ticks != 0 && std::chrono::steady_clock::now().time_since_epoch().count() >= ticks;
+}
+
+std::chrono::steady_clock::time_point CancelToken::deadline_point() const noexcept {
+    int64_t ticks = deadline.load(std::memory_order_acquire);
+    if (ticks == 0) return std::chrono::steady_clock::time_point::max();
+    return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(ticks));
+}
+
+const char* CancelToken::reason() const noexcept {
+    if (cancel_requested()) return "query cancelled";
+    if (expired()) return "query timed out";
+    return "";
+}
+
+const CancelToken* active_cancel_token() noexcept {
+    return current_token;
+}
+
+bool cancellation_requested() noexcept {
+    return current_token && current_token->stop_requested();
+}
+
+CancelScope::CancelScope(const CancelToken* token) : previous(current_token) {
+    current_token = token;
+}
+
+CancelScope::~CancelScope() {
+    current_token = previous;
+}
+
+}
\ No newline at end of file
@@ -1,42 +1,151 @@
 #include "imdb/database.hpp"
+#include "imdb/sort.hpp"
+#include "imdb/planner.hpp"
+#include "imdb/profile.hpp"
+#include "imdb/view.hpp"
+#include "imdb/cancel.hpp"
 #include <algorithm>
+#include <map>
 #include <utility>
 #include <optional>
+#include <unordered_map>
+#include <numeric>
+#include <cmath>
 
 namespace imdb {
 
 Database::Database(const std::string& name) : database_name(name) {}
 
+Database::~Database() {
+    views.clear();
+}
+
+Table* Database::find_table(const std::string& table_name) const {
+    auto it = tables.find(table_name);
+    if (it == tables.end()) return nullptr;
+    return it->second.get();
+}
+
+bool Database::has_dependents(const std::string& table_name) const {
+    for (const auto& pair : views) {
+        if (pair.second->depends_on(table_name)) return true;
+    }
+    return false;
+}
+
+void Database::collect_writes(const std::string& table_name, std::map<std::string, bool>& wanted) const {
+    if (!find_table(table_name)) return;
+    auto it = wanted.find(table_name);
+    if (it != wanted.end() && it->second) return;
+    wanted[table_name] = true;
+    for (const auto& pair : views) {
+        if (!pair.second->depends_on(table_name)) continue;
+        for (const auto& source : pair.second->sources()) wanted.emplace(source, false);
+        collect_writes(pair.first, wanted);
+    }
+}
+
+std::map<std::string, bool> Database::lock_set(const std::vector<std::string>& reads,
+                                               const std::vector<std::string>& writes) const {
+    std::map<std::string, bool> wanted;
+    for (const auto& name : writes) collect_writes(name, wanted);
+    for (const auto& name : reads) {
+        if (find_table(name)) wanted.emplace(name, false);
+    }
+    return wanted;
+}
+
+TableLocks Database::lock_tables(const std::vector<std::string>& reads, const std::vector<std::string>& writes) const {
+    for (;;) {
+        std::map<std::string, bool> wanted;
+        std::vector<std::shared_ptr<Table>> pinned;
+        {
+            std::shared_lock<std::shared_mutex> lock(catalog);
+            wanted = lock_set(reads, writes);
+            for (const auto& entry : wanted) pinned.push_back(tables.at(entry.first));
+        }
+
+        TableLocks held;
+        size_t i = 0;
+        for (const auto& entry : wanted) {
+            if (entry.second) held.writers.emplace_back(pinned[i]->mutex());
+            else held.readers.emplace_back(pinned[i]->mutex());
+            i++;
+        }
+
+        std::shared_lock<std::shared_mutex> lock(catalog);
+        bool same = lock_set(reads, writes) == wanted;
+        i = 0;
+        for (const auto& entry : wanted) {
+            if (!same) break;
+            same = find_table(entry.first) == pinned[i++].get();
+        }
+        if (!same) continue;
+        held.pinned = std::move(pinned);
+        return held;
+    }
+}
+
+TableReader Database::read_table(const std::string& table_name) const {
+    TableReader handle;
+    handle.held = lock_tables({ table_name }, {});
+    std::shared_lock<std::shared_mutex> lock(catalog);
+    handle.table = find_table(table_name);
+    return handle;
+}
+
+TableWriter Database::write_table(const std::string& table_name) {
+    TableWriter handle;
+    handle.held = lock_tables({}, { table_name });
+    std::shared_lock<std::shared_mutex> lock(catalog);
+    handle.table = find_table(table_name);
+    return handle;
+}
+
+std::unique_ptr<Database> Database::snapshot(const std::vector<std::string>& names) const {
+    auto snap = std::make_unique<Database>(database_name);
+    TableLocks held = lock_tables(names, {});
+    std::shared_lock<std::shared_mutex> lock(catalog);
+    for (const auto& name : names) {
+        if (Table* t = find_table(name)) snap->tables[name] = t->snapshot();
+    }
+    return snap;
+}
+
 bool Database::create_table(const std::string& table_name) {
-    if (table_exists(table_name)) return false;
-    tables[table_name] = std::make_unique<Table>(table_name);
+    std::unique_lock<std::shared_mutex> lock(catalog);
+    if (find_table(table_name)) return false;
+    tables[table_name] = std::make_shared<Table>(table_name);
     return true;
 }
 
 bool Database::drop_table(const std::string& table_name) {
+    TableLocks held = lock_tables({}, { table_name });
+    std::unique_lock<std::shared_mutex> lock(catalog);
     auto it = tables.find(table_name);
     if (it == tables.end()) return false;
+    if (views.count(table_name) || has_dependents(table_name)) return false;
     tables.erase(it);
     return true;
 }
 
 Table* Database::get_table(const std::string& table_name) {
-    auto it = tables.find(table_name);
-    if (it == tables.end()) return nullptr;
-    return it->second.get();
+    std::shared_lock<std::shared_mutex> lock(catalog);
+    return find_table(table_name);
 }
 
 const Table* Database::get_table(const std::string& table_name) const {
-    auto it = tables.find(table_name);
-    if (it == tables.end()) return nullptr;
-    return it->second.get();
+    std::shared_lock<std::shared_mutex> lock(catalog);
+    return find_table(table_name);
 }
 
 bool Database::table_exists(const std::string& table_name) const {
-    return tables.find(table_name) != tables.end();
+    std::shared_lock<std::shared_mutex> lock(catalog);
+    return find_table(table_name) != nullptr;
 }
 
 std::vector<std::string> Database::get_table_names() const {
+    std::shared_lock<std::shared_mutex> lock(catalog);
     std::vector<std::string> names;
     names.reserve(tables.size());
     for (const auto& pair : tables) names.push_back(pair.first);
@@ -45,79 +154,665 @@ std::vector<std::string> Database::get_table_names() const {
 }
 
 void Database::clear_all_tables() {
+    TableLocks held = lock_tables({}, get_table_names());
+    std::unique_lock<std::shared_mutex> lock(catalog);
+    views.clear();
     tables.clear();
 }
 
 size_t Database::get_total_rows() const {
+    TableLocks held = lock_tables(get_table_names(), {});
+    std::shared_lock<std::shared_mutex> lock(catalog);
     size_t total = 0;
     for (const auto& pair : tables) total += pair.second->row_count();
     return total;
 }
 
 bool Database::rename_table(const std::string& old_name, const std::string& new_name) {
+    TableLocks held = lock_tables({}, { old_name });
+    std::unique_lock<std::shared_mutex> lock(catalog);
     auto it = tables.find(old_name);
     if (it == tables.end()) return false;
-    if (table_exists(new_name)) return false;
+    if (find_table(new_name)) return false;
+    if (views.count(old_name) || has_dependents(old_name)) return false;
     auto ptr = std::move(it->second);
     tables.erase(it);
     tables[new_name] = std::move(ptr);
     return true;
 }
 
-static std::optional<size_t> find_index_by_name(const std::vector<Column>& cols, const std::string& name) {
-    for (size_t i = 0; i < cols.size(); i++) if (cols[i].name == name) return i;
-    return std::nullopt;
+bool Database::create_view(const std::string& name, const SqlStatement& definition, std::string& err) {
+    if (!create_table(name)) { err = "table exists"; return false; }
+    std::vector<std::string> writes{ name, definition.table };
+    for (const auto& join : definition.joins) writes.push_back(join.table);
+    std::unique_ptr<MaterializedView> view;
+    {
+        TableLocks held = lock_tables({}, writes);
+        view = MaterializedView::create(*this, name, definition, err);
+    }
+    std::unique_lock<std::shared_mutex> lock(catalog);
+    if (!view) {
+        tables.erase(name);
+        return false;
+    }
+    views[name] = std::move(view);
+    return true;
+}
+
+bool Database::drop_view(const std::string& name) {
+    std::vector<std::string> writes{ name };
+    {
+        std::shared_lock<std::shared_mutex> lock(catalog);
+        auto it = views.find(name);
+        if (it == views.end()) return false;
+        writes.insert(writes.end(), it->second->sources().begin(), it->second->sources().end());
+    }
+    TableLocks held = lock_tables({}, writes);
+    std::unique_lock<std::shared_mutex> lock(catalog);
+    auto it = views.find(name);
+    if (it == views.end() || has_dependents(name)) return false;
+    views.erase(it);
+    tables.erase(name);
+    return true;
+}
+
+bool Database::is_view(const std::string& name) const {
+    std::shared_lock<std::shared_mutex> lock(catalog);
+    return views.find(name) != views.end();
+}
+
+bool Database::has_dependent_views(const std::string& table_name) const {
+    std::shared_lock<std::shared_mutex> lock(catalog);
+    return has_dependents(table_name);
+}
+
+const MaterializedView* Database::get_view(const std::string& name) const {
+    std::shared_lock<std::shared_mutex> lock(catalog);
+    auto it = views.find(name);
+    if (it == views.end()) return nullptr;
+    return it->second.get();
+}
+
+std::vector<std::string> Database::get_view_names() const {
+    std::shared_lock<std::shared_mutex> lock(catalog);
+    std::vector<std::string> names;
+    names.reserve(views.size());
+    for (const auto& pair : views) names.push_back(pair.first);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+bool Database::table_versions(const std::vector<std::string>& names, TableVersions& out) const {
+    out.clear();
+    std::shared_lock<std::shared_mutex> lock(catalog);
+    for (const auto& name : names) {
+        const Table* t = find_table(name);
+        if (!t) return false;
+        out.emplace_back(name, t->version());
+    }
+    return true;
+}
+
+namespace {
+
+constexpr size_t none = static_cast<size_t>(-1);
+
+struct BoundJoinSide {
+    const Table* table = nullptr;
+    size_t column = 0;
+    const Predicate* predicate = nullptr;
+    std::optional<PredicateEvaluator> where;
+    std::optional<std::vector<size_t>> candidates;
+
+    size_t size() const { return candidates ? candidates->size() : table->row_count(); }
+    size_t row(size_t i) const { return candidates ? (*candidates)[i] : i; }
+    const Value& key(size_t r) const { return table->get_rows()[r].values[column]; }
+};
+
+bool bind_join_side(const Database& db, const JoinInput& input, BoundJoinSide& out) {
+    out.table = db.get_table(input.table);
+    if (!out.table) return false;
+    auto idx = out.table->get_column_index(input.column);
+    if (!idx) return false;
+    out.column = *idx;
+    if (input.where) {
+        out.where = PredicateEvaluator::bind(*input.where, out.table->get_columns());
+        if (!out.where) return false;
+        out.predicate = &*input.where;
+    }
+    return true;
+}
+
+void filter_side(BoundJoinSide& side) {
+    if (!side.where || side.candidates) return;
+    side.candidates = side.table->find_rows(*side.predicate);
+}
+
+struct ChainedHash {
+    std::unordered_map<Value, size_t> heads;
+    std::vector<size_t> next;
+
+    template <typename Entry, typename Key>
+    void build(size_t count, size_t capacity, Entry entry, Key key) {
+        heads.reserve(count);
+        next.assign(capacity, none);
+        for (size_t i = count; i > 0; i--) {
+            size_t e = entry(i - 1);
+            auto [it, inserted] = heads.try_emplace(key(e), e);
+            if (!inserted) {
+                next[e] = it->second;
+                it->second = e;
+            }
+        }
+    }
+
+    size_t first(const Value& key) const {
+        auto it = heads.find(key);
+        return it == heads.end() ? none : it->second;
+    }
+};
+
+void hash_join(const BoundJoinSide& left, const BoundJoinSide& right, JoinResult& out) {
+    ChainedHash hash;
+    hash.build(right.size(), right.table->row_count(),
+               [&](size_t i) { return right.row(i); },
+               [&](size_t r) -> const Value& { return right.key(r); });
+
+    size_t work = 0;
+    for (size_t i = 0; i < left.size(); i++) {
+        if (cancellation_due(work++)) return;
+        size_t l = left.row(i);
+        for (size_t r = hash.first(left.key(l)); r != none; r = hash.next[r]) {
+            if (cancellation_due(work++)) return;
+            out.add(l, r);
+        }
+    }
+}
+
+void index_join(const BoundJoinSide& outer, const BoundJoinSide& inner, bool outer_is_left, JoinResult& out) {
+    const ColumnIndex* index = inner.table->get_index(inner.column);
+    std::vector<size_t> matches;
+    size_t work = 0;
+    for (size_t i = 0; i < outer.size(); i++) {
+        if (cancellation_due(work++)) return;
+        size_t o = outer.row(i);
+        const std::vector<size_t>* hits = index->find(outer.key(o));
+        if (!hits) continue;
+        matches.assign(hits->begin(), hits->end());
+        if (inner.where) inner.where->filter_batch(inner.table->get_rows(), matches);
+        for (size_t m : matches) {
+            if (cancellation_due(work++)) return;
+            if (outer_is_left) out.add(o, m);
+            else out.add(m, o);
+        }
+    }
+}
+
+std::optional<std::vector<size_t>> presorted_row_ids(const BoundJoinSide& side) {
+    if (side.where) {
+        if (!side.table->is_sorted_by(side.column)) return std::nullopt;
+        return side.candidates;
+    }
+    const ColumnIndex* index = side.table->get_index(side.column);
+    if (index && index->kind() == IndexKind::Ordered) return index->sorted_row_ids();
+    if (!side.table->is_sorted_by(side.column)) return std::nullopt;
+    std::vector<size_t> ids(side.table->row_count());
+    std::iota(ids.begin(), ids.end(), 0);
+    return ids;
+}
+
+std::vector<size_t> sorted_row_ids(const BoundJoinSide& side) {
+    std::vector<size_t> ids(side.size());
+    for (size_t i = 0; i < ids.size(); i++) ids[i] = side.row(i);
+    return order_rows(*side.table, ids, side.column, false);
+}
+
+void merge_join(const BoundJoinSide& left, const std::vector<size_t>& lids,
+                const BoundJoinSide& right, const std::vector<size_t>& rids,
+                JoinResult& out) {
+    auto lkey = [&](size_t i) -> const Value& { return left.key(lids[i]); };
+    auto rkey = [&](size_t j) -> const Value& { return right.key(rids[j]); };
+
+    size_t i = 0, j = 0;
+    size_t work = 0;
+    while (i < lids.size() && j < rids.size()) {
+        if (cancellation_due(work++)) return;
+        const Value& lv = lkey(i);
+        const Value& rv = rkey(j);
+        if (lv < rv) { i++; continue; }
+        if (rv < lv) { j++; continue; }
+
+        size_t i_end = i + 1;
+        while (i_end < lids.size() && lkey(i_end) == lv) i_end++;
+        size_t j_end = j + 1;
+        while (j_end < rids.size() && rkey(j_end) == rv) j_end++;
+
+        for (size_t a = i; a < i_end; a++) {
+            if (cancellation_due(work++)) return;
+            for (size_t b = j; b < j_end; b++) out.add(lids[a], rids[b]);
+        }
+        i = i_end;
+        j = j_end;
+    }
+}
+
+double estimated_rows(const BoundJoinSide& side) {
+    double rows = static_cast<double>(side.table->row_count());
+    if (side.candidates) return static_cast<double>(side.candidates->size());
+    if (side.predicate) return rows * estimate_selectivity(*side.table, *side.predicate);
+    return rows;
+}
+
+double index_probe_cost(const BoundJoinSide& probe, const BoundJoinSide& indexed) {
+    const ColumnIndex* index = indexed.table->get_index(indexed.column);
+    if (!index) return -1.0;
+    double rows = static_cast<double>(indexed.table->row_count());
+    double per_probe = index->kind() == IndexKind::Hash ? 1.0 : std::max(1.0, std::log2(rows));
+    double cost = estimated_rows(probe) * per_probe;
+    return cost < rows ? cost : -1.0;
+}
+
+bool is_presorted(const BoundJoinSide& side) {
+    if (!side.where) {
+        const ColumnIndex* index = side.table->get_index(side.column);
+        if (index && index->kind() == IndexKind::Ordered) return true;
+    }
+    return side.table->is_sorted_by(side.column);
+}
+
+JoinStrategy choose_strategy(const BoundJoinSide& left, const BoundJoinSide& right, bool& outer_is_left) {
+    double probe_right = index_probe_cost(left, right);
+    double probe_left = index_probe_cost(right, left);
+    outer_is_left = true;
+    if (probe_right >= 0.0 && (probe_left < 0.0 || probe_right <= probe_left)) return JoinStrategy::IndexNestedLoop;
+    if (probe_left >= 0.0) {
+        outer_is_left = false;
+        return JoinStrategy::IndexNestedLoop;
+    }
+    if (is_presorted(left) && is_presorted(right)) return JoinStrategy::SortMerge;
+    return JoinStrategy::Hash;
+}
+
+struct JoinEdge {
+    size_t left = 0;
+    size_t left_column = 0;
+    size_t right = 0;
+    size_t right_column = 0;
+    double distinct = 1.0;
+};
+
+struct JoinGraph {
+    std::vector<const Table*> tables;
+    std::vector<std::string> names;
+    std::vector<JoinEdge> edges;
+};
+
+bool bind_join_graph(const Database& db, const std::vector<JoinCondition>& conditions, JoinGraph& out) {
+    auto slot = [&](const std::string& name) -> std::optional<size_t> {
+        for (size_t i = 0; i < out.names.size(); i++) {
+            if (out.names[i] == name) return i;
+        }
+        const Table* table = db.get_table(name);
+        if (!table) return std::nullopt;
+        out.tables.push_back(table);
+        out.names.push_back(name);
+        return out.names.size() - 1;
+    };
+
+    for (const auto& c : conditions) {
+        auto l = slot(c.left_table);
+        auto r = slot(c.right_table);
+        if (!l || !r || *l == *r) return false;
+        auto lc = out.tables[*l]->get_column_index(c.left_column);
+        auto rc = out.tables[*r]->get_column_index(c.right_column);
+        if (!lc || !rc) return false;
+        if (out.tables[*l]->get_columns()[*lc].type != out.tables[*r]->get_columns()[*rc].type) return false;
+
+        JoinEdge e{ *l, *lc, *r, *rc, 1.0 };
+        size_t distinct = std::max(out.tables[*l]->estimate_distinct(*lc), out.tables[*r]->estimate_distinct(*rc));
+        e.distinct = std::max<double>(1.0, static_cast<double>(distinct));
+        out.edges.push_back(e);
+    }
+    return !out.edges.empty();
+}
+
+double table_rows(const JoinGraph& g, size_t t) {
+    return static_cast<double>(g.tables[t]->row_count());
+}
+
+bool plan_join_graph(const JoinGraph& g, JoinPlan& out) {
+    out.tables = g.names;
+    out.steps.clear();
+
+    size_t first_edge = 0;
+    double best = -1.0;
+    for (size_t e = 0; e < g.edges.size(); e++) {
+        const JoinEdge& edge = g.edges[e];
+        double est = table_rows(g, edge.left) * table_rows(g, edge.right) / edge.distinct;
+        if (best < 0.0 || est < best) {
+            best = est;
+            first_edge = e;
+        }
+    }
+    const JoinEdge& seed = g.edges[first_edge];
+    size_t start = table_rows(g, seed.right) < table_rows(g, seed.left) ? seed.right : seed.left;
+
+    std::vector<bool> joined(g.tables.size(), false);
+    joined[start] = true;
+    double current = table_rows(g, start);
+    out.steps.push_back(JoinStep{ start, first_edge, JoinStrategy::Hash, true, current });
+
+    for (size_t n = 1; n < g.tables.size(); n++) {
+        std::optional<JoinStep> chosen;
+        for (size_t t = 0; t < g.tables.size(); t++) {
+            if (joined[t]) continue;
+            double est = current * table_rows(g, t);
+            std::optional<size_t> key;
+            for (size_t e = 0; e < g.edges.size(); e++) {
+                const JoinEdge& edge = g.edges[e];
+                bool links = (edge.left == t && joined[edge.right]) || (edge.right == t && joined[edge.left]);
+                if (!links) continue;
+                est /= edge.distinct;
+                if (!key || edge.distinct > g.edges[*key].distinct) key = e;
+            }
+            if (!key) continue;
+            if (!chosen || est < chosen->estimated_rows) chosen = JoinStep{ t, *key, JoinStrategy::Hash, true, est };
+        }
+        if (!chosen) return false;
+
+        const JoinEdge& edge = g.edges[chosen->condition];
+        size_t inner_column = edge.left == chosen->table ? edge.left_column : edge.right_column;
+        double rows = table_rows(g, chosen->table);
+        const ColumnIndex* index = g.tables[chosen->table]->get_index(inner_column);
+        if (index) {
+            double per_probe = index->kind() == IndexKind::Hash ? 1.0 : std::max(1.0, std::log2(rows));
+            if (current * per_probe < rows) chosen->strategy = JoinStrategy::IndexNestedLoop;
+        }
+        chosen->build_inner = rows <= current;
+
+        joined[chosen->table] = true;
+        current = chosen->estimated_rows;
+        out.steps.push_back(*chosen);
+    }
+    return true;
+}
+
+void extend_join(const JoinGraph& g, const JoinStep& step,
+                 const std::vector<size_t>& position, size_t width,
+                 const std::vector<size_t>& tuples, std::vector<size_t>& out) {
+    const JoinEdge& key = g.edges[step.condition];
+    const bool inner_is_left = key.left == step.table;
+    const size_t inner_column = inner_is_left ? key.left_column : key.right_column;
+    const size_t outer = inner_is_left ? key.right : key.left;
+    const size_t outer_column = inner_is_left ? key.right_column : key.left_column;
+    const Table& inner = *g.tables[step.table];
+    const std::vector<Row>& inner_rows = inner.get_rows();
+    const std::vector<Row>& outer_rows = g.tables[outer]->get_rows();
+    const size_t count = width == 0 ? 0 : tuples.size() / width;
+
+    std::vector<const JoinEdge*> checks;
+    for (size_t e = 0; e < g.edges.size(); e++) {
+        const JoinEdge& edge = g.edges[e];
+        if (e == step.condition) continue;
+        if ((edge.left == step.table && position[edge.right] != none) ||
+            (edge.right == step.table && position[edge.left] != none)) {
+            checks.push_back(&edge);
+        }
+    }
+
+    auto outer_key = [&](size_t t) -> const Value& {
+        return outer_rows[tuples[t * width + position[outer]]].values[outer_column];
+    };
+    auto side_value = [&](size_t t, size_t r, size_t table, size_t column) -> const Value& {
+        size_t row = table == step.table ? r : tuples[t * width + position[table]];
+        return g.tables[table]->get_rows()[row].values[column];
+    };
+    size_t work = 0;
+    auto emit = [&](size_t t, size_t r) {
+        if (cancellation_due(++work)) return;
+        for (const JoinEdge* e : checks) {
+            if (side_value(t, r, e->left, e->left_column) != side_value(t, r, e->right, e->right_column)) return;
+        }
+        out.insert(out.end(), tuples.begin() + t * width, tuples.begin() + (t + 1) * width);
+        out.push_back(r);
+    };
+
+    if (step.strategy == JoinStrategy::IndexNestedLoop) {
+        const ColumnIndex* index = inner.get_index(inner_column);
+        for (size_t t = 0; t < count; t++) {
+            if (cancellation_due(work++)) return;
+            const std::vector<size_t>* hits = index->find(outer_key(t));
+            if (!hits) continue;
+            for (size_t r : *hits) emit(t, r);
+        }
+        return;
+    }
+
+    ChainedHash hash;
+    if (step.build_inner) {
+        hash.build(inner_rows.size(), inner_rows.size(),
+                   [](size_t i) { return i; },
+                   [&](size_t r) -> const Value& { return inner_rows[r].values[inner_column]; });
+        for (size_t t = 0; t < count; t++) {
+            if (cancellation_due(work++)) return;
+            for (size_t r = hash.first(outer_key(t)); r != none; r = hash.next[r]) emit(t, r);
+        }
+        return;
+    }
+
+    hash.build(count, count, [](size_t i) { return i; }, outer_key);
+    for (size_t r = 0; r < inner_rows.size(); r++) {
+        if (cancellation_due(work++)) return;
+        for (size_t t = hash.first(inner_rows[r].values[inner_column]); t != none; t = hash.next[t]) emit(t, r);
+    }
+}
+
+std::vector<std::string> condition_tables(const std::vector<JoinCondition>& conditions) {
+    std::vector<std::string> names;
+    for (const auto& c : conditions) {
+        names.push_back(c.left_table);
+        names.push_back(c.right_table);
+    }
+    return names;
+}
+
+bool materialize_join(const JoinResult& joined,
+                      const std::vector<std::string>& out_columns,
+                      std::vector<std::string>& out_headers,
+                      std::vector<std::vector<Value>>& out_rows) {
+    std::vector<JoinColumn> cols;
+    if (out_columns.empty()) {
+        cols = joined.all_columns();
+    } else {
+        for (const auto& name : out_columns) {
+            auto col = joined.resolve(name);
+            if (!col) return false;
+            cols.push_back(*col);
+        }
+    }
+    std::vector<ColumnType> types;
+    joined.materialize(cols, out_headers, types, out_rows);
+    return true;
+}
+
+}
+
+bool Database::join_rows(const std::string& left_table,
+                         const std::string& left_col,
+                         const std::string& right_table,
+                         const std::string& right_col,
+                         JoinResult& out) const {
+    return join_rows(JoinInput{ left_table, left_col, std::nullopt },
+                     JoinInput{ right_table, right_col, std::nullopt }, out);
+}
+
+bool Database::join_rows(const JoinInput& left_input, const JoinInput& right_input, JoinResult& out) const {
+    TableLocks held = lock_tables({ left_input.table, right_input.table }, {});
+    if (!join_rows_unlocked(left_input, right_input, out)) return false;
+    out.pin();
+    return true;
+}
+
+bool Database::join_rows_unlocked(const JoinInput& left_input, const JoinInput& right_input, JoinResult& out) const {
+    BoundJoinSide left, right;
+    if (!bind_join_side(*this, left_input, left) || !bind_join_side(*this, right_input, right)) return false;
+    if (left.table->get_columns()[left.column].type != right.table->get_columns()[right.column].type) return false;
+
+    out = JoinResult({ left.table, right.table }, { left_input.table, right_input.table });
+
+    bool outer_is_left = true;
+    JoinStrategy strategy = choose_strategy(left, right, outer_is_left);
+    out.set_strategy(strategy);
+    StageTimer timer(join_strategy_name(strategy));
+    if (timer.active()) timer.label(left_input.table + " " + right_input.table);
+    auto finish = [&](size_t rows_in) {
+        timer.rows(rows_in, out.size());
+        timer.bytes(out.size() * out.width() * sizeof(size_t));
+    };
+    if (strategy == JoinStrategy::IndexNestedLoop) {
+        BoundJoinSide& outer = outer_is_left ? left : right;
+        filter_side(outer);
+        index_join(outer, outer_is_left ? right : left, outer_is_left, out);
+        finish(outer.size());
+        return !cancellation_requested();
+    }
+
+    filter_side(left);
+    filter_side(right);
+    if (strategy == JoinStrategy::Hash) {
+        hash_join(left, right, out);
+        finish(left.size() + right.size());
+        return !cancellation_requested();
+    }
+
+    auto lsorted = presorted_row_ids(left);
+    auto rsorted = presorted_row_ids(right);
+    if (!lsorted) lsorted = sorted_row_ids(left);
+    if (!rsorted) rsorted = sorted_row_ids(right);
+    merge_join(left, *lsorted, right, *rsorted, out);
+    finish(left.size() + right.size());
+    return !cancellation_requested();
+}
+
+bool Database::inner_join(const std::string& left_table,
+                          const std::string& left_col,
+                          const std::string& right_table,
+                          const std::string& right_col,
+                          std::vector<std::string>& out_headers,
+                          std::vector<std::vector<Value>>& out_rows) const {
+    return inner_join(left_table, left_col, right_table, right_col, {}, out_headers, out_rows);
 }
 
 bool Database::inner_join(const std::string& left_table,
                           const std::string& left_col,
                           const std::string& right_table,
                           const std::string& right_col,
+                          const std::vector<std::string>& out_columns,
                           std::vector<std::string>& out_headers,
                           std::vector<std::vector<Value>>& out_rows) const {
     out_headers.clear();
     out_rows.clear();
 
-    const Table* lt = get_table(left_table);
-    const Table* rt = get_table(right_table);
-    if (!lt || !rt) return false;
+    TableLocks held = lock_tables({ left_table, right_table }, {});
+    JoinResult joined;
+    if (!join_rows_unlocked(JoinInput{ left_table, left_col, std::nullopt },
+                            JoinInput{ right_table, right_col, std::nullopt }, joined)) {
+        return false;
+    }
+    return materialize_join(joined, out_columns, out_headers, out_rows);
+}
 
-    auto lcols = lt->get_columns();
-    auto rcols = rt->get_columns();
+bool Database::plan_join(const std::vector<JoinCondition>& conditions, JoinPlan& out) const {
+    TableLocks held = lock_tables(condition_tables(conditions), {});
+    return plan_join_unlocked(conditions, out);
+}
 
-    auto li = find_index_by_name(lcols, left_col);
-    auto ri = find_index_by_name(rcols, right_col);
-    if (!li || !ri) return false;
+bool Database::plan_join_unlocked(const std::vector<JoinCondition>& conditions, JoinPlan& out) const {
+    if (conditions.size() == 1) {
+        const JoinCondition& c = conditions[0];
+        BoundJoinSide left, right;
+        if (!bind_join_side(*this, JoinInput{ c.left_table, c.left_column, std::nullopt }, left) ||
+            !bind_join_side(*this, JoinInput{ c.right_table, c.right_column, std::nullopt }, right)) {
+            return false;
+        }
+        if (left.table->get_columns()[left.column].type != right.table->get_columns()[right.column].type) return false;
 
-    if (lcols[*li].type != rcols[*ri].type) return false;
+        bool outer_is_left = true;
+        JoinStrategy strategy = choose_strategy(left, right, outer_is_left);
+        double distinct = static_cast<double>(std::max<size_t>(1, std::max(left.table->estimate_distinct(left.column),
+                                                                           right.table->estimate_distinct(right.column))));
+        double outer_rows = estimated_rows(outer_is_left ? left : right);
+        double joined = estimated_rows(left) * estimated_rows(right) / distinct;
+        out.tables = { c.left_table, c.right_table };
+        out.steps = { JoinStep{ outer_is_left ? size_t(0) : size_t(1), 0, JoinStrategy::Hash, true, outer_rows },
+                      JoinStep{ outer_is_left ? size_t(1) : size_t(0), 0, strategy, true, joined } };
+        return true;
+    }
 
-    out_headers.reserve(lcols.size() + rcols.size());
-    for (const auto& c : lcols) out_headers.push_back(left_table + "." + c.name);
-    for (const auto& c : rcols) out_headers.push_back(right_table + "." + c.name);
+    JoinGraph graph;
+    if (!bind_join_graph(*this, conditions, graph)) return false;
+    return plan_join_graph(graph, out);
+}
 
-    auto lrows = lt->select_all();
-    auto rrows = rt->select_all();
+bool Database::join_rows(const std::vector<JoinCondition>& conditions, JoinResult& out) const {
+    TableLocks held = lock_tables(condition_tables(conditions), {});
+    if (!join_rows_unlocked(conditions, out)) return false;
+    out.pin();
+    return true;
+}
 
-    for (const auto& lr : lrows) {
-        if (*li >= lr.values.size()) continue;
-        const Value& lv = lr.values[*li];
-        if (!value_matches_type(lv, lcols[*li].type)) continue;
+bool Database::join_rows_unlocked(const std::vector<JoinCondition>& conditions, JoinResult& out) const {
+    if (conditions.size() == 1) {
+        const JoinCondition& c = conditions[0];
+        return join_rows_unlocked(JoinInput{ c.left_table, c.left_column, std::nullopt },
+                                  JoinInput{ c.right_table, c.right_column, std::nullopt }, out);
+    }
 
-        for (const auto& rr : rrows) {
-            if (*ri >= rr.values.size()) continue;
-            const Value& rv = rr.values[*ri];
-            if (!value_matches_type(rv, rcols[*ri].type)) continue;
+    JoinGraph graph;
+    JoinPlan plan;
+    if (!bind_join_graph(*this, conditions, graph) || !plan_join_graph(graph, plan)) return false;
 
-            if (lv == rv) {
-                std::vector<Value> combined;
-                combined.reserve(lr.values.size() + rr.values.size());
-                combined.insert(combined.end(), lr.values.begin(), lr.values.end());
-                combined.insert(combined.end(), rr.values.begin(), rr.values.end());
-                out_rows.push_back(std::move(combined));
-            }
-        }
+    std::vector<size_t> position(graph.tables.size(), none);
+    position[plan.steps[0].table] = 0;
+    std::vector<size_t> tuples(graph.tables[plan.steps[0].table]->row_count());
+    std::iota(tuples.begin(), tuples.end(), 0);
+
+    std::vector<size_t> next;
+    for (size_t s = 1; s < plan.steps.size(); s++) {
+        StageTimer timer(join_strategy_name(plan.steps[s].strategy));
+        if (timer.active()) timer.label(graph.names[plan.steps[s].table]);
+        next.clear();
+        extend_join(graph, plan.steps[s], position, s, tuples, next);
+        timer.rows(tuples.size() / s, next.size() / (s + 1));
+        timer.bytes(next.capacity() * sizeof(size_t));
+        position[plan.steps[s].table] = s;
+        tuples.swap(next);
+        if (cancellation_requested()) return false;
+    }
+
+    const size_t width = plan.steps.size();
+    out = JoinResult(graph.tables, graph.names);
+    out.set_strategy(plan.steps.back().strategy);
+    out.reserve(tuples.size() / width);
+    std::vector<size_t> tuple(width);
+    for (size_t i = 0; i < tuples.size(); i += width) {
+        for (size_t t = 0; t < width; t++) tuple[t] = tuples[i + position[t]];
+        out.add(tuple);
     }
     return true;
 }
 
+bool Database::inner_join(const std::vector<JoinCondition>& conditions,
+                          const std::vector<std::string>& out_columns,
+                          std::vector<std::string>& out_headers,
+                          std::vector<std::vector<Value>>& out_rows) const {
+    out_headers.clear();
+    out_rows.clear();
+
+    TableLocks held = lock_tables(condition_tables(conditions), {});
+    JoinResult joined;
+    if (!join_rows_unlocked(conditions, joined)) return false;
+    return materialize_join(joined, out_columns, out_headers, out_rows);
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include "imdb/index.hpp"
+#include <algorithm>
+
+namespace imdb {
+
+const char* index_kind_name(IndexKind k) noexcept {
+    if (k == IndexKind::Hash) return "Hash";
+    if (k == IndexKind::Ordered) return "Ordered";
+    return "Unknown";
+}
+
+std::optional<IndexKind> parse_index_kind(const std::string& s) {
+    if (s == "HASH") return IndexKind::Hash;
+    if (s == "ORDERED" || s == "BTREE") return IndexKind::Ordered;
+    return std::nullopt;
+}
+
+ColumnIndex::ColumnIndex(IndexKind kind, size_t column) : index_kind(kind), column_index(column) {}
+
+std::vector<size_t>& ColumnIndex::postings(const Value& key) {
+    if (index_kind == IndexKind::Hash) return hashed[key];
+    return ordered[key];
+}
+
+void ColumnIndex::insert(const Value& key, size_t row) {
+    auto& ids = postings(key);
+    if (ids.empty() || ids.back() < row) ids.push_back(row);
+    else ids.insert(std::lower_bound(ids.begin(), ids.end(), row), row);
+}
+
+void ColumnIndex::erase(const Value& key, size_t row) {
+    auto& ids = postings(key);
+    auto pos = std::lower_bound(ids.begin(), ids.end(), row);
+    if (pos != ids.end() && *pos == row) ids.erase(pos);
+    if (!ids.empty()) return;
+    if (index_kind == IndexKind::Hash) hashed.erase(key);
+    else ordered.erase(key);
+}
+
+void ColumnIndex::rebuild(const std::vector<Row>& rows) {
+    ordered.clear();
+    hashed.clear();
+    if (index_kind == IndexKind::Hash) hashed.reserve(rows.size());
+    for (size_t r = 0; r < rows.size(); r++) postings(rows[r].values[column_index]).push_back(r);
+}
+
+const std::vector<size_t>* ColumnIndex::find(const Value& key) const {
+    if (index_kind == IndexKind::Hash) {
+        auto it = hashed.find(key);
+        return it == hashed.end() ? nullptr : &it->second;
+    }
+    auto it = ordered.find(key);
+    return it == ordered.end() ? nullptr : &it->second;
+}
+
+std::vector<size_t> ColumnIndex::sorted_row_ids() const {
+    std::vector<size_t> ids;
+    for (const auto& entry : ordered) ids.insert(ids.end(), entry.second.begin(), entry.second.end());
+    return ids;
+}
+
+}
\ No newline at end of file
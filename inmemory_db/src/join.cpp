@@ -0,0 +1,158 @@
+#include "imdb/join.hpp"
+#include "imdb/profile.hpp"
+#include "imdb/cancel.hpp"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+namespace imdb {
+
+const char* join_strategy_name(JoinStrategy s) noexcept {
+    switch (s) {
+        case JoinStrategy::Hash: return "HashJoin";
+        case JoinStrategy::SortMerge: return "SortMergeJoin";
+        case JoinStrategy::IndexNestedLoop: return "IndexNestedLoopJoin";
+    }
+    return "Unknown";
+}
+
+std::vector<std::string> describe_join_plan(const JoinPlan& plan, const std::vector<JoinCondition>& conditions) {
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < plan.steps.size(); i++) {
+        const JoinStep& step = plan.steps[i];
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1);
+        if (i == 0) {
+            out << "Scan " << plan.tables[step.table] << " est_rows=" << step.estimated_rows;
+            lines.push_back(out.str());
+            continue;
+        }
+        const JoinCondition& c = conditions[step.condition];
+        out << join_strategy_name(step.strategy) << " " << plan.tables[step.table]
+            << " ON " << c.left_table << "." << c.left_column << " = " << c.right_table << "." << c.right_column;
+        if (step.strategy == JoinStrategy::Hash) out << " build=" << (step.build_inner ? "inner" : "outer");
+        out << " est_rows=" << step.estimated_rows;
+        lines.push_back(out.str());
+    }
+    return lines;
+}
+
+JoinResult::JoinResult(std::vector<const Table*> sources, std::vector<std::string> names)
+    : tables(std::move(sources)), table_names(std::move(names)) {
+    table_columns.reserve(tables.size());
+    for (const Table* t : tables) table_columns.push_back(t->get_columns());
+}
+
+void JoinResult::pin() {
+    if (!pinned.empty()) return;
+    for (auto& t : tables) {
+        pinned.push_back(t->snapshot());
+        t = pinned.back().get();
+    }
+}
+
+void JoinResult::add(size_t left_row, size_t right_row) {
+    row_ids.push_back(left_row);
+    row_ids.push_back(right_row);
+}
+
+void JoinResult::add(const std::vector<size_t>& tuple) {
+    row_ids.insert(row_ids.end(), tuple.begin(), tuple.end());
+}
+
+void JoinResult::reorder(const std::vector<size_t>& order) {
+    const size_t w = tables.size();
+    std::vector<size_t> reordered;
+    reordered.reserve(order.size() * w);
+    for (size_t i : order) {
+        reordered.insert(reordered.end(), row_ids.begin() + i * w, row_ids.begin() + (i + 1) * w);
+    }
+    row_ids.swap(reordered);
+}
+
+std::optional<JoinColumn> JoinResult::resolve(const std::string& name) const {
+    size_t dot = name.find('.');
+    if (dot != std::string::npos) {
+        std::string table = name.substr(0, dot);
+        std::string column = name.substr(dot + 1);
+        for (size_t s = 0; s < tables.size(); s++) {
+            if (table_names[s] != table) continue;
+            for (size_t i = 0; i < table_columns[s].size(); i++) {
+                if (table_columns[s][i].name == column) return JoinColumn{ s, i };
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::optional<JoinColumn> found;
+    for (size_t s = 0; s < tables.size(); s++) {
+        for (size_t i = 0; i < table_columns[s].size(); i++) {
+            if (table_columns[s][i].name != name) continue;
+            if (found) return std::nullopt;
+            found = JoinColumn{ s, i };
+        }
+    }
+    return found;
+}
+
+std::vector<JoinColumn> JoinResult::all_columns() const {
+    std::vector<JoinColumn> cols;
+    for (size_t s = 0; s < tables.size(); s++) {
+        for (size_t i = 0; i < table_columns[s].size(); i++) cols.push_back({ s, i });
+    }
+    return cols;
+}
+
+std::string JoinResult::header(const JoinColumn& col) const {
+    return table_names[col.side] + "." + table_columns[col.side][col.index].name;
+}
+
+void JoinResult::materialize(const std::vector<JoinColumn>& cols,
+                             std::vector<std::string>& out_headers,
+                             std::vector<ColumnType>& out_types,
+                             std::vector<std::vector<Value>>& out_rows) const {
+    out_headers.clear();
+    out_types.clear();
+    out_rows.clear();
+    StageTimer timer("Materialize");
+    out_headers.reserve(cols.size());
+    out_types.reserve(cols.size());
+    for (const auto& c : cols) {
+        out_headers.push_back(header(c));
+        out_types.push_back(column_type(c));
+    }
+
+    out_rows.reserve(size());
+    for (size_t i = 0; i < size(); i++) {
+        if (cancellation_due(i)) return;
+        std::vector<Value> row;
+        row.reserve(cols.size());
+        for (const auto& c : cols) row.push_back(value(i, c));
+        out_rows.push_back(std::move(row));
+    }
+    timer.rows(size(), out_rows.size());
+    timer.bytes(out_rows.size() * cols.size() * sizeof(Value));
+}
+
+bool JoinResult::export_csv(const std::string& path, const std::vector<JoinColumn>& cols) const {
+    std::ofstream out(path);
+    if (!out.is_open()) return false;
+
+    for (size_t c = 0; c < cols.size(); c++) {
+        out << csv_escape(header(cols[c]));
+        if (c + 1 < cols.size()) out << ",";
+    }
+    out << "\n";
+
+    for (size_t i = 0; i < size(); i++) {
+        for (size_t c = 0; c < cols.size(); c++) {
+            out << csv_escape(value_to_string(value(i, cols[c])));
+            if (c + 1 < cols.size()) out << ",";
+        }
+        out << "\n";
+    }
+    return true;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,911 @@
+#include "imdb/plan.hpp"
+#include "imdb/profile.hpp"
+#include "imdb/pool.hpp"
+#include "imdb/cancel.hpp"
+#include "imdb/sort.hpp"
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include <utility>
+
+namespace imdb {
+
+const char* plan_node_name(PlanNode::Kind kind) noexcept {
+    switch (kind) {
+        case PlanNode::Kind::Scan: return "Scan";
+        case PlanNode::Kind::Join: return "Join";
+        case PlanNode::Kind::Filter: return "Filter";
+        case PlanNode::Kind::Aggregate: return "Aggregate";
+        case PlanNode::Kind::Sort: return "Sort";
+        case PlanNode::Kind::Limit: return "Limit";
+        case PlanNode::Kind::Project: return "Project";
+        case PlanNode::Kind::Insert: return "Insert";
+        case PlanNode::Kind::Update: return "Update";
+        case PlanNode::Kind::Delete: return "Delete";
+        case PlanNode::Kind::CreateTable: return "CreateTable";
+    }
+    return "?";
+}
+
+std::string describe_predicate(const Predicate& p) {
+    switch (p.kind) {
+        case Predicate::Kind::Compare: {
+            std::string rhs = p.parameter ? "?" + std::to_string(*p.parameter + 1) : value_to_string(p.value);
+            return p.column + " " + op_symbol(p.op) + " " + rhs;
+        }
+        case Predicate::Kind::Not:
+            return "NOT " + describe_predicate(p.children[0]);
+        case Predicate::Kind::And:
+        case Predicate::Kind::Or: {
+            std::string out = "(";
+            for (size_t i = 0; i < p.children.size(); i++) {
+                if (i > 0) out += p.kind == Predicate::Kind::And ? " AND " : " OR ";
+                out += describe_predicate(p.children[i]);
+            }
+            return out + ")";
+        }
+    }
+    return "";
+}
+
+namespace {
+
+std::optional<int64_t> parse_int(const std::string& s) {
+    try {
+        size_t p = 0;
+        long long v = std::stoll(s, &p);
+        if (p == s.size()) return static_cast<int64_t>(v);
+    } catch (...) {}
+    return std::nullopt;
+}
+
+Value coerce(const Value& v, ColumnType type) {
+    if (type == ColumnType::Int) {
+        if (const auto* s = std::get_if<std::string>(&v)) {
+            if (auto x = parse_int(*s)) return *x;
+        }
+    } else if (const auto* i = std::get_if<int64_t>(&v)) {
+        return std::to_string(*i);
+    }
+    return v;
+}
+
+std::pair<std::string, std::string> split_qualified(const std::string& name) {
+    size_t dot = name.find('.');
+    if (dot == std::string::npos) return { "", name };
+    return { name.substr(0, dot), name.substr(dot + 1) };
+}
+
+struct Scope {
+    std::vector<std::string> names;
+    std::vector<const Table*> tables;
+
+    bool resolve(const std::string& name, size_t& table, size_t& column, std::string& err) const {
+        auto [prefix, bare] = split_qualified(name);
+        bool found = false;
+        for (size_t t = 0; t < tables.size(); t++) {
+            if (!prefix.empty() && names[t] != prefix) continue;
+            auto idx = tables[t]->get_column_index(bare);
+            if (!idx) continue;
+            if (found) { err = "ambiguous column " + name; return false; }
+            found = true;
+            table = t;
+            column = *idx;
+        }
+        if (!found) err = "no such column";
+        return found;
+    }
+
+    ColumnType type(size_t table, size_t column) const { return tables[table]->get_columns()[column].type; }
+    std::string bare(size_t table, size_t column) const { return tables[table]->get_columns()[column].name; }
+    std::string qualified(size_t table, size_t column) const { return names[table] + "." + bare(table, column); }
+};
+
+bool bind_predicate(Predicate& p, const Scope& scope, bool qualify, std::vector<bool>& used, std::string& err) {
+    for (auto& child : p.children) {
+        if (!bind_predicate(child, scope, qualify, used, err)) return false;
+    }
+    if (p.kind != Predicate::Kind::Compare) return true;
+    size_t table = 0;
+    size_t column = 0;
+    if (!scope.resolve(p.column, table, column, err)) return false;
+    used[table] = true;
+    p.column = qualify ? scope.qualified(table, column) : scope.bare(table, column);
+    if (!p.parameter) p.value = coerce(p.value, scope.type(table, column));
+    return true;
+}
+
+bool bind_values(Predicate& p, const std::vector<Value>& params, std::string& err) {
+    for (auto& child : p.children) {
+        if (!bind_values(child, params, err)) return false;
+    }
+    if (p.kind != Predicate::Kind::Compare || !p.parameter) return true;
+    if (*p.parameter >= params.size()) { err = "missing parameter"; return false; }
+    p.value = params[*p.parameter];
+    p.parameter.reset();
+    return true;
+}
+
+bool bind_operand(Operand& o, ColumnType type, std::string& err) {
+    if (o.parameter) return true;
+    o.value = coerce(o.value, type);
+    if (value_matches_type(o.value, type)) return true;
+    err = "type mismatch";
+    return false;
+}
+
+PlanNode make_scan(const Table& table, const std::string& name, std::optional<Predicate> where) {
+    PlanNode scan;
+    scan.kind = PlanNode::Kind::Scan;
+    scan.table = name;
+    scan.catalog_version = table.catalog_version();
+    scan.access = where ? plan_access(table, *where) : plan_scan(table);
+    scan.where = std::move(where);
+    return scan;
+}
+
+bool compile_where(const Scope& scope, const std::optional<Predicate>& where, std::optional<Predicate>& out, std::string& err) {
+    if (!where) return true;
+    Predicate p = *where;
+    std::vector<bool> used(scope.tables.size(), false);
+    if (!bind_predicate(p, scope, false, used, err)) return false;
+    out = std::move(p);
+    return true;
+}
+
+bool compile_join(const Database& db, const SqlStatement& stmt, const Scope& scope, PlanNode& out, std::string& err) {
+    PlanNode join;
+    join.kind = PlanNode::Kind::Join;
+    join.columns = scope.names;
+    for (size_t j = 0; j < stmt.joins.size(); j++) {
+        const auto& sql = stmt.joins[j];
+        auto lhs = split_qualified(sql.left);
+        auto rhs = split_qualified(sql.right);
+        if (lhs.first == sql.table || (!rhs.first.empty() && rhs.first != sql.table)) std::swap(lhs, rhs);
+        if (lhs.first.empty()) {
+            lhs.first = scope.names[0];
+            for (size_t t = 0; t <= j; t++) {
+                if (scope.tables[t]->get_column_index(lhs.second)) { lhs.first = scope.names[t]; break; }
+            }
+        }
+        const Table* left = db.get_table(lhs.first);
+        if (!left || !left->get_column_index(lhs.second) || !scope.tables[j + 1]->get_column_index(rhs.second)) {
+            err = "no such column";
+            return false;
+        }
+        join.conditions.push_back(JoinCondition{ lhs.first, lhs.second, sql.table, rhs.second });
+    }
+
+    std::vector<Predicate> residual;
+    if (stmt.where) {
+        std::vector<Predicate> conjuncts;
+        if (stmt.where->kind == Predicate::Kind::And) conjuncts = stmt.where->children;
+        else conjuncts.push_back(*stmt.where);
+        if (join.conditions.size() == 1) join.side_filters.resize(2);
+        for (const auto& conjunct : conjuncts) {
+            Predicate qualified = conjunct;
+            std::vector<bool> used(scope.tables.size(), false);
+            if (!bind_predicate(qualified, scope, true, used, err)) return false;
+            if (join.side_filters.empty() || std::count(used.begin(), used.end(), true) != 1) {
+                residual.push_back(std::move(qualified));
+                continue;
+            }
+            Predicate bare = conjunct;
+            bind_predicate(bare, scope, false, used, err);
+            auto& filter = join.side_filters[used[0] ? 0 : 1];
+            if (filter) filter = Predicate::all_of({ std::move(*filter), std::move(bare) });
+            else filter = std::move(bare);
+        }
+    }
+
+    if (residual.empty()) {
+        out = std::move(join);
+        return true;
+    }
+    out = PlanNode{};
+    out.kind = PlanNode::Kind::Filter;
+    out.where = Predicate::all_of(std::move(residual));
+    out.children.push_back(std::move(join));
+    return true;
+}
+
+bool compile_select(const Database& db, const SqlStatement& stmt, PlanNode& out, std::string& err) {
+    Scope scope;
+    scope.names.push_back(stmt.table);
+    for (const auto& join : stmt.joins) scope.names.push_back(join.table);
+    for (const auto& name : scope.names) {
+        const Table* t = db.get_table(name);
+        if (!t) { err = "no such table"; return false; }
+        scope.tables.push_back(t);
+    }
+
+    PlanNode top;
+    if (stmt.joins.empty()) {
+        std::optional<Predicate> where;
+        if (!compile_where(scope, stmt.where, where, err)) return false;
+        top = make_scan(*scope.tables[0], stmt.table, std::move(where));
+    } else if (!compile_join(db, stmt, scope, top, err)) {
+        return false;
+    }
+
+    size_t table = 0;
+    size_t column = 0;
+    PlanNode project;
+    project.kind = PlanNode::Kind::Project;
+    bool has_aggregate = std::any_of(stmt.items.begin(), stmt.items.end(),
+                                     [](const SqlSelectItem& item) { return item.aggregate.has_value(); });
+    if (has_aggregate || !stmt.group_by.empty()) {
+        PlanNode agg;
+        agg.kind = PlanNode::Kind::Aggregate;
+        for (const auto& name : stmt.group_by) {
+            if (!scope.resolve(name, table, column, err)) return false;
+            agg.aggregate.group_by.push_back(name);
+        }
+        for (const auto& item : stmt.items) {
+            if (item.aggregate) {
+                if (!item.aggregate->column.empty() && !scope.resolve(item.aggregate->column, table, column, err)) return false;
+                project.output.push_back(agg.aggregate.group_by.size() + agg.aggregate.aggregates.size());
+                project.columns.push_back(aggregate_header(*item.aggregate));
+                agg.aggregate.aggregates.push_back(*item.aggregate);
+                continue;
+            }
+            auto g = std::find(stmt.group_by.begin(), stmt.group_by.end(), item.column);
+            if (g == stmt.group_by.end()) { err = "column must appear in GROUP BY"; return false; }
+            project.output.push_back(static_cast<size_t>(g - stmt.group_by.begin()));
+            project.columns.push_back(item.column);
+        }
+        agg.children.push_back(std::move(top));
+        top = std::move(agg);
+    } else {
+        for (const auto& item : stmt.items) {
+            if (item.column != "*") {
+                if (!scope.resolve(item.column, table, column, err)) return false;
+                project.columns.push_back(item.column);
+                continue;
+            }
+            for (size_t t = 0; t < scope.tables.size(); t++) {
+                for (size_t c = 0; c < scope.tables[t]->column_count(); c++) {
+                    project.columns.push_back(stmt.joins.empty() ? scope.bare(t, c) : scope.qualified(t, c));
+                }
+            }
+        }
+        if (stmt.order_by && !scope.resolve(*stmt.order_by, table, column, err)) return false;
+    }
+
+    if (stmt.order_by || stmt.limit) {
+        PlanNode order;
+        order.kind = stmt.order_by ? PlanNode::Kind::Sort : PlanNode::Kind::Limit;
+        if (stmt.order_by) order.columns.push_back(*stmt.order_by);
+        order.descending = stmt.descending;
+        order.limit = stmt.limit;
+        order.children.push_back(std::move(top));
+        top = std::move(order);
+    }
+    project.children.push_back(std::move(top));
+    out = std::move(project);
+    return true;
+}
+
+bool compile_insert(const Database& db, const SqlStatement& stmt, PlanNode& out, std::string& err) {
+    const Table* t = db.get_table(stmt.table);
+    if (!t) { err = "no such table"; return false; }
+    if (db.is_view(stmt.table)) { err = "cannot modify materialized view"; return false; }
+    auto cols = t->get_columns();
+    if (cols.empty()) { err = "define columns first"; return false; }
+    std::vector<size_t> targets;
+    if (stmt.columns.empty()) {
+        targets.resize(cols.size());
+        std::iota(targets.begin(), targets.end(), 0);
+    }
+    for (const auto& name : stmt.columns) {
+        auto idx = t->get_column_index(name);
+        if (!idx) { err = "no such column"; return false; }
+        targets.push_back(*idx);
+    }
+
+    out = PlanNode{};
+    out.kind = PlanNode::Kind::Insert;
+    out.table = stmt.table;
+    out.catalog_version = t->catalog_version();
+    for (const auto& row : stmt.values) {
+        if (row.size() != targets.size()) { err = "need " + std::to_string(targets.size()) + " values"; return false; }
+        std::vector<Operand> full(cols.size());
+        for (size_t i = 0; i < targets.size(); i++) {
+            full[targets[i]] = row[i];
+            if (!bind_operand(full[targets[i]], cols[targets[i]].type, err)) return false;
+        }
+        out.values.push_back(std::move(full));
+    }
+    return true;
+}
+
+bool compile_modify(const Database& db, const SqlStatement& stmt, PlanNode& out, std::string& err) {
+    const Table* t = db.get_table(stmt.table);
+    if (!t) { err = "no such table"; return false; }
+    if (db.is_view(stmt.table)) { err = "cannot modify materialized view"; return false; }
+    Scope scope{ { stmt.table }, { t } };
+    std::optional<Predicate> where;
+    if (!compile_where(scope, stmt.where, where, err)) return false;
+
+    out = PlanNode{};
+    out.kind = stmt.kind == SqlKind::Update ? PlanNode::Kind::Update : PlanNode::Kind::Delete;
+    out.table = stmt.table;
+    if (stmt.kind == SqlKind::Update) {
+        auto cols = t->get_columns();
+        out.values.emplace_back();
+        for (size_t i = 0; i < stmt.columns.size(); i++) {
+            auto idx = t->get_column_index(stmt.columns[i]);
+            if (!idx) { err = "no such column"; return false; }
+            Operand value = stmt.values[0][i];
+            if (!bind_operand(value, cols[*idx].type, err)) return false;
+            out.columns.push_back(stmt.columns[i]);
+            out.values[0].push_back(std::move(value));
+        }
+    }
+    out.children.push_back(make_scan(*t, stmt.table, std::move(where)));
+    return true;
+}
+
+bool compile_create(const Database& db, const SqlStatement& stmt, PlanNode& out, std::string& err) {
+    if (db.table_exists(stmt.table)) { err = "table exists"; return false; }
+    size_t keys = 0;
+    for (size_t i = 0; i < stmt.definitions.size(); i++) {
+        if (stmt.definitions[i].primary_key) keys++;
+        for (size_t j = 0; j < i; j++) {
+            if (stmt.definitions[j].name == stmt.definitions[i].name) { err = "duplicate column"; return false; }
+        }
+    }
+    if (keys > 1) { err = "multiple primary keys"; return false; }
+    out = PlanNode{};
+    out.kind = PlanNode::Kind::CreateTable;
+    out.table = stmt.table;
+    out.definitions = stmt.definitions;
+    return true;
+}
+
+constexpr size_t snapshot_min_rows = 4096;
+
+bool long_read(const PlanNode& node) {
+    if (node.kind == PlanNode::Kind::Join) return true;
+    if (node.kind == PlanNode::Kind::Scan && node.access.table_rows >= snapshot_min_rows &&
+        (node.access.method == AccessMethod::FullScan || node.access.method == AccessMethod::ZoneMapScan)) {
+        return true;
+    }
+    return std::any_of(node.children.begin(), node.children.end(), long_read);
+}
+
+struct Relation {
+    const Table* table = nullptr;
+    std::vector<size_t> ids;
+    std::optional<JoinResult> join;
+    bool materialized = false;
+    std::vector<std::string> headers;
+    std::vector<ColumnType> types;
+    std::vector<std::vector<Value>> rows;
+};
+
+template <typename TypeOf>
+std::vector<ColumnType> aggregate_types(const AggregateQuery& query, TypeOf type_of) {
+    std::vector<ColumnType> types;
+    for (const auto& name : query.group_by) types.push_back(type_of(name));
+    for (const auto& spec : query.aggregates) {
+        switch (spec.func) {
+            case AggregateFunc::Count:
+            case AggregateFunc::Sum: types.push_back(ColumnType::Int); break;
+            case AggregateFunc::Avg: types.push_back(ColumnType::Text); break;
+            case AggregateFunc::Min:
+            case AggregateFunc::Max: types.push_back(type_of(spec.column)); break;
+        }
+    }
+    return types;
+}
+
+std::optional<size_t> find_result_column(const std::vector<std::string>& headers, const std::string& name) {
+    std::optional<size_t> found;
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (headers[i] == name) return i;
+        size_t dot = headers[i].rfind('.');
+        if (dot != std::string::npos && headers[i].compare(dot + 1, std::string::npos, name) == 0) {
+            if (found) return std::nullopt;
+            found = i;
+        }
+    }
+    return found;
+}
+
+class Executor {
+public:
+    Executor(Database& db, const std::vector<Value>& params, std::string& err)
+        : db(db), params(params), err(err), threads(ThreadPool::shared().size()) {}
+
+    bool run(const PlanNode& node, Relation& out) {
+        if (cancellation_requested()) return fail(active_cancel_token()->reason());
+        if (!dispatch(node, out)) {
+            if (cancellation_requested()) err = active_cancel_token()->reason();
+            return false;
+        }
+        if (node.kind == PlanNode::Kind::Insert || node.kind == PlanNode::Kind::Update ||
+            node.kind == PlanNode::Kind::Delete || node.kind == PlanNode::Kind::CreateTable) {
+            return true;
+        }
+        if (cancellation_requested()) return fail(active_cancel_token()->reason());
+        return true;
+    }
+
+private:
+    bool dispatch(const PlanNode& node, Relation& out) {
+        switch (node.kind) {
+            case PlanNode::Kind::Scan: return scan(node, out);
+            case PlanNode::Kind::Join: return join(node, out);
+            case PlanNode::Kind::Filter: return filter(node, out);
+            case PlanNode::Kind::Aggregate: return aggregate(node, out);
+            case PlanNode::Kind::Sort: return sort(node, out);
+            case PlanNode::Kind::Limit: return limit(node, out);
+            case PlanNode::Kind::Project: return project(node, out);
+            case PlanNode::Kind::Insert: return insert(node, out);
+            case PlanNode::Kind::Update: return update(node, out);
+            case PlanNode::Kind::Delete: return remove(node, out);
+            case PlanNode::Kind::CreateTable: return create(node, out);
+        }
+        return false;
+    }
+
+    Database& db;
+    const std::vector<Value>& params;
+    std::string& err;
+    size_t threads;
+
+    bool fail(const std::string& message) {
+        err = message;
+        return false;
+    }
+
+    std::optional<Predicate> bound(const std::optional<Predicate>& where) {
+        if (!where) return std::nullopt;
+        Predicate p = *where;
+        if (!bind_values(p, params, err)) return std::nullopt;
+        return p;
+    }
+
+    bool operand(const Operand& o, Value& out) {
+        if (!o.parameter) { out = o.value; return true; }
+        if (*o.parameter >= params.size()) return fail("missing parameter");
+        out = params[*o.parameter];
+        return true;
+    }
+
+    bool scan(const PlanNode& node, Relation& out) {
+        const Table* t = db.get_table(node.table);
+        if (!t) return fail("no such table");
+        out = Relation{};
+        out.table = t;
+        if (!node.where) {
+            out.ids.resize(t->row_count());
+            std::iota(out.ids.begin(), out.ids.end(), 0);
+            return true;
+        }
+        auto evaluator = PredicateEvaluator::bind(*node.where, t->get_columns());
+        if (!evaluator) return fail("no such column");
+        AccessPlan access = node.access;
+        if (t->catalog_version() != node.catalog_version) access = plan_access(*t, *node.where);
+        if (evaluator->parameter_count() > 0 && !evaluator->bind_parameters(params)) return fail("missing parameter");
+        if (access.parameter) access.value = params[*access.parameter];
+        out.ids = t->find_rows(*evaluator, access);
+        return true;
+    }
+
+    bool join(const PlanNode& node, Relation& out) {
+        out = Relation{};
+        JoinResult joined;
+        bool ok = false;
+        if (node.side_filters.size() == 2 && (node.side_filters[0] || node.side_filters[1])) {
+            const auto& c = node.conditions[0];
+            size_t left = c.left_table == node.columns[0] ? 0 : 1;
+            JoinInput lhs{ c.left_table, c.left_column, bound(node.side_filters[left]) };
+            JoinInput rhs{ c.right_table, c.right_column, bound(node.side_filters[1 - left]) };
+            if (!err.empty()) return false;
+            ok = db.join_rows_unlocked(lhs, rhs, joined);
+        } else {
+            ok = db.join_rows_unlocked(node.conditions, joined);
+        }
+        if (!ok) return fail("cannot join");
+        out.join = std::move(joined);
+        return true;
+    }
+
+    bool filter(const PlanNode& node, Relation& out) {
+        if (!run(node.children[0], out)) return false;
+        if (!out.join) return fail("bad plan");
+        JoinResult& joined = *out.join;
+        std::vector<std::string> names;
+        std::vector<const Predicate*> stack{ &*node.where };
+        while (!stack.empty()) {
+            const Predicate* p = stack.back();
+            stack.pop_back();
+            for (const auto& child : p->children) stack.push_back(&child);
+            if (p->kind == Predicate::Kind::Compare && std::find(names.begin(), names.end(), p->column) == names.end()) {
+                names.push_back(p->column);
+            }
+        }
+        std::vector<JoinColumn> refs;
+        std::vector<Column> columns;
+        for (const auto& name : names) {
+            auto col = joined.resolve(name);
+            if (!col) return fail("no such column");
+            refs.push_back(*col);
+            columns.push_back(Column{ name, joined.column_type(*col) });
+        }
+        auto evaluator = PredicateEvaluator::bind(*node.where, columns);
+        if (!evaluator) return fail("no such column");
+        if (evaluator->parameter_count() > 0 && !evaluator->bind_parameters(params)) return fail("missing parameter");
+
+        StageTimer timer("Filter");
+        std::vector<size_t> keep;
+        std::vector<Row> batch;
+        std::vector<size_t> selected;
+        for (size_t begin = 0; begin < joined.size(); begin += PredicateEvaluator::batch_size) {
+            size_t end = std::min(joined.size(), begin + PredicateEvaluator::batch_size);
+            batch.resize(end - begin);
+            for (size_t i = begin; i < end; i++) {
+                auto& values = batch[i - begin].values;
+                values.clear();
+                for (const auto& ref : refs) values.push_back(joined.value(i, ref));
+            }
+            selected.clear();
+            evaluator->filter(batch, selected);
+            for (size_t s : selected) keep.push_back(begin + s);
+        }
+        timer.rows(joined.size(), keep.size());
+        joined.reorder(keep);
+        return true;
+    }
+
+    bool aggregate(const PlanNode& node, Relation& out) {
+        const PlanNode& child = node.children[0];
+        AggregateQuery query = node.aggregate;
+        std::vector<std::string> headers;
+        std::vector<std::vector<Value>> rows;
+        std::vector<ColumnType> types;
+        bool ok = false;
+        if (child.kind == PlanNode::Kind::Scan) {
+            const Table* t = db.get_table(child.table);
+            if (!t) return fail("no such table");
+            query.where = bound(child.where);
+            if (child.where && !query.where) return false;
+            ok = hash_aggregate(*t, query, headers, rows, threads);
+            auto cols = t->get_columns();
+            if (ok) types = aggregate_types(query, [&](const std::string& name) {
+                return cols[*t->get_column_index(name)].type;
+            });
+        } else {
+            if (!run(child, out)) return false;
+            ok = hash_aggregate(*out.join, query, headers, rows, threads);
+            if (ok) types = aggregate_types(query, [&](const std::string& name) {
+                return out.join->column_type(*out.join->resolve(name));
+            });
+        }
+        if (!ok) return fail("cannot aggregate");
+        out = Relation{};
+        out.materialized = true;
+        out.headers = std::move(headers);
+        out.types = std::move(types);
+        out.rows = std::move(rows);
+        return true;
+    }
+
+    bool sort(const PlanNode& node, Relation& out) {
+        if (!run(node.children[0], out)) return false;
+        const std::string& name = node.columns[0];
+        std::vector<const Value*> keys;
+        if (out.materialized) {
+            auto column = find_result_column(out.headers, name);
+            if (!column) return fail("no such column");
+            keys.reserve(out.rows.size());
+            for (const auto& row : out.rows) keys.push_back(&row[*column]);
+            auto order = order_by(keys, node.descending, node.limit, threads);
+            std::vector<std::vector<Value>> sorted;
+            sorted.reserve(order.size());
+            for (size_t i : order) sorted.push_back(std::move(out.rows[i]));
+            out.rows.swap(sorted);
+            return true;
+        }
+        if (out.join) {
+            auto col = out.join->resolve(name);
+            if (!col) return fail("no such column");
+            keys.reserve(out.join->size());
+            for (size_t i = 0; i < out.join->size(); i++) keys.push_back(&out.join->value(i, *col));
+            out.join->reorder(order_by(keys, node.descending, node.limit, threads));
+            return true;
+        }
+        auto column = out.table->get_column_index(split_qualified(name).second);
+        if (!column) return fail("no such column");
+        out.ids = order_rows(*out.table, out.ids, *column, node.descending, node.limit, threads);
+        return true;
+    }
+
+    bool limit(const PlanNode& node, Relation& out) {
+        if (!run(node.children[0], out)) return false;
+        size_t n = *node.limit;
+        if (out.materialized) {
+            if (n < out.rows.size()) out.rows.resize(n);
+        } else if (out.join) {
+            if (n < out.join->size()) {
+                std::vector<size_t> keep(n);
+                std::iota(keep.begin(), keep.end(), 0);
+                out.join->reorder(keep);
+            }
+        } else if (n < out.ids.size()) {
+            out.ids.resize(n);
+        }
+        return true;
+    }
+
+    bool project(const PlanNode& node, Relation& out) {
+        if (!run(node.children[0], out)) return false;
+        if (out.materialized) {
+            std::vector<size_t> picks = node.output;
+            if (picks.empty()) {
+                for (const auto& name : node.columns) {
+                    auto column = find_result_column(out.headers, name);
+                    if (!column) return fail("no such column");
+                    picks.push_back(*column);
+                }
+            }
+            StageTimer timer("Project");
+            timer.rows(out.rows.size(), out.rows.size());
+            std::vector<std::string> headers;
+            std::vector<ColumnType> types;
+            for (size_t i : picks) {
+                headers.push_back(out.headers[i]);
+                types.push_back(out.types[i]);
+            }
+            for (auto& row : out.rows) {
+                std::vector<Value> projected;
+                projected.reserve(picks.size());
+                for (size_t i : picks) projected.push_back(std::move(row[i]));
+                row.swap(projected);
+            }
+            out.headers = std::move(headers);
+            out.types = std::move(types);
+            return true;
+        }
+        if (out.join) {
+            std::vector<JoinColumn> cols;
+            for (const auto& name : node.columns) {
+                auto col = out.join->resolve(name);
+                if (!col) return fail("no such column");
+                cols.push_back(*col);
+            }
+            out.join->materialize(cols, out.headers, out.types, out.rows);
+            out.join.reset();
+            out.materialized = true;
+            return true;
+        }
+        std::vector<size_t> column_ids;
+        auto cols = out.table->get_columns();
+        out.types.clear();
+        for (const auto& name : node.columns) {
+            auto column = out.table->get_column_index(split_qualified(name).second);
+            if (!column) return fail("no such column");
+            column_ids.push_back(*column);
+            out.types.push_back(cols[*column].type);
+        }
+        auto rows = out.table->select_rows(out.ids, column_ids);
+        out.headers = node.columns;
+        out.rows.reserve(rows.size());
+        for (auto& row : rows) out.rows.push_back(std::move(row.values));
+        out.materialized = true;
+        return true;
+    }
+
+    bool insert(const PlanNode& node, Relation& out) {
+        Table* t = db.get_table(node.table);
+        if (!t) return fail("no such table");
+        if (t->catalog_version() != node.catalog_version) return fail("table changed since compile");
+        out = Relation{};
+        std::vector<std::vector<Value>> rows(node.values.size());
+        for (size_t r = 0; r < rows.size(); r++) {
+            rows[r].resize(node.values[r].size());
+            for (size_t i = 0; i < rows[r].size(); i++) {
+                if (!operand(node.values[r][i], rows[r][i])) return false;
+            }
+        }
+        if (!t->insert_rows(rows)) return fail("row rejected");
+        out.ids.resize(rows.size());
+        std::iota(out.ids.begin(), out.ids.end(), 0);
+        return true;
+    }
+
+    bool update(const PlanNode& node, Relation& out) {
+        if (!run(node.children[0], out)) return false;
+        Table* t = db.get_table(node.table);
+        std::vector<std::pair<size_t, Value>> assignments;
+        auto cols = t->get_columns();
+        for (size_t i = 0; i < node.columns.size(); i++) {
+            auto column = t->get_column_index(node.columns[i]);
+            if (!column) return fail("no such column");
+            Value v;
+            if (!operand(node.values[0][i], v)) return false;
+            if (!value_matches_type(v, cols[*column].type)) return fail("type mismatch");
+            assignments.emplace_back(*column, std::move(v));
+        }
+        size_t affected = 0;
+        if (!t->update_rows(out.ids, assignments, affected)) return fail("row rejected");
+        out.ids.resize(affected);
+        return true;
+    }
+
+    bool remove(const PlanNode& node, Relation& out) {
+        if (!run(node.children[0], out)) return false;
+        size_t deleted = db.get_table(node.table)->delete_rows(out.ids);
+        out.ids.resize(deleted);
+        return true;
+    }
+
+    bool create(const PlanNode& node, Relation& out) {
+        out = Relation{};
+        if (!db.create_table(node.table)) return fail("table exists");
+        TableWriter t = db.write_table(node.table);
+        for (const auto& def : node.definitions) t->add_column(def.name, def.type);
+        for (const auto& def : node.definitions) {
+            if (def.primary_key) t->set_primary_key(def.name);
+            if (def.not_null) t->set_not_null(def.name, true);
+        }
+        return true;
+    }
+};
+
+void describe_node(const Database& db, const PlanNode& node, size_t depth,
+                   std::vector<std::pair<size_t, std::string>>& out) {
+    std::ostringstream line;
+    auto join_names = [&](const std::vector<std::string>& names) {
+        for (size_t i = 0; i < names.size(); i++) line << (i ? ", " : "") << names[i];
+    };
+    switch (node.kind) {
+        case PlanNode::Kind::Scan: {
+            const Table* t = db.get_table(node.table);
+            AccessPlan access = node.access;
+            if (t && node.where && t->catalog_version() != node.catalog_version) access = plan_access(*t, *node.where);
+            line << node.table << ": " << describe_access(access);
+            break;
+        }
+        case PlanNode::Kind::Join:
+            line << "Join: ";
+            join_names(node.columns);
+            break;
+        case PlanNode::Kind::Filter:
+            line << "Filter: " << describe_predicate(*node.where);
+            break;
+        case PlanNode::Kind::Aggregate: {
+            line << "Aggregate: ";
+            if (!node.aggregate.group_by.empty()) {
+                line << "GROUP BY ";
+                join_names(node.aggregate.group_by);
+                line << "; ";
+            }
+            std::vector<std::string> aggs;
+            for (const auto& spec : node.aggregate.aggregates) aggs.push_back(aggregate_header(spec));
+            join_names(aggs);
+            break;
+        }
+        case PlanNode::Kind::Sort:
+            line << "Sort: " << node.columns[0] << (node.descending ? " DESC" : " ASC");
+            if (node.limit) line << " LIMIT " << *node.limit;
+            break;
+        case PlanNode::Kind::Limit:
+            line << "Limit: " << *node.limit;
+            break;
+        case PlanNode::Kind::Project:
+            line << "Project: ";
+            join_names(node.columns);
+            break;
+        case PlanNode::Kind::Insert:
+            line << "Insert: " << node.table << " rows=" << node.values.size();
+            break;
+        case PlanNode::Kind::Update:
+            line << "Update: " << node.table << " SET ";
+            join_names(node.columns);
+            break;
+        case PlanNode::Kind::Delete:
+            line << "Delete: " << node.table;
+            break;
+        case PlanNode::Kind::CreateTable:
+            line << "CreateTable: " << node.table << " (";
+            for (size_t i = 0; i < node.definitions.size(); i++) {
+                const auto& def = node.definitions[i];
+                line << (i ? ", " : "") << def.name << " " << type_name(def.type);
+                if (def.primary_key) line << " PRIMARY KEY";
+                if (def.not_null) line << " NOT NULL";
+            }
+            line << ")";
+            break;
+    }
+    out.emplace_back(depth, line.str());
+
+    if (node.kind == PlanNode::Kind::Join) {
+        JoinPlan plan;
+        if (db.plan_join_unlocked(node.conditions, plan)) {
+            auto steps = describe_join_plan(plan, node.conditions);
+            for (size_t i = 0; i < steps.size(); i++) out.emplace_back(depth + 1, std::to_string(i + 1) + ": " + steps[i]);
+        }
+        for (size_t i = 0; i < node.side_filters.size(); i++) {
+            const Table* t = db.get_table(node.columns[i]);
+            if (!t || !node.side_filters[i]) continue;
+            out.emplace_back(depth + 1, node.columns[i] + ": " + describe_access(plan_access(*t, *node.side_filters[i])));
+        }
+    }
+    for (const auto& child : node.children) describe_node(db, child, depth + 1, out);
+}
+
+}
+
+bool compile_sql(const Database& db, const SqlStatement& stmt, PlanNode& out, std::string& err) {
+    std::vector<std::string> names{ stmt.table };
+    for (const auto& join : stmt.joins) names.push_back(join.table);
+    TableLocks held = db.lock_tables(names, {});
+    return compile_sql_unlocked(db, stmt, out, err);
+}
+
+bool compile_sql_unlocked(const Database& db, const SqlStatement& stmt, PlanNode& out, std::string& err) {
+    switch (stmt.kind) {
+        case SqlKind::Select: return compile_select(db, stmt, out, err);
+        case SqlKind::Insert: return compile_insert(db, stmt, out, err);
+        case SqlKind::Update:
+        case SqlKind::Delete: return compile_modify(db, stmt, out, err);
+        case SqlKind::CreateTable: return compile_create(db, stmt, out, err);
+    }
+    return false;
+}
+
+bool execute_plan(Database& db, const PlanNode& plan, const std::vector<Value>& params,
+                  QueryResult& out, std::string& err) {
+    std::vector<std::string> writes;
+    if (plan.kind == PlanNode::Kind::Insert || plan.kind == PlanNode::Kind::Update ||
+        plan.kind == PlanNode::Kind::Delete) {
+        writes.push_back(plan.table);
+    }
+    if (writes.empty() && plan.kind != PlanNode::Kind::CreateTable && long_read(plan)) {
+        auto snapshot = db.snapshot(plan_tables(plan));
+        return execute_plan_unlocked(*snapshot, plan, params, out, err);
+    }
+    TableLocks held = db.lock_tables(plan_tables(plan), writes);
+    return execute_plan_unlocked(db, plan, params, out, err);
+}
+
+bool execute_plan_unlocked(Database& db, const PlanNode& plan, const std::vector<Value>& params,
+                           QueryResult& out, std::string& err) {
+    out = QueryResult{};
+    err.clear();
+    Relation rel;
+    Executor executor(db, params, err);
+    if (!executor.run(plan, rel)) {
+        out.affected = rel.ids.size();
+        return false;
+    }
+    out.headers = std::move(rel.headers);
+    out.types = std::move(rel.types);
+    out.rows = std::move(rel.rows);
+    out.affected = rel.materialized ? out.rows.size() : rel.ids.size();
+    return true;
+}
+
+std::vector<std::string> plan_tables(const PlanNode& plan) {
+    std::vector<std::string> names;
+    if (plan.kind == PlanNode::Kind::Join) names = plan.columns;
+    else if (!plan.table.empty()) names.push_back(plan.table);
+    for (const auto& child : plan.children) {
+        for (auto& name : plan_tables(child)) {
+            if (std::find(names.begin(), names.end(), name) == names.end()) names.push_back(std::move(name));
+        }
+    }
+    return names;
+}
+
+std::vector<std::pair<size_t, std::string>> describe_plan(const Database& db, const PlanNode& plan) {
+    std::vector<std::pair<size_t, std::string>> out;
+    TableLocks held = db.lock_tables(plan_tables(plan), {});
+    describe_node(db, plan, 0, out);
+    return out;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include "imdb/planner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <sstream>
+#include <iomanip>
+
+namespace imdb {
+
+const char* access_method_name(AccessMethod m) noexcept {
+    switch (m) {
+        case AccessMethod::FullScan: return "FullScan";
+        case AccessMethod::ZoneMapScan: return "ZoneMapScan";
+        case AccessMethod::HashIndex: return "HashIndex";
+        case AccessMethod::OrderedIndex: return "OrderedIndex";
+    }
+    return "Unknown";
+}
+
+static bool is_null(const Value& v) {
+    return std::holds_alternative<std::monostate>(v);
+}
+
+static double interpolate(const Value& lower, const Value& upper, const Value& v) {
+    auto lo = std::get_if<int64_t>(&lower);
+    auto hi = std::get_if<int64_t>(&upper);
+    auto x = std::get_if<int64_t>(&v);
+    if (!lo || !hi || !x) return 0.5;
+    if (*hi <= *lo) return 1.0;
+    double f = (static_cast<double>(*x) - static_cast<double>(*lo)) / (static_cast<double>(*hi) - static_cast<double>(*lo));
+    return std::clamp(f, 0.0, 1.0);
+}
+
+static double fraction_below(const ColumnStats& s, const Value& v) {
+    if (!(s.min() < v)) return 0.0;
+    if (s.max() < v) return 1.0;
+
+    const auto& buckets = s.histogram();
+    if (buckets.empty()) return interpolate(s.min(), s.max(), v);
+
+    size_t total = 0;
+    for (const auto& b : buckets) total += b.count;
+    double below = 0.0;
+    Value lower = s.min();
+    for (const auto& b : buckets) {
+        if (b.upper < v) {
+            below += static_cast<double>(b.count);
+            lower = b.upper;
+            continue;
+        }
+        below += static_cast<double>(b.count) * interpolate(lower, b.upper, v);
+        break;
+    }
+    return std::min(1.0, below / static_cast<double>(total));
+}
+
+static double leaf_selectivity(const Table& table, size_t column, CompareOp op, const Value& v) {
+    const ColumnStats& s = table.column_stats(column);
+    const size_t n = s.value_count() + s.null_count();
+    if (n == 0) return 0.0;
+    const double present = static_cast<double>(s.value_count()) / static_cast<double>(n);
+
+    double eq = 0.0;
+    if (!is_null(v) && s.value_count() > 0 && !(v < s.min()) && !(s.max() < v)) {
+        eq = present / static_cast<double>(std::max<size_t>(1, table.estimate_distinct(column)));
+    }
+    if (is_null(v)) eq = static_cast<double>(s.null_count()) / static_cast<double>(n);
+
+    switch (op) {
+        case CompareOp::Eq: return eq;
+        case CompareOp::Ne: return 1.0 - eq;
+        default: break;
+    }
+    if (is_null(v) || s.value_count() == 0) return 0.0;
+    double below = fraction_below(s, v) * present;
+    switch (op) {
+        case CompareOp::Lt: return below;
+        case CompareOp::Le: return std::min(present, below + eq);
+        case CompareOp::Gt: return std::max(0.0, present - below - eq);
+        case CompareOp::Ge: return std::max(0.0, present - below);
+        default: return 1.0;
+    }
+}
+
+static double parameter_selectivity(const Table& table, size_t column, CompareOp op) {
+    const ColumnStats& s = table.column_stats(column);
+    const size_t n = s.value_count() + s.null_count();
+    if (n == 0) return 0.0;
+    const double present = static_cast<double>(s.value_count()) / static_cast<double>(n);
+    const double eq = present / static_cast<double>(std::max<size_t>(1, table.estimate_distinct(column)));
+    if (op == CompareOp::Eq) return eq;
+    if (op == CompareOp::Ne) return 1.0 - eq;
+    return present / 3.0;
+}
+
+double estimate_selectivity(const Table& table, const Predicate& where) {
+    switch (where.kind) {
+        case Predicate::Kind::Compare: {
+            auto column = table.get_column_index(where.column);
+            if (!column) return 1.0;
+            if (where.parameter) return parameter_selectivity(table, *column, where.op);
+            return leaf_selectivity(table, *column, where.op, where.value);
+        }
+        case Predicate::Kind::And: {
+            double s = 1.0;
+            for (const auto& child : where.children) s *= estimate_selectivity(table, child);
+            return s;
+        }
+        case Predicate::Kind::Or: {
+            double miss = 1.0;
+            for (const auto& child : where.children) miss *= 1.0 - estimate_selectivity(table, child);
+            return 1.0 - miss;
+        }
+        case Predicate::Kind::Not:
+            if (where.children.empty()) return 1.0;
+            return 1.0 - estimate_selectivity(table, where.children[0]);
+    }
+    return 1.0;
+}
+
+AccessPlan plan_scan(const Table& table) {
+    AccessPlan plan;
+    plan.table_rows = table.row_count();
+    plan.estimated_rows = static_cast<double>(plan.table_rows);
+    plan.estimated_cost = static_cast<double>(plan.table_rows);
+    return plan;
+}
+
+static void consider_leaf(const Table& table, const Predicate& leaf, AccessPlan& best) {
+    if (leaf.kind != Predicate::Kind::Compare || leaf.op == CompareOp::Ne) return;
+    if (!leaf.parameter && is_null(leaf.value)) return;
+    auto column = table.get_column_index(leaf.column);
+    if (!column) return;
+
+    const double n = static_cast<double>(table.row_count());
+    const double fetched = n * (leaf.parameter ? parameter_selectivity(table, *column, leaf.op)
+                                               : leaf_selectivity(table, *column, leaf.op, leaf.value));
+    auto consider = [&](AccessMethod method, double cost) {
+        if (cost >= best.estimated_cost) return;
+        best.method = method;
+        best.column = leaf.column;
+        best.op = leaf.op;
+        best.value = leaf.value;
+        best.parameter = leaf.parameter;
+        best.estimated_cost = cost;
+    };
+
+    if (const ColumnIndex* index = table.get_index(*column)) {
+        if (index->kind() == IndexKind::Hash && leaf.op == CompareOp::Eq) consider(AccessMethod::HashIndex, 1.0 + fetched);
+        if (index->kind() == IndexKind::Ordered) consider(AccessMethod::OrderedIndex, std::log2(std::max(2.0, n)) + fetched);
+    }
+
+    if (leaf.parameter) return;
+    const ZoneMap& zones = table.zone_map(*column);
+    size_t matched = 0;
+    for (size_t z = 0; z < zones.zone_count(); z++) {
+        if (zones.may_match(z, leaf.op, leaf.value)) matched++;
+    }
+    if (matched < zones.zone_count()) {
+        double scanned = std::min(n, static_cast<double>(matched * ZoneMap::zone_rows));
+        consider(AccessMethod::ZoneMapScan, static_cast<double>(zones.zone_count()) + scanned);
+    }
+}
+
+AccessPlan plan_access(const Table& table, const Predicate& where) {
+    AccessPlan best = plan_scan(table);
+    best.selectivity = estimate_selectivity(table, where);
+    best.estimated_rows = static_cast<double>(best.table_rows) * best.selectivity;
+
+    if (where.kind == Predicate::Kind::And) {
+        for (const auto& child : where.children) consider_leaf(table, child, best);
+    } else {
+        consider_leaf(table, where, best);
+    }
+    return best;
+}
+
+std::vector<size_t> access_candidates(const Table& table, const AccessPlan& plan) {
+    std::vector<size_t> ids;
+    auto column = table.get_column_index(plan.column);
+    if (plan.method == AccessMethod::FullScan || !column) {
+        ids.resize(table.row_count());
+        std::iota(ids.begin(), ids.end(), 0);
+        return ids;
+    }
+
+    if (plan.method == AccessMethod::ZoneMapScan) {
+        const ZoneMap& zones = table.zone_map(*column);
+        for (size_t z = 0; z < zones.zone_count(); z++) {
+            if (!zones.may_match(z, plan.op, plan.value)) continue;
+            size_t end = std::min(table.row_count(), (z + 1) * ZoneMap::zone_rows);
+            for (size_t r = z * ZoneMap::zone_rows; r < end; r++) ids.push_back(r);
+        }
+        return ids;
+    }
+
+    const ColumnIndex* index = table.get_index(*column);
+    if (!index) return access_candidates(table, plan_scan(table));
+    if (plan.op == CompareOp::Eq) {
+        if (const std::vector<size_t>* hits = index->find(plan.value)) ids = *hits;
+        return ids;
+    }
+
+    const auto& entries = index->ordered_entries();
+    auto first = entries.begin();
+    auto last = entries.end();
+    switch (plan.op) {
+        case CompareOp::Lt: last = entries.lower_bound(plan.value); break;
+        case CompareOp::Le: last = entries.upper_bound(plan.value); break;
+        case CompareOp::Gt: first = entries.upper_bound(plan.value); break;
+        case CompareOp::Ge: first = entries.lower_bound(plan.value); break;
+        default: break;
+    }
+    for (auto it = first; it != last; ++it) ids.insert(ids.end(), it->second.begin(), it->second.end());
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+std::string describe_access(const AccessPlan& plan) {
+    std::ostringstream out;
+    out << access_method_name(plan.method);
+    if (plan.method != AccessMethod::FullScan) {
+        out << "(" << plan.column << " " << op_symbol(plan.op) << " "
+            << (plan.parameter ? "?" + std::to_string(*plan.parameter + 1) : value_to_string(plan.value)) << ")";
+    }
+    out << std::fixed << std::setprecision(2)
+        << " rows=" << plan.table_rows
+        << " selectivity=" << std::setprecision(4) << plan.selectivity
+        << " est_rows=" << std::setprecision(1) << plan.estimated_rows
+        << " cost=" << plan.estimated_cost;
+    return out.str();
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "imdb/pool.hpp"
+#include <algorithm>
+
+namespace imdb {
+
+static thread_local const ThreadPool* worker_of = nullptr;
+
+ThreadPool::ThreadPool(size_t count) {
+    start(std::max<size_t>(1, count));
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+    for (auto& queue : queues) {
+        for (auto& task : queue->tasks) run(task);
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(std::max<size_t>(1, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+void ThreadPool::start(size_t count) {
+    std::deque<Task> leftover;
+    {
+        std::unique_lock<std::shared_mutex> lock(layout);
+        std::vector<std::unique_ptr<Queue>> next;
+        for (size_t i = 0; i < std::max<size_t>(1, count - 1); i++) next.push_back(std::make_unique<Queue>());
+        for (auto& queue : queues) {
+            for (auto& task : queue->tasks) leftover.push_back(std::move(task));
+        }
+        for (size_t i = 0; i < leftover.size(); i++) next[i % next.size()]->tasks.push_back(std::move(leftover[i]));
+        queues.swap(next);
+        std::lock_guard<std::mutex> wake_lock(wake_mutex);
+        stopping = false;
+    }
+    for (size_t i = 0; i < queues.size(); i++) workers.emplace_back([this, i]() { work(i); });
+    threads.store(count, std::memory_order_release);
+}
+
+void ThreadPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+}
+
+bool ThreadPool::resize(size_t count) {
+    if (worker_of == this) return false;
+    std::lock_guard<std::mutex> lock(control);
+    count = std::max<size_t>(1, count);
+    if (count == size()) return true;
+    stop();
+    start(count);
+    return true;
+}
+
+void ThreadPool::run(Task& task) {
+    if (task.job) {
+        task.job();
+        return;
+    }
+    Batch& batch = *task.batch;
+    if (!batch.token || !batch.token->stop_requested()) {
+        CancelScope scope(batch.token);
+        (*batch.task)(task.index);
+    }
+    if (batch.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(batch.done_mutex);
+        batch.done.notify_all();
+    }
+}
+
+bool ThreadPool::take(size_t self, Task& out) {
+    std::shared_lock<std::shared_mutex> lock(layout);
+    size_t n = queues.size();
+    if (n == 0) return false;
+    if (self < n) {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> guard(own.guard);
+        if (!own.tasks.empty()) {
+            out = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued.fetch_sub(1, std::memory_order_acq_rel);
+            return true;
+        }
+    }
+    size_t first = self < n ? self + 1 : 0;
+    for (size_t k = 0; k < n; k++) {
+        Queue& victim = *queues[(first + k) % n];
+        std::lock_guard<std::mutex> guard(victim.guard);
+        auto it = victim.tasks.begin();
+        if (self >= n) {
+            while (it != victim.tasks.end() && it->job) ++it;
+        }
+        if (it == victim.tasks.end()) continue;
+        out = std::move(*it);
+        victim.tasks.erase(it);
+        queued.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::work(size_t self) {
+    worker_of = this;
+    Task task;
+    while (true) {
+        if (take(self, task)) {
+            run(task);
+            task = Task{};
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake.wait(lock, [&]() { return stopping || queued.load(std::memory_order_acquire) > 0; });
+        if (stopping) return;
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) return;
+    const CancelToken* token = active_cancel_token();
+    auto serial = [&]() {
+        for (size_t i = 0; i < count; i++) {
+            if (token && token->stop_requested()) return;
+            task(i);
+        }
+    };
+    if (count == 1 || size() == 1) {
+        serial();
+        return;
+    }
+
+    auto batch = std::make_shared<Batch>();
+    batch->task = &task;
+    batch->token = token;
+    batch->remaining.store(count, std::memory_order_release);
+    {
+        std::shared_lock<std::shared_mutex> lock(layout);
+        size_t n = queues.size();
+        if (n == 0) {
+            lock.unlock();
+            serial();
+            return;
+        }
+        for (size_t i = 1; i < count; i++) {
+            Queue& queue = *queues[i % n];
+            std::lock_guard<std::mutex> guard(queue.guard);
+            queue.tasks.push_back(Task{ batch, i, {} });
+        }
+        queued.fetch_add(count - 1, std::memory_order_acq_rel);
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+    }
+    wake.notify_all();
+
+    Task own{ batch, 0, {} };
+    run(own);
+    Task stolen;
+    while (batch->remaining.load(std::memory_order_acquire) > 0) {
+        if (take(static_cast<size_t>(-1), stolen)) {
+            run(stolen);
+            stolen = Task{};
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(batch->done_mutex);
+        batch->done.wait(lock, [&]() { return batch->remaining.load(std::memory_order_acquire) == 0; });
+    }
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+    {
+        std::shared_lock<std::shared_mutex> lock(layout);
+        Queue& queue = *queues[next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size()];
+        {
+            std::lock_guard<std::mutex> guard(queue.guard);
+            Task task;
+            task.job = std::move(job);
+            queue.tasks.push_back(std::move(task));
+        }
+        queued.fetch_add(1, std::memory_order_acq_rel);
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+    }
+    wake.notify_all();
+}
+
+size_t morsel_count(size_t rows, size_t morsel) {
+    return (rows + morsel - 1) / morsel;
+}
+
+}
\ No newline at end of file
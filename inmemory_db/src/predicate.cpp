@@ -0,0 +1,295 @@
+#include "imdb/predicate.hpp"
+#include "imdb/cancel.hpp"
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace imdb {
+
+Predicate Predicate::compare(const std::string& column, CompareOp op, const Value& value) {
+    Predicate p;
+    p.kind = Kind::Compare;
+    p.column = column;
+    p.op = op;
+    p.value = value;
+    return p;
+}
+
+Predicate Predicate::placeholder(const std::string& column, CompareOp op, size_t slot) {
+    Predicate p = compare(column, op, Value{});
+    p.parameter = slot;
+    return p;
+}
+
+Predicate Predicate::all_of(std::vector<Predicate> children) {
+    if (children.size() == 1) return std::move(children[0]);
+    Predicate p;
+    p.kind = Kind::And;
+    p.children = std::move(children);
+    return p;
+}
+
+Predicate Predicate::any_of(std::vector<Predicate> children) {
+    if (children.size() == 1) return std::move(children[0]);
+    Predicate p;
+    p.kind = Kind::Or;
+    p.children = std::move(children);
+    return p;
+}
+
+Predicate Predicate::negate(Predicate child) {
+    Predicate p;
+    p.kind = Kind::Not;
+    p.children.push_back(std::move(child));
+    return p;
+}
+
+const char* op_symbol(CompareOp op) noexcept {
+    switch (op) {
+        case CompareOp::Eq: return "=";
+        case CompareOp::Ne: return "!=";
+        case CompareOp::Lt: return "<";
+        case CompareOp::Le: return "<=";
+        case CompareOp::Gt: return ">";
+        case CompareOp::Ge: return ">=";
+    }
+    return "?";
+}
+
+std::optional<CompareOp> parse_compare_op(const std::string& s) {
+    if (s == "=" || s == "==") return CompareOp::Eq;
+    if (s == "!=" || s == "<>") return CompareOp::Ne;
+    if (s == "<") return CompareOp::Lt;
+    if (s == "<=") return CompareOp::Le;
+    if (s == ">") return CompareOp::Gt;
+    if (s == ">=") return CompareOp::Ge;
+    return std::nullopt;
+}
+
+template <typename T>
+static bool compare_ordered(const T& a, CompareOp op, const T& b) {
+    switch (op) {
+        case CompareOp::Eq: return a == b;
+        case CompareOp::Ne: return a != b;
+        case CompareOp::Lt: return a < b;
+        case CompareOp::Le: return a <= b;
+        case CompareOp::Gt: return a > b;
+        case CompareOp::Ge: return a >= b;
+    }
+    return false;
+}
+
+bool compare_values(const Value& lhs, CompareOp op, const Value& rhs) {
+    if (op == CompareOp::Eq) return lhs == rhs;
+    if (op == CompareOp::Ne) return lhs != rhs;
+    if (lhs.index() != rhs.index()) return false;
+    if (auto a = std::get_if<int64_t>(&lhs)) return compare_ordered(*a, op, std::get<int64_t>(rhs));
+    if (auto a = std::get_if<std::string>(&lhs)) return compare_ordered(*a, op, std::get<std::string>(rhs));
+    return false;
+}
+
+std::optional<PredicateEvaluator> PredicateEvaluator::bind(const Predicate& predicate,
+                                                           const std::vector<Column>& columns) {
+    PredicateEvaluator ev;
+    auto r = ev.bind_node(predicate, columns);
+    if (!r) return std::nullopt;
+    ev.root = *r;
+    return ev;
+}
+
+static double leaf_selectivity(CompareOp op) {
+    if (op == CompareOp::Eq) return 0.1;
+    if (op == CompareOp::Ne) return 0.9;
+    return 0.33;
+}
+
+std::optional<size_t> PredicateEvaluator::bind_node(const Predicate& p, const std::vector<Column>& columns) {
+    Node node;
+    node.kind = p.kind;
+
+    if (p.kind == Predicate::Kind::Compare) {
+        size_t i = 0;
+        while (i < columns.size() && columns[i].name != p.column) i++;
+        if (i == columns.size()) return std::nullopt;
+        node.column = i;
+        node.op = p.op;
+        node.value = p.value;
+        node.cost = columns[i].type == ColumnType::Int ? 1.0 : 2.0;
+        node.selectivity = leaf_selectivity(p.op);
+        if (p.parameter) parameters.emplace_back(nodes.size(), *p.parameter);
+    } else {
+        if (p.children.empty()) return std::nullopt;
+        if (p.kind == Predicate::Kind::Not && p.children.size() != 1) return std::nullopt;
+        for (const auto& child : p.children) {
+            auto c = bind_node(child, columns);
+            if (!c) return std::nullopt;
+            node.children.push_back(*c);
+        }
+        order_children(node);
+    }
+
+    nodes.push_back(std::move(node));
+    return nodes.size() - 1;
+}
+
+void PredicateEvaluator::order_children(Node& node) {
+    node.cost = 0.0;
+    for (size_t c : node.children) node.cost += nodes[c].cost;
+
+    if (node.kind == Predicate::Kind::Not) {
+        node.selectivity = 1.0 - nodes[node.children[0]].selectivity;
+        return;
+    }
+
+    if (node.kind == Predicate::Kind::And) {
+        std::stable_sort(node.children.begin(), node.children.end(), [&](size_t a, size_t b) {
+            return (1.0 - nodes[a].selectivity) / nodes[a].cost > (1.0 - nodes[b].selectivity) / nodes[b].cost;
+        });
+        node.selectivity = 1.0;
+        for (size_t c : node.children) node.selectivity *= nodes[c].selectivity;
+        return;
+    }
+
+    std::stable_sort(node.children.begin(), node.children.end(), [&](size_t a, size_t b) {
+        return nodes[a].selectivity / nodes[a].cost > nodes[b].selectivity / nodes[b].cost;
+    });
+    double miss = 1.0;
+    for (size_t c : node.children) miss *= 1.0 - nodes[c].selectivity;
+    node.selectivity = 1.0 - miss;
+}
+
+size_t PredicateEvaluator::parameter_count() const noexcept {
+    size_t count = 0;
+    for (const auto& [node, slot] : parameters) count = std::max(count, slot + 1);
+    return count;
+}
+
+bool PredicateEvaluator::bind_parameters(const std::vector<Value>& values) {
+    for (const auto& [node, slot] : parameters) {
+        if (slot >= values.size()) return false;
+        nodes[node].value = values[slot];
+    }
+    return true;
+}
+
+void PredicateEvaluator::filter(const std::vector<Row>& rows, std::vector<size_t>& out) const {
+    filter_range(rows, 0, rows.size(), out);
+}
+
+void PredicateEvaluator::filter_range(const std::vector<Row>& rows, size_t begin, size_t end,
+                                      std::vector<size_t>& out) const {
+    std::vector<size_t> selection;
+    selection.reserve(batch_size);
+    end = std::min(end, rows.size());
+    for (; begin < end; begin += batch_size) {
+        if (cancellation_requested()) return;
+        size_t batch_end = std::min(end, begin + batch_size);
+        selection.clear();
+        for (size_t r = begin; r < batch_end; r++) selection.push_back(r);
+        eval(root, rows, selection);
+        out.insert(out.end(), selection.begin(), selection.end());
+    }
+}
+
+void PredicateEvaluator::filter_batch(const std::vector<Row>& rows, std::vector<size_t>& selection) const {
+    eval(root, rows, selection);
+}
+
+template <typename Match>
+static void compact_selection(const std::vector<Row>& rows, size_t column,
+                              std::vector<size_t>& selection, Match match) {
+    size_t kept = 0;
+    for (size_t i = 0; i < selection.size(); i++) {
+        const auto& values = rows[selection[i]].values;
+        if (column < values.size() && match(values[column])) selection[kept++] = selection[i];
+    }
+    selection.resize(kept);
+}
+
+void PredicateEvaluator::eval_compare(const Node& node, const std::vector<Row>& rows,
+                                      std::vector<size_t>& selection) const {
+    const CompareOp op = node.op;
+    if (auto iv = std::get_if<int64_t>(&node.value)) {
+        const int64_t x = *iv;
+        if (op == CompareOp::Ne) {
+            compact_selection(rows, node.column, selection, [x](const Value& v) {
+                auto p = std::get_if<int64_t>(&v);
+                return !p || *p != x;
+            });
+            return;
+        }
+        compact_selection(rows, node.column, selection, [x, op](const Value& v) {
+            auto p = std::get_if<int64_t>(&v);
+            return p && compare_ordered(*p, op, x);
+        });
+        return;
+    }
+    if (auto sv = std::get_if<std::string>(&node.value)) {
+        const std::string& x = *sv;
+        if (op == CompareOp::Ne) {
+            compact_selection(rows, node.column, selection, [&x](const Value& v) {
+                auto p = std::get_if<std::string>(&v);
+                return !p || *p != x;
+            });
+            return;
+        }
+        compact_selection(rows, node.column, selection, [&x, op](const Value& v) {
+            auto p = std::get_if<std::string>(&v);
+            return p && compare_ordered(*p, op, x);
+        });
+        return;
+    }
+    compact_selection(rows, node.column, selection, [&node](const Value& v) {
+        return compare_values(v, node.op, node.value);
+    });
+}
+
+void PredicateEvaluator::eval(size_t index, const std::vector<Row>& rows, std::vector<size_t>& selection) const {
+    const Node& node = nodes[index];
+    if (selection.empty()) return;
+
+    switch (node.kind) {
+        case Predicate::Kind::Compare:
+            eval_compare(node, rows, selection);
+            return;
+        case Predicate::Kind::And:
+            for (size_t c : node.children) {
+                eval(c, rows, selection);
+                if (selection.empty()) return;
+            }
+            return;
+        case Predicate::Kind::Or: {
+            std::vector<size_t> remaining = selection;
+            std::vector<size_t> matched;
+            std::vector<size_t> hits;
+            std::vector<size_t> scratch;
+            for (size_t c : node.children) {
+                hits = remaining;
+                eval(c, rows, hits);
+                if (hits.empty()) continue;
+                scratch.clear();
+                std::merge(matched.begin(), matched.end(), hits.begin(), hits.end(), std::back_inserter(scratch));
+                matched.swap(scratch);
+                scratch.clear();
+                std::set_difference(remaining.begin(), remaining.end(), hits.begin(), hits.end(),
+                                    std::back_inserter(scratch));
+                remaining.swap(scratch);
+                if (remaining.empty()) break;
+            }
+            selection.swap(matched);
+            return;
+        }
+        case Predicate::Kind::Not: {
+            std::vector<size_t> hits = selection;
+            eval(node.children[0], rows, hits);
+            std::vector<size_t> kept;
+            kept.reserve(selection.size() - hits.size());
+            std::set_difference(selection.begin(), selection.end(), hits.begin(), hits.end(),
+                                std::back_inserter(kept));
+            selection.swap(kept);
+            return;
+        }
+    }
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "imdb/profile.hpp"
+#include <iomanip>
+
+namespace imdb {
+
+static thread_local QueryProfile* current_profile = nullptr;
+
+QueryProfile* active_profile() noexcept {
+    return current_profile;
+}
+
+ProfileScope::ProfileScope(QueryProfile& profile) : previous(current_profile) {
+    current_profile = &profile;
+}
+
+ProfileScope::~ProfileScope() {
+    current_profile = previous;
+}
+
+void QueryProfile::add_stage(StageProfile stage) {
+    stage.depth = depth;
+    stages.push_back(std::move(stage));
+}
+
+uint64_t QueryProfile::total_nanos() const {
+    uint64_t total = 0;
+    for (const auto& s : stages) {
+        if (s.depth == 0) total += s.nanos;
+    }
+    return total;
+}
+
+static double to_millis(uint64_t nanos) {
+    return static_cast<double>(nanos) / 1e6;
+}
+
+void QueryProfile::print(std::ostream& out) const {
+    out << "\n=== EXPLAIN ANALYZE ===\n";
+    const int wn = 32, wt = 10, wr = 10, wb = 12, ws = 12;
+
+    out << std::left << std::setw(wn) << "Stage" << std::right << " | "
+              << std::setw(wt) << "Time ms" << " | "
+              << std::setw(wr) << "Rows in" << " | "
+              << std::setw(wr) << "Rows out" << " | "
+              << std::setw(wb) << "Bytes" << " | "
+              << std::setw(ws) << "Rows skip" << " | "
+              << std::setw(ws) << "Zones skip" << "\n";
+
+    out << std::string(wn, '-') << "-+-"
+              << std::string(wt, '-') << "-+-"
+              << std::string(wr, '-') << "-+-"
+              << std::string(wr, '-') << "-+-"
+              << std::string(wb, '-') << "-+-"
+              << std::string(ws, '-') << "-+-"
+              << std::string(ws, '-') << "\n";
+
+    for (const auto& s : stages) {
+        out << std::left << std::setw(wn) << (std::string(s.depth * 2, ' ') + s.name) << std::right << " | "
+                  << std::setw(wt) << std::fixed << std::setprecision(3) << to_millis(s.nanos) << " | "
+                  << std::setw(wr) << s.rows_in << " | "
+                  << std::setw(wr) << s.rows_out << " | "
+                  << std::setw(wb) << s.bytes << " | "
+                  << std::setw(ws) << s.rows_skipped << " | "
+                  << std::setw(ws) << s.zones_skipped << "\n";
+    }
+    out << "Total: " << std::fixed << std::setprecision(3) << to_millis(total_nanos()) << " ms\n\n";
+    out.unsetf(std::ios::fixed);
+}
+
+StageTimer::StageTimer(const char* name) : profile(current_profile) {
+    if (!profile) return;
+    index = profile->stages.size();
+    StageProfile stage;
+    stage.name = name;
+    profile->add_stage(std::move(stage));
+    profile->depth++;
+    start = std::chrono::steady_clock::now();
+}
+
+StageTimer::~StageTimer() {
+    if (!profile) return;
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    profile->stages[index].nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    profile->depth--;
+}
+
+void StageTimer::label(const std::string& detail) {
+    if (profile) profile->stages[index].name += " " + detail;
+}
+
+void StageTimer::rows(size_t in, size_t out) {
+    if (!profile) return;
+    profile->stages[index].rows_in = in;
+    profile->stages[index].rows_out = out;
+}
+
+void StageTimer::bytes(size_t n) {
+    if (profile) profile->stages[index].bytes += n;
+}
+
+void StageTimer::skipped(size_t rows, size_t zones) {
+    if (!profile) return;
+    profile->stages[index].rows_skipped = rows;
+    profile->stages[index].zones_skipped = zones;
+}
+
+}
\ No newline at end of file
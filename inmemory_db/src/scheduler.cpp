@@ -0,0 +1,210 @@
+#include "imdb/scheduler.hpp"
+#include "imdb/cancel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <utility>
+
+namespace imdb {
+
+static size_t lane_of(QueryClass cls) noexcept {
+    return static_cast<size_t>(cls);
+}
+
+static size_t whole_rows(double rows) noexcept {
+    return static_cast<size_t>(std::max(0.0, rows));
+}
+
+static size_t materialized_bytes(double rows, size_t columns) noexcept {
+    return whole_rows(rows) * std::max<size_t>(1, columns) * sizeof(Value);
+}
+
+const char* query_class_name(QueryClass cls) noexcept {
+    return cls == QueryClass::Short ? "SHORT" : "LONG";
+}
+
+QueryCost estimate_cost(const Database& db, const PlanNode& plan) {
+    QueryCost cost;
+    double input = 0.0;
+    for (size_t i = 0; i < plan.children.size(); i++) {
+        QueryCost child = estimate_cost(db, plan.children[i]);
+        cost.work += child.work;
+        cost.bytes += child.bytes;
+        if (i == 0) input = child.rows;
+    }
+
+    switch (plan.kind) {
+        case PlanNode::Kind::Scan: {
+            const Table* t = db.get_table(plan.table);
+            cost.work += plan.access.estimated_cost;
+            cost.rows = plan.access.estimated_rows;
+            cost.bytes += whole_rows(cost.rows) * sizeof(size_t);
+            if (t) cost.bytes += materialized_bytes(cost.rows, t->column_count());
+            break;
+        }
+        case PlanNode::Kind::Join: {
+            std::vector<std::string> seen;
+            for (const auto& c : plan.conditions) {
+                for (const auto* name : { &c.left_table, &c.right_table }) {
+                    if (std::find(seen.begin(), seen.end(), *name) != seen.end()) continue;
+                    seen.push_back(*name);
+                    const Table* t = db.get_table(*name);
+                    double rows = t ? static_cast<double>(t->row_count()) : 0.0;
+                    cost.work += rows;
+                    cost.rows = std::max(cost.rows, rows);
+                    if (t) cost.bytes += materialized_bytes(rows, t->column_count());
+                }
+            }
+            cost.work += cost.rows;
+            break;
+        }
+        case PlanNode::Kind::Sort:
+            cost.work += input * std::log2(std::max(2.0, input));
+            cost.rows = plan.limit ? std::min(input, static_cast<double>(*plan.limit)) : input;
+            cost.bytes += whole_rows(input) * sizeof(size_t);
+            break;
+        case PlanNode::Kind::Limit:
+            cost.rows = plan.limit ? std::min(input, static_cast<double>(*plan.limit)) : input;
+            break;
+        case PlanNode::Kind::Project:
+            cost.rows = input;
+            cost.bytes += materialized_bytes(input, plan.columns.size());
+            break;
+        case PlanNode::Kind::Insert:
+            cost.rows = static_cast<double>(plan.values.size());
+            cost.work += cost.rows;
+            cost.bytes += materialized_bytes(cost.rows, plan.values.empty() ? 0 : plan.values[0].size());
+            break;
+        case PlanNode::Kind::Filter:
+        case PlanNode::Kind::Aggregate:
+        case PlanNode::Kind::Update:
+        case PlanNode::Kind::Delete:
+            cost.work += input;
+            cost.rows = input;
+            break;
+        case PlanNode::Kind::CreateTable:
+            break;
+    }
+    return cost;
+}
+
+Admission::Admission(Admission&& other) noexcept
+    : scheduler(std::exchange(other.scheduler, nullptr)), cls(other.cls), bytes(other.bytes), waited(other.waited) {}
+
+Admission& Admission::operator=(Admission&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    scheduler = std::exchange(other.scheduler, nullptr);
+    cls = other.cls;
+    bytes = other.bytes;
+    waited = other.waited;
+    return *this;
+}
+
+void Admission::release() noexcept {
+    if (!scheduler) return;
+    scheduler->finish(cls, bytes);
+    scheduler = nullptr;
+}
+
+QueryScheduler::QueryScheduler() {
+    size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+    lanes[lane_of(QueryClass::Short)].limits = ClassLimits{ std::max<size_t>(4, cores * 2), size_t(256) << 20 };
+    lanes[lane_of(QueryClass::Long)].limits = ClassLimits{ std::max<size_t>(1, cores / 2), size_t(1) << 30 };
+}
+
+QueryScheduler& QueryScheduler::shared() {
+    static QueryScheduler scheduler;
+    return scheduler;
+}
+
+QueryClass QueryScheduler::classify(const QueryCost& cost) noexcept {
+    return cost.work <= short_work_limit ? QueryClass::Short : QueryClass::Long;
+}
+
+bool QueryScheduler::can_start(QueryClass cls, uint64_t ticket, size_t bytes,
+                               std::chrono::steady_clock::time_point since) const {
+    const Lane& lane = lanes[lane_of(cls)];
+    if (lane.queue.front() != ticket) return false;
+    if (lane.stats.running >= lane.limits.max_running) return false;
+    if (lane.stats.running > 0 && lane.stats.memory + bytes > lane.limits.memory_budget) return false;
+    if (cls == QueryClass::Long && !lanes[lane_of(QueryClass::Short)].queue.empty() &&
+        std::chrono::steady_clock::now() - since < long_yield_limit) {
+        return false;
+    }
+    return true;
+}
+
+Admission QueryScheduler::admit(QueryClass cls, size_t bytes) {
+    auto since = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(guard);
+    Lane& lane = lanes[lane_of(cls)];
+    uint64_t ticket = next_ticket++;
+    lane.queue.push_back(ticket);
+    lane.stats.waiting++;
+
+    Admission admission;
+    admission.cls = cls;
+    while (!can_start(cls, ticket, bytes, since)) {
+        if (cancellation_requested()) {
+            lane.queue.erase(std::find(lane.queue.begin(), lane.queue.end(), ticket));
+            lane.stats.waiting--;
+            lane.stats.abandoned++;
+            changed.notify_all();
+            admission.waited = std::chrono::steady_clock::now() - since;
+            return admission;
+        }
+        auto wake = std::chrono::steady_clock::time_point::max();
+        if (const CancelToken* token = active_cancel_token()) wake = token->deadline_point();
+        if (cls == QueryClass::Long && !lanes[lane_of(QueryClass::Short)].queue.empty()) {
+            wake = std::min(wake, since + long_yield_limit);
+        }
+        if (wake == std::chrono::steady_clock::time_point::max()) changed.wait(lock);
+        else changed.wait_until(lock, wake);
+    }
+
+    lane.queue.pop_front();
+    lane.stats.waiting--;
+    lane.stats.running++;
+    lane.stats.memory += bytes;
+    lane.stats.admitted++;
+    admission.waited = std::chrono::steady_clock::now() - since;
+    uint64_t nanos = static_cast<uint64_t>(admission.waited.count());
+    lane.stats.wait_nanos += nanos;
+    lane.stats.max_wait_nanos = std::max(lane.stats.max_wait_nanos, nanos);
+    admission.scheduler = this;
+    admission.bytes = bytes;
+    changed.notify_all();
+    return admission;
+}
+
+void QueryScheduler::finish(QueryClass cls, size_t bytes) noexcept {
+    {
+        std::lock_guard<std::mutex> lock(guard);
+        Lane& lane = lanes[lane_of(cls)];
+        lane.stats.running--;
+        lane.stats.memory -= bytes;
+    }
+    changed.notify_all();
+}
+
+void QueryScheduler::set_limits(QueryClass cls, ClassLimits limits) {
+    {
+        std::lock_guard<std::mutex> lock(guard);
+        limits.max_running = std::max<size_t>(1, limits.max_running);
+        lanes[lane_of(cls)].limits = limits;
+    }
+    changed.notify_all();
+}
+
+ClassLimits QueryScheduler::limits(QueryClass cls) const {
+    std::lock_guard<std::mutex> lock(guard);
+    return lanes[lane_of(cls)].limits;
+}
+
+SchedulerStats QueryScheduler::stats(QueryClass cls) const {
+    std::lock_guard<std::mutex> lock(guard);
+    return lanes[lane_of(cls)].stats;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,359 @@
+#include "imdb/server.hpp"
+#include "imdb/pool.hpp"
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace imdb {
+
+static bool socket_address(const std::string& path, sockaddr_un& addr, std::string& err) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        err = "bad socket path: " + path;
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+static std::string system_error(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+std::string frame_response(const std::string& payload) {
+    std::string frame = std::to_string(payload.size());
+    frame.push_back('\n');
+    frame += payload;
+    return frame;
+}
+
+Server::Server(std::string socket_path, SessionFactory factory)
+    : socket_path(std::move(socket_path)), factory(std::move(factory)),
+      executor(std::make_unique<ThreadPool>(session_threads + 1)) {}
+
+Server::~Server() {
+    shutdown();
+}
+
+bool Server::listen(std::string& err) {
+    sockaddr_un addr;
+    if (!socket_address(socket_path, addr, err)) return false;
+
+    struct stat st;
+    if (::lstat(socket_path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            err = "path exists and is not a socket: " + socket_path;
+            return false;
+        }
+        ServerClient probe;
+        std::string ignored;
+        if (probe.connect(socket_path, ignored)) {
+            err = "socket in use: " + socket_path;
+            return false;
+        }
+        ::unlink(socket_path.c_str());
+    }
+
+    listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) { err = system_error("socket"); return false; }
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        err = system_error("bind " + socket_path);
+        shutdown();
+        return false;
+    }
+    if (::listen(listener, SOMAXCONN) < 0) { err = system_error("listen"); shutdown(); return false; }
+
+    poller = ::epoll_create1(EPOLL_CLOEXEC);
+    wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    finished = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (poller < 0 || wakeup < 0 || finished < 0) { err = system_error("epoll"); shutdown(); return false; }
+    for (int fd : { listener, wakeup, finished }) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (::epoll_ctl(poller, EPOLL_CTL_ADD, fd, &ev) < 0) { err = system_error("epoll_ctl"); shutdown(); return false; }
+    }
+    return true;
+}
+
+void Server::run() {
+    if (poller < 0) return;
+    epoll_event events[64];
+    bool stopping = false;
+    while (!stopping) {
+        int n = ::epoll_wait(poller, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wakeup) {
+                uint64_t count = 0;
+                while (::read(wakeup, &count, sizeof(count)) > 0) {}
+                stopping = true;
+                continue;
+            }
+            if (fd == finished) {
+                collect();
+                continue;
+            }
+            if (fd == listener) {
+                accept_clients();
+                continue;
+            }
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue;
+            service(*it->second, events[i].events);
+        }
+    }
+    shutdown();
+}
+
+void Server::stop() noexcept {
+    if (wakeup < 0) return;
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wakeup, &one, sizeof(one));
+    (void)ignored;
+}
+
+void Server::accept_clients() {
+    while (true) {
+        int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        auto client = std::make_unique<Client>();
+        client->fd = fd;
+        client->id = ++next_client;
+        client->session = factory();
+        client->interest = EPOLLIN;
+        epoll_event ev{};
+        ev.events = client->interest;
+        ev.data.fd = fd;
+        if (!client->session || ::epoll_ctl(poller, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            ::close(fd);
+            continue;
+        }
+        connections.emplace(fd, std::move(client));
+        clients.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Server::service(Client& client, uint32_t events) {
+    bool healthy = (events & EPOLLERR) == 0;
+    if (healthy && (events & (EPOLLIN | EPOLLHUP))) healthy = read_client(client);
+    if (client.busy && (events & EPOLLHUP)) healthy = false;
+    if (healthy) healthy = flush_client(client);
+    if (healthy) {
+        dispatch(client);
+        healthy = flush_client(client);
+    }
+    bool drained = client.written == client.output.size();
+    bool done = client.closing || (client.eof && client.input.find('\n') == std::string::npos);
+    if (!healthy || (drained && done && !client.busy)) {
+        close_client(client.fd);
+        return;
+    }
+    watch(client);
+}
+
+bool Server::read_client(Client& client) {
+    char chunk[65536];
+    while (!client.eof) {
+        ssize_t n = ::recv(client.fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            client.input.append(chunk, static_cast<size_t>(n));
+            if (static_cast<size_t>(n) < sizeof(chunk)) break;
+            continue;
+        }
+        if (n == 0) { client.eof = true; break; }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        return false;
+    }
+    return true;
+}
+
+void Server::dispatch(Client& client) {
+    if (client.busy || client.closing || client.output.size() - client.written >= max_pending_output) return;
+    size_t end = client.input.find('\n');
+    if (end == std::string::npos) {
+        if (client.input.size() > max_request_bytes) {
+            client.output += frame_response("ERR: request too long\n");
+            client.closing = true;
+        }
+        return;
+    }
+    std::string request = client.input.substr(0, end);
+    client.input.erase(0, end + 1);
+    if (!request.empty() && request.back() == '\r') request.pop_back();
+    client.busy = true;
+    {
+        std::lock_guard<std::mutex> lock(completion_mutex);
+        in_flight++;
+    }
+    executor->submit([this, fd = client.fd, id = client.id, session = client.session, request = std::move(request)]() {
+        Completion done{ fd, id, {}, true };
+        done.keep = session->handle(request, done.response);
+        std::lock_guard<std::mutex> lock(completion_mutex);
+        completions.push_back(std::move(done));
+        uint64_t one = 1;
+        ssize_t ignored = ::write(finished, &one, sizeof(one));
+        (void)ignored;
+        in_flight--;
+        idle.notify_all();
+    });
+}
+
+void Server::collect() {
+    uint64_t count = 0;
+    while (::read(finished, &count, sizeof(count)) > 0) {}
+    std::vector<Completion> done;
+    {
+        std::lock_guard<std::mutex> lock(completion_mutex);
+        done.swap(completions);
+    }
+    for (auto& completion : done) {
+        auto it = connections.find(completion.fd);
+        if (it == connections.end() || it->second->id != completion.id) continue;
+        Client& client = *it->second;
+        client.output += frame_response(completion.response);
+        client.busy = false;
+        if (!completion.keep) client.closing = true;
+        requests.fetch_add(1, std::memory_order_relaxed);
+        service(client, 0);
+    }
+}
+
+bool Server::flush_client(Client& client) {
+    while (client.written < client.output.size()) {
+        ssize_t n = ::send(client.fd, client.output.data() + client.written, client.output.size() - client.written, MSG_NOSIGNAL);
+        if (n > 0) { client.written += static_cast<size_t>(n); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return false;
+    }
+    if (client.written == client.output.size()) {
+        client.output.clear();
+        client.written = 0;
+    } else if (client.written > max_pending_output) {
+        client.output.erase(0, client.written);
+        client.written = 0;
+    }
+    return true;
+}
+
+void Server::watch(Client& client) {
+    uint32_t interest = 0;
+    bool backlog = client.output.size() - client.written >= max_pending_output || client.input.size() > max_request_bytes;
+    if (!client.eof && !client.closing && !backlog) interest |= EPOLLIN;
+    if (client.written < client.output.size()) interest |= EPOLLOUT;
+    if (interest == client.interest) return;
+    epoll_event ev{};
+    ev.events = interest;
+    ev.data.fd = client.fd;
+    if (::epoll_ctl(poller, EPOLL_CTL_MOD, client.fd, &ev) < 0) {
+        close_client(client.fd);
+        return;
+    }
+    client.interest = interest;
+}
+
+void Server::close_client(int fd) {
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+    ::epoll_ctl(poller, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    connections.erase(it);
+    clients.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Server::shutdown() {
+    {
+        std::unique_lock<std::mutex> lock(completion_mutex);
+        idle.wait(lock, [&]() { return in_flight == 0; });
+        completions.clear();
+    }
+    while (!connections.empty()) close_client(connections.begin()->first);
+    if (listener >= 0) {
+        ::close(listener);
+        listener = -1;
+        ::unlink(socket_path.c_str());
+    }
+    if (poller >= 0) { ::close(poller); poller = -1; }
+    if (wakeup >= 0) { ::close(wakeup); wakeup = -1; }
+    if (finished >= 0) { ::close(finished); finished = -1; }
+}
+
+ServerClient::~ServerClient() {
+    close();
+}
+
+bool ServerClient::connect(const std::string& socket_path, std::string& err) {
+    close();
+    sockaddr_un addr;
+    if (!socket_address(socket_path, addr, err)) return false;
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { err = system_error("socket"); return false; }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        err = system_error("connect " + socket_path);
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool ServerClient::send(const std::string& request) {
+    if (fd < 0) return false;
+    std::string line = request;
+    line.push_back('\n');
+    size_t sent = 0;
+    while (sent < line.size()) {
+        ssize_t n = ::send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) { sent += static_cast<size_t>(n); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        return false;
+    }
+    return true;
+}
+
+bool ServerClient::receive(std::string& response) {
+    if (fd < 0) return false;
+    char chunk[65536];
+    while (true) {
+        size_t header = buffer.find('\n');
+        if (header != std::string::npos) {
+            size_t length = 0;
+            for (size_t i = 0; i < header; i++) {
+                if (buffer[i] < '0' || buffer[i] > '9') return false;
+                length = length * 10 + static_cast<size_t>(buffer[i] - '0');
+            }
+            if (buffer.size() - header - 1 >= length) {
+                response = buffer.substr(header + 1, length);
+                buffer.erase(0, header + 1 + length);
+                return true;
+            }
+        }
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n > 0) { buffer.append(chunk, static_cast<size_t>(n)); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        return false;
+    }
+}
+
+void ServerClient::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    buffer.clear();
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "imdb/sort.hpp"
+#include "imdb/profile.hpp"
+#include "imdb/pool.hpp"
+#include "imdb/cancel.hpp"
+#include <algorithm>
+#include <numeric>
+#include <queue>
+
+namespace imdb {
+
+namespace {
+
+constexpr size_t min_rows_per_thread = 32768;
+constexpr size_t max_rows_per_run = 1 << 20;
+
+struct KeyLess {
+    const std::vector<const Value*>* keys;
+    bool descending;
+
+    bool operator()(size_t a, size_t b) const {
+        const Value& x = *(*keys)[a];
+        const Value& y = *(*keys)[b];
+        if (x == y) return a < b;
+        return descending ? y < x : x < y;
+    }
+};
+
+std::vector<size_t> top_k(const std::vector<const Value*>& keys, const KeyLess& less, size_t k) {
+    if (k == 0) return {};
+    std::priority_queue<size_t, std::vector<size_t>, KeyLess> heap(less);
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (cancellation_due(i)) break;
+        if (heap.size() < k) {
+            heap.push(i);
+        } else if (less(i, heap.top())) {
+            heap.pop();
+            heap.push(i);
+        }
+    }
+    std::vector<size_t> out(heap.size());
+    for (size_t i = out.size(); i > 0; i--) {
+        out[i - 1] = heap.top();
+        heap.pop();
+    }
+    return out;
+}
+
+void parallel_sort(std::vector<size_t>& order, const KeyLess& less, size_t threads) {
+    size_t parts = std::max<size_t>({ 1, std::min(threads, order.size() / min_rows_per_thread),
+                                      order.size() / max_rows_per_run });
+    if (parts == 1) {
+        std::sort(order.begin(), order.end(), less);
+        return;
+    }
+
+    std::vector<size_t> bounds(parts + 1);
+    for (size_t p = 0; p <= parts; p++) bounds[p] = order.size() * p / parts;
+
+    ThreadPool& pool = ThreadPool::shared();
+    pool.parallel_for(parts, [&](size_t p) {
+        std::sort(order.begin() + bounds[p], order.begin() + bounds[p + 1], less);
+    });
+
+    for (size_t width = 1; width < parts; width *= 2) {
+        if (cancellation_requested()) return;
+        size_t pairs = (parts - width + 2 * width - 1) / (2 * width);
+        pool.parallel_for(pairs, [&](size_t i) {
+            size_t p = i * 2 * width;
+            size_t first = bounds[p];
+            size_t middle = bounds[p + width];
+            size_t last = bounds[std::min(parts, p + 2 * width)];
+            std::inplace_merge(order.begin() + first, order.begin() + middle, order.begin() + last, less);
+        });
+    }
+}
+
+}
+
+std::vector<size_t> order_by(const std::vector<const Value*>& keys, bool descending,
+                             std::optional<size_t> limit, size_t threads) {
+    KeyLess less{ &keys, descending };
+    if (limit && *limit < keys.size()) {
+        StageTimer timer("TopK");
+        std::vector<size_t> out = top_k(keys, less, *limit);
+        timer.rows(keys.size(), out.size());
+        timer.bytes(2 * out.size() * sizeof(size_t));
+        return out;
+    }
+
+    StageTimer timer("Sort");
+    std::vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    parallel_sort(order, less, threads);
+    timer.rows(keys.size(), order.size());
+    timer.bytes(order.capacity() * sizeof(size_t));
+    return order;
+}
+
+std::vector<size_t> order_rows(const Table& table, const std::vector<size_t>& row_ids,
+                               size_t column, bool descending,
+                               std::optional<size_t> limit, size_t threads) {
+    const auto& rows = table.get_rows();
+    std::vector<const Value*> keys;
+    keys.reserve(row_ids.size());
+    for (size_t r : row_ids) keys.push_back(&rows[r].values[column]);
+
+    std::vector<size_t> order = order_by(keys, descending, limit, threads);
+    for (auto& i : order) i = row_ids[i];
+    return order;
+}
+
+}
\ No newline at end of file
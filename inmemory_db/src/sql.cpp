@@ -0,0 +1,419 @@
+#include "imdb/sql.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <utility>
+
+namespace imdb {
+
+static std::string upper(std::string s) {
+    for (auto& c : s) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    return s;
+}
+
+static bool is_word_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.';
+}
+
+bool lex_sql(const std::string& text, std::vector<SqlToken>& out, std::string& err) {
+    out.clear();
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (std::isspace(static_cast<unsigned char>(c))) { i++; continue; }
+        SqlToken token;
+        token.offset = i;
+        if (c == '\'' || c == '"') {
+            token.kind = SqlTokenKind::String;
+            i++;
+            bool closed = false;
+            while (i < text.size()) {
+                if (text[i] == c) {
+                    if (i + 1 < text.size() && text[i + 1] == c) {
+                        token.text.push_back(c);
+                        i += 2;
+                        continue;
+                    }
+                    closed = true;
+                    i++;
+                    break;
+                }
+                token.text.push_back(text[i++]);
+            }
+            if (!closed) { err = "unterminated string"; return false; }
+        } else if (std::isdigit(static_cast<unsigned char>(c))) {
+            token.kind = SqlTokenKind::Number;
+            while (i < text.size() && is_word_char(text[i])) token.text.push_back(text[i++]);
+        } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            token.kind = SqlTokenKind::Word;
+            while (i < text.size() && is_word_char(text[i])) token.text.push_back(text[i++]);
+        } else if (c == '?') {
+            token.kind = SqlTokenKind::Parameter;
+            token.text = "?";
+            i++;
+        } else {
+            token.kind = SqlTokenKind::Symbol;
+            std::string two = text.substr(i, 2);
+            if (two == "<=" || two == ">=" || two == "!=" || two == "<>" || two == "==") {
+                token.text = two;
+                i += 2;
+            } else if (std::string("(),*=<>;-").find(c) != std::string::npos) {
+                token.text = std::string(1, c);
+                i++;
+            } else {
+                err = "unexpected character '" + std::string(1, c) + "'";
+                return false;
+            }
+        }
+        out.push_back(std::move(token));
+    }
+    SqlToken end;
+    end.offset = text.size();
+    out.push_back(std::move(end));
+    return true;
+}
+
+namespace {
+
+const char* const keywords[] = {
+    "SELECT", "FROM", "WHERE", "JOIN", "INNER", "ON", "GROUP", "BY", "ORDER", "ASC", "DESC", "LIMIT",
+    "INSERT", "INTO", "VALUES", "UPDATE", "SET", "DELETE", "CREATE", "TABLE", "PRIMARY", "KEY",
+    "NOT", "NULL", "AND", "OR"
+};
+
+bool is_keyword(const std::string& word) {
+    std::string u = upper(word);
+    return std::any_of(std::begin(keywords), std::end(keywords), [&](const char* k) { return u == k; });
+}
+
+class SqlParser {
+public:
+    SqlParser(const std::vector<SqlToken>& tokens, std::string& err) : tokens(tokens), err(err) {}
+
+    bool parse(SqlStatement& out) {
+        bool ok = false;
+        if (at_keyword("SELECT")) ok = parse_select(out);
+        else if (at_keyword("INSERT")) ok = parse_insert(out);
+        else if (at_keyword("UPDATE")) ok = parse_update(out);
+        else if (at_keyword("DELETE")) ok = parse_delete(out);
+        else if (at_keyword("CREATE")) ok = parse_create(out);
+        else return fail("expected SELECT, INSERT, UPDATE, DELETE or CREATE");
+        if (!ok) return false;
+        accept_symbol(";");
+        if (peek().kind != SqlTokenKind::End) return fail("unexpected token");
+        out.parameter_count = parameters;
+        return true;
+    }
+
+private:
+    const std::vector<SqlToken>& tokens;
+    std::string& err;
+    size_t pos = 0;
+    size_t parameters = 0;
+
+    const SqlToken& peek(size_t ahead = 0) const { return tokens[std::min(pos + ahead, tokens.size() - 1)]; }
+
+    bool at_keyword(const char* word, size_t ahead = 0) const {
+        const auto& t = peek(ahead);
+        return t.kind == SqlTokenKind::Word && upper(t.text) == word;
+    }
+
+    bool at_symbol(const char* s) const {
+        const auto& t = peek();
+        return t.kind == SqlTokenKind::Symbol && t.text == s;
+    }
+
+    bool accept_keyword(const char* word) {
+        if (!at_keyword(word)) return false;
+        pos++;
+        return true;
+    }
+
+    bool accept_symbol(const char* s) {
+        if (!at_symbol(s)) return false;
+        pos++;
+        return true;
+    }
+
+    bool fail(const std::string& message) {
+        const auto& t = peek();
+        if (t.kind == SqlTokenKind::End) err = message + " at end of statement";
+        else err = message + " near '" + t.text + "'";
+        return false;
+    }
+
+    bool expect_keyword(const char* word) {
+        if (accept_keyword(word)) return true;
+        return fail(std::string("expected ") + word);
+    }
+
+    bool expect_symbol(const char* s) {
+        if (accept_symbol(s)) return true;
+        return fail(std::string("expected '") + s + "'");
+    }
+
+    bool parse_name(std::string& out) {
+        const auto& t = peek();
+        if ((t.kind == SqlTokenKind::Word && !is_keyword(t.text)) || t.kind == SqlTokenKind::String) {
+            out = t.text;
+            pos++;
+            return true;
+        }
+        return fail("expected name");
+    }
+
+    bool parse_names(std::vector<std::string>& out) {
+        do {
+            out.emplace_back();
+            if (!parse_name(out.back())) return false;
+        } while (accept_symbol(","));
+        return true;
+    }
+
+    bool parse_operand(Operand& out) {
+        const auto& t = peek();
+        out = Operand{};
+        if (t.kind == SqlTokenKind::Parameter) {
+            out.parameter = parameters++;
+        } else if (t.kind == SqlTokenKind::String || t.kind == SqlTokenKind::Number) {
+            out.value = t.text;
+        } else if (t.kind == SqlTokenKind::Symbol && t.text == "-" && peek(1).kind == SqlTokenKind::Number) {
+            pos++;
+            out.value = "-" + peek().text;
+        } else if (t.kind == SqlTokenKind::Word && upper(t.text) == "NULL") {
+            out.value = std::monostate{};
+        } else if (t.kind == SqlTokenKind::Word && !is_keyword(t.text)) {
+            out.value = t.text;
+        } else {
+            return fail("expected value");
+        }
+        pos++;
+        return true;
+    }
+
+    bool parse_or(Predicate& out) {
+        std::vector<Predicate> terms(1);
+        if (!parse_and(terms[0])) return false;
+        while (accept_keyword("OR")) {
+            terms.emplace_back();
+            if (!parse_and(terms.back())) return false;
+        }
+        out = Predicate::any_of(std::move(terms));
+        return true;
+    }
+
+    bool parse_and(Predicate& out) {
+        std::vector<Predicate> terms(1);
+        if (!parse_unary(terms[0])) return false;
+        while (accept_keyword("AND")) {
+            terms.emplace_back();
+            if (!parse_unary(terms.back())) return false;
+        }
+        out = Predicate::all_of(std::move(terms));
+        return true;
+    }
+
+    bool parse_unary(Predicate& out) {
+        if (accept_keyword("NOT")) {
+            Predicate child;
+            if (!parse_unary(child)) return false;
+            out = Predicate::negate(std::move(child));
+            return true;
+        }
+        if (accept_symbol("(")) {
+            if (!parse_or(out)) return false;
+            return expect_symbol(")");
+        }
+        std::string column;
+        if (!parse_name(column)) return false;
+        auto op = peek().kind == SqlTokenKind::Symbol ? parse_compare_op(peek().text) : std::nullopt;
+        if (!op) return fail("expected comparison");
+        pos++;
+        Operand operand;
+        if (!parse_operand(operand)) return false;
+        if (operand.parameter) out = Predicate::placeholder(column, *op, *operand.parameter);
+        else out = Predicate::compare(column, *op, operand.value);
+        return true;
+    }
+
+    bool parse_where(SqlStatement& out) {
+        if (!accept_keyword("WHERE")) return true;
+        Predicate where;
+        if (!parse_or(where)) return false;
+        out.where = std::move(where);
+        return true;
+    }
+
+    bool parse_item(SqlSelectItem& out) {
+        if (accept_symbol("*")) {
+            out.column = "*";
+            return true;
+        }
+        if (peek().kind == SqlTokenKind::Word && peek(1).kind == SqlTokenKind::Symbol && peek(1).text == "(") {
+            auto func = parse_aggregate_func(upper(peek().text));
+            if (!func) return fail("unknown function");
+            pos += 2;
+            AggregateSpec spec;
+            spec.func = *func;
+            if (accept_symbol("*")) {
+                if (*func != AggregateFunc::Count) return fail("only COUNT accepts *");
+            } else if (!parse_name(spec.column)) {
+                return false;
+            }
+            out.aggregate = spec;
+            return expect_symbol(")");
+        }
+        return parse_name(out.column);
+    }
+
+    bool parse_select(SqlStatement& out) {
+        out.kind = SqlKind::Select;
+        pos++;
+        do {
+            out.items.emplace_back();
+            if (!parse_item(out.items.back())) return false;
+        } while (accept_symbol(","));
+        if (!expect_keyword("FROM") || !parse_name(out.table)) return false;
+        while (at_keyword("JOIN") || at_keyword("INNER")) {
+            accept_keyword("INNER");
+            SqlJoin join;
+            if (!expect_keyword("JOIN") || !parse_name(join.table) || !expect_keyword("ON") ||
+                !parse_name(join.left) || !expect_symbol("=") || !parse_name(join.right)) {
+                return false;
+            }
+            out.joins.push_back(std::move(join));
+        }
+        if (!parse_where(out)) return false;
+        if (accept_keyword("GROUP")) {
+            if (!expect_keyword("BY") || !parse_names(out.group_by)) return false;
+        }
+        if (accept_keyword("ORDER")) {
+            std::string column;
+            if (!expect_keyword("BY") || !parse_name(column)) return false;
+            out.order_by = column;
+            if (accept_keyword("DESC")) out.descending = true;
+            else accept_keyword("ASC");
+        }
+        if (accept_keyword("LIMIT")) {
+            const auto& t = peek();
+            const char* end = t.text.data() + t.text.size();
+            size_t limit = 0;
+            auto parsed = std::from_chars(t.text.data(), end, limit);
+            if (t.kind != SqlTokenKind::Number || parsed.ec != std::errc{} || parsed.ptr != end) return fail("bad LIMIT");
+            out.limit = limit;
+            pos++;
+        }
+        return true;
+    }
+
+    bool parse_insert(SqlStatement& out) {
+        out.kind = SqlKind::Insert;
+        pos++;
+        if (!expect_keyword("INTO") || !parse_name(out.table)) return false;
+        if (accept_symbol("(")) {
+            if (!parse_names(out.columns) || !expect_symbol(")")) return false;
+        }
+        if (!expect_keyword("VALUES")) return false;
+        do {
+            if (!expect_symbol("(")) return false;
+            out.values.emplace_back();
+            do {
+                out.values.back().emplace_back();
+                if (!parse_operand(out.values.back().back())) return false;
+            } while (accept_symbol(","));
+            if (!expect_symbol(")")) return false;
+        } while (accept_symbol(","));
+        return true;
+    }
+
+    bool parse_update(SqlStatement& out) {
+        out.kind = SqlKind::Update;
+        pos++;
+        if (!parse_name(out.table) || !expect_keyword("SET")) return false;
+        out.values.emplace_back();
+        do {
+            out.columns.emplace_back();
+            out.values[0].emplace_back();
+            if (!parse_name(out.columns.back()) || !expect_symbol("=") || !parse_operand(out.values[0].back())) {
+                return false;
+            }
+        } while (accept_symbol(","));
+        return parse_where(out);
+    }
+
+    bool parse_delete(SqlStatement& out) {
+        out.kind = SqlKind::Delete;
+        pos++;
+        if (!expect_keyword("FROM") || !parse_name(out.table)) return false;
+        return parse_where(out);
+    }
+
+    bool parse_create(SqlStatement& out) {
+        out.kind = SqlKind::CreateTable;
+        pos++;
+        if (!expect_keyword("TABLE") || !parse_name(out.table) || !expect_symbol("(")) return false;
+        do {
+            SqlColumnDef def;
+            if (!parse_name(def.name)) return false;
+            std::string type = peek().kind == SqlTokenKind::Word ? upper(peek().text) : "";
+            if (type == "INT" || type == "INTEGER" || type == "BIGINT") def.type = ColumnType::Int;
+            else if (type == "TEXT" || type == "VARCHAR" || type == "STRING") def.type = ColumnType::Text;
+            else return fail("unknown type");
+            pos++;
+            if (accept_symbol("(")) {
+                if (peek().kind != SqlTokenKind::Number) return fail("expected length");
+                pos++;
+                if (!expect_symbol(")")) return false;
+            }
+            while (true) {
+                if (accept_keyword("PRIMARY")) {
+                    if (!expect_keyword("KEY")) return false;
+                    def.primary_key = true;
+                } else if (accept_keyword("NOT")) {
+                    if (!expect_keyword("NULL")) return false;
+                    def.not_null = true;
+                } else {
+                    break;
+                }
+            }
+            out.definitions.push_back(std::move(def));
+        } while (accept_symbol(","));
+        return expect_symbol(")");
+    }
+};
+
+}
+
+bool parse_sql(const std::string& text, SqlStatement& out, std::string& err) {
+    std::vector<SqlToken> tokens;
+    if (!lex_sql(text, tokens, err)) return false;
+    out = SqlStatement{};
+    SqlParser parser(tokens, err);
+    return parser.parse(out);
+}
+
+std::string normalize_sql(const std::string& text) {
+    std::vector<SqlToken> tokens;
+    std::string err;
+    if (!lex_sql(text, tokens, err)) return text;
+    std::string out;
+    for (const auto& t : tokens) {
+        if (t.kind == SqlTokenKind::End) break;
+        if (!out.empty()) out.push_back(' ');
+        if (t.kind == SqlTokenKind::Word && is_keyword(t.text)) {
+            out += upper(t.text);
+        } else if (t.kind == SqlTokenKind::String) {
+            out.push_back('\'');
+            for (char c : t.text) {
+                if (c == '\'') out.push_back(c);
+                out.push_back(c);
+            }
+            out.push_back('\'');
+        } else {
+            out += t.text;
+        }
+    }
+    return out;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "imdb/statement.hpp"
+#include "imdb/cancel.hpp"
+#include <numeric>
+#include <utility>
+
+namespace imdb {
+
+std::optional<PreparedStatement> PreparedStatement::prepare(Database& db, StatementSpec spec) {
+    PreparedStatement stmt;
+    stmt.db = &db;
+    stmt.spec = std::move(spec);
+    TableLocks held = db.lock_tables({ stmt.spec.table }, {});
+    if (!stmt.bind()) return std::nullopt;
+    return stmt;
+}
+
+std::optional<ColumnType> PreparedStatement::parameter_type(size_t slot) const {
+    if (slot >= parameter_types.size()) return std::nullopt;
+    return parameter_types[slot];
+}
+
+bool PreparedStatement::bind_operand(const Operand& operand, ColumnType type) {
+    if (!operand.parameter) return value_matches_type(operand.value, type);
+    size_t slot = *operand.parameter;
+    if (parameter_types.size() <= slot) parameter_types.resize(slot + 1);
+    parameter_types[slot] = type;
+    return true;
+}
+
+void PreparedStatement::collect_parameters(const Predicate& p, const std::vector<Column>& cols) {
+    for (const auto& child : p.children) collect_parameters(child, cols);
+    if (p.kind != Predicate::Kind::Compare || !p.parameter) return;
+    for (const auto& c : cols) {
+        if (c.name == p.column) bind_operand(Operand{ Value{}, p.parameter }, c.type);
+    }
+}
+
+bool PreparedStatement::bind() {
+    table = db->get_table(spec.table);
+    if (!table) return false;
+    if (spec.kind != StatementKind::Select && db->is_view(spec.table)) return false;
+    version = table->catalog_version();
+    column_ids.clear();
+    headers.clear();
+    types.clear();
+    parameter_types.clear();
+    where.reset();
+
+    const auto cols = table->get_columns();
+    switch (spec.kind) {
+        case StatementKind::Select:
+            if (spec.columns.empty()) {
+                for (size_t i = 0; i < cols.size(); i++) {
+                    column_ids.push_back(i);
+                    headers.push_back(cols[i].name);
+                    types.push_back(cols[i].type);
+                }
+            }
+            for (const auto& name : spec.columns) {
+                auto idx = table->get_column_index(name);
+                if (!idx) return false;
+                column_ids.push_back(*idx);
+                headers.push_back(name);
+                types.push_back(cols[*idx].type);
+            }
+            break;
+        case StatementKind::Insert:
+            if (spec.where || spec.values.size() != cols.size()) return false;
+            for (size_t i = 0; i < cols.size(); i++) {
+                if (!bind_operand(spec.values[i], cols[i].type)) return false;
+            }
+            break;
+        case StatementKind::Update: {
+            auto idx = table->get_column_index(spec.update_column);
+            if (!idx || spec.values.size() != 1) return false;
+            update_column = *idx;
+            if (!bind_operand(spec.values[0], cols[update_column].type)) return false;
+            break;
+        }
+        case StatementKind::Delete:
+            break;
+    }
+
+    if (spec.where) {
+        where = PredicateEvaluator::bind(*spec.where, cols);
+        if (!where) return false;
+        collect_parameters(*spec.where, cols);
+        plan = plan_access(*table, *spec.where);
+    } else {
+        plan = plan_scan(*table);
+    }
+
+    for (const auto& type : parameter_types) {
+        if (!type) return false;
+    }
+    return true;
+}
+
+bool PreparedStatement::refresh() {
+    if (db->get_table(spec.table) == table && table->catalog_version() == version) return true;
+    return bind();
+}
+
+bool PreparedStatement::execute(const std::vector<Value>& params, StatementResult& out) {
+    std::vector<std::string> names{ spec.table };
+    TableLocks held = spec.kind == StatementKind::Select ? db->lock_tables(names, {}) : db->lock_tables({}, names);
+    if (!refresh()) return false;
+    if (params.size() != parameter_types.size()) return false;
+    for (size_t i = 0; i < params.size(); i++) {
+        if (!value_matches_type(params[i], *parameter_types[i])) return false;
+    }
+
+    out = StatementResult{};
+    auto operand = [&](const Operand& o) -> const Value& { return o.parameter ? params[*o.parameter] : o.value; };
+
+    if (spec.kind == StatementKind::Insert) {
+        std::vector<Value> values;
+        values.reserve(spec.values.size());
+        for (const auto& o : spec.values) values.push_back(operand(o));
+        if (!table->insert_row(values)) return false;
+        out.affected = 1;
+        return true;
+    }
+
+    std::vector<size_t> ids;
+    if (where) {
+        where->bind_parameters(params);
+        if (plan.parameter) plan.value = params[*plan.parameter];
+        ids = table->find_rows(*where, plan);
+    } else {
+        ids.resize(table->row_count());
+        std::iota(ids.begin(), ids.end(), 0);
+    }
+    if (cancellation_requested()) return false;
+
+    switch (spec.kind) {
+        case StatementKind::Select:
+            out.headers = headers;
+            out.types = types;
+            out.rows = table->select_rows(ids, column_ids);
+            out.affected = out.rows.size();
+            break;
+        case StatementKind::Update:
+            out.affected = table->update_rows(ids, update_column, operand(spec.values[0]));
+            break;
+        case StatementKind::Delete:
+            out.affected = table->delete_rows(ids);
+            break;
+        case StatementKind::Insert:
+            break;
+    }
+    return true;
+}
+
+}
\ No newline at end of file
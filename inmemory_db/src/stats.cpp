@@ -0,0 +1,159 @@
+#include "imdb/stats.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace imdb {
+
+static uint64_t mix_hash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void HyperLogLog::add(const Value& v) {
+    uint64_t h = mix_hash(static_cast<uint64_t>(std::hash<Value>{}(v)));
+    size_t slot = static_cast<size_t>(h >> (64 - precision));
+    uint64_t rest = (h << precision) | (uint64_t(1) << (precision - 1));
+    uint8_t rank = static_cast<uint8_t>(std::countl_zero(rest) + 1);
+    registers[slot] = std::max(registers[slot], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    for (size_t i = 0; i < register_count; i++) registers[i] = std::max(registers[i], other.registers[i]);
+}
+
+double HyperLogLog::estimate() const {
+    const double m = static_cast<double>(register_count);
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (uint8_t r : registers) {
+        sum += std::ldexp(1.0, -static_cast<int>(r));
+        if (r == 0) zeros++;
+    }
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double raw = alpha * m * m / sum;
+    if (raw <= 2.5 * m && zeros > 0) return m * std::log(m / static_cast<double>(zeros));
+    return raw;
+}
+
+static std::vector<HistogramBucket>::iterator bucket_of(std::vector<HistogramBucket>& buckets, const Value& v) {
+    return std::lower_bound(buckets.begin(), buckets.end(), v,
+                            [](const HistogramBucket& b, const Value& x) { return b.upper < x; });
+}
+
+void ColumnStats::add(const Value& v) {
+    changes++;
+    if (std::holds_alternative<std::monostate>(v)) {
+        nulls++;
+        return;
+    }
+    values++;
+    sketch.add(v);
+    if (std::holds_alternative<std::monostate>(min_value) || v < min_value) min_value = v;
+    if (std::holds_alternative<std::monostate>(max_value) || max_value < v) max_value = v;
+    if (buckets.empty()) return;
+    auto bucket = bucket_of(buckets, v);
+    if (bucket == buckets.end()) {
+        bucket = std::prev(buckets.end());
+        bucket->upper = v;
+    }
+    bucket->count++;
+}
+
+void ColumnStats::remove(const Value& v) {
+    changes++;
+    if (std::holds_alternative<std::monostate>(v)) {
+        if (nulls > 0) nulls--;
+        return;
+    }
+    if (values > 0) values--;
+    if (values == 0) {
+        min_value = Value{};
+        max_value = Value{};
+        sketch.clear();
+        buckets.clear();
+        return;
+    }
+    auto bucket = bucket_of(buckets, v);
+    if (bucket != buckets.end() && bucket->count > 0) bucket->count--;
+}
+
+bool ColumnStats::stale(size_t rows) const noexcept {
+    return changes > std::max(refresh_floor, rows / 4);
+}
+
+void ColumnStats::rebuild(const std::vector<Row>& rows, size_t column) {
+    *this = ColumnStats{};
+    std::vector<Value> sorted;
+    sorted.reserve(rows.size());
+    for (const auto& row : rows) {
+        add(row.values[column]);
+        if (!std::holds_alternative<std::monostate>(row.values[column])) sorted.push_back(row.values[column]);
+    }
+    changes = 0;
+    if (sorted.empty()) return;
+
+    std::sort(sorted.begin(), sorted.end());
+    const size_t n = sorted.size();
+    const size_t b = std::min(histogram_buckets, n);
+    size_t begin = 0;
+    for (size_t i = 0; i < b; i++) {
+        size_t end = (i + 1) * n / b;
+        if (end == begin) continue;
+        const Value& upper = sorted[end - 1];
+        if (!buckets.empty() && buckets.back().upper == upper) buckets.back().count += end - begin;
+        else buckets.push_back(HistogramBucket{ upper, end - begin });
+        begin = end;
+    }
+}
+
+size_t ColumnStats::distinct() const {
+    if (values == 0) return 0;
+    size_t estimate = static_cast<size_t>(std::llround(sketch.estimate()));
+    return std::clamp<size_t>(estimate, 1, values);
+}
+
+void ZoneMap::add(const Value& v, size_t row) {
+    size_t z = row / zone_rows;
+    if (zones.size() <= z) zones.resize(z + 1);
+    if (row != appended) {
+        ascending = false;
+    } else {
+        if (appended > 0 && v < last) ascending = false;
+        last = v;
+        appended++;
+    }
+    if (std::holds_alternative<std::monostate>(v)) return;
+    Zone& zone = zones[z];
+    if (std::holds_alternative<std::monostate>(zone.min) || v < zone.min) zone.min = v;
+    if (std::holds_alternative<std::monostate>(zone.max) || zone.max < v) zone.max = v;
+}
+
+void ZoneMap::rebuild(const std::vector<Row>& rows, size_t column) {
+    zones.clear();
+    last = std::monostate{};
+    appended = 0;
+    ascending = true;
+    for (size_t r = 0; r < rows.size(); r++) add(rows[r].values[column], r);
+}
+
+bool ZoneMap::may_match(size_t zone, CompareOp op, const Value& v) const {
+    if (std::holds_alternative<std::monostate>(v)) return true;
+    const Zone& z = zones[zone];
+    if (std::holds_alternative<std::monostate>(z.min)) return op == CompareOp::Ne;
+    switch (op) {
+        case CompareOp::Eq: return !(v < z.min) && !(z.max < v);
+        case CompareOp::Ne: return true;
+        case CompareOp::Lt: return z.min < v;
+        case CompareOp::Le: return !(v < z.min);
+        case CompareOp::Gt: return v < z.max;
+        case CompareOp::Ge: return !(z.max < v);
+    }
+    return true;
+}
+
+}
\ No newline at end of file
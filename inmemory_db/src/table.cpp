@@ -1,13 +1,88 @@
 #include "imdb/table.hpp"
 #include "imdb/types.hpp"
+#include "imdb/planner.hpp"
+#include "imdb/profile.hpp"
+#include "imdb/pool.hpp"
+#include "imdb/cancel.hpp"
 #include <stdexcept>
-#include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
 
 namespace imdb {
 
-Table::Table(const std::string& name) : table_name(name), primary_key_index(std::nullopt) {}
+static std::atomic<uint64_t> version_clock{ 0 };
+
+static void scan_rows(const PredicateEvaluator& evaluator, const std::vector<Row>& rows, std::vector<size_t>& out) {
+    ThreadPool& pool = ThreadPool::shared();
+    size_t morsels = morsel_count(rows.size());
+    if (morsels < 2 || pool.size() == 1) {
+        evaluator.filter(rows, out);
+        return;
+    }
+    std::vector<std::vector<size_t>> parts(morsels);
+    pool.parallel_for(morsels, [&](size_t m) {
+        evaluator.filter_range(rows, m * ThreadPool::morsel_rows, (m + 1) * ThreadPool::morsel_rows, parts[m]);
+    });
+    size_t total = 0;
+    for (const auto& part : parts) total += part.size();
+    out.reserve(out.size() + total);
+    for (const auto& part : parts) out.insert(out.end(), part.begin(), part.end());
+}
+
+Table::Table(const std::string& name)
+    : table_name(name), storage(std::make_shared<TableStorage>()), primary_key_index(std::nullopt) {
+    touch();
+}
+
+Table::~Table() {
+    if (pins_storage) storage->snapshots.fetch_sub(1, std::memory_order_release);
+}
+
+void Table::detach() {
+    if (storage->snapshots.load(std::memory_order_acquire) > 0) storage = std::make_shared<TableStorage>(*storage);
+}
+
+std::shared_ptr<Table> Table::snapshot() const {
+    auto copy = std::make_shared<Table>(table_name);
+    copy->columns = columns;
+    copy->storage = storage;
+    copy->pins_storage = true;
+    storage->snapshots.fetch_add(1, std::memory_order_relaxed);
+    copy->primary_key_index = primary_key_index;
+    copy->catalog_changes = catalog_changes;
+    copy->data_version.store(version(), std::memory_order_release);
+    return copy;
+}
+
+void Table::touch() {
+    data_version.store(++version_clock, std::memory_order_release);
+    for (size_t i = 0; i < storage->stats.size(); i++) {
+        if (storage->stats[i].stale(storage->rows.size())) storage->stats[i].rebuild(storage->rows, i);
+    }
+}
+
+void Table::add_observer(TableObserver* observer) {
+    if (std::find(observers.begin(), observers.end(), observer) == observers.end()) observers.push_back(observer);
+}
+
+void Table::remove_observer(TableObserver* observer) {
+    observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+}
+
+void Table::reset_observers() {
+    for (auto* observer : observers) observer->on_reset(*this);
+}
+
+void Table::notify_updates(std::vector<std::pair<size_t, Row>> changed) {
+    if (changed.empty()) return;
+    std::vector<std::pair<Row, Row>> changes;
+    changes.reserve(changed.size());
+    for (auto& [r, before] : changed) changes.emplace_back(std::move(before), storage->rows[r]);
+    for (auto* observer : observers) observer->on_update_rows(*this, changes);
+}
 
 std::optional<size_t> Table::find_column_index(const std::string& column_name) const {
     for (size_t i = 0; i < columns.size(); i++) {
@@ -26,21 +101,29 @@ bool Table::is_null_value(const Value& v) const {
 
 void Table::add_column(const std::string& name, ColumnType type) {
     if (find_column_index(name).has_value()) throw std::runtime_error("column exists");
+    detach();
     Column c;
     c.name = name;
     c.type = type;
     c.not_null = false;
     c.is_primary_key = false;
     columns.push_back(c);
+    storage->stats.emplace_back();
+    storage->zone_maps.emplace_back();
+    catalog_changes++;
+    touch();
 
-    if (!rows.empty()) {
+    if (!storage->rows.empty()) {
         Value default_value;
         if (type == ColumnType::Int) default_value = static_cast<int64_t>(0);
         else default_value = std::string("");
-        for (size_t r = 0; r < rows.size(); r++) {
-            rows[r].values.push_back(default_value);
+        for (size_t r = 0; r < storage->rows.size(); r++) {
+            storage->rows[r].values.push_back(default_value);
         }
+        storage->stats.back().rebuild(storage->rows, columns.size() - 1);
+        storage->zone_maps.back().rebuild(storage->rows, columns.size() - 1);
     }
+    reset_observers();
 }
 
 bool Table::remove_column(const std::string& name) {
@@ -48,46 +131,102 @@ bool Table::remove_column(const std::string& name) {
     if (!idx) return false;
     if (primary_key_index && *primary_key_index == *idx) return false;
 
+    detach();
     size_t column_index = *idx;
     std::vector<Column> new_columns;
     for (size_t i = 0; i < columns.size(); i++) {
         if (i != column_index) new_columns.push_back(columns[i]);
     }
     columns.swap(new_columns);
+    storage->stats.erase(storage->stats.begin() + column_index);
+    storage->zone_maps.erase(storage->zone_maps.begin() + column_index);
 
-    for (size_t r = 0; r < rows.size(); r++) {
+    for (size_t r = 0; r < storage->rows.size(); r++) {
         std::vector<Value> new_values;
-        for (size_t i = 0; i < rows[r].values.size(); i++) {
-            if (i != column_index) new_values.push_back(rows[r].values[i]);
+        for (size_t i = 0; i < storage->rows[r].values.size(); i++) {
+            if (i != column_index) new_values.push_back(storage->rows[r].values[i]);
         }
-        rows[r].values.swap(new_values);
+        storage->rows[r].values.swap(new_values);
     }
 
     if (primary_key_index && *primary_key_index > column_index) {
         primary_key_index = *primary_key_index - 1;
     }
+
+    std::vector<ColumnIndex> kept_indexes;
+    for (auto& index : storage->indexes) {
+        if (index.column() == column_index) continue;
+        if (index.column() > column_index) index.set_column(index.column() - 1);
+        kept_indexes.push_back(std::move(index));
+    }
+    storage->indexes.swap(kept_indexes);
+    catalog_changes++;
+    touch();
+    reset_observers();
     return true;
 }
 
-bool Table::insert_row(const std::vector<Value>& values) {
+bool Table::row_fits(const std::vector<Value>& values) const {
     if (values.size() != columns.size()) return false;
-
     for (size_t i = 0; i < values.size(); i++) {
         if (!value_matches_type(values[i], columns[i].type)) return false;
         if (columns[i].not_null && is_null_value(values[i])) return false;
     }
+    return !primary_key_index || !is_null_value(values[*primary_key_index]);
+}
+
+void Table::append_row(const std::vector<Value>& values) {
+    Row row;
+    row.values = values;
+    storage->rows.push_back(row);
+    for (auto& index : storage->indexes) index.insert(values[index.column()], storage->rows.size() - 1);
+    for (size_t i = 0; i < values.size(); i++) {
+        storage->stats[i].add(values[i]);
+        storage->zone_maps[i].add(values[i], storage->rows.size() - 1);
+    }
+}
+
+bool Table::insert_row(const std::vector<Value>& values) {
+    if (!row_fits(values)) return false;
 
     if (primary_key_index) {
         const Value& key_value = values[*primary_key_index];
-        if (is_null_value(key_value)) return false;
-        for (size_t r = 0; r < rows.size(); r++) {
-            if (rows[r].values[*primary_key_index] == key_value) return false;
+        for (size_t r = 0; r < storage->rows.size(); r++) {
+            if (storage->rows[r].values[*primary_key_index] == key_value) return false;
         }
     }
 
-    Row row;
-    row.values = values;
-    rows.push_back(row);
+    detach();
+    append_row(values);
+    touch();
+    for (auto* observer : observers) observer->on_insert(*this, storage->rows.back());
+    return true;
+}
+
+bool Table::insert_rows(const std::vector<std::vector<Value>>& rows) {
+    for (const auto& values : rows) {
+        if (!row_fits(values)) return false;
+    }
+    if (primary_key_index) {
+        size_t key = *primary_key_index;
+        std::vector<Value> keys;
+        keys.reserve(rows.size());
+        for (const auto& values : rows) keys.push_back(values[key]);
+        std::sort(keys.begin(), keys.end());
+        if (std::adjacent_find(keys.begin(), keys.end()) != keys.end()) return false;
+        for (const auto& row : storage->rows) {
+            if (std::binary_search(keys.begin(), keys.end(), row.values[key])) return false;
+        }
+    }
+    if (rows.empty()) return true;
+
+    detach();
+    size_t first = storage->rows.size();
+    for (const auto& values : rows) append_row(values);
+    touch();
+    for (size_t r = first; r < storage->rows.size(); r++) {
+        for (auto* observer : observers) observer->on_insert(*this, storage->rows[r]);
+    }
     return true;
 }
 
@@ -96,50 +235,134 @@ bool Table::insert_row(const Row& row) {
 }
 
 std::vector<Row> Table::select_all() const {
-    return rows;
+    return storage->rows;
 }
 
 std::vector<Row> Table::select_where(const std::string& column_name, const Value& value) const {
-    std::vector<Row> result;
-    auto idx = find_column_index(column_name);
-    if (!idx) return result;
-    size_t column_index = *idx;
+    return select_where(Predicate::compare(column_name, CompareOp::Eq, value));
+}
+
+std::vector<size_t> Table::find_rows(const Predicate& where) const {
+    auto evaluator = PredicateEvaluator::bind(where, columns);
+    if (!evaluator) return {};
+    return find_rows(*evaluator, plan_access(*this, where));
+}
+
+std::vector<size_t> Table::find_rows(const PredicateEvaluator& evaluator, const AccessPlan& plan) const {
+    std::vector<size_t> ids;
+    StageTimer timer("Scan");
+    if (timer.active()) timer.label(table_name + " " + access_method_name(plan.method));
+    if (plan.method == AccessMethod::FullScan) {
+        scan_rows(evaluator, storage->rows, ids);
+        timer.rows(storage->rows.size(), ids.size());
+        timer.bytes(ids.capacity() * sizeof(size_t));
+        return ids;
+    }
+
+    std::vector<size_t> candidates = access_candidates(*this, plan);
+    std::vector<size_t> selection;
+    for (size_t begin = 0; begin < candidates.size(); begin += PredicateEvaluator::batch_size) {
+        if (cancellation_requested()) break;
+        size_t end = std::min(candidates.size(), begin + PredicateEvaluator::batch_size);
+        selection.assign(candidates.begin() + begin, candidates.begin() + end);
+        evaluator.filter_batch(storage->rows, selection);
+        ids.insert(ids.end(), selection.begin(), selection.end());
+    }
 
-    for (size_t r = 0; r < rows.size(); r++) {
-        if (column_index < rows[r].values.size() && rows[r].values[column_index] == value) {
-            result.push_back(rows[r]);
+    if (timer.active()) {
+        size_t zones = 0;
+        if (plan.method == AccessMethod::ZoneMapScan) {
+            const ZoneMap& map = storage->zone_maps[*get_column_index(plan.column)];
+            for (size_t z = 0; z < map.zone_count(); z++) {
+                if (!map.may_match(z, plan.op, plan.value)) zones++;
+            }
         }
+        timer.rows(storage->rows.size(), ids.size());
+        timer.bytes((ids.capacity() + candidates.capacity() + selection.capacity()) * sizeof(size_t));
+        timer.skipped(storage->rows.size() - candidates.size(), zones);
+    }
+    return ids;
+}
+
+std::vector<Row> Table::select_rows(const std::vector<size_t>& row_ids) const {
+    StageTimer timer("Materialize");
+    std::vector<Row> result;
+    result.reserve(row_ids.size());
+    for (size_t r : row_ids) {
+        if (r < storage->rows.size()) result.push_back(storage->rows[r]);
+    }
+    timer.rows(row_ids.size(), result.size());
+    timer.bytes(result.size() * (sizeof(Row) + columns.size() * sizeof(Value)));
+    return result;
+}
+
+std::vector<Row> Table::select_rows(const std::vector<size_t>& row_ids, const std::vector<size_t>& column_ids) const {
+    std::vector<Row> result;
+    for (size_t c : column_ids) {
+        if (c >= columns.size()) return result;
     }
+    StageTimer timer("Materialize");
+    result.reserve(row_ids.size());
+    for (size_t r : row_ids) {
+        if (r >= storage->rows.size()) continue;
+        Row row;
+        row.values.reserve(column_ids.size());
+        for (size_t c : column_ids) row.values.push_back(storage->rows[r].values[c]);
+        result.push_back(std::move(row));
+    }
+    timer.rows(row_ids.size(), result.size());
+    timer.bytes(result.size() * (sizeof(Row) + column_ids.size() * sizeof(Value)));
     return result;
 }
 
+std::vector<Row> Table::select_where(const Predicate& where) const {
+    return select_rows(find_rows(where));
+}
+
+std::vector<Row> Table::select_where(const Predicate& where, const std::vector<std::string>& column_names) const {
+    std::vector<size_t> column_ids;
+    for (const auto& name : column_names) {
+        auto idx = find_column_index(name);
+        if (!idx) return {};
+        column_ids.push_back(*idx);
+    }
+    return select_rows(find_rows(where), column_ids);
+}
+
 size_t Table::update_where(const std::string& column_name, const Value& old_value,
                            const std::string& update_column, const Value& new_value) {
-    auto src_idx = find_column_index(column_name);
-    auto upd_idx = find_column_index(update_column);
-    if (!src_idx || !upd_idx) return 0;
+    return update_where(Predicate::compare(column_name, CompareOp::Eq, old_value), update_column, new_value);
+}
 
-    size_t source_index = *src_idx;
-    size_t update_index = *upd_idx;
+size_t Table::update_where(const Predicate& where, const std::string& update_column, const Value& new_value) {
+    auto upd_idx = find_column_index(update_column);
+    if (!upd_idx) return 0;
+    if (!value_matches_type(new_value, columns[*upd_idx].type)) return 0;
+    if (columns[*upd_idx].not_null && is_null_value(new_value)) return 0;
+    std::vector<size_t> ids = find_rows(where);
+    if (cancellation_requested()) return 0;
+    return update_rows(ids, *upd_idx, new_value);
+}
 
+size_t Table::update_rows(const std::vector<size_t>& ids, size_t update_index, const Value& new_value) {
+    if (update_index >= columns.size()) return 0;
     if (!value_matches_type(new_value, columns[update_index].type)) return 0;
     if (columns[update_index].not_null && is_null_value(new_value)) return 0;
 
+    detach();
     size_t updated_count = 0;
+    std::vector<std::pair<size_t, Row>> changed;
+    StageTimer timer("Update");
+    if (timer.active()) timer.label(table_name);
 
-    for (size_t r = 0; r < rows.size(); r++) {
-        bool match = false;
-        if (source_index < rows[r].values.size() && rows[r].values[source_index] == old_value) {
-            match = true;
-        }
-        if (!match) continue;
-
+    for (size_t r : ids) {
+        if (r >= storage->rows.size()) continue;
         if (primary_key_index && update_index == *primary_key_index) {
             if (is_null_value(new_value)) continue;
             bool clash = false;
-            for (size_t k = 0; k < rows.size(); k++) {
+            for (size_t k = 0; k < storage->rows.size(); k++) {
                 if (k == r) continue;
-                if (rows[k].values[update_index] == new_value) {
+                if (storage->rows[k].values[update_index] == new_value) {
                     clash = true;
                     break;
                 }
@@ -147,88 +370,366 @@ size_t Table::update_where(const std::string& column_name, const Value& old_valu
             if (clash) continue;
         }
 
-        rows[r].values[update_index] = new_value;
+        for (auto& index : storage->indexes) {
+            if (index.column() != update_index) continue;
+            index.erase(storage->rows[r].values[update_index], r);
+            index.insert(new_value, r);
+        }
+        storage->stats[update_index].remove(storage->rows[r].values[update_index]);
+        storage->stats[update_index].add(new_value);
+        storage->zone_maps[update_index].add(new_value, r);
+        if (!observers.empty()) changed.emplace_back(r, storage->rows[r]);
+        storage->rows[r].values[update_index] = new_value;
         updated_count++;
     }
 
+    timer.rows(ids.size(), updated_count);
+    if (updated_count > 0) touch();
+    notify_updates(std::move(changed));
     return updated_count;
 }
 
+bool Table::update_rows(const std::vector<size_t>& ids, const std::vector<std::pair<size_t, Value>>& assignments,
+                        size_t& updated) {
+    updated = 0;
+    for (const auto& [column, value] : assignments) {
+        if (column >= columns.size()) return false;
+        if (!value_matches_type(value, columns[column].type)) return false;
+        if (columns[column].not_null && is_null_value(value)) return false;
+    }
+    std::vector<size_t> targets;
+    targets.reserve(ids.size());
+    for (size_t r : ids) {
+        if (r < storage->rows.size()) targets.push_back(r);
+    }
+    for (const auto& [column, value] : assignments) {
+        if (!primary_key_index || column != *primary_key_index || targets.empty()) continue;
+        if (is_null_value(value) || targets.size() > 1) return false;
+        for (size_t k = 0; k < storage->rows.size(); k++) {
+            if (k != targets[0] && storage->rows[k].values[column] == value) return false;
+        }
+    }
+    if (targets.empty()) return true;
+
+    detach();
+    std::vector<std::pair<size_t, Row>> changed;
+    StageTimer timer("Update");
+    if (timer.active()) timer.label(table_name);
+    for (size_t r : targets) {
+        if (!observers.empty()) changed.emplace_back(r, storage->rows[r]);
+        for (const auto& [column, value] : assignments) {
+            Value& current = storage->rows[r].values[column];
+            for (auto& index : storage->indexes) {
+                if (index.column() != column) continue;
+                index.erase(current, r);
+                index.insert(value, r);
+            }
+            storage->stats[column].remove(current);
+            storage->stats[column].add(value);
+            storage->zone_maps[column].add(value, r);
+            current = value;
+        }
+    }
+    updated = targets.size();
+    timer.rows(ids.size(), updated);
+    touch();
+    notify_updates(std::move(changed));
+    return true;
+}
+
 size_t Table::delete_where(const std::string& column_name, const Value& value) {
-    auto idx = find_column_index(column_name);
-    if (!idx) return 0;
-    size_t column_index = *idx;
+    return delete_where(Predicate::compare(column_name, CompareOp::Eq, value));
+}
+
+size_t Table::delete_where(const Predicate& where) {
+    std::vector<size_t> ids = find_rows(where);
+    if (cancellation_requested()) return 0;
+    return delete_rows(ids);
+}
+
+size_t Table::delete_rows(const std::vector<size_t>& ids) {
+    StageTimer timer("Delete");
+    if (timer.active()) timer.label(table_name);
+    timer.rows(storage->rows.size(), ids.size());
+    if (ids.empty()) return 0;
+    detach();
 
-    size_t before = rows.size();
     std::vector<Row> kept;
-    for (size_t r = 0; r < rows.size(); r++) {
-        bool match = false;
-        if (column_index < rows[r].values.size() && rows[r].values[column_index] == value) {
-            match = true;
+    kept.reserve(storage->rows.size() - std::min(storage->rows.size(), ids.size()));
+    timer.bytes(kept.capacity() * sizeof(Row));
+    size_t next = 0;
+    size_t deleted = 0;
+    std::vector<Row> removed;
+    for (size_t r = 0; r < storage->rows.size(); r++) {
+        while (next < ids.size() && ids[next] < r) next++;
+        if (next < ids.size() && ids[next] == r) {
+            for (size_t c = 0; c < storage->stats.size(); c++) storage->stats[c].remove(storage->rows[r].values[c]);
+            if (!observers.empty()) removed.push_back(std::move(storage->rows[r]));
+            next++;
+            deleted++;
+            continue;
         }
-        if (!match) kept.push_back(rows[r]);
+        kept.push_back(std::move(storage->rows[r]));
+    }
+    storage->rows.swap(kept);
+    for (auto& index : storage->indexes) index.rebuild(storage->rows);
+    for (size_t c = 0; c < storage->zone_maps.size(); c++) storage->zone_maps[c].rebuild(storage->rows, c);
+    if (deleted > 0) touch();
+    if (!removed.empty()) {
+        for (auto* observer : observers) observer->on_delete_rows(*this, removed);
     }
-    rows.swap(kept);
-    return before - rows.size();
+    return deleted;
 }
 
 void Table::clear_all_rows() {
-    rows.clear();
+    detach();
+    storage->rows.clear();
+    for (auto& index : storage->indexes) index.rebuild(storage->rows);
+    for (auto& s : storage->stats) s = ColumnStats{};
+    for (auto& z : storage->zone_maps) z = ZoneMap{};
+    touch();
+    reset_observers();
+}
+
+bool Table::stage_batch(const std::vector<TableChange>& changes, TableBatch& out) const {
+    out.rows = storage->rows;
+    out.origin.resize(out.rows.size());
+    for (size_t r = 0; r < out.origin.size(); r++) out.origin[r] = r;
+
+    std::vector<size_t> ids;
+    for (const auto& change : changes) {
+        if (change.kind == TableChange::Kind::Insert) {
+            if (change.values.size() != columns.size()) return false;
+            out.rows.push_back(Row{ change.values });
+            out.origin.push_back(TableBatch::new_row);
+            continue;
+        }
+        ids.clear();
+        if (change.where) {
+            auto evaluator = PredicateEvaluator::bind(*change.where, columns);
+            if (!evaluator) return false;
+            evaluator->filter(out.rows, ids);
+        } else {
+            ids.resize(out.rows.size());
+            for (size_t r = 0; r < ids.size(); r++) ids[r] = r;
+        }
+        if (change.kind == TableChange::Kind::Update) {
+            for (const auto& [column, value] : change.assignments) {
+                if (column >= columns.size()) return false;
+                for (size_t r : ids) out.rows[r].values[column] = value;
+            }
+            continue;
+        }
+        size_t next = 0;
+        size_t kept = 0;
+        for (size_t r = 0; r < out.rows.size(); r++) {
+            if (next < ids.size() && ids[next] == r) {
+                next++;
+                continue;
+            }
+            if (kept != r) {
+                out.rows[kept] = std::move(out.rows[r]);
+                out.origin[kept] = out.origin[r];
+            }
+            kept++;
+        }
+        out.rows.resize(kept);
+        out.origin.resize(kept);
+    }
+
+    for (const auto& row : out.rows) {
+        for (size_t c = 0; c < columns.size(); c++) {
+            if (!value_matches_type(row.values[c], columns[c].type)) return false;
+            if (columns[c].not_null && is_null_value(row.values[c])) return false;
+        }
+    }
+    if (primary_key_index) {
+        std::vector<Value> keys;
+        keys.reserve(out.rows.size());
+        for (const auto& row : out.rows) {
+            if (is_null_value(row.values[*primary_key_index])) return false;
+            keys.push_back(row.values[*primary_key_index]);
+        }
+        std::sort(keys.begin(), keys.end());
+        if (std::adjacent_find(keys.begin(), keys.end()) != keys.end()) return false;
+    }
+    return true;
+}
+
+void Table::apply_batch(TableBatch batch) {
+    StageTimer timer("Apply");
+    if (timer.active()) timer.label(table_name);
+    auto next = std::make_shared<TableStorage>();
+    next->rows = std::move(batch.rows);
+    for (const auto& index : storage->indexes) {
+        ColumnIndex rebuilt(index.kind(), index.column());
+        rebuilt.rebuild(next->rows);
+        next->indexes.push_back(std::move(rebuilt));
+    }
+    next->stats.resize(columns.size());
+    next->zone_maps.resize(columns.size());
+    for (size_t c = 0; c < columns.size(); c++) {
+        next->stats[c].rebuild(next->rows, c);
+        next->zone_maps[c].rebuild(next->rows, c);
+    }
+    timer.rows(storage->rows.size(), next->rows.size());
+
+    std::shared_ptr<TableStorage> previous = std::move(storage);
+    storage = std::move(next);
+    touch();
+    if (observers.empty()) return;
+
+    std::vector<bool> kept(previous->rows.size(), false);
+    std::vector<std::pair<size_t, Row>> changed;
+    for (size_t r = 0; r < storage->rows.size(); r++) {
+        size_t origin = batch.origin[r];
+        if (origin == TableBatch::new_row) continue;
+        kept[origin] = true;
+        if (previous->rows[origin].values == storage->rows[r].values) continue;
+        changed.emplace_back(r, previous->rows[origin]);
+    }
+    notify_updates(std::move(changed));
+    std::vector<Row> removed;
+    for (size_t r = 0; r < previous->rows.size(); r++) {
+        if (!kept[r]) removed.push_back(previous->rows[r]);
+    }
+    if (!removed.empty()) {
+        for (auto* observer : observers) observer->on_delete_rows(*this, removed);
+    }
+    for (size_t r = 0; r < storage->rows.size(); r++) {
+        if (batch.origin[r] != TableBatch::new_row) continue;
+        for (auto* observer : observers) observer->on_insert(*this, storage->rows[r]);
+    }
+}
+
+bool Table::create_index(const std::string& column_name, IndexKind kind) {
+    auto idx = find_column_index(column_name);
+    if (!idx) return false;
+    if (get_index(*idx)) return false;
+    detach();
+    ColumnIndex index(kind, *idx);
+    index.rebuild(storage->rows);
+    storage->indexes.push_back(std::move(index));
+    catalog_changes++;
+    return true;
+}
+
+bool Table::drop_index(const std::string& column_name) {
+    auto idx = find_column_index(column_name);
+    if (!idx) return false;
+    for (size_t i = 0; i < storage->indexes.size(); i++) {
+        if (storage->indexes[i].column() == *idx) {
+            detach();
+            storage->indexes.erase(storage->indexes.begin() + i);
+            catalog_changes++;
+            return true;
+        }
+    }
+    return false;
+}
+
+const ColumnIndex* Table::get_index(size_t column) const {
+    for (const auto& index : storage->indexes) {
+        if (index.column() == column) return &index;
+    }
+    return nullptr;
+}
+
+bool Table::is_sorted_by(size_t column) const {
+    return storage->zone_maps[column].sorted();
+}
+
+size_t Table::estimate_distinct(size_t column) const {
+    if (const ColumnIndex* index = get_index(column)) return index->distinct_keys();
+    return storage->stats[column].distinct();
 }
 
-void Table::print_table() const {
-    std::cout << "\n=== Table: " << table_name << " ===\n";
+void Table::analyze() {
+    detach();
+    for (size_t i = 0; i < storage->stats.size(); i++) {
+        storage->stats[i].rebuild(storage->rows, i);
+        storage->zone_maps[i].rebuild(storage->rows, i);
+    }
+    catalog_changes++;
+}
+
+void Table::print_table(std::ostream& out) const {
+    out << "\n=== Table: " << table_name << " ===\n";
     if (columns.empty()) {
-        std::cout << "No columns defined.\n";
+        out << "No columns defined.\n";
         return;
     }
 
     const int width = 18;
     for (size_t i = 0; i < columns.size(); i++) {
-        std::cout << std::setw(width) << columns[i].name;
-        if (i + 1 < columns.size()) std::cout << " | ";
+        out << std::setw(width) << columns[i].name;
+        if (i + 1 < columns.size()) out << " | ";
     }
-    std::cout << "\n";
+    out << "\n";
     for (size_t i = 0; i < columns.size(); i++) {
-        std::cout << std::string(width, '-');
-        if (i + 1 < columns.size()) std::cout << "-+-";
+        out << std::string(width, '-');
+        if (i + 1 < columns.size()) out << "-+-";
     }
-    std::cout << "\n";
+    out << "\n";
 
-    for (size_t r = 0; r < rows.size(); r++) {
+    for (size_t r = 0; r < storage->rows.size(); r++) {
         for (size_t i = 0; i < columns.size(); i++) {
             std::string cell = "";
-            if (i < rows[r].values.size()) cell = value_to_string(rows[r].values[i]);
-            std::cout << std::setw(width) << cell;
-            if (i + 1 < columns.size()) std::cout << " | ";
+            if (i < storage->rows[r].values.size()) cell = value_to_string(storage->rows[r].values[i]);
+            out << std::setw(width) << cell;
+            if (i + 1 < columns.size()) out << " | ";
         }
-        std::cout << "\n";
+        out << "\n";
     }
 
-    std::cout << "\nRows: " << rows.size() << "\n\n";
+    out << "\nRows: " << storage->rows.size() << "\n\n";
 }
 
-void Table::print_schema() const {
-    std::cout << "\n=== Schema for Table: " << table_name << " ===\n";
-    const int wn = 20, wt = 10, wnn = 8, wpk = 12;
+void Table::print_schema(std::ostream& out) const {
+    out << "\n=== Schema for Table: " << table_name << " ===\n";
+    const int wn = 20, wt = 10, wnn = 8, wpk = 12, wix = 10, wst = 10;
 
-    std::cout << std::setw(wn) << "Column Name" << " | "
+    out << std::setw(wn) << "Column Name" << " | "
               << std::setw(wt) << "Type" << " | "
               << std::setw(wnn) << "NotNull" << " | "
-              << std::setw(wpk) << "PrimaryKey" << "\n";
-
-    std::cout << std::string(wn, '-') << "-+-"
+              << std::setw(wpk) << "PrimaryKey" << " | "
+              << std::setw(wix) << "Index" << " | "
+              << std::setw(wst) << "Nulls" << " | "
+              << std::setw(wst) << "Distinct" << " | "
+              << std::setw(wst) << "Min" << " | "
+              << std::setw(wst) << "Max" << "\n";
+
+    out << std::string(wn, '-') << "-+-"
               << std::string(wt, '-') << "-+-"
               << std::string(wnn, '-') << "-+-"
-              << std::string(wpk, '-') << "\n";
+              << std::string(wpk, '-') << "-+-"
+              << std::string(wix, '-') << "-+-"
+              << std::string(wst, '-') << "-+-"
+              << std::string(wst, '-') << "-+-"
+              << std::string(wst, '-') << "-+-"
+              << std::string(wst, '-') << "\n";
 
     for (size_t i = 0; i < columns.size(); i++) {
-        std::cout << std::setw(wn) << columns[i].name << " | "
+        const ColumnIndex* index = get_index(i);
+        out << std::setw(wn) << columns[i].name << " | "
                   << std::setw(wt) << type_name(columns[i].type) << " | "
                   << std::setw(wnn) << (columns[i].not_null ? "yes" : "no") << " | "
-                  << std::setw(wpk) << (columns[i].is_primary_key ? "yes" : "no") << "\n";
+                  << std::setw(wpk) << (columns[i].is_primary_key ? "yes" : "no") << " | "
+                  << std::setw(wix) << (index ? index_kind_name(index->kind()) : "-") << " | "
+                  << std::setw(wst) << storage->stats[i].null_count() << " | "
+                  << std::setw(wst) << estimate_distinct(i) << " | "
+                  << std::setw(wst) << value_to_string(storage->stats[i].min()) << " | "
+                  << std::setw(wst) << value_to_string(storage->stats[i].max()) << "\n";
+    }
+
+    for (size_t i = 0; i < columns.size(); i++) {
+        const auto& buckets = storage->stats[i].histogram();
+        if (buckets.empty()) continue;
+        out << "Histogram " << columns[i].name << ":";
+        for (const auto& b : buckets) out << " <=" << value_to_string(b.upper) << " (" << b.count << ")";
+        out << "\n";
     }
-    std::cout << "\n";
+    out << "\n";
 }
 
 bool Table::set_primary_key(const std::string& column_name) {
@@ -236,12 +737,12 @@ bool Table::set_primary_key(const std::string& column_name) {
     if (!idx) return false;
     size_t i = *idx;
 
-    for (size_t r = 0; r < rows.size(); r++) {
-        if (is_null_value(rows[r].values[i])) return false;
+    for (size_t r = 0; r < storage->rows.size(); r++) {
+        if (is_null_value(storage->rows[r].values[i])) return false;
     }
-    for (size_t a = 0; a < rows.size(); a++) {
-        for (size_t b = a + 1; b < rows.size(); b++) {
-            if (rows[a].values[i] == rows[b].values[i]) return false;
+    for (size_t a = 0; a < storage->rows.size(); a++) {
+        for (size_t b = a + 1; b < storage->rows.size(); b++) {
+            if (storage->rows[a].values[i] == storage->rows[b].values[i]) return false;
         }
     }
 
@@ -251,6 +752,7 @@ bool Table::set_primary_key(const std::string& column_name) {
     primary_key_index = i;
     columns[i].is_primary_key = true;
     columns[i].not_null = true;
+    catalog_changes++;
     return true;
 }
 
@@ -260,11 +762,12 @@ bool Table::set_not_null(const std::string& column_name, bool value) {
     size_t i = *idx;
 
     if (value) {
-        for (size_t r = 0; r < rows.size(); r++) {
-            if (is_null_value(rows[r].values[i])) return false;
+        for (size_t r = 0; r < storage->rows.size(); r++) {
+            if (is_null_value(storage->rows[r].values[i])) return false;
         }
     }
     columns[i].not_null = value;
+    catalog_changes++;
     return true;
 }
 
@@ -303,21 +806,45 @@ static std::vector<std::string> parse_csv_line_simple(const std::string& line) {
 }
 
 size_t Table::import_csv(const std::string& path, bool header) {
+    std::string err;
+    return import_csv(path, header, err);
+}
+
+size_t Table::import_csv(const std::string& path, bool header, std::string& err) {
+    std::vector<std::vector<Value>> parsed;
+    if (!read_csv(path, header, parsed, err) || cancellation_requested()) return 0;
+    size_t first = storage->rows.size();
+    size_t inserted = 0;
+    for (size_t i = 0; i < parsed.size(); i++) {
+        if (cancellation_due(i)) {
+            std::vector<size_t> added(storage->rows.size() - first);
+            std::iota(added.begin(), added.end(), first);
+            delete_rows(added);
+            return 0;
+        }
+        if (insert_row(parsed[i])) inserted++;
+    }
+    return inserted;
+}
+
+bool Table::read_csv(const std::string& path, bool header, std::vector<std::vector<Value>>& out,
+                     std::string& err) const {
+    err.clear();
     std::ifstream in(path);
     if (!in.is_open()) {
-        std::cout << "IMPORT CSV: cannot open file: " << path << "\n";
-        return 0;
+        err = "cannot open file: " + path;
+        return false;
     }
     if (columns.empty()) {
-        std::cout << "IMPORT CSV: table has no columns\n";
-        return 0;
+        err = "table has no columns";
+        return false;
     }
 
-    size_t inserted = 0;
     std::string line;
     bool first_line = true;
 
-    while (std::getline(in, line)) {
+    for (size_t n = 0; std::getline(in, line); n++) {
+        if (cancellation_due(n)) return false;
         if (first_line && header) {
             first_line = false;
             continue;
@@ -343,31 +870,9 @@ size_t Table::import_csv(const std::string& path, bool header) {
             }
         }
 
-        if (insert_row(values)) inserted++;
-    }
-    return inserted;
-}
-
-static std::string csv_escape(const std::string& s) {
-    bool need = false;
-    for (size_t i = 0; i < s.size(); i++) {
-        char c = s[i];
-        if (c == ',' || c == '"' || c == '\n' || c == '\r') {
-            need = true;
-            break;
-        }
-    }
-    if (!need) return s;
-
-    std::string out;
-    out.push_back('"');
-    for (size_t i = 0; i < s.size(); i++) {
-        char c = s[i];
-        if (c == '"') out.push_back('"');
-        out.push_back(c);
+        out.push_back(std::move(values));
     }
-    out.push_back('"');
-    return out;
+    return true;
 }
 
 bool Table::export_csv(const std::string& path) const {
@@ -380,15 +885,22 @@ bool Table::export_csv(const std::string& path) const {
     }
     out << "\n";
 
-    for (size_t r = 0; r < rows.size(); r++) {
-        for (size_t i = 0; i < columns.size(); i++) {
-            std::string s = "";
-            if (i < rows[r].values.size()) s = value_to_string(rows[r].values[i]);
-            out << csv_escape(s);
-            if (i + 1 < columns.size()) out << ",";
+    const std::vector<Row>& rows = storage->rows;
+    std::vector<std::string> chunks(morsel_count(rows.size()));
+    ThreadPool::shared().parallel_for(chunks.size(), [&](size_t m) {
+        std::string& chunk = chunks[m];
+        size_t end = std::min(rows.size(), (m + 1) * ThreadPool::morsel_rows);
+        for (size_t r = m * ThreadPool::morsel_rows; r < end; r++) {
+            for (size_t i = 0; i < columns.size(); i++) {
+                std::string s = "";
+                if (i < rows[r].values.size()) s = value_to_string(rows[r].values[i]);
+                chunk += csv_escape(s);
+                if (i + 1 < columns.size()) chunk += ",";
+            }
+            chunk += "\n";
         }
-        out << "\n";
-    }
+    });
+    for (const auto& chunk : chunks) out << chunk;
     return true;
 }
 
@@ -0,0 +1,155 @@
+#include "imdb/transaction.hpp"
+#include "imdb/profile.hpp"
+#include "imdb/cancel.hpp"
+#include <utility>
+
+namespace imdb {
+
+Transaction::Transaction(Database& db) : db(db) {}
+
+Transaction::WriteSet* Transaction::write_set(const std::string& table, std::string& err) {
+    auto it = writes.find(table);
+    if (it != writes.end()) return &it->second;
+    if (db.is_view(table)) { err = "cannot modify materialized view"; return nullptr; }
+    TableLocks held = db.lock_tables({ table }, {});
+    const Table* t = db.get_table(table);
+    if (!t) { err = "no such table"; return nullptr; }
+    WriteSet set;
+    set.catalog_version = t->catalog_version();
+    set.columns = t->get_columns();
+    if (set.columns.empty()) { err = "define columns first"; return nullptr; }
+    return &writes.emplace(table, std::move(set)).first->second;
+}
+
+bool Transaction::check_where(const WriteSet& set, const std::optional<Predicate>& where, std::string& err) const {
+    if (!where || PredicateEvaluator::bind(*where, set.columns)) return true;
+    err = "bad condition";
+    return false;
+}
+
+bool Transaction::insert(const std::string& table, std::vector<Value> values, std::string& err) {
+    WriteSet* set = write_set(table, err);
+    if (!set) return false;
+    if (values.size() != set->columns.size()) { err = "need " + std::to_string(set->columns.size()) + " values"; return false; }
+    for (size_t i = 0; i < values.size(); i++) {
+        if (!value_matches_type(values[i], set->columns[i].type)) { err = "type mismatch"; return false; }
+    }
+    TableChange change;
+    change.kind = TableChange::Kind::Insert;
+    change.values = std::move(values);
+    set->changes.push_back(std::move(change));
+    return true;
+}
+
+bool Transaction::update(const std::string& table, std::optional<Predicate> where,
+                         const std::string& column, const Value& value, std::string& err) {
+    WriteSet* set = write_set(table, err);
+    if (!set || !check_where(*set, where, err)) return false;
+    for (size_t i = 0; i < set->columns.size(); i++) {
+        if (set->columns[i].name != column) continue;
+        if (!value_matches_type(value, set->columns[i].type)) { err = "type mismatch"; return false; }
+        TableChange change;
+        change.kind = TableChange::Kind::Update;
+        change.where = std::move(where);
+        change.assignments.emplace_back(i, value);
+        set->changes.push_back(std::move(change));
+        return true;
+    }
+    err = "no such column";
+    return false;
+}
+
+bool Transaction::remove(const std::string& table, std::optional<Predicate> where, std::string& err) {
+    WriteSet* set = write_set(table, err);
+    if (!set || !check_where(*set, where, err)) return false;
+    TableChange change;
+    change.kind = TableChange::Kind::Delete;
+    change.where = std::move(where);
+    set->changes.push_back(std::move(change));
+    return true;
+}
+
+bool Transaction::stage(const PlanNode& plan, std::string& err) {
+    auto literal = [&](const Operand& operand, Value& out) {
+        if (operand.parameter) { err = "use PREPARE for parameters"; return false; }
+        out = operand.value;
+        return true;
+    };
+    switch (plan.kind) {
+        case PlanNode::Kind::Insert: {
+            for (const auto& row : plan.values) {
+                std::vector<Value> values(row.size());
+                for (size_t i = 0; i < row.size(); i++) {
+                    if (!literal(row[i], values[i])) return false;
+                }
+                if (!insert(plan.table, std::move(values), err)) return false;
+            }
+            return true;
+        }
+        case PlanNode::Kind::Update: {
+            WriteSet* set = write_set(plan.table, err);
+            if (!set) return false;
+            TableChange change;
+            change.kind = TableChange::Kind::Update;
+            change.where = plan.children[0].where;
+            for (size_t i = 0; i < plan.columns.size(); i++) {
+                size_t column = 0;
+                while (column < set->columns.size() && set->columns[column].name != plan.columns[i]) column++;
+                if (column == set->columns.size()) { err = "no such column"; return false; }
+                Value value;
+                if (!literal(plan.values[0][i], value)) return false;
+                change.assignments.emplace_back(column, std::move(value));
+            }
+            set->changes.push_back(std::move(change));
+            return true;
+        }
+        case PlanNode::Kind::Delete:
+            return remove(plan.table, plan.children[0].where, err);
+        default:
+            err = "only INSERT, UPDATE and DELETE are buffered";
+            return false;
+    }
+}
+
+bool Transaction::commit(std::string& err) {
+    std::map<std::string, WriteSet> pending_writes;
+    pending_writes.swap(writes);
+    if (pending_writes.empty()) return true;
+
+    std::vector<std::string> names;
+    for (const auto& pair : pending_writes) names.push_back(pair.first);
+    TableLocks held = db.lock_tables({}, names);
+
+    std::vector<std::pair<Table*, TableBatch>> batches;
+    {
+        StageTimer timer("Validate");
+        size_t rows_in = 0;
+        size_t rows_out = 0;
+        for (auto& [name, set] : pending_writes) {
+            Table* t = db.get_table(name);
+            if (!t) { err = "no such table: " + name; return false; }
+            if (t->catalog_version() != set.catalog_version) { err = "table changed since BEGIN: " + name; return false; }
+            TableBatch batch;
+            if (!t->stage_batch(set.changes, batch)) { err = "constraint violation in " + name; return false; }
+            rows_in += t->row_count();
+            rows_out += batch.rows.size();
+            batches.emplace_back(t, std::move(batch));
+        }
+        timer.rows(rows_in, rows_out);
+    }
+    if (cancellation_requested()) { err = active_cancel_token()->reason(); return false; }
+    for (auto& [t, batch] : batches) t->apply_batch(std::move(batch));
+    return true;
+}
+
+void Transaction::rollback() {
+    writes.clear();
+}
+
+size_t Transaction::pending() const noexcept {
+    size_t n = 0;
+    for (const auto& pair : writes) n += pair.second.changes.size();
+    return n;
+}
+
+}
\ No newline at end of file
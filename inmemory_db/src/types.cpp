@@ -23,4 +23,26 @@ bool value_matches_type(const Value& v, ColumnType t) noexcept {
     return false;
 }
 
+std::string csv_escape(const std::string& s) {
+    bool need = false;
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        if (c == ',' || c == '"' || c == '\n' || c == '\r') {
+            need = true;
+            break;
+        }
+    }
+    if (!need) return s;
+
+    std::string out;
+    out.push_back('"');
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        if (c == '"') out.push_back('"');
+        out.push_back(c);
+    }
+    out.push_back('"');
+    return out;
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,495 @@
+#include "imdb/view.hpp"
+#include "imdb/cancel.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <numeric>
+#include <utility>
+
+namespace imdb {
+
+namespace {
+
+std::string bare_name(const std::string& name) {
+    return name.substr(name.find('.') + 1);
+}
+
+bool is_null(const Value& v) {
+    return std::holds_alternative<std::monostate>(v);
+}
+
+bool matches(const std::optional<PredicateEvaluator>& where, const Row& row) {
+    if (!where) return true;
+    std::vector<Row> rows{ row };
+    std::vector<size_t> hits;
+    where->filter(rows, hits);
+    return !hits.empty();
+}
+
+bool bind_filter(const std::optional<Predicate>& where, const std::vector<Column>& cols,
+                 std::optional<PredicateEvaluator>& out, std::string& err) {
+    out.reset();
+    if (!where) return true;
+    out = PredicateEvaluator::bind(*where, cols);
+    if (!out) err = "no such column";
+    return out.has_value();
+}
+
+std::string aggregate_label(AggregateFunc func, const std::string& column) {
+    std::string label = aggregate_name(func);
+    for (auto& ch : label) ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    return column.empty() ? label : label + "_" + column;
+}
+
+}
+
+MaterializedView::MaterializedView(Database& db, std::string name, SqlStatement definition)
+    : db(db), view_name(std::move(name)), definition(std::move(definition)) {
+    source_names.push_back(this->definition.table);
+    for (const auto& join : this->definition.joins) source_names.push_back(join.table);
+}
+
+MaterializedView::~MaterializedView() {
+    for (Table* t : source_tables) t->remove_observer(this);
+}
+
+std::unique_ptr<MaterializedView> MaterializedView::create(Database& db, const std::string& name,
+                                                           const SqlStatement& definition, std::string& err) {
+    if (definition.kind != SqlKind::Select) { err = "view must be a SELECT"; return nullptr; }
+    if (definition.order_by || definition.limit) { err = "views cannot ORDER BY or LIMIT"; return nullptr; }
+    if (definition.parameter_count > 0) { err = "views cannot take parameters"; return nullptr; }
+    if (definition.joins.size() > 1) { err = "only two-table joins can be materialized"; return nullptr; }
+    if (!db.get_table(name)) { err = "no such table"; return nullptr; }
+
+    std::unique_ptr<MaterializedView> view(new MaterializedView(db, name, definition));
+    if (view->depends_on(name)) { err = "view cannot read itself"; return nullptr; }
+    view->target = db.get_table(name);
+    if (!view->bind(err)) return nullptr;
+    view->rebuild();
+    for (const auto& source : view->source_names) {
+        Table* t = db.get_table(source);
+        t->add_observer(view.get());
+        view->source_tables.push_back(t);
+    }
+    return view;
+}
+
+bool MaterializedView::depends_on(const std::string& table) const {
+    return std::find(source_names.begin(), source_names.end(), table) != source_names.end();
+}
+
+bool MaterializedView::bind(std::string& err) {
+    PlanNode compiled;
+    if (!compile_sql_unlocked(db, definition, compiled, err)) return false;
+    where.reset();
+    columns.clear();
+    join_columns.clear();
+    sides.clear();
+    group_columns.clear();
+    aggregates.clear();
+    output.clear();
+    groups.clear();
+
+    std::vector<Column> layout;
+    const PlanNode& child = compiled.children[0];
+    bool ok = false;
+    if (child.kind == PlanNode::Kind::Aggregate) {
+        if (child.children[0].kind != PlanNode::Kind::Scan) { err = "aggregates over joins cannot be materialized"; return false; }
+        ok = bind_aggregate(compiled, layout, err);
+    } else if (child.kind == PlanNode::Kind::Scan) {
+        ok = bind_select(compiled, layout, err);
+    } else {
+        ok = bind_join(compiled, layout, err);
+    }
+    if (!ok) return false;
+
+    for (size_t i = 0; i < layout.size(); i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (layout[j].name == layout[i].name) { err = "duplicate column " + layout[i].name; return false; }
+        }
+    }
+    if (target->column_count() == 0) {
+        for (const auto& c : layout) target->add_column(c.name, c.type);
+    } else {
+        auto existing = target->get_columns();
+        bool same = existing.size() == layout.size();
+        for (size_t i = 0; same && i < layout.size(); i++) {
+            same = existing[i].name == layout[i].name && existing[i].type == layout[i].type;
+        }
+        if (!same) { err = "view definition no longer matches"; return false; }
+    }
+    plan = std::move(compiled);
+    return true;
+}
+
+bool MaterializedView::bind_select(const PlanNode& project, std::vector<Column>& layout, std::string& err) {
+    const PlanNode& scan = project.children[0];
+    const Table* base = db.get_table(scan.table);
+    auto cols = base->get_columns();
+    view_shape = Shape::Select;
+    if (!bind_filter(scan.where, cols, where, err)) return false;
+    for (const auto& name : project.columns) {
+        auto idx = base->get_column_index(bare_name(name));
+        if (!idx) { err = "no such column"; return false; }
+        columns.push_back(*idx);
+        layout.push_back(Column{ cols[*idx].name, cols[*idx].type });
+    }
+    return true;
+}
+
+bool MaterializedView::bind_aggregate(const PlanNode& project, std::vector<Column>& layout, std::string& err) {
+    const PlanNode& agg = project.children[0];
+    const PlanNode& scan = agg.children[0];
+    const Table* base = db.get_table(scan.table);
+    auto cols = base->get_columns();
+    view_shape = Shape::Aggregate;
+    if (!bind_filter(scan.where, cols, where, err)) return false;
+
+    std::vector<Column> produced;
+    for (const auto& name : agg.aggregate.group_by) {
+        auto idx = base->get_column_index(bare_name(name));
+        if (!idx) { err = "no such column"; return false; }
+        group_columns.push_back(*idx);
+        produced.push_back(Column{ cols[*idx].name, cols[*idx].type });
+    }
+    for (const auto& spec : agg.aggregate.aggregates) {
+        BoundAggregate bound;
+        bound.func = spec.func;
+        ColumnType type = ColumnType::Int;
+        std::string column;
+        if (!spec.column.empty()) {
+            auto idx = base->get_column_index(bare_name(spec.column));
+            if (!idx) { err = "no such column"; return false; }
+            bound.column = *idx;
+            column = cols[*idx].name;
+            type = cols[*idx].type;
+            if ((spec.func == AggregateFunc::Sum || spec.func == AggregateFunc::Avg) && type != ColumnType::Int) {
+                err = "SUM and AVG need an INT column";
+                return false;
+            }
+        } else if (spec.func != AggregateFunc::Count) {
+            err = "only COUNT accepts *";
+            return false;
+        }
+        if (spec.func == AggregateFunc::Count || spec.func == AggregateFunc::Sum) type = ColumnType::Int;
+        if (spec.func == AggregateFunc::Avg) type = ColumnType::Text;
+        aggregates.push_back(bound);
+        produced.push_back(Column{ aggregate_label(spec.func, column), type });
+    }
+    output = project.output;
+    for (size_t i : output) layout.push_back(produced[i]);
+    return true;
+}
+
+bool MaterializedView::bind_join(const PlanNode& project, std::vector<Column>& layout, std::string& err) {
+    const PlanNode* node = &project.children[0];
+    std::optional<Predicate> residual;
+    if (node->kind == PlanNode::Kind::Filter) {
+        residual = node->where;
+        node = &node->children[0];
+    }
+    if (node->kind != PlanNode::Kind::Join || node->columns.size() != 2) {
+        err = "view shape cannot be maintained incrementally";
+        return false;
+    }
+    const auto& names = node->columns;
+    if (names[0] == names[1]) { err = "self-joins cannot be materialized"; return false; }
+    view_shape = Shape::Join;
+
+    const JoinCondition& cond = node->conditions[0];
+    std::vector<Column> combined;
+    sides.resize(2);
+    for (size_t s = 0; s < 2; s++) {
+        Side& side = sides[s];
+        side.table = db.get_table(names[s]);
+        side.key_name = cond.left_table == names[s] ? cond.left_column : cond.right_column;
+        side.key = *side.table->get_column_index(side.key_name);
+        auto cols = side.table->get_columns();
+        std::optional<Predicate> filter;
+        if (s < node->side_filters.size()) filter = node->side_filters[s];
+        if (!bind_filter(filter, cols, side.filter, err)) return false;
+        for (const auto& c : cols) combined.push_back(Column{ names[s] + "." + c.name, c.type });
+    }
+    if (!bind_filter(residual, combined, where, err)) return false;
+
+    for (const auto& name : project.columns) {
+        size_t dot = name.find('.');
+        std::string prefix = dot == std::string::npos ? "" : name.substr(0, dot);
+        std::optional<JoinColumn> found;
+        for (size_t s = 0; s < 2; s++) {
+            if (!prefix.empty() && names[s] != prefix) continue;
+            auto idx = sides[s].table->get_column_index(bare_name(name));
+            if (!idx) continue;
+            if (found) { err = "ambiguous column " + name; return false; }
+            found = JoinColumn{ s, *idx };
+        }
+        if (!found) { err = "no such column"; return false; }
+        join_columns.push_back(*found);
+    }
+    for (const auto& col : join_columns) {
+        Column source = sides[col.side].table->get_columns()[col.index];
+        size_t same = std::count_if(join_columns.begin(), join_columns.end(), [&](const JoinColumn& other) {
+            return sides[other.side].table->get_columns()[other.index].name == source.name;
+        });
+        layout.push_back(Column{ same > 1 ? names[col.side] + "_" + source.name : source.name, source.type });
+    }
+    return true;
+}
+
+void MaterializedView::rebuild() {
+    CancelScope detached(nullptr);
+    target->clear_all_rows();
+    groups.clear();
+    switch (view_shape) {
+        case Shape::Select: {
+            const auto& rows = db.get_table(plan.children[0].table)->get_rows();
+            std::vector<size_t> ids;
+            if (where) {
+                where->filter(rows, ids);
+            } else {
+                ids.resize(rows.size());
+                std::iota(ids.begin(), ids.end(), 0);
+            }
+            std::vector<Value> values(columns.size());
+            for (size_t id : ids) {
+                for (size_t c = 0; c < columns.size(); c++) values[c] = rows[id].values[columns[c]];
+                target->insert_row(values);
+            }
+            break;
+        }
+        case Shape::Aggregate: {
+            const auto& rows = db.get_table(plan.children[0].children[0].table)->get_rows();
+            for (const auto& row : rows) apply_group(row, true, false);
+            if (group_columns.empty() && groups.empty()) groups[std::vector<Value>{}].states.resize(aggregates.size());
+            for (auto it = groups.begin(); it != groups.end(); ++it) publish_group(it);
+            break;
+        }
+        case Shape::Join: {
+            QueryResult result;
+            std::string err;
+            if (!execute_plan_unlocked(db, plan, {}, result, err)) break;
+            for (const auto& row : result.rows) target->insert_row(row);
+            break;
+        }
+    }
+}
+
+void MaterializedView::on_insert(const Table& table, const Row& row) {
+    CancelScope detached(nullptr);
+    if (stale) return;
+    apply(table, row, true);
+}
+
+void MaterializedView::on_delete(const Table& table, const Row& row) {
+    CancelScope detached(nullptr);
+    if (stale) return;
+    apply(table, row, false);
+    flush_removals();
+}
+
+void MaterializedView::on_delete_rows(const Table& table, const std::vector<Row>& rows) {
+    CancelScope detached(nullptr);
+    if (stale) return;
+    for (const auto& row : rows) apply(table, row, false);
+    flush_removals();
+}
+
+void MaterializedView::on_update_rows(const Table& table, const std::vector<std::pair<Row, Row>>& changes) {
+    CancelScope detached(nullptr);
+    if (stale) return;
+    if (view_shape == Shape::Aggregate) {
+        for (const auto& [before, after] : changes) {
+            apply(table, before, false);
+            apply(table, after, true);
+        }
+        return;
+    }
+    for (const auto& change : changes) apply(table, change.first, false);
+    flush_removals();
+    for (const auto& change : changes) apply(table, change.second, true);
+}
+
+void MaterializedView::on_reset(const Table&) {
+    CancelScope detached(nullptr);
+    std::string err;
+    stale = !bind(err);
+    if (!stale) {
+        rebuild();
+        return;
+    }
+    target->clear_all_rows();
+    groups.clear();
+}
+
+void MaterializedView::apply(const Table& table, const Row& row, bool insert) {
+    switch (view_shape) {
+        case Shape::Select: apply_row(row, insert); break;
+        case Shape::Aggregate: apply_group(row, insert, true); break;
+        case Shape::Join: apply_join(table, row, insert); break;
+    }
+}
+
+void MaterializedView::apply_row(const Row& row, bool insert) {
+    if (!matches(where, row)) return;
+    std::vector<Value> values;
+    values.reserve(columns.size());
+    for (size_t c : columns) values.push_back(row.values[c]);
+    if (insert) target->insert_row(values);
+    else remove_row(values);
+}
+
+void MaterializedView::apply_group(const Row& row, bool insert, bool publish) {
+    if (!matches(where, row)) return;
+    std::vector<Value> key;
+    key.reserve(group_columns.size());
+    for (size_t c : group_columns) key.push_back(row.values[c]);
+
+    auto it = groups.find(key);
+    if (it == groups.end()) {
+        if (!insert) return;
+        it = groups.emplace(std::move(key), Group{}).first;
+        it->second.states.resize(aggregates.size());
+    }
+    Group& group = it->second;
+    if (insert) group.rows++;
+    else if (group.rows > 0) group.rows--;
+
+    const int64_t delta = insert ? 1 : -1;
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        Accumulator& state = group.states[a];
+        if (!aggregates[a].column) {
+            state.count += delta;
+            continue;
+        }
+        const Value& v = row.values[*aggregates[a].column];
+        if (is_null(v)) continue;
+        state.count += delta;
+        if (auto* n = std::get_if<int64_t>(&v)) {
+            if (insert) state.sum.add(*n);
+            else state.sum.subtract(*n);
+        }
+        if (aggregates[a].func != AggregateFunc::Min && aggregates[a].func != AggregateFunc::Max) continue;
+        if (insert) {
+            state.values[v]++;
+            continue;
+        }
+        auto found = state.values.find(v);
+        if (found != state.values.end() && --found->second == 0) state.values.erase(found);
+    }
+    if (publish) publish_group(it);
+}
+
+std::vector<Value> MaterializedView::group_row(const std::vector<Value>& key, const Group& group) const {
+    std::vector<Value> produced = key;
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        const Accumulator& state = group.states[a];
+        switch (aggregates[a].func) {
+            case AggregateFunc::Count:
+                produced.emplace_back(state.count);
+                break;
+            case AggregateFunc::Sum:
+                if (state.count == 0) produced.emplace_back(std::monostate{});
+                else if (auto sum = state.sum.value()) produced.emplace_back(*sum);
+                else produced.emplace_back(std::monostate{});
+                break;
+            case AggregateFunc::Avg: {
+                if (state.count == 0) {
+                    produced.emplace_back(std::monostate{});
+                    break;
+                }
+                char buf[64];
+                std::snprintf(buf, sizeof(buf), "%.2f", state.sum.average(state.count));
+                produced.emplace_back(std::string(buf));
+                break;
+            }
+            case AggregateFunc::Min:
+                if (state.values.empty()) produced.emplace_back(std::monostate{});
+                else produced.push_back(state.values.begin()->first);
+                break;
+            case AggregateFunc::Max:
+                if (state.values.empty()) produced.emplace_back(std::monostate{});
+                else produced.push_back(state.values.rbegin()->first);
+                break;
+        }
+    }
+    std::vector<Value> values;
+    values.reserve(output.size());
+    for (size_t i : output) values.push_back(produced[i]);
+    return values;
+}
+
+void MaterializedView::publish_group(std::map<std::vector<Value>, Group>::iterator it) {
+    Group& group = it->second;
+    if (group.rows == 0 && !group_columns.empty()) {
+        if (group.slot) remove_slot(*group.slot);
+        groups.erase(it);
+        return;
+    }
+    auto values = group_row(it->first, group);
+    if (!group.slot) {
+        group.slot = target->row_count();
+        target->insert_row(values);
+        return;
+    }
+    auto current = target->get_rows()[*group.slot].values;
+    for (size_t c = 0; c < values.size(); c++) {
+        if (current[c] != values[c]) target->update_rows({ *group.slot }, c, values[c]);
+    }
+}
+
+void MaterializedView::apply_join(const Table& table, const Row& row, bool insert) {
+    size_t s = &table == sides[0].table ? 0 : 1;
+    const Side& self = sides[s];
+    const Side& other = sides[1 - s];
+    if (!matches(self.filter, row)) return;
+    const Value& key = row.values[self.key];
+
+    auto ids = other.table->find_rows(Predicate::compare(other.key_name, CompareOp::Eq, key));
+    const auto& others = other.table->get_rows();
+    for (size_t id : ids) {
+        const Row& match = others[id];
+        if (!matches(other.filter, match)) continue;
+        const Row& left = s == 0 ? row : match;
+        const Row& right = s == 0 ? match : row;
+        if (where) {
+            Row combined{ left.values };
+            combined.values.insert(combined.values.end(), right.values.begin(), right.values.end());
+            if (!matches(where, combined)) continue;
+        }
+        std::vector<Value> values;
+        values.reserve(join_columns.size());
+        for (const auto& col : join_columns) values.push_back((col.side == 0 ? left : right).values[col.index]);
+        if (insert) target->insert_row(values);
+        else remove_row(values);
+    }
+}
+
+void MaterializedView::remove_row(const std::vector<Value>& values) {
+    removals.push_back(values);
+}
+
+void MaterializedView::flush_removals() {
+    if (removals.empty()) return;
+    std::map<std::vector<Value>, size_t> wanted;
+    for (auto& values : removals) wanted[std::move(values)]++;
+    removals.clear();
+    const auto& rows = target->get_rows();
+    std::vector<size_t> ids;
+    for (size_t i = rows.size(); i-- > 0 && !wanted.empty();) {
+        auto it = wanted.find(rows[i].values);
+        if (it == wanted.end()) continue;
+        ids.push_back(i);
+        if (--it->second == 0) wanted.erase(it);
+    }
+    std::reverse(ids.begin(), ids.end());
+    target->delete_rows(ids);
+}
+
+void MaterializedView::remove_slot(size_t slot) {
+    target->delete_rows({ slot });
+    for (auto& [key, group] : groups) {
+        if (group.slot && *group.slot > slot) --*group.slot;
+    }
+}
+
+}
\ No newline at end of file
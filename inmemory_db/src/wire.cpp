@@ -0,0 +1,220 @@
+#include "imdb/wire.hpp"
+#include "imdb/pool.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace imdb {
+
+static_assert(std::endian::native == std::endian::little, "wire format is little-endian");
+
+namespace {
+
+template <typename T>
+void put(std::string& out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+void pad(std::string& out) {
+    out.append((8 - out.size() % 8) % 8, '\0');
+}
+
+std::vector<WireType> wire_types(const std::vector<ColumnType>& types, size_t column_count) {
+    std::vector<WireType> out(column_count, WireType::Text);
+    for (size_t c = 0; c < column_count && c < types.size(); c++) {
+        if (types[c] == ColumnType::Int) out[c] = WireType::Int;
+    }
+    return out;
+}
+
+template <typename T>
+void put_array(std::string& out, const std::vector<T>& values) {
+    size_t at = out.size();
+    out.resize(at + values.size() * sizeof(T));
+    std::memcpy(out.data() + at, values.data(), values.size() * sizeof(T));
+}
+
+template <typename CellAt>
+void encode_batch(std::string& out, size_t begin, size_t end, const std::vector<WireType>& types, CellAt cell_at) {
+    size_t count = end - begin;
+    put<uint32_t>(out, static_cast<uint32_t>(count));
+    put<uint32_t>(out, 0);
+    std::vector<int64_t> numbers;
+    std::vector<uint64_t> offsets;
+    std::string bytes;
+    for (size_t c = 0; c < types.size(); c++) {
+        std::string validity((count + 7) / 8, '\0');
+        for (size_t r = 0; r < count; r++) {
+            const Value* value = cell_at(begin + r, c);
+            if (value && !std::holds_alternative<std::monostate>(*value)) validity[r / 8] |= static_cast<char>(1u << (r % 8));
+        }
+        out += validity;
+        pad(out);
+        if (types[c] == WireType::Int) {
+            numbers.assign(count, 0);
+            for (size_t r = 0; r < count; r++) {
+                const Value* value = cell_at(begin + r, c);
+                if (const int64_t* number = value ? std::get_if<int64_t>(value) : nullptr) numbers[r] = *number;
+            }
+            put_array(out, numbers);
+            continue;
+        }
+        offsets.assign(1, 0);
+        bytes.clear();
+        for (size_t r = 0; r < count; r++) {
+            const Value* value = cell_at(begin + r, c);
+            if (value && std::holds_alternative<std::string>(*value)) bytes += std::get<std::string>(*value);
+            else if (value && std::holds_alternative<int64_t>(*value)) bytes += value_to_string(*value);
+            offsets.push_back(bytes.size());
+        }
+        put_array(out, offsets);
+        out += bytes;
+        pad(out);
+    }
+}
+
+template <typename CellAt>
+std::string encode(const std::vector<std::string>& headers, const std::vector<ColumnType>& column_types,
+                   size_t row_count, CellAt cell_at) {
+    std::vector<WireType> types = wire_types(column_types, headers.size());
+    std::string out(wire_magic, sizeof(wire_magic));
+    put<uint8_t>(out, wire_version);
+    out.append(3, '\0');
+    put<uint32_t>(out, static_cast<uint32_t>(headers.size()));
+    for (size_t c = 0; c < headers.size(); c++) {
+        put<uint8_t>(out, static_cast<uint8_t>(types[c]));
+        put<uint32_t>(out, static_cast<uint32_t>(headers[c].size()));
+        out += headers[c];
+    }
+    pad(out);
+
+    std::vector<std::string> batches(morsel_count(row_count, wire_batch_rows));
+    ThreadPool::shared().parallel_for(batches.size(), [&](size_t b) {
+        size_t begin = b * wire_batch_rows;
+        encode_batch(batches[b], begin, std::min(row_count, begin + wire_batch_rows), types, cell_at);
+    });
+    size_t total = out.size() + 8;
+    for (const auto& batch : batches) total += batch.size();
+    out.reserve(total);
+    for (const auto& batch : batches) out += batch;
+    put<uint32_t>(out, 0);
+    put<uint32_t>(out, 0);
+    return out;
+}
+
+class Reader {
+private:
+    std::string_view data;
+    size_t pos = 0;
+
+public:
+    explicit Reader(std::string_view data) : data(data) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (data.size() - pos < sizeof(T)) return false;
+        std::memcpy(&value, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    bool bytes(size_t n, std::string_view& out) {
+        if (data.size() - pos < n) return false;
+        out = data.substr(pos, n);
+        pos += n;
+        return true;
+    }
+
+    bool align() {
+        size_t skip = (8 - pos % 8) % 8;
+        if (data.size() - pos < skip) return false;
+        pos += skip;
+        return true;
+    }
+
+    size_t remaining() const noexcept { return data.size() - pos; }
+    bool done() const noexcept { return pos == data.size(); }
+};
+
+}
+
+std::string encode_result(const std::vector<std::string>& headers, const std::vector<ColumnType>& types,
+                          const std::vector<Row>& rows) {
+    return encode(headers, types, rows.size(), [&](size_t r, size_t c) {
+        return c < rows[r].values.size() ? &rows[r].values[c] : nullptr;
+    });
+}
+
+std::string encode_result(const std::vector<std::string>& headers, const std::vector<ColumnType>& types,
+                          const std::vector<std::vector<Value>>& rows) {
+    return encode(headers, types, rows.size(), [&](size_t r, size_t c) {
+        return c < rows[r].size() ? &rows[r][c] : nullptr;
+    });
+}
+
+bool decode_result(std::string_view data, std::vector<WireColumn>& columns,
+                   std::vector<std::vector<Value>>& rows, std::string& err) {
+    columns.clear();
+    rows.clear();
+    Reader in(data);
+    std::string_view magic;
+    uint8_t version = 0;
+    std::string_view reserved;
+    uint32_t column_count = 0;
+    if (!in.bytes(sizeof(wire_magic), magic) || magic != std::string_view(wire_magic, sizeof(wire_magic))) {
+        err = "not a result batch";
+        return false;
+    }
+    if (!in.get(version) || version != wire_version) { err = "unsupported wire version"; return false; }
+    if (!in.bytes(3, reserved) || !in.get(column_count)) { err = "truncated header"; return false; }
+    for (uint32_t c = 0; c < column_count; c++) {
+        uint8_t type = 0;
+        uint32_t length = 0;
+        std::string_view name;
+        if (!in.get(type) || !in.get(length) || !in.bytes(length, name) || type > 1) { err = "bad column header"; return false; }
+        columns.push_back(WireColumn{ std::string(name), static_cast<WireType>(type) });
+    }
+    if (!in.align()) { err = "truncated header"; return false; }
+
+    while (true) {
+        uint32_t count = 0;
+        uint32_t unused = 0;
+        if (!in.get(count) || !in.get(unused)) { err = "truncated batch"; return false; }
+        if (count == 0) break;
+        if (count > in.remaining() / (sizeof(int64_t) * std::max<size_t>(1, columns.size()))) {
+            err = "truncated batch";
+            return false;
+        }
+        size_t base = rows.size();
+        rows.resize(base + count, std::vector<Value>(columns.size()));
+        for (size_t c = 0; c < columns.size(); c++) {
+            std::string_view validity;
+            if (!in.bytes((count + 7) / 8, validity) || !in.align()) { err = "truncated batch"; return false; }
+            auto present = [&](size_t r) { return (static_cast<uint8_t>(validity[r / 8]) >> (r % 8)) & 1u; };
+            if (columns[c].type == WireType::Int) {
+                for (size_t r = 0; r < count; r++) {
+                    int64_t number = 0;
+                    if (!in.get(number)) { err = "truncated batch"; return false; }
+                    if (present(r)) rows[base + r][c] = number;
+                }
+                continue;
+            }
+            std::vector<uint64_t> offsets(count + 1);
+            for (auto& offset : offsets) {
+                if (!in.get(offset)) { err = "truncated batch"; return false; }
+            }
+            std::string_view bytes;
+            if (!in.bytes(offsets.back(), bytes) || !in.align()) { err = "truncated batch"; return false; }
+            for (size_t r = 0; r < count; r++) {
+                if (offsets[r] > offsets[r + 1] || offsets[r + 1] > bytes.size()) { err = "bad string offsets"; return false; }
+                if (present(r)) rows[base + r][c] = std::string(bytes.substr(offsets[r], offsets[r + 1] - offsets[r]));
+            }
+        }
+    }
+    if (!in.done()) { err = "trailing bytes"; return false; }
+    return true;
+}
+
+}
\ No newline at end of file
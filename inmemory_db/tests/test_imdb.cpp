@@ -2,8 +2,31 @@
 #include "imdb/database.hpp"
 #include "imdb/table.hpp"
 #include "imdb/types.hpp"
+#include "imdb/aggregate.hpp"
+#include "imdb/sort.hpp"
+#include "imdb/planner.hpp"
+#include "imdb/profile.hpp"
+#include "imdb/statement.hpp"
+#include "imdb/sql.hpp"
+#include "imdb/plan.hpp"
+#include "imdb/cache.hpp"
+#include "imdb/view.hpp"
+#include "imdb/transaction.hpp"
+#include "imdb/pool.hpp"
+#include "imdb/async.hpp"
+#include "imdb/wire.hpp"
+#include "imdb/scheduler.hpp"
+#ifdef IMDB_SERVER
+#include "imdb/server.hpp"
+#endif
 #include <filesystem>
 #include <fstream>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <limits>
 
 using namespace imdb;
 namespace fs = std::filesystem;
@@ -217,4 +240,1541 @@ TEST_CASE("inner_join_missing_table_or_column_returns_false") {
     std::vector<std::vector<Value>> rows;
     REQUIRE_FALSE(db.inner_join("a", "id", "b", "id", headers, rows));
     REQUIRE_FALSE(db.inner_join("a", "nope", "a", "id", headers, rows));
+}
+
+TEST_CASE("compound_predicate_select_update_delete") {
+    Database db("T");
+    db.create_table("new_house");
+    Table* t = db.get_table("new_house");
+    t->add_column("id", ColumnType::Int);
+    t->add_column("address", ColumnType::Text);
+    t->add_column("city", ColumnType::Text);
+    t->add_column("price", ColumnType::Int);
+    t->add_column("bedrooms", ColumnType::Int);
+    auto csv = write_csv();
+    t->import_csv(csv.string(), true);
+
+    auto cheap_or_sunny = Predicate::any_of({
+        Predicate::compare("price", CompareOp::Lt, int64_t(900000)),
+        Predicate::compare("city", CompareOp::Eq, std::string("Sunnyvale")) });
+    REQUIRE(t->select_where(cheap_or_sunny).size() == 2);
+
+    auto big_not_sunny = Predicate::all_of({
+        Predicate::compare("bedrooms", CompareOp::Ge, int64_t(3)),
+        Predicate::negate(Predicate::compare("city", CompareOp::Eq, std::string("Sunnyvale"))) });
+    auto rows = t->select_where(big_not_sunny);
+    REQUIRE(rows.size() == 1);
+    REQUIRE(std::get<int64_t>(rows[0].values[0]) == 3);
+
+    REQUIRE(t->update_where(cheap_or_sunny, "bedrooms", int64_t(5)) == 2);
+    REQUIRE(t->select_where(Predicate::compare("bedrooms", CompareOp::Eq, int64_t(5))).size() == 2);
+    REQUIRE(t->delete_where(Predicate::negate(cheap_or_sunny)) == 1);
+    REQUIRE(t->row_count() == 2);
+    REQUIRE(t->select_where(Predicate::compare("nope", CompareOp::Eq, int64_t(1))).empty());
+}
+
+TEST_CASE("predicate_batches_preserve_row_order") {
+    Table t("big");
+    t.add_column("id", ColumnType::Int);
+    t.add_column("bucket", ColumnType::Int);
+    for (int64_t i = 0; i < 5000; i++) REQUIRE(t.insert_row({ i, i % 7 }));
+    auto p = Predicate::any_of({
+        Predicate::compare("bucket", CompareOp::Eq, int64_t(3)),
+        Predicate::all_of({ Predicate::compare("id", CompareOp::Ge, int64_t(4000)),
+                            Predicate::compare("bucket", CompareOp::Ne, int64_t(0)) }) });
+    auto ids = t.find_rows(p);
+    size_t expected = 0;
+    for (int64_t i = 0; i < 5000; i++) {
+        if (i % 7 == 3 || (i >= 4000 && i % 7 != 0)) expected++;
+    }
+    REQUIRE(ids.size() == expected);
+    REQUIRE(std::is_sorted(ids.begin(), ids.end()));
+}
+
+
+TEST_CASE("hash_aggregate_group_by") {
+    Table t("sales");
+    t.add_column("city", ColumnType::Text);
+    t.add_column("price", ColumnType::Int);
+    REQUIRE(t.insert_row({ std::string("A"), int64_t(10) }));
+    REQUIRE(t.insert_row({ std::string("B"), int64_t(5) }));
+    REQUIRE(t.insert_row({ std::string("A"), int64_t(20) }));
+    REQUIRE(t.insert_row({ std::string("A"), Value(std::monostate{}) }));
+
+    AggregateQuery q;
+    q.group_by = { "city" };
+    q.aggregates = { { AggregateFunc::Count, "" }, { AggregateFunc::Count, "price" },
+                     { AggregateFunc::Sum, "price" }, { AggregateFunc::Min, "price" },
+                     { AggregateFunc::Max, "price" }, { AggregateFunc::Avg, "price" } };
+    std::vector<std::string> headers;
+    std::vector<std::vector<Value>> rows;
+    REQUIRE(hash_aggregate(t, q, headers, rows));
+    REQUIRE(headers.size() == 7);
+    REQUIRE(headers[1] == "COUNT(*)");
+    REQUIRE(rows.size() == 2);
+    REQUIRE(std::get<std::string>(rows[0][0]) == "A");
+    REQUIRE(std::get<int64_t>(rows[0][1]) == 3);
+    REQUIRE(std::get<int64_t>(rows[0][2]) == 2);
+    REQUIRE(std::get<int64_t>(rows[0][3]) == 30);
+    REQUIRE(std::get<int64_t>(rows[0][4]) == 10);
+    REQUIRE(std::get<int64_t>(rows[0][5]) == 20);
+    REQUIRE(std::get<std::string>(rows[0][6]) == "15.00");
+
+    q.group_by.clear();
+    q.aggregates = { { AggregateFunc::Sum, "price" } };
+    q.where = Predicate::compare("city", CompareOp::Eq, std::string("Z"));
+    REQUIRE(hash_aggregate(t, q, headers, rows));
+    REQUIRE(rows.size() == 1);
+    REQUIRE(std::holds_alternative<std::monostate>(rows[0][0]));
+
+    q.aggregates = { { AggregateFunc::Sum, "city" } };
+    REQUIRE_FALSE(hash_aggregate(t, q, headers, rows));
+
+    const int64_t top = std::numeric_limits<int64_t>::max();
+    REQUIRE(t.insert_row({ std::string("C"), top }));
+    REQUIRE(t.insert_row({ std::string("C"), top }));
+    REQUIRE(t.insert_row({ std::string("D"), top }));
+    REQUIRE(t.insert_row({ std::string("D"), int64_t(1) }));
+    REQUIRE(t.insert_row({ std::string("D"), int64_t(-2) }));
+    q.group_by = { "city" };
+    q.aggregates = { { AggregateFunc::Sum, "price" }, { AggregateFunc::Avg, "price" } };
+    q.where = Predicate::compare("price", CompareOp::Ne, int64_t(5));
+    REQUIRE(hash_aggregate(t, q, headers, rows));
+    REQUIRE(rows.size() == 3);
+    REQUIRE(std::get<std::string>(rows[1][0]) == "C");
+    REQUIRE(std::holds_alternative<std::monostate>(rows[1][1]));
+    REQUIRE(std::get<std::string>(rows[1][2]) == "9223372036854775808.00");
+    REQUIRE(std::get<int64_t>(rows[2][1]) == top - 1);
+}
+
+TEST_CASE("hash_aggregate_parallel_matches_serial") {
+    Table t("big");
+    t.add_column("bucket", ColumnType::Int);
+    t.add_column("value", ColumnType::Int);
+    for (int64_t i = 0; i < 100000; i++) REQUIRE(t.insert_row({ i % 13, i }));
+    AggregateQuery q;
+    q.group_by = { "bucket" };
+    q.aggregates = { { AggregateFunc::Count, "" }, { AggregateFunc::Sum, "value" }, { AggregateFunc::Max, "value" } };
+    q.where = Predicate::compare("value", CompareOp::Ge, int64_t(10));
+    std::vector<std::string> h1, h4;
+    std::vector<std::vector<Value>> serial, parallel;
+    REQUIRE(hash_aggregate(t, q, h1, serial, 1));
+    REQUIRE(hash_aggregate(t, q, h4, parallel, 4));
+    REQUIRE(serial.size() == 13);
+    REQUIRE(serial == parallel);
+}
+
+
+TEST_CASE("order_by_top_k_and_parallel_sort") {
+    Table t("big");
+    t.add_column("id", ColumnType::Int);
+    t.add_column("score", ColumnType::Int);
+    for (int64_t i = 0; i < 100000; i++) REQUIRE(t.insert_row({ i, (i * 7919) % 1000 }));
+    std::vector<size_t> ids(t.row_count());
+    for (size_t i = 0; i < ids.size(); i++) ids[i] = i;
+
+    auto serial = order_rows(t, ids, 1, true, std::nullopt, 1);
+    auto parallel = order_rows(t, ids, 1, true, std::nullopt, 4);
+    REQUIRE(serial == parallel);
+    REQUIRE(std::get<int64_t>(t.get_rows()[serial.front()].values[1]) == 999);
+    REQUIRE(std::get<int64_t>(t.get_rows()[serial.back()].values[1]) == 0);
+
+    auto top = order_rows(t, ids, 1, true, size_t(10), 1);
+    REQUIRE(top.size() == 10);
+    REQUIRE(std::equal(top.begin(), top.end(), serial.begin()));
+
+    auto asc = order_rows(t, t.find_rows(Predicate::compare("id", CompareOp::Lt, int64_t(5))), 1, false, size_t(3));
+    REQUIRE(asc.size() == 3);
+    REQUIRE(asc[0] == 0);
+
+    REQUIRE(order_rows(t, ids, 1, true, size_t(0), 1).empty());
+    REQUIRE(order_rows(t, ids, 1, false, size_t(0), 4).empty());
+}
+
+
+TEST_CASE("projection_select_and_join") {
+    Database db("T");
+    db.create_table("a");
+    db.create_table("b");
+    Table* a = db.get_table("a");
+    Table* b = db.get_table("b");
+    a->add_column("id", ColumnType::Int);
+    a->add_column("name", ColumnType::Text);
+    a->add_column("wide", ColumnType::Text);
+    b->add_column("id", ColumnType::Int);
+    b->add_column("note", ColumnType::Text);
+    REQUIRE(a->insert_row({ int64_t(1), std::string("x"), std::string("...") }));
+    REQUIRE(a->insert_row({ int64_t(2), std::string("y"), std::string("...") }));
+    REQUIRE(b->insert_row({ int64_t(2), std::string("p") }));
+
+    auto rows = a->select_where(Predicate::compare("id", CompareOp::Ge, int64_t(1)), { "name" });
+    REQUIRE(rows.size() == 2);
+    REQUIRE(rows[0].values.size() == 1);
+    REQUIRE(std::get<std::string>(rows[1].values[0]) == "y");
+    REQUIRE(a->select_where(Predicate::compare("id", CompareOp::Eq, int64_t(1)), { "nope" }).empty());
+
+    std::vector<std::string> headers;
+    std::vector<std::vector<Value>> out;
+    REQUIRE(db.inner_join("a", "id", "b", "id", { "b.note", "name" }, headers, out));
+    REQUIRE(headers == std::vector<std::string>{ "b.note", "a.name" });
+    REQUIRE(out.size() == 1);
+    REQUIRE(out[0].size() == 2);
+    REQUIRE(std::get<std::string>(out[0][0]) == "p");
+    REQUIRE(std::get<std::string>(out[0][1]) == "y");
+    REQUIRE_FALSE(db.inner_join("a", "id", "b", "id", { "id" }, headers, out));
+}
+
+
+TEST_CASE("join_rows_late_materialization") {
+    Database db("T");
+    db.create_table("a");
+    db.create_table("b");
+    Table* a = db.get_table("a");
+    Table* b = db.get_table("b");
+    a->add_column("id", ColumnType::Int);
+    a->add_column("name", ColumnType::Text);
+    b->add_column("id", ColumnType::Int);
+    b->add_column("amount", ColumnType::Int);
+    REQUIRE(a->insert_row({ int64_t(1), std::string("x") }));
+    REQUIRE(a->insert_row({ int64_t(2), std::string("y") }));
+    REQUIRE(b->insert_row({ int64_t(2), int64_t(10) }));
+    REQUIRE(b->insert_row({ int64_t(1), int64_t(5) }));
+    REQUIRE(b->insert_row({ int64_t(2), int64_t(7) }));
+
+    JoinResult joined;
+    REQUIRE(db.join_rows("a", "id", "b", "id", joined));
+    REQUIRE(joined.size() == 3);
+    REQUIRE(joined.row_pair(0) == std::pair<size_t, size_t>(0, 1));
+    REQUIRE(joined.row_pair(1) == std::pair<size_t, size_t>(1, 0));
+    REQUIRE(joined.row_pair(2) == std::pair<size_t, size_t>(1, 2));
+    auto amount = joined.resolve("b.amount");
+    REQUIRE(amount.has_value());
+    REQUIRE(std::get<int64_t>(joined.value(2, *amount)) == 7);
+    REQUIRE_FALSE(joined.resolve("id").has_value());
+
+    AggregateQuery q;
+    q.group_by = { "name" };
+    q.aggregates = { { AggregateFunc::Sum, "amount" } };
+    std::vector<std::string> headers;
+    std::vector<std::vector<Value>> rows;
+    REQUIRE(hash_aggregate(joined, q, headers, rows));
+    REQUIRE(rows.size() == 2);
+    REQUIRE(std::get<int64_t>(rows[1][1]) == 17);
+
+    fs::path dir = "inmemory_db/tests/sample";
+    fs::create_directories(dir);
+    REQUIRE(joined.export_csv((dir / "join_out.csv").string(), { *joined.resolve("name"), *amount }));
+    std::ifstream in((dir / "join_out.csv").string());
+    std::string header;
+    std::getline(in, header);
+    REQUIRE(header == "a.name,b.amount");
+}
+
+
+TEST_CASE("sort_merge_join_with_ordered_index") {
+    Database db("T");
+    db.create_table("a");
+    db.create_table("b");
+    Table* a = db.get_table("a");
+    Table* b = db.get_table("b");
+    a->add_column("id", ColumnType::Int);
+    a->add_column("name", ColumnType::Text);
+    b->add_column("id", ColumnType::Int);
+    b->add_column("note", ColumnType::Text);
+    REQUIRE(a->insert_row({ int64_t(3), std::string("z") }));
+    REQUIRE(a->insert_row({ int64_t(1), std::string("x") }));
+    REQUIRE(a->insert_row({ int64_t(1), std::string("w") }));
+    REQUIRE(b->insert_row({ int64_t(1), std::string("p") }));
+    REQUIRE(b->insert_row({ int64_t(3), std::string("q") }));
+    REQUIRE(b->insert_row({ int64_t(2), std::string("r") }));
+    REQUIRE(b->insert_row({ int64_t(1), std::string("s") }));
+
+    JoinResult hashed;
+    REQUIRE(db.join_rows("a", "id", "b", "id", hashed));
+    REQUIRE(hashed.strategy() == JoinStrategy::Hash);
+    REQUIRE(hashed.size() == 5);
+
+    REQUIRE(a->create_index("id", IndexKind::Ordered));
+    REQUIRE_FALSE(a->create_index("id", IndexKind::Ordered));
+    REQUIRE(b->create_index("id", IndexKind::Ordered));
+    JoinResult merged;
+    REQUIRE(db.join_rows("a", "id", "b", "id", merged));
+    REQUIRE(merged.strategy() == JoinStrategy::SortMerge);
+    REQUIRE(merged.size() == 5);
+    REQUIRE(merged.row_pair(0) == std::pair<size_t, size_t>(1, 0));
+    REQUIRE(merged.row_pair(1) == std::pair<size_t, size_t>(1, 3));
+    REQUIRE(merged.row_pair(4) == std::pair<size_t, size_t>(0, 1));
+
+    REQUIRE(b->update_where("note", std::string("r"), "id", int64_t(3)) == 1);
+    REQUIRE(a->delete_where("name", std::string("w")) == 1);
+    REQUIRE(db.join_rows("a", "id", "b", "id", merged));
+    REQUIRE(merged.size() == 4);
+    REQUIRE(b->get_index(0)->find(int64_t(3))->size() == 2);
+    REQUIRE(*a->get_index(0)->find(int64_t(1)) == std::vector<size_t>{ 1 });
+
+    REQUIRE(b->drop_index("id"));
+    REQUIRE_FALSE(b->is_sorted_by(0));
+    REQUIRE(db.join_rows("a", "id", "b", "id", merged));
+    REQUIRE(merged.strategy() == JoinStrategy::Hash);
+    REQUIRE(merged.size() == 4);
+
+    REQUIRE(b->delete_where("id", int64_t(1)) == 2);
+    REQUIRE(b->is_sorted_by(0));
+    REQUIRE(db.join_rows("a", "id", "b", "id", merged));
+    REQUIRE(merged.strategy() == JoinStrategy::SortMerge);
+    REQUIRE(merged.size() == 2);
+    REQUIRE(b->insert_row({ int64_t(2), std::string("t") }));
+    REQUIRE_FALSE(b->is_sorted_by(0));
+    REQUIRE(db.join_rows("a", "id", "b", "id", merged));
+    REQUIRE(merged.strategy() == JoinStrategy::Hash);
+}
+
+
+TEST_CASE("index_nested_loop_join_probes_index") {
+    Database db("T");
+    db.create_table("small");
+    db.create_table("big");
+    Table* small = db.get_table("small");
+    Table* big = db.get_table("big");
+    small->add_column("id", ColumnType::Int);
+    small->add_column("tag", ColumnType::Text);
+    big->add_column("id", ColumnType::Int);
+    big->add_column("payload", ColumnType::Int);
+    for (int64_t i = 0; i < 20000; i++) REQUIRE(big->insert_row({ (i * 7) % 20000, i }));
+    REQUIRE(small->insert_row({ int64_t(14), std::string("a") }));
+    REQUIRE(small->insert_row({ int64_t(3), std::string("b") }));
+    REQUIRE(small->insert_row({ int64_t(99999), std::string("c") }));
+
+    REQUIRE(big->create_index("id", IndexKind::Hash));
+    JoinResult joined;
+    REQUIRE(db.join_rows("small", "id", "big", "id", joined));
+    REQUIRE(joined.strategy() == JoinStrategy::IndexNestedLoop);
+    REQUIRE(joined.size() == 2);
+    REQUIRE(joined.row_pair(0) == std::pair<size_t, size_t>(0, 2));
+    REQUIRE(std::get<int64_t>(joined.value(1, *joined.resolve("big.id"))) == 3);
+
+    REQUIRE(db.join_rows("big", "id", "small", "id", joined));
+    REQUIRE(joined.strategy() == JoinStrategy::IndexNestedLoop);
+    REQUIRE(joined.size() == 2);
+    REQUIRE(joined.row_pair(0) == std::pair<size_t, size_t>(2, 0));
+
+    REQUIRE(big->drop_index("id"));
+    REQUIRE(big->create_index("id", IndexKind::Ordered));
+    JoinInput left{ "small", "id", Predicate::compare("tag", CompareOp::Ne, std::string("a")) };
+    JoinInput right{ "big", "id", Predicate::compare("payload", CompareOp::Lt, int64_t(10)) };
+    REQUIRE(db.join_rows(left, right, joined));
+    REQUIRE(joined.strategy() == JoinStrategy::IndexNestedLoop);
+    REQUIRE(joined.size() == 0);
+    right.where = Predicate::compare("payload", CompareOp::Ge, int64_t(10));
+    REQUIRE(db.join_rows(left, right, joined));
+    REQUIRE(joined.size() == 1);
+    REQUIRE(std::get<std::string>(joined.value(0, *joined.resolve("tag"))) == "b");
+}
+
+
+TEST_CASE("multi_way_join_orders_by_estimated_size") {
+    Database db("T");
+    db.create_table("customers");
+    db.create_table("orders");
+    db.create_table("items");
+    Table* customers = db.get_table("customers");
+    Table* orders = db.get_table("orders");
+    Table* items = db.get_table("items");
+    customers->add_column("id", ColumnType::Int);
+    customers->add_column("name", ColumnType::Text);
+    orders->add_column("id", ColumnType::Int);
+    orders->add_column("cust_id", ColumnType::Int);
+    items->add_column("order_id", ColumnType::Int);
+    items->add_column("cust_id", ColumnType::Int);
+    for (int64_t i = 0; i < 100; i++) REQUIRE(customers->insert_row({ i, "c" + std::to_string(i) }));
+    for (int64_t i = 0; i < 2000; i++) REQUIRE(orders->insert_row({ i, i % 100 }));
+    REQUIRE(items->insert_row({ int64_t(3), int64_t(3) }));
+    REQUIRE(items->insert_row({ int64_t(3), int64_t(4) }));
+    REQUIRE(items->insert_row({ int64_t(17), int64_t(17) }));
+    REQUIRE(items->insert_row({ int64_t(1999), int64_t(99) }));
+    REQUIRE(items->insert_row({ int64_t(5000), int64_t(0) }));
+
+    REQUIRE(orders->estimate_distinct(0) > 1900);
+    REQUIRE(orders->estimate_distinct(0) <= 2000);
+    REQUIRE(orders->estimate_distinct(1) > 95);
+    REQUIRE(orders->estimate_distinct(1) < 105);
+
+    std::vector<JoinCondition> conditions{
+        { "customers", "id", "orders", "cust_id" },
+        { "orders", "id", "items", "order_id" },
+    };
+    JoinPlan plan;
+    REQUIRE(db.plan_join(conditions, plan));
+    REQUIRE(plan.steps.size() == 3);
+    REQUIRE(plan.tables[plan.steps[0].table] == "items");
+    REQUIRE(plan.tables[plan.steps[1].table] == "orders");
+    REQUIRE(plan.tables[plan.steps[2].table] == "customers");
+    REQUIRE_FALSE(plan.steps[1].build_inner);
+
+    JoinResult joined;
+    REQUIRE(db.join_rows(conditions, joined));
+    REQUIRE(joined.width() == 3);
+    REQUIRE(joined.size() == 4);
+    REQUIRE(joined.row_id(0, 0) == 3);
+    REQUIRE(joined.row_id(0, 1) == 3);
+    REQUIRE(joined.row_id(0, 2) == 0);
+    REQUIRE(std::get<std::string>(joined.value(3, *joined.resolve("name"))) == "c99");
+
+    conditions.push_back({ "items", "cust_id", "customers", "id" });
+    REQUIRE(db.join_rows(conditions, joined));
+    REQUIRE(joined.size() == 3);
+
+    REQUIRE(customers->create_index("id", IndexKind::Hash));
+    REQUIRE(db.plan_join(conditions, plan));
+    REQUIRE(plan.tables[plan.steps[1].table] == "customers");
+    REQUIRE(plan.steps[1].strategy == JoinStrategy::IndexNestedLoop);
+    REQUIRE(db.join_rows(conditions, joined));
+    REQUIRE(joined.size() == 3);
+
+    std::vector<std::string> headers;
+    std::vector<std::vector<Value>> rows;
+    REQUIRE(db.inner_join(conditions, { "customers.name", "items.order_id" }, headers, rows));
+    REQUIRE(headers == std::vector<std::string>{ "customers.name", "items.order_id" });
+    REQUIRE(rows.size() == 3);
+
+    REQUIRE_FALSE(db.join_rows({ { "customers", "id", "orders", "missing" }, { "orders", "id", "items", "order_id" } }, joined));
+    REQUIRE_FALSE(db.join_rows({ { "customers", "id", "orders", "cust_id" }, { "orders", "id", "orders", "cust_id" } }, joined));
+}
+
+
+TEST_CASE("column_stats_incremental_and_analyze") {
+    Table t("t");
+    t.add_column("id", ColumnType::Int);
+    t.add_column("city", ColumnType::Text);
+    for (int64_t i = 0; i < 50000; i++) {
+        Value city = i % 10 == 0 ? Value{} : Value{ "c" + std::to_string(i % 500) };
+        REQUIRE(t.insert_row({ i, city }));
+    }
+
+    const ColumnStats& ids = t.column_stats(0);
+    REQUIRE(ids.null_count() == 0);
+    REQUIRE(ids.value_count() == 50000);
+    REQUIRE(std::get<int64_t>(ids.min()) == 0);
+    REQUIRE(std::get<int64_t>(ids.max()) == 49999);
+    REQUIRE(ids.distinct() > 48000);
+    REQUIRE(ids.distinct() < 52000);
+    REQUIRE_FALSE(ids.histogram().empty());
+    REQUIRE(std::get<int64_t>(ids.histogram().back().upper) == 49999);
+    size_t inserted = 0;
+    for (const auto& b : ids.histogram()) inserted += b.count;
+    REQUIRE(inserted == ids.value_count());
+
+    const ColumnStats& cities = t.column_stats(1);
+    REQUIRE(cities.null_count() == 5000);
+    REQUIRE(cities.distinct() > 440);
+    REQUIRE(cities.distinct() < 460);
+
+    REQUIRE(t.delete_where(Predicate::compare("id", CompareOp::Lt, int64_t(1000))) == 1000);
+    REQUIRE(t.column_stats(1).null_count() == 4900);
+    REQUIRE(t.column_stats(0).value_count() == 49000);
+    REQUIRE(std::get<int64_t>(t.column_stats(0).min()) == 0);
+    REQUIRE(t.column_stats(0).changes_since_analyze() > 0);
+
+    t.analyze();
+    REQUIRE(std::get<int64_t>(t.column_stats(0).min()) == 1000);
+    REQUIRE(t.column_stats(0).changes_since_analyze() == 0);
+    const auto& buckets = t.column_stats(0).histogram();
+    REQUIRE(buckets.size() == ColumnStats::histogram_buckets);
+    size_t total = 0;
+    for (const auto& b : buckets) total += b.count;
+    REQUIRE(total == 49000);
+    REQUIRE(buckets.front().count == 49000 / ColumnStats::histogram_buckets);
+    REQUIRE(std::get<int64_t>(buckets.back().upper) == 49999);
+
+    REQUIRE(t.update_where(Predicate::compare("id", CompareOp::Eq, int64_t(2001)), "city", Value{}) == 1);
+    REQUIRE(t.column_stats(1).null_count() == 4901);
+
+    REQUIRE(t.delete_where(Predicate::compare("id", CompareOp::Lt, int64_t(20000))) == 19000);
+    REQUIRE(t.column_stats(0).changes_since_analyze() == 0);
+    REQUIRE(std::get<int64_t>(t.column_stats(0).min()) == 20000);
+    REQUIRE(t.column_stats(0).distinct() > 29000);
+    REQUIRE(t.column_stats(0).distinct() < 31000);
+    size_t refreshed = 0;
+    for (const auto& b : t.column_stats(0).histogram()) refreshed += b.count;
+    REQUIRE(refreshed == 30000);
+
+    t.add_column("flag", ColumnType::Int);
+    REQUIRE(t.column_stats(2).value_count() == 30000);
+    REQUIRE(t.column_stats(2).distinct() == 1);
+    REQUIRE(t.remove_column("city"));
+    REQUIRE(t.column_stats(1).value_count() == 30000);
+    t.clear_all_rows();
+    REQUIRE(t.column_stats(0).value_count() == 0);
+    REQUIRE(t.column_stats(0).distinct() == 0);
+}
+
+TEST_CASE("access_path_selection_uses_stats_zone_maps_and_indexes") {
+    Table t("t");
+    t.add_column("id", ColumnType::Int);
+    t.add_column("bucket", ColumnType::Int);
+    for (int64_t i = 0; i < 20000; i++) REQUIRE(t.insert_row({ i, i % 4 }));
+
+    auto expected = [&](const Predicate& p) {
+        std::vector<size_t> ids;
+        PredicateEvaluator::bind(p, t.get_columns())->filter(t.get_rows(), ids);
+        return ids;
+    };
+    auto check = [&](const Predicate& p, AccessMethod method) {
+        REQUIRE(plan_access(t, p).method == method);
+        REQUIRE(t.find_rows(p) == expected(p));
+    };
+
+    Predicate point = Predicate::compare("id", CompareOp::Eq, int64_t(5));
+    Predicate range = Predicate::compare("id", CompareOp::Lt, int64_t(100));
+    Predicate wide = Predicate::compare("bucket", CompareOp::Ge, int64_t(0));
+    Predicate one_bucket = Predicate::compare("bucket", CompareOp::Eq, int64_t(2));
+    check(point, AccessMethod::ZoneMapScan);
+    check(range, AccessMethod::ZoneMapScan);
+    check(wide, AccessMethod::FullScan);
+    check(one_bucket, AccessMethod::FullScan);
+
+    REQUIRE(t.create_index("id", IndexKind::Hash));
+    check(point, AccessMethod::HashIndex);
+    check(range, AccessMethod::ZoneMapScan);
+    check(Predicate::all_of({ one_bucket, point }), AccessMethod::HashIndex);
+    check(Predicate::any_of({ one_bucket, point }), AccessMethod::FullScan);
+
+    REQUIRE(t.create_index("bucket", IndexKind::Ordered));
+    check(one_bucket, AccessMethod::OrderedIndex);
+    check(Predicate::compare("bucket", CompareOp::Gt, int64_t(2)), AccessMethod::OrderedIndex);
+    check(wide, AccessMethod::FullScan);
+
+    AccessPlan plan = plan_access(t, point);
+    REQUIRE(plan.table_rows == 20000);
+    REQUIRE(plan.estimated_rows < 2.0);
+    REQUIRE(describe_access(plan).find("HashIndex(id = 5)") == 0);
+
+    t.analyze();
+    double s = estimate_selectivity(t, Predicate::compare("id", CompareOp::Lt, int64_t(5000)));
+    REQUIRE(s > 0.24);
+    REQUIRE(s < 0.26);
+    REQUIRE(estimate_selectivity(t, Predicate::compare("id", CompareOp::Gt, int64_t(50000))) == 0.0);
+
+    REQUIRE(t.delete_where(range) == 100);
+    REQUIRE(t.update_where(Predicate::compare("id", CompareOp::Eq, int64_t(150)), "id", int64_t(-1)) == 1);
+    check(Predicate::compare("id", CompareOp::Lt, int64_t(0)), AccessMethod::ZoneMapScan);
+    REQUIRE(t.find_rows(Predicate::compare("id", CompareOp::Lt, int64_t(0))).size() == 1);
+}
+
+
+TEST_CASE("query_profile_records_stages") {
+    Table t("t");
+    t.add_column("id", ColumnType::Int);
+    for (int64_t i = 0; i < 5000; i++) REQUIRE(t.insert_row({ i }));
+
+    QueryProfile profile;
+    {
+        ProfileScope scope(profile);
+        StageTimer outer("Execute");
+        auto ids = t.find_rows(Predicate::compare("id", CompareOp::Lt, int64_t(100)));
+        REQUIRE(ids.size() == 100);
+        REQUIRE(t.select_rows(ids).size() == 100);
+    }
+    REQUIRE(active_profile() == nullptr);
+    t.find_rows(Predicate::compare("id", CompareOp::Lt, int64_t(100)));
+
+    const auto& stages = profile.get_stages();
+    REQUIRE(stages.size() == 3);
+    REQUIRE(stages[0].name == "Execute");
+    REQUIRE(stages[0].depth == 0);
+    REQUIRE(stages[1].name == "Scan t ZoneMapScan");
+    REQUIRE(stages[1].depth == 1);
+    REQUIRE(stages[1].rows_in == 5000);
+    REQUIRE(stages[1].rows_out == 100);
+    REQUIRE(stages[1].rows_skipped == 5000 - ZoneMap::zone_rows);
+    REQUIRE(stages[1].zones_skipped == 4);
+    REQUIRE(stages[1].bytes > 0);
+    REQUIRE(stages[2].name == "Materialize");
+    REQUIRE(stages[2].rows_out == 100);
+    REQUIRE(profile.total_nanos() == stages[0].nanos);
+    REQUIRE(stages[0].nanos >= stages[1].nanos);
+}
+
+TEST_CASE("prepared_statements_bind_parameters_and_replan") {
+    Database db("DB");
+    REQUIRE(db.create_table("t"));
+    Table* t = db.get_table("t");
+    t->add_column("id", ColumnType::Int);
+    t->add_column("name", ColumnType::Text);
+
+    StatementSpec insert;
+    insert.kind = StatementKind::Insert;
+    insert.table = "t";
+    insert.values = { Operand{ Value{}, 0 }, Operand{ Value{ std::string("row") }, std::nullopt } };
+    auto ins = PreparedStatement::prepare(db, insert);
+    REQUIRE(ins.has_value());
+    REQUIRE(ins->parameter_count() == 1);
+    REQUIRE(ins->parameter_type(0) == ColumnType::Int);
+    StatementResult result;
+    for (int64_t i = 0; i < 500; i++) REQUIRE(ins->execute({ Value{ i } }, result));
+    REQUIRE(t->row_count() == 500);
+    REQUIRE_FALSE(ins->execute({ Value{ std::string("x") } }, result));
+
+    StatementSpec select;
+    select.kind = StatementKind::Select;
+    select.table = "t";
+    select.columns = { "id" };
+    select.where = Predicate::placeholder("id", CompareOp::Eq, 0);
+    auto sel = PreparedStatement::prepare(db, select);
+    REQUIRE(sel.has_value());
+    REQUIRE(sel->access_plan().method != AccessMethod::HashIndex);
+    REQUIRE(sel->execute({ Value{ int64_t(42) } }, result));
+    REQUIRE(result.rows.size() == 1);
+    REQUIRE(std::get<int64_t>(result.rows[0].values[0]) == 42);
+
+    REQUIRE(t->create_index("id", IndexKind::Hash));
+    REQUIRE(sel->execute({ Value{ int64_t(7) } }, result));
+    REQUIRE(sel->access_plan().method == AccessMethod::HashIndex);
+    REQUIRE(result.headers == std::vector<std::string>{ "id" });
+    REQUIRE(std::get<int64_t>(result.rows[0].values[0]) == 7);
+
+    StatementSpec update;
+    update.kind = StatementKind::Update;
+    update.table = "t";
+    update.update_column = "name";
+    update.values = { Operand{ Value{}, 0 } };
+    update.where = Predicate::placeholder("id", CompareOp::Lt, 1);
+    auto upd = PreparedStatement::prepare(db, update);
+    REQUIRE(upd.has_value());
+    REQUIRE(upd->parameter_type(0) == ColumnType::Text);
+    REQUIRE(upd->parameter_type(1) == ColumnType::Int);
+    REQUIRE(upd->execute({ Value{ std::string("low") }, Value{ int64_t(10) } }, result));
+    REQUIRE(result.affected == 10);
+
+    StatementSpec remove;
+    remove.kind = StatementKind::Delete;
+    remove.table = "t";
+    remove.where = Predicate::placeholder("name", CompareOp::Eq, 0);
+    auto del = PreparedStatement::prepare(db, remove);
+    REQUIRE(del.has_value());
+    REQUIRE(del->execute({ Value{ std::string("low") } }, result));
+    REQUIRE(result.affected == 10);
+    REQUIRE(t->row_count() == 490);
+
+    REQUIRE(db.drop_table("t"));
+    REQUIRE_FALSE(sel->execute({ Value{ int64_t(1) } }, result));
+}
+
+TEST_CASE("sql_front_end_compiles_reusable_plans") {
+    Database db("DB");
+    auto run = [&](const std::string& text, QueryResult& result) {
+        SqlStatement stmt;
+        PlanNode plan;
+        std::string err;
+        REQUIRE(parse_sql(text, stmt, err));
+        REQUIRE(compile_sql(db, stmt, plan, err));
+        return execute_plan(db, plan, {}, result, err);
+    };
+
+    QueryResult result;
+    REQUIRE(run("CREATE TABLE users (id INT PRIMARY KEY, name TEXT NOT NULL, city TEXT)", result));
+    REQUIRE(run("CREATE TABLE orders (oid INT, uid INT, amount INT)", result));
+    REQUIRE(run("INSERT INTO users VALUES (1, 'ann', 'Oslo'), (2, 'bob', 'Rome'), (3, 'cy', 'Oslo')", result));
+    REQUIRE(result.affected == 3);
+    REQUIRE_FALSE(run("INSERT INTO users (id, city) VALUES (4, 'Rome')", result));
+    REQUIRE(run("INSERT INTO orders VALUES (1, 1, 10), (2, 1, 20), (3, 2, 5), (4, 3, 7);", result));
+
+    REQUIRE(run("SELECT city, COUNT(*) FROM users GROUP BY city ORDER BY city", result));
+    REQUIRE(result.headers == std::vector<std::string>{ "city", "COUNT(*)" });
+    REQUIRE(result.rows.size() == 2);
+    REQUIRE(std::get<int64_t>(result.rows[0][1]) == 2);
+
+    REQUIRE(run("SELECT users.name, SUM(amount) FROM users JOIN orders ON id = uid WHERE amount > 5 AND city = 'Oslo' "
+                "GROUP BY users.name ORDER BY users.name", result));
+    REQUIRE(result.rows.size() == 2);
+    REQUIRE(std::get<std::string>(result.rows[0][0]) == "ann");
+    REQUIRE(std::get<int64_t>(result.rows[0][1]) == 30);
+
+    REQUIRE(run("UPDATE users SET city = 'Pisa' WHERE name = 'bob' OR id > 2", result));
+    REQUIRE(result.affected == 2);
+    REQUIRE_FALSE(run("INSERT INTO users VALUES (5, 'dee', 'Nice'), (1, 'dup', 'Oslo')", result));
+    REQUIRE_FALSE(run("UPDATE users SET city = 'Bern', id = 1 WHERE id = 2", result));
+    REQUIRE_FALSE(run("UPDATE users SET city = 'Bern', id = 9 WHERE id > 1", result));
+    REQUIRE(run("SELECT name, city FROM users WHERE id > 1 ORDER BY name", result));
+    REQUIRE(result.rows.size() == 2);
+    REQUIRE(std::get<std::string>(result.rows[0][1]) == "Pisa");
+    REQUIRE(std::get<std::string>(result.rows[1][1]) == "Pisa");
+    REQUIRE(run("UPDATE users SET city = 'Bern', id = 9 WHERE id = 3", result));
+    REQUIRE(result.affected == 1);
+    REQUIRE(run("SELECT name, city FROM users WHERE id = 9", result));
+    REQUIRE(result.rows.size() == 1);
+    REQUIRE(std::get<std::string>(result.rows[0][1]) == "Bern");
+    REQUIRE(run("DELETE FROM orders WHERE amount < 8", result));
+    REQUIRE(result.affected == 2);
+
+    SqlStatement stmt;
+    std::string err;
+    REQUIRE(parse_sql("select name from users where id >= ? order by name desc limit 1", stmt, err));
+    REQUIRE(stmt.parameter_count == 1);
+    PlanNode plan;
+    REQUIRE(compile_sql(db, stmt, plan, err));
+    REQUIRE(plan.kind == PlanNode::Kind::Project);
+    REQUIRE(plan.children[0].kind == PlanNode::Kind::Sort);
+    REQUIRE(plan.children[0].children[0].kind == PlanNode::Kind::Scan);
+    REQUIRE(execute_plan(db, plan, { Value{ int64_t(1) } }, result, err));
+    REQUIRE(std::get<std::string>(result.rows[0][0]) == "cy");
+    REQUIRE(execute_plan(db, plan, { Value{ int64_t(2) } }, result, err));
+    REQUIRE(std::get<std::string>(result.rows[0][0]) == "cy");
+    REQUIRE_FALSE(execute_plan(db, plan, {}, result, err));
+
+    REQUIRE_FALSE(parse_sql("SELECT FROM users", stmt, err));
+    REQUIRE_FALSE(parse_sql("SELECT name FROM users WHERE name = 'open", stmt, err));
+    REQUIRE(err == "unterminated string");
+    REQUIRE(parse_sql("SELECT nope FROM users", stmt, err));
+    REQUIRE_FALSE(compile_sql(db, stmt, plan, err));
+    REQUIRE(err == "no such column");
+}
+
+TEST_CASE("result_cache_tracks_table_versions_and_capacity") {
+    Database db("DB");
+    REQUIRE(db.create_table("t"));
+    Table* t = db.get_table("t");
+    t->add_column("id", ColumnType::Int);
+    uint64_t v0 = t->version();
+    REQUIRE(t->insert_row({ Value{ int64_t(1) } }));
+    REQUIRE(t->version() > v0);
+    uint64_t v1 = t->version();
+    REQUIRE(t->update_where(Predicate::compare("id", CompareOp::Eq, Value{ int64_t(9) }), "id", Value{ int64_t(2) }) == 0);
+    REQUIRE(t->version() == v1);
+    t->analyze();
+    REQUIRE(t->version() == v1);
+
+    ResultCache& cache = db.result_cache();
+    TableVersions versions;
+    REQUIRE(db.table_versions({ "t" }, versions));
+    REQUIRE_FALSE(db.table_versions({ "t", "missing" }, versions));
+    REQUIRE(db.table_versions({ "t" }, versions));
+
+    CachedResult result{ { "id" }, { ColumnType::Int }, { { Value{ int64_t(1) } } } };
+    REQUIRE(cache.lookup("SELECT * FROM t", versions) == nullptr);
+    cache.store("SELECT * FROM t", versions, result);
+    auto hit = cache.lookup("SELECT * FROM t", versions);
+    REQUIRE(hit != nullptr);
+    REQUIRE(hit->rows.size() == 1);
+
+    REQUIRE(t->insert_row({ Value{ int64_t(2) } }));
+    TableVersions changed;
+    REQUIRE(db.table_versions({ "t" }, changed));
+    REQUIRE(cache.lookup("SELECT * FROM t", changed) == nullptr);
+    REQUIRE(cache.stats().entries == 0);
+
+    REQUIRE(db.drop_table("t"));
+    REQUIRE(db.create_table("t"));
+    TableVersions recreated;
+    REQUIRE(db.table_versions({ "t" }, recreated));
+    REQUIRE(recreated != changed);
+
+    size_t one = estimate_bytes(result) + std::string("q0").size();
+    cache.set_capacity(one * 2);
+    cache.store("q0", versions, result);
+    cache.store("q1", versions, result);
+    REQUIRE(cache.lookup("q0", versions) != nullptr);
+    cache.store("q2", versions, result);
+    REQUIRE(cache.lookup("q1", versions) == nullptr);
+    REQUIRE(cache.lookup("q0", versions) != nullptr);
+    REQUIRE(cache.lookup("q2", versions) != nullptr);
+    auto stats = cache.stats();
+    REQUIRE(stats.entries == 2);
+    REQUIRE(stats.evictions == 1);
+    REQUIRE(stats.bytes <= stats.capacity);
+    REQUIRE(stats.hits == 4);
+    cache.clear();
+    REQUIRE(cache.stats().entries == 0);
+    REQUIRE(normalize_sql("select  *  from t where name = \"x\"") == normalize_sql("SELECT * FROM t WHERE name = 'x'"));
+}
+
+TEST_CASE("materialized_views_track_base_table_deltas") {
+    Database db("DB");
+    auto run = [&](const std::string& text) {
+        SqlStatement stmt;
+        std::string err;
+        PlanNode plan;
+        QueryResult result;
+        REQUIRE(parse_sql(text, stmt, err));
+        REQUIRE(compile_sql(db, stmt, plan, err));
+        REQUIRE(execute_plan(db, plan, {}, result, err));
+        std::sort(result.rows.begin(), result.rows.end());
+        return result.rows;
+    };
+    auto contents = [&](const std::string& name) {
+        std::vector<std::vector<Value>> rows;
+        for (const auto& row : db.get_table(name)->get_rows()) rows.push_back(row.values);
+        std::sort(rows.begin(), rows.end());
+        return rows;
+    };
+    auto define = [&](const std::string& name, const std::string& text) {
+        SqlStatement stmt;
+        std::string err;
+        REQUIRE(parse_sql(text, stmt, err));
+        return db.create_view(name, stmt, err);
+    };
+
+    run("CREATE TABLE o (id INT, cust TEXT, amt INT)");
+    run("CREATE TABLE c (name TEXT, city TEXT)");
+    run("INSERT INTO o VALUES (1, 'a', 10), (2, 'b', 20), (3, 'a', NULL)");
+    run("INSERT INTO c VALUES ('a', 'x'), ('b', 'y')");
+
+    const std::vector<std::pair<std::string, std::string>> views = {
+        { "big", "SELECT id, amt FROM o WHERE amt > 8" },
+        { "totals", "SELECT cust, COUNT(*), COUNT(amt), SUM(amt), AVG(amt), MIN(amt), MAX(amt) FROM o GROUP BY cust" },
+        { "overall", "SELECT COUNT(*), SUM(amt) FROM o WHERE amt > 15" },
+        { "located", "SELECT o.id, c.city FROM o JOIN c ON o.cust = c.name WHERE c.city != 'z'" },
+    };
+    for (const auto& [name, text] : views) REQUIRE(define(name, text));
+    REQUIRE(db.get_view("totals")->shape() == MaterializedView::Shape::Aggregate);
+    REQUIRE(db.get_view("located")->shape() == MaterializedView::Shape::Join);
+    auto verify = [&]() {
+        for (const auto& [name, text] : views) {
+            auto expected = run(text);
+            auto actual = contents(name);
+            REQUIRE(actual == expected);
+        }
+    };
+    verify();
+
+    std::mt19937 rng(7);
+    const char* names[] = { "a", "b", "c", "d" };
+    for (int step = 0; step < 200; step++) {
+        int id = static_cast<int>(rng() % 30);
+        switch (rng() % 6) {
+            case 0:
+            case 1:
+                run("INSERT INTO o VALUES (" + std::to_string(id) + ", " +
+                    (rng() % 8 == 0 ? std::string("NULL") : "'" + std::string(names[rng() % 4]) + "'") + ", " +
+                    (rng() % 6 == 0 ? std::string("NULL") : std::to_string(rng() % 40)) + ")");
+                break;
+            case 2:
+                run("UPDATE o SET amt = " + std::to_string(rng() % 40) + " WHERE id = " + std::to_string(id));
+                break;
+            case 3:
+                run("DELETE FROM o WHERE id = " + std::to_string(id));
+                break;
+            case 4:
+                run("UPDATE c SET city = '" + std::string(rng() % 2 ? "z" : "x") + "' WHERE name = '" + names[rng() % 4] + "'");
+                if (rng() % 4 == 0) run("INSERT INTO c VALUES ('" + std::string(names[rng() % 4]) + "', 'w')");
+                if (rng() % 8 == 0) run("INSERT INTO c VALUES (NULL, 'n')");
+                break;
+            case 5:
+                if (rng() % 2) run("DELETE FROM o WHERE amt < " + std::to_string(rng() % 20));
+                else run("UPDATE o SET amt = " + std::to_string(rng() % 40) + " WHERE cust = '" + names[rng() % 4] + "'");
+                break;
+        }
+        verify();
+    }
+
+    db.get_table("o")->clear_all_rows();
+    verify();
+    REQUIRE(db.get_table("overall")->row_count() == 1);
+
+    run("INSERT INTO o VALUES (1, 'a', 9223372036854775807), (2, 'a', 9223372036854775807)");
+    verify();
+    REQUIRE(std::holds_alternative<std::monostate>(contents("overall")[0][1]));
+    run("DELETE FROM o WHERE id = 2");
+    verify();
+    REQUIRE(std::get<int64_t>(contents("overall")[0][1]) == std::numeric_limits<int64_t>::max());
+    run("DELETE FROM o WHERE id = 1");
+
+    SqlStatement stmt;
+    std::string err;
+    REQUIRE(parse_sql("INSERT INTO big VALUES (1, 1)", stmt, err));
+    PlanNode plan;
+    REQUIRE_FALSE(compile_sql(db, stmt, plan, err));
+    REQUIRE(err == "cannot modify materialized view");
+    REQUIRE_FALSE(define("sorted", "SELECT id FROM o ORDER BY id"));
+    REQUIRE_FALSE(define("agg_join", "SELECT COUNT(*) FROM o JOIN c ON o.cust = c.name"));
+    REQUIRE_FALSE(db.table_exists("sorted"));
+    REQUIRE_FALSE(db.drop_table("o"));
+    REQUIRE_FALSE(db.drop_table("big"));
+    REQUIRE(define("layered", "SELECT id FROM big WHERE amt > 30"));
+    REQUIRE_FALSE(db.drop_view("big"));
+    run("INSERT INTO o VALUES (99, 'a', 35)");
+    REQUIRE(db.get_table("layered")->row_count() == 1);
+    REQUIRE(db.drop_view("layered"));
+    REQUIRE(db.drop_view("big"));
+    REQUIRE(db.get_view_names() == std::vector<std::string>{ "located", "overall", "totals" });
+}
+
+TEST_CASE("database_serves_concurrent_readers_and_writers") {
+    Database db("DB");
+    auto run = [&](const std::string& text) {
+        SqlStatement stmt;
+        std::string err;
+        PlanNode plan;
+        QueryResult result;
+        if (!parse_sql(text, stmt, err) || !compile_sql(db, stmt, plan, err)) return QueryResult{};
+        execute_plan(db, plan, {}, result, err);
+        return result;
+    };
+    run("CREATE TABLE t (id INT, grp INT)");
+    SqlStatement definition;
+    std::string err;
+    REQUIRE(parse_sql("SELECT grp, COUNT(*), SUM(id) FROM t GROUP BY grp", definition, err));
+    REQUIRE(db.create_view("totals", definition, err));
+
+    constexpr int writers = 4;
+    constexpr int readers = 4;
+    constexpr int per_writer = 150;
+    std::atomic<int> inconsistent{ 0 };
+    std::atomic<bool> done{ false };
+    std::vector<std::thread> pool;
+
+    for (int w = 0; w < writers; w++) {
+        pool.emplace_back([&, w]() {
+            for (int i = 0; i < per_writer; i++) {
+                int id = w * per_writer + i;
+                run("INSERT INTO t VALUES (" + std::to_string(id) + ", " + std::to_string(id % 7) + ")");
+                if (i % 3 == 2) run("DELETE FROM t WHERE id = " + std::to_string(id - 1));
+            }
+        });
+    }
+    for (int r = 0; r < readers; r++) {
+        pool.emplace_back([&]() {
+            StatementSpec spec;
+            spec.table = "t";
+            spec.where = Predicate::compare("grp", CompareOp::Eq, Value{ int64_t(3) });
+            auto stmt = PreparedStatement::prepare(db, spec);
+            while (!done) {
+                StatementResult out;
+                if (!stmt || !stmt->execute({}, out)) inconsistent++;
+                TableLocks held = db.lock_tables({ "t", "totals" }, {});
+                int64_t counted = 0;
+                for (const auto& row : db.get_table("totals")->get_rows()) counted += std::get<int64_t>(row.values[1]);
+                if (counted != static_cast<int64_t>(db.get_table("t")->row_count())) inconsistent++;
+            }
+        });
+    }
+    pool.emplace_back([&]() {
+        for (int i = 0; !done; i++) {
+            std::string name = "scratch" + std::to_string(i % 3);
+            db.create_table(name);
+            db.get_table_names();
+            db.drop_table(name);
+        }
+    });
+
+    for (int w = 0; w < writers; w++) pool[w].join();
+    done = true;
+    for (size_t i = writers; i < pool.size(); i++) pool[i].join();
+
+    REQUIRE(inconsistent == 0);
+    REQUIRE(db.get_table("t")->row_count() == static_cast<size_t>(writers * (per_writer - per_writer / 3)));
+    auto expected = run("SELECT grp, COUNT(*), SUM(id) FROM t GROUP BY grp");
+    std::vector<std::vector<Value>> actual;
+    for (const auto& row : db.get_table("totals")->get_rows()) actual.push_back(row.values);
+    std::sort(expected.rows.begin(), expected.rows.end());
+    std::sort(actual.begin(), actual.end());
+    REQUIRE(actual == expected.rows);
+    REQUIRE(db.lock_tables({}, { "t" }).exclusive() == 2);
+}
+
+TEST_CASE("table_handles_and_joins_hold_latches") {
+    Database db("DB");
+    REQUIRE(db.create_table("a"));
+    REQUIRE(db.create_table("b"));
+    for (const char* name : { "a", "b" }) {
+        TableWriter t = db.write_table(name);
+        t->add_column("id", ColumnType::Int);
+        t->add_column("v", ColumnType::Int);
+    }
+    REQUIRE_FALSE(db.read_table("missing"));
+
+    std::atomic<bool> done{ false };
+    std::atomic<int> bad{ 0 };
+    std::thread writer([&]() {
+        for (int64_t i = 0; i < 300; i++) {
+            db.write_table(i % 2 ? "a" : "b")->insert_row({ i / 2, i });
+            if (i % 50 == 49) db.write_table("b")->delete_where(Predicate::compare("v", CompareOp::Lt, i - 60));
+        }
+        done = true;
+    });
+    std::thread reader([&]() {
+        while (!done) {
+            std::vector<std::string> headers;
+            std::vector<std::vector<Value>> rows;
+            if (!db.inner_join("a", "id", "b", "id", headers, rows)) bad++;
+            for (const auto& row : rows) {
+                if (row[0] != row[2]) bad++;
+            }
+            TableReader a = db.read_table("a");
+            if (a->select_all().size() != a->row_count()) bad++;
+            a = {};
+            JoinResult joined;
+            if (!db.join_rows("a", "id", "b", "id", joined)) bad++;
+            std::vector<ColumnType> types;
+            joined.materialize(joined.all_columns(), headers, types, rows);
+            if (rows.size() != joined.size()) bad++;
+            for (const auto& row : rows) {
+                if (row[0] != row[2]) bad++;
+            }
+        }
+    });
+    writer.join();
+    reader.join();
+    REQUIRE(bad == 0);
+
+    JoinResult kept;
+    REQUIRE(db.join_rows({ { "a", "id", "b", "id" } }, kept));
+    REQUIRE(kept.size() > 0);
+    REQUIRE(db.write_table("b")->delete_where(Predicate::compare("v", CompareOp::Ge, int64_t(0))) > 0);
+    REQUIRE(db.drop_table("a"));
+    std::vector<std::string> kept_headers;
+    std::vector<ColumnType> kept_types;
+    std::vector<std::vector<Value>> kept_rows;
+    kept.materialize(kept.all_columns(), kept_headers, kept_types, kept_rows);
+    REQUIRE(kept_rows.size() == kept.size());
+    for (const auto& row : kept_rows) REQUIRE(row[0] == row[2]);
+
+    std::atomic<bool> dropped{ false };
+    std::thread dropper;
+    {
+        TableReader held = db.read_table("b");
+        dropper = std::thread([&]() { dropped = db.drop_table("b"); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        REQUIRE_FALSE(dropped);
+        REQUIRE(held->row_count() == 0);
+    }
+    dropper.join();
+    REQUIRE(dropped);
+    REQUIRE_FALSE(db.table_exists("b"));
+}
+
+TEST_CASE("snapshots_isolate_long_reads_from_writers") {
+    Database db("DB");
+    REQUIRE(db.create_table("t"));
+    Table* t = db.get_table("t");
+    t->add_column("id", ColumnType::Int);
+    t->add_column("v", ColumnType::Int);
+    for (int64_t i = 0; i < 5000; i++) REQUIRE(t->insert_row({ Value{ i }, Value{ int64_t(0) } }));
+    t->create_index("id", IndexKind::Hash);
+    REQUIRE(t->snapshot_readers() == 0);
+
+    auto snapshot = db.snapshot({ "t", "missing" });
+    const Table* pinned = snapshot->get_table("t");
+    REQUIRE(pinned != nullptr);
+    REQUIRE_FALSE(snapshot->table_exists("missing"));
+    REQUIRE(t->snapshot_readers() == 1);
+    REQUIRE(pinned->version() == t->version());
+
+    std::thread writer([&]() {
+        SqlStatement stmt;
+        std::string err;
+        PlanNode plan;
+        QueryResult out;
+        REQUIRE(parse_sql("UPDATE t SET v = 1 WHERE id = 7", stmt, err));
+        REQUIRE(compile_sql(db, stmt, plan, err));
+        REQUIRE(execute_plan(db, plan, {}, out, err));
+        REQUIRE(out.affected == 1);
+        REQUIRE(db.get_table("t")->insert_row({ Value{ int64_t(9999) }, Value{ int64_t(2) } }));
+    });
+    writer.join();
+
+    REQUIRE(t->snapshot_readers() == 0);
+    REQUIRE(t->row_count() == 5001);
+    REQUIRE(pinned->row_count() == 5000);
+    REQUIRE(pinned->version() < t->version());
+    auto before = pinned->select_where(Predicate::compare("id", CompareOp::Eq, Value{ int64_t(7) }));
+    auto after = t->select_where(Predicate::compare("id", CompareOp::Eq, Value{ int64_t(7) }));
+    REQUIRE(std::get<int64_t>(before[0].values[1]) == 0);
+    REQUIRE(std::get<int64_t>(after[0].values[1]) == 1);
+    REQUIRE(pinned->select_where(Predicate::compare("id", CompareOp::Eq, Value{ int64_t(9999) })).empty());
+
+    snapshot.reset();
+    REQUIRE(t->insert_row({ Value{ int64_t(10000) }, Value{ int64_t(3) } }));
+    REQUIRE(t->snapshot_readers() == 0);
+
+    SqlStatement stmt;
+    std::string err;
+    PlanNode plan;
+    QueryResult out;
+    REQUIRE(parse_sql("SELECT COUNT(*), SUM(v) FROM t", stmt, err));
+    REQUIRE(compile_sql(db, stmt, plan, err));
+    REQUIRE(execute_plan(db, plan, {}, out, err));
+    REQUIRE(out.rows[0][0] == Value{ int64_t(5002) });
+    REQUIRE(out.rows[0][1] == Value{ int64_t(6) });
+}
+
+TEST_CASE("transactions_buffer_writes_until_commit") {
+    Database db("DB");
+    REQUIRE(db.create_table("t"));
+    Table* t = db.get_table("t");
+    t->add_column("id", ColumnType::Int);
+    t->add_column("v", ColumnType::Int);
+    REQUIRE(t->set_primary_key("id"));
+    t->create_index("v", IndexKind::Ordered);
+    for (int64_t i = 0; i < 10; i++) REQUIRE(t->insert_row({ Value{ i }, Value{ i } }));
+    SqlStatement view_sql;
+    std::string err;
+    REQUIRE(parse_sql("SELECT COUNT(*), SUM(v) FROM t", view_sql, err));
+    REQUIRE(db.create_view("totals", view_sql, err));
+    uint64_t version = t->version();
+
+    Transaction txn(db);
+    REQUIRE(txn.insert("t", { Value{ int64_t(10) }, Value{ int64_t(-1) } }, err));
+    REQUIRE(txn.update("t", Predicate::compare("v", CompareOp::Lt, Value{ int64_t(0) }), "v", Value{ int64_t(100) }, err));
+    REQUIRE(txn.remove("t", Predicate::compare("id", CompareOp::Lt, Value{ int64_t(5) }), err));
+    REQUIRE_FALSE(txn.insert("t", { Value{ int64_t(1) } }, err));
+    REQUIRE_FALSE(txn.update("t", std::nullopt, "missing", Value{ int64_t(1) }, err));
+    REQUIRE_FALSE(txn.insert("totals", { Value{ int64_t(1) }, Value{ int64_t(1) } }, err));
+    REQUIRE(txn.pending() == 3);
+    REQUIRE(t->row_count() == 10);
+    REQUIRE(t->version() == version);
+
+    REQUIRE(txn.commit(err));
+    REQUIRE(txn.empty());
+    REQUIRE(t->row_count() == 6);
+    REQUIRE(t->version() > version);
+    auto moved = t->select_where(Predicate::compare("v", CompareOp::Eq, Value{ int64_t(100) }));
+    REQUIRE(moved.size() == 1);
+    REQUIRE(moved[0].values[0] == Value{ int64_t(10) });
+    auto totals = db.get_table("totals")->select_all();
+    REQUIRE(totals[0].values[0] == Value{ int64_t(6) });
+    REQUIRE(totals[0].values[1] == Value{ int64_t(135) });
+
+    version = t->version();
+    REQUIRE(txn.insert("t", { Value{ int64_t(20) }, Value{ int64_t(1) } }, err));
+    REQUIRE(txn.insert("t", { Value{ int64_t(20) }, Value{ int64_t(2) } }, err));
+    REQUIRE_FALSE(txn.commit(err));
+    REQUIRE(err.find("constraint") != std::string::npos);
+    REQUIRE(txn.empty());
+    REQUIRE(t->row_count() == 6);
+    REQUIRE(t->version() == version);
+
+    REQUIRE(txn.remove("t", std::nullopt, err));
+    txn.rollback();
+    REQUIRE(txn.pending() == 0);
+    REQUIRE(txn.commit(err));
+    REQUIRE(t->row_count() == 6);
+
+    SqlStatement stmt;
+    PlanNode plan;
+    REQUIRE(parse_sql("UPDATE t SET v = 7 WHERE id = 9", stmt, err));
+    REQUIRE(compile_sql(db, stmt, plan, err));
+    REQUIRE(txn.stage(plan, err));
+    REQUIRE(parse_sql("DELETE FROM t WHERE v = 7", stmt, err));
+    REQUIRE(compile_sql(db, stmt, plan, err));
+    REQUIRE(txn.stage(plan, err));
+    REQUIRE(txn.commit(err));
+    REQUIRE(t->row_count() == 4);
+    REQUIRE(t->find_rows(Predicate::compare("v", CompareOp::Ge, Value{ int64_t(7) })).size() == 2);
+    totals = db.get_table("totals")->select_all();
+    REQUIRE(totals[0].values[0] == Value{ int64_t(4) });
+    REQUIRE(totals[0].values[1] == Value{ int64_t(119) });
+}
+
+TEST_CASE("thread_pool_runs_morsels_and_keeps_scan_order") {
+    ThreadPool pool(4);
+    REQUIRE(pool.size() == 4);
+    std::vector<int> hits(1000, 0);
+    pool.parallel_for(hits.size(), [&](size_t i) { hits[i]++; });
+    REQUIRE(std::count(hits.begin(), hits.end(), 1) == 1000);
+
+    std::atomic<size_t> inner{ 0 };
+    pool.parallel_for(8, [&](size_t) {
+        pool.parallel_for(8, [&](size_t) { inner++; });
+    });
+    REQUIRE(inner == 64);
+    pool.resize(1);
+    REQUIRE(pool.size() == 1);
+    pool.parallel_for(3, [&](size_t i) { hits[i]++; });
+    REQUIRE(hits[2] == 2);
+    pool.resize(3);
+    REQUIRE(pool.size() == 3);
+    REQUIRE(morsel_count(0) == 0);
+    REQUIRE(morsel_count(ThreadPool::morsel_rows + 1) == 2);
+
+    Database db("DB");
+    REQUIRE(db.create_table("t"));
+    Table* t = db.get_table("t");
+    t->add_column("id", ColumnType::Int);
+    t->add_column("v", ColumnType::Int);
+    const int64_t n = 5 * static_cast<int64_t>(ThreadPool::morsel_rows) + 17;
+    for (int64_t i = 0; i < n; i++) REQUIRE(t->insert_row({ Value{ i }, Value{ i % 3 } }));
+    Predicate where = Predicate::compare("v", CompareOp::Eq, Value{ int64_t(1) });
+
+    size_t threads = ThreadPool::shared().size();
+    ThreadPool::shared().resize(1);
+    auto serial = t->find_rows(where);
+    ThreadPool::shared().resize(4);
+    auto parallel = t->find_rows(where);
+    REQUIRE(parallel == serial);
+    REQUIRE(std::is_sorted(parallel.begin(), parallel.end()));
+    REQUIRE(parallel.size() == static_cast<size_t>((n + 1) / 3));
+    REQUIRE(t->update_where(where, "v", Value{ int64_t(4) }) == parallel.size());
+    REQUIRE(t->delete_where(Predicate::compare("v", CompareOp::Eq, Value{ int64_t(4) })) == parallel.size());
+
+    auto path = std::filesystem::temp_directory_path() / "imdb_pool_export.csv";
+    REQUIRE(t->export_csv(path.string()));
+    std::ifstream in(path);
+    std::string line;
+    size_t lines = 0;
+    std::string last;
+    while (std::getline(in, line)) {
+        lines++;
+        last = line;
+    }
+    REQUIRE(lines == t->row_count() + 1);
+    REQUIRE(last == std::to_string(n - 1) + "," + std::to_string((n - 1) % 3));
+    std::filesystem::remove(path);
+    ThreadPool::shared().resize(threads);
+}
+
+TEST_CASE("async_queries_support_cancellation_and_deadlines") {
+    size_t threads = ThreadPool::shared().size();
+    ThreadPool::shared().resize(1);
+    REQUIRE(run_async([]() { return std::this_thread::get_id(); }).get() != std::this_thread::get_id());
+    Database db("DB");
+    REQUIRE(db.create_table("t"));
+    Table* t = db.get_table("t");
+    t->add_column("id", ColumnType::Int);
+    t->add_column("v", ColumnType::Int);
+    for (int64_t i = 0; i < 3 * static_cast<int64_t>(ThreadPool::morsel_rows); i++) {
+        REQUIRE(t->insert_row({ Value{ i }, Value{ i % 10 } }));
+    }
+
+    std::vector<AsyncQuery> queries;
+    for (int64_t k = 0; k < 8; k++) {
+        queries.push_back(execute_async(db, "SELECT COUNT(*) FROM t WHERE v = ?", { Value{ k } }));
+    }
+    for (auto& query : queries) {
+        QueryOutcome outcome = query.get();
+        REQUIRE(outcome.ok);
+        REQUIRE(outcome.result.rows[0][0] == Value{ int64_t(ThreadPool::morsel_rows * 3 / 10 + 1) });
+    }
+
+    auto failed = execute_async(db, "SELECT * FROM missing");
+    QueryOutcome missing = failed.get();
+    REQUIRE_FALSE(missing.ok);
+    REQUIRE(missing.err == "no such table");
+
+    AsyncOptions cancelled;
+    cancelled.token = std::make_shared<CancelToken>();
+    cancelled.token->cancel();
+    QueryOutcome dropped = execute_async(db, "DELETE FROM t WHERE v = 1", {}, cancelled).get();
+    REQUIRE_FALSE(dropped.ok);
+    REQUIRE(dropped.err == "query cancelled");
+    REQUIRE(t->row_count() == 3 * ThreadPool::morsel_rows);
+
+    AsyncOptions late;
+    late.timeout = std::chrono::milliseconds(0);
+    QueryOutcome expired = execute_async(db, "SELECT * FROM t", {}, late).get();
+    REQUIRE_FALSE(expired.ok);
+    REQUIRE(expired.err == "query timed out");
+
+    auto token = std::make_shared<CancelToken>();
+    std::atomic<bool> started{ false };
+    auto waiting = run_async([&]() {
+        started = true;
+        while (!cancellation_requested()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return active_cancel_token()->reason();
+    }, token);
+    while (!started) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    REQUIRE(waiting.wait_for(std::chrono::milliseconds(5)) == std::future_status::timeout);
+    token->cancel();
+    REQUIRE(std::string(waiting.get()) == "query cancelled");
+
+    {
+        CancelScope scope(token.get());
+        std::atomic<size_t> ran{ 0 };
+        ThreadPool::shared().parallel_for(64, [&](size_t) { ran++; });
+        REQUIRE(ran == 0);
+        REQUIRE(t->delete_where(Predicate::compare("v", CompareOp::Eq, Value{ int64_t(2) })) == 0);
+        REQUIRE(t->update_where(Predicate::compare("v", CompareOp::Eq, Value{ int64_t(2) }), "v", Value{ int64_t(0) }) == 0);
+    }
+    REQUIRE(t->delete_where(Predicate::compare("v", CompareOp::Eq, Value{ int64_t(2) })) > 0);
+
+    CancelToken first;
+    CancelToken second;
+    CancelToken unwatched;
+    first.watch_interrupts();
+    second.watch_interrupts();
+    interrupt_all();
+    CancelToken later;
+    later.watch_interrupts();
+    REQUIRE(first.stop_requested());
+    REQUIRE(second.stop_requested());
+    REQUIRE(std::string(second.reason()) == "query cancelled");
+    REQUIRE_FALSE(unwatched.stop_requested());
+    REQUIRE_FALSE(later.stop_requested());
+    ThreadPool::shared().resize(threads);
+}
+
+TEST_CASE("cancelled_operations_abort_without_partial_writes") {
+    Database db("DB");
+    for (const char* name : { "a", "b" }) {
+        REQUIRE(db.create_table(name));
+        Table* t = db.get_table(name);
+        t->add_column("k", ColumnType::Int);
+        t->add_column("v", ColumnType::Int);
+        for (int64_t i = 0; i < 3000; i++) REQUIRE(t->insert_row({ Value{ int64_t(1) }, Value{ i } }));
+    }
+    Table* a = db.get_table("a");
+
+    CancelToken deadline;
+    deadline.set_timeout(std::chrono::milliseconds(1));
+    {
+        CancelScope scope(&deadline);
+        auto started = std::chrono::steady_clock::now();
+        std::vector<std::string> headers;
+        std::vector<std::vector<Value>> rows;
+        REQUIRE_FALSE(db.inner_join("a", "k", "b", "k", headers, rows));
+        REQUIRE(std::chrono::steady_clock::now() - started < std::chrono::seconds(5));
+        REQUIRE(std::string(deadline.reason()) == "query timed out");
+
+        SqlStatement stmt;
+        PlanNode plan;
+        QueryResult out;
+        std::string err;
+        REQUIRE(parse_sql("SELECT * FROM a JOIN b ON a.k = b.k", stmt, err));
+        REQUIRE(compile_sql(db, stmt, plan, err));
+        REQUIRE_FALSE(execute_plan(db, plan, {}, out, err));
+        REQUIRE(err == "query timed out");
+        REQUIRE(parse_sql("UPDATE a SET v = 0", stmt, err));
+        REQUIRE(compile_sql(db, stmt, plan, err));
+        REQUIRE_FALSE(execute_plan(db, plan, {}, out, err));
+
+        std::vector<Value> values(100000);
+        std::vector<const Value*> pointers;
+        for (size_t i = 0; i < values.size(); i++) {
+            values[i] = Value{ int64_t(values.size() - i) };
+            pointers.push_back(&values[i]);
+        }
+        REQUIRE(order_by(pointers, false, size_t(10)).size() < 10);
+    }
+    REQUIRE(a->find_rows(Predicate::compare("v", CompareOp::Eq, Value{ int64_t(0) })).size() == 1);
+
+    auto path = std::filesystem::temp_directory_path() / "imdb_cancel_import.csv";
+    {
+        std::ofstream csv(path);
+        for (int i = 0; i < 10000; i++) csv << "2," << i << "\n";
+    }
+    CancelToken stop;
+    stop.cancel();
+    uint64_t version = a->version();
+    {
+        CancelScope scope(&stop);
+        REQUIRE(a->import_csv(path.string(), false) == 0);
+        REQUIRE(a->delete_where(Predicate::compare("k", CompareOp::Eq, Value{ int64_t(1) })) == 0);
+        Transaction txn(db);
+        std::string err;
+        REQUIRE(txn.remove("a", std::nullopt, err));
+        REQUIRE_FALSE(txn.commit(err));
+        REQUIRE(err == "query cancelled");
+    }
+    REQUIRE(a->row_count() == 3000);
+    REQUIRE(a->version() == version);
+    REQUIRE(a->import_csv(path.string(), false) == 10000);
+    std::filesystem::remove(path);
+}
+
+#ifdef IMDB_SERVER
+TEST_CASE("server_pipelines_requests_per_client_over_unix_socket") {
+    static std::atomic<bool> gate{ false };
+    class CountingSession : public ServerSession {
+    private:
+        size_t seen = 0;
+
+    public:
+        bool handle(const std::string& request, std::string& response) override {
+            if (request == "QUIT") { response = "bye\n"; return false; }
+            if (request == "BIG") { response.assign(6u << 20, 'x'); return true; }
+            if (request == "WAIT") {
+                while (!gate) std::this_thread::yield();
+                response = "go\n";
+                return true;
+            }
+            response = std::to_string(++seen) + " " + request + "\n";
+            return true;
+        }
+    };
+
+    auto path = (std::filesystem::temp_directory_path() / "imdb_server_test.sock").string();
+    Server server(path, []() { return std::make_unique<CountingSession>(); });
+    std::string err;
+    REQUIRE(server.listen(err));
+    Server rival(path, []() { return std::make_unique<CountingSession>(); });
+    REQUIRE_FALSE(rival.listen(err));
+    REQUIRE(err.find("in use") != std::string::npos);
+    std::thread loop([&]() { server.run(); });
+
+    ServerClient a;
+    ServerClient b;
+    REQUIRE(a.connect(path, err));
+    REQUIRE(b.connect(path, err));
+    for (int i = 0; i < 200; i++) REQUIRE(a.send("a" + std::to_string(i)));
+    REQUIRE(b.send("BIG"));
+    for (int i = 0; i < 50; i++) REQUIRE(b.send("b" + std::to_string(i)));
+
+    std::string response;
+    REQUIRE(b.receive(response));
+    REQUIRE(response.size() == (6u << 20));
+    for (int i = 0; i < 200; i++) {
+        REQUIRE(a.receive(response));
+        REQUIRE(response == std::to_string(i + 1) + " a" + std::to_string(i) + "\n");
+    }
+    for (int i = 0; i < 50; i++) {
+        REQUIRE(b.receive(response));
+        REQUIRE(response == std::to_string(i + 1) + " b" + std::to_string(i) + "\n");
+    }
+
+    ServerClient c;
+    REQUIRE(c.connect(path, err));
+    REQUIRE(c.send("WAIT"));
+    REQUIRE(b.send("b50"));
+    REQUIRE(b.receive(response));
+    REQUIRE(response == "51 b50\n");
+    gate = true;
+    REQUIRE(c.receive(response));
+    REQUIRE(response == "go\n");
+
+    REQUIRE(a.send("QUIT\nignored"));
+    REQUIRE(a.receive(response));
+    REQUIRE(response == "bye\n");
+    REQUIRE_FALSE(a.receive(response));
+
+    server.stop();
+    loop.join();
+    REQUIRE(server.request_count() == 254);
+    REQUIRE_FALSE(std::filesystem::exists(path));
+    REQUIRE_FALSE(b.receive(response));
+}
+#endif
+
+TEST_CASE("binary_results_round_trip_columns_nulls_and_batches") {
+    std::vector<std::string> headers{ "id", "name", "mixed", "empty" };
+    std::vector<ColumnType> types{ ColumnType::Int, ColumnType::Text, ColumnType::Text, ColumnType::Text };
+    std::vector<std::vector<Value>> rows;
+    for (int64_t i = 0; i < int64_t(wire_batch_rows) + 10; i++) {
+        Value name = i % 3 == 0 ? Value{} : Value{ "n" + std::to_string(i) };
+        Value mixed = i % 2 == 0 ? Value{ i } : Value{ std::string("x") };
+        rows.push_back({ Value{ -i }, name, mixed, Value{} });
+    }
+    std::string batch = encode_result(headers, types, rows);
+    REQUIRE(batch.compare(0, 4, "IMDB") == 0);
+    REQUIRE(batch.size() % 8 == 0);
+
+    std::vector<WireColumn> columns;
+    std::vector<std::vector<Value>> decoded;
+    std::string err;
+    REQUIRE(decode_result(batch, columns, decoded, err));
+    REQUIRE(columns.size() == 4);
+    REQUIRE(columns[0].name == "id");
+    REQUIRE(columns[0].type == WireType::Int);
+    REQUIRE(columns[1].type == WireType::Text);
+    REQUIRE(columns[2].type == WireType::Text);
+    REQUIRE(columns[3].type == WireType::Text);
+    REQUIRE(decoded.size() == rows.size());
+    for (size_t r = 0; r < rows.size(); r++) {
+        REQUIRE(decoded[r][0] == rows[r][0]);
+        REQUIRE(decoded[r][1] == rows[r][1]);
+        REQUIRE(value_to_string(decoded[r][2]) == value_to_string(rows[r][2]));
+        REQUIRE(std::holds_alternative<std::monostate>(decoded[r][3]));
+    }
+
+    std::vector<Row> table_rows{ Row{ { Value{ int64_t(7) }, Value{ std::string("") } } } };
+    REQUIRE(decode_result(encode_result({ "a", "b" }, { ColumnType::Int, ColumnType::Text }, table_rows), columns, decoded, err));
+    REQUIRE(decoded.size() == 1);
+    REQUIRE(decoded[0][1] == Value{ std::string("") });
+    REQUIRE(decode_result(encode_result({ "a" }, { ColumnType::Text }, std::vector<Row>{}), columns, decoded, err));
+    REQUIRE(decoded.empty());
+    REQUIRE(columns[0].type == WireType::Text);
+
+    REQUIRE_FALSE(decode_result(std::string_view(batch).substr(0, batch.size() - 8), columns, decoded, err));
+    REQUIRE(err == "truncated batch");
+    REQUIRE_FALSE(decode_result("IMDX", columns, decoded, err));
+
+    std::string oversized = encode_result({ "a" }, { ColumnType::Int }, std::vector<Row>{});
+    uint32_t huge = 0xFFFFFFFFu;
+    std::memcpy(oversized.data() + oversized.size() - 8, &huge, sizeof(huge));
+    oversized.append(8, '\0');
+    REQUIRE_FALSE(decode_result(oversized, columns, decoded, err));
+    REQUIRE(err == "truncated batch");
+}
+
+TEST_CASE("scheduler_classifies_by_cost_and_prioritizes_short_queries") {
+    Database db("sched");
+    db.create_table("big");
+    Table* big = db.get_table("big");
+    big->add_column("id", ColumnType::Int);
+    big->add_column("v", ColumnType::Int);
+    for (int64_t i = 0; i < 120000; i++) REQUIRE(big->insert_row({ Value{ i }, Value{ i % 10 } }));
+    REQUIRE(big->create_index("id", IndexKind::Hash));
+
+    auto cost_of = [&](const std::string& sql) {
+        SqlStatement stmt;
+        PlanNode plan;
+        std::string err;
+        REQUIRE(parse_sql(sql, stmt, err));
+        REQUIRE(compile_sql(db, stmt, plan, err));
+        return estimate_cost(db, plan);
+    };
+    QueryCost point = cost_of("SELECT * FROM big WHERE id = 5");
+    QueryCost scan = cost_of("SELECT v, COUNT(*) FROM big GROUP BY v");
+    REQUIRE(QueryScheduler::classify(point) == QueryClass::Short);
+    REQUIRE(QueryScheduler::classify(scan) == QueryClass::Long);
+    REQUIRE(point.bytes < scan.bytes);
+
+    QueryScheduler scheduler;
+    scheduler.set_limits(QueryClass::Short, ClassLimits{ 1, 100 });
+    scheduler.set_limits(QueryClass::Long, ClassLimits{ 1, 1000 });
+    Admission short_slot = scheduler.admit(QueryClass::Short, 80);
+    Admission long_slot = scheduler.admit(QueryClass::Long, 10);
+    REQUIRE(short_slot.admitted());
+    REQUIRE(long_slot.admitted());
+
+    std::atomic<bool> long_started{ false };
+    std::thread waiting_long([&]() {
+        Admission a = scheduler.admit(QueryClass::Long, 10);
+        long_started = true;
+    });
+    while (scheduler.stats(QueryClass::Long).waiting == 0) std::this_thread::yield();
+    std::thread waiting_short([&]() { Admission a = scheduler.admit(QueryClass::Short, 30); });
+    while (scheduler.stats(QueryClass::Short).waiting == 0) std::this_thread::yield();
+
+    long_slot.release();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    REQUIRE_FALSE(long_started);
+    REQUIRE(scheduler.stats(QueryClass::Long).running == 0);
+    short_slot.release();
+    waiting_short.join();
+    waiting_long.join();
+    REQUIRE(long_started);
+
+    SchedulerStats stats = scheduler.stats(QueryClass::Long);
+    REQUIRE(stats.admitted == 2);
+    REQUIRE(stats.running == 0);
+    REQUIRE(stats.max_wait_nanos >= 50000000u);
+    REQUIRE(scheduler.stats(QueryClass::Short).memory == 0);
+
+    Admission hog = scheduler.admit(QueryClass::Short, 500);
+    REQUIRE(hog.admitted());
+    CancelToken stop;
+    stop.cancel();
+    {
+        CancelScope scope(&stop);
+        Admission refused = scheduler.admit(QueryClass::Short, 1);
+        REQUIRE_FALSE(refused.admitted());
+    }
+    REQUIRE(scheduler.stats(QueryClass::Short).abandoned == 1);
+    REQUIRE(scheduler.stats(QueryClass::Short).waiting == 0);
+
+    std::thread starved_short([&]() { Admission a = scheduler.admit(QueryClass::Short, 1); });
+    while (scheduler.stats(QueryClass::Short).waiting == 0) std::this_thread::yield();
+    auto yield_start = std::chrono::steady_clock::now();
+    Admission yielded = scheduler.admit(QueryClass::Long, 10);
+    REQUIRE(yielded.admitted());
+    REQUIRE(std::chrono::steady_clock::now() - yield_start >= QueryScheduler::long_yield_limit);
+    REQUIRE(scheduler.stats(QueryClass::Short).waiting == 1);
+    yielded.release();
+    hog.release();
+    starved_short.join();
+
+    QueryOutcome outcome = execute_async(db, "SELECT COUNT(*) FROM big").get();
+    REQUIRE(outcome.ok);
+    REQUIRE(outcome.query_class == QueryClass::Long);
+    REQUIRE(execute_async(db, "SELECT * FROM big WHERE id = 7").get().query_class == QueryClass::Short);
 }
\ No newline at end of file